@@ -34,6 +34,7 @@
 #include "datalink.h"
 #include "handlers.h"
 #include "client.h"
+#include "address.h"
 
 void dlenv_init(
     void)
@@ -96,6 +97,13 @@ void dlenv_init(
         apdu_timeout_set(60000);
 #endif
     }
+    pEnv = getenv("BACNET_ADDRESS_CACHE");
+    if (pEnv) {
+        if (!address_set_capacity(strtol(pEnv, NULL, 0))) {
+            fprintf(stderr, "BACNET_ADDRESS_CACHE=%s: unable to resize\r\n",
+                pEnv);
+        }
+    }
     if (!datalink_init(getenv("BACNET_IFACE"))) {
         exit(1);
     }
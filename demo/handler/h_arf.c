@@ -35,6 +35,7 @@
 #include "npdu.h"
 #include "abort.h"
 #include "arf.h"
+#include "segment.h"
 /* demo objects */
 #include "device.h"
 #include "ai.h"
@@ -95,6 +96,13 @@ shall be TRUE, otherwise FALSE.
 */
 
 #if defined(BACFILE)
+/* ComplexACK header, end of file, start position and the tags
+   around the file data */
+#define ARF_ACK_OVERHEAD (3 + 1 + 1 + 5 + 5 + 1)
+
+/* file data too long for one APDU, on its way into a segmented ACK */
+static uint8_t File_Buf[MAX_APDU_SEGMENTED];
+
 void handler_atomic_read_file(
     uint8_t * service_request,
     uint16_t service_len,
@@ -107,18 +115,18 @@ void handler_atomic_read_file(
     bool error = false;
     int bytes_sent = 0;
     BACNET_NPDU_DATA npdu_data;
-    BACNET_ADDRESS my_address;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
+    size_t file_len = 0;
+    bool end_of_file = false;
 
 #if PRINT_ENABLED
     fprintf(stderr, "Received Atomic-Read-File Request!\n");
 #endif
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
         len =
@@ -161,10 +169,29 @@ void handler_atomic_read_file(
                     error_class = ERROR_CLASS_OBJECT;
                     error_code = ERROR_CODE_FILE_ACCESS_DENIED;
                 }
+            } else if (data.type.stream.requestedOctetCount <=
+                (segment_reply_max_apdu(service_data) - ARF_ACK_OVERHEAD)) {
+                /* too long for fileData, but it fits in segments */
+                if (bacfile_read_stream_data(data.object_instance,
+                        data.type.stream.fileStartPosition, &File_Buf[0],
+                        data.type.stream.requestedOctetCount, &file_len,
+                        &end_of_file)) {
+                    len =
+                        arf_ack_encode_stream_apdu(&Handler_Transmit_Buffer
+                        [pdu_len], service_data->invoke_id, end_of_file,
+                        data.type.stream.fileStartPosition, &File_Buf[0],
+                        file_len);
+                } else {
+                    error = true;
+                    error_class = ERROR_CLASS_OBJECT;
+                    error_code = ERROR_CODE_FILE_ACCESS_DENIED;
+                }
             } else {
                 len =
                     abort_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
                     service_data->invoke_id,
+                    service_data->segmented_response_accepted ?
+                    ABORT_REASON_BUFFER_OVERFLOW :
                     ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
 #if PRINT_ENABLED
                 fprintf(stderr, "Too Big To Send (%d >= %d). Sending Abort!\n",
@@ -192,10 +219,10 @@ void handler_atomic_read_file(
             error_class, error_code);
     }
   ARF_ABORT:
-    pdu_len += len;
+    /* a long ACK goes out in segments */
     bytes_sent =
-        datalink_send_pdu(src, &npdu_data, &Handler_Transmit_Buffer[0],
-        pdu_len);
+        segment_send_pdu(src, &npdu_data, service_data,
+        &Handler_Transmit_Buffer[0], pdu_len, len);
 #if PRINT_ENABLED
     if (bytes_sent <= 0) {
         fprintf(stderr, "Failed to send PDU (%s)!\n", strerror(errno));
@@ -85,7 +85,6 @@ void handler_atomic_write_file(
     bool error = false;
     int bytes_sent = 0;
     BACNET_NPDU_DATA npdu_data;
-    BACNET_ADDRESS my_address;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
 
@@ -93,10 +92,9 @@ void handler_atomic_write_file(
     fprintf(stderr, "Received AtomicWriteFile Request!\n");
 #endif
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
         len =
@@ -37,6 +37,7 @@
 #include "abort.h"
 #include "cov.h"
 #include "tsm.h"
+#include "timerwheel.h"
 /* demo objects */
 #include "device.h"
 #include "ai.h"
@@ -60,7 +61,7 @@ typedef struct BACnet_COV_Subscription {
     uint32_t subscriberProcessIdentifier;
     BACNET_OBJECT_ID monitoredObjectIdentifier;
     bool issueConfirmedNotifications;   /* optional */
-    uint32_t lifetime;  /* optional */
+    BACNET_TIMER lifetime;      /* optional */
     bool send_requested;
 } BACNET_COV_SUBSCRIPTION;
 
@@ -94,6 +95,39 @@ TimeRemaining [3] Unsigned,
 COVIncrement [4] REAL OPTIONAL
 */
 
+/* the subscription lapses without a renewal */
+static void cov_lifetime_expired(
+    BACNET_TIMER * timer)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription;
+
+    cov_subscription = (BACNET_COV_SUBSCRIPTION *) ((uint8_t *) timer -
+        offsetof(BACNET_COV_SUBSCRIPTION, lifetime));
+    cov_subscription->valid = false;
+}
+
+/* a lifetime of zero (or none given) is an indefinite subscription */
+static void cov_lifetime_start(
+    BACNET_COV_SUBSCRIPTION * cov_subscription,
+    uint32_t lifetime_seconds)
+{
+    if (lifetime_seconds == 0) {
+        timer_wheel_stop(&cov_subscription->lifetime);
+        return;
+    }
+    if (lifetime_seconds > (UINT32_MAX / 1000))
+        lifetime_seconds = UINT32_MAX / 1000;
+    timer_wheel_start(&cov_subscription->lifetime, lifetime_seconds * 1000,
+        cov_lifetime_expired);
+}
+
+/* seconds left before the subscription lapses, rounded up */
+static uint32_t cov_lifetime_remaining(
+    BACNET_COV_SUBSCRIPTION * cov_subscription)
+{
+    return (timer_wheel_remaining(&cov_subscription->lifetime) + 999) / 1000;
+}
+
 static int cov_encode_subscription(
     uint8_t * apdu,
     int max_apdu,
@@ -169,7 +203,7 @@ static int cov_encode_subscription(
     /* TimeRemaining [3] Unsigned, */
     len =
         encode_context_unsigned(&apdu[apdu_len], 3,
-        cov_subscription->lifetime);
+        cov_lifetime_remaining(cov_subscription));
     apdu_len += len;
 
     return apdu_len;
@@ -213,7 +247,7 @@ void handler_cov_init(
             OBJECT_ANALOG_INPUT;
         COV_Subscriptions[index].monitoredObjectIdentifier.instance = 0;
         COV_Subscriptions[index].issueConfirmedNotifications = false;
-        COV_Subscriptions[index].lifetime = 0;
+        timer_wheel_stop(&COV_Subscriptions[index].lifetime);
         COV_Subscriptions[index].send_requested = false;
     }
 }
@@ -244,11 +278,13 @@ static bool cov_list_subscribe(
                 existing_entry = true;
                 if (cov_data->cancellationRequest) {
                     COV_Subscriptions[index].valid = false;
+                    timer_wheel_stop(&COV_Subscriptions[index].lifetime);
                 } else {
                     bacnet_address_copy(&COV_Subscriptions[index].dest, src);
                     COV_Subscriptions[index].issueConfirmedNotifications =
                         cov_data->issueConfirmedNotifications;
-                    COV_Subscriptions[index].lifetime = cov_data->lifetime;
+                    cov_lifetime_start(&COV_Subscriptions[index],
+                        cov_data->lifetime);
                     COV_Subscriptions[index].send_requested = true;
                 }
                 break;
@@ -273,7 +309,7 @@ static bool cov_list_subscribe(
             cov_data->subscriberProcessIdentifier;
         COV_Subscriptions[index].issueConfirmedNotifications =
             cov_data->issueConfirmedNotifications;
-        COV_Subscriptions[index].lifetime = cov_data->lifetime;
+        cov_lifetime_start(&COV_Subscriptions[index], cov_data->lifetime);
         COV_Subscriptions[index].send_requested = true;
     } else if (!existing_entry) {
         if (first_invalid_index < 0) {
@@ -297,7 +333,6 @@ static bool cov_send_request(
     int len = 0;
     int pdu_len = 0;
     BACNET_NPDU_DATA npdu_data;
-    BACNET_ADDRESS my_address;
     int bytes_sent = 0;
     uint8_t invoke_id = 0;
     bool status = false;        /* return value */
@@ -307,11 +342,10 @@ static bool cov_send_request(
 #if PRINT_ENABLED
     fprintf(stderr, "COVnotification: requested\n");
 #endif
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], &cov_subscription->dest,
-        &my_address, &npdu_data);
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0],
+        &cov_subscription->dest, &npdu_data);
     /* load the COV data structure for outgoing message */
     cov_data.subscriberProcessIdentifier =
         cov_subscription->subscriberProcessIdentifier;
@@ -320,7 +354,7 @@ static bool cov_send_request(
         cov_subscription->monitoredObjectIdentifier.type;
     cov_data.monitoredObjectIdentifier.instance =
         cov_subscription->monitoredObjectIdentifier.instance;
-    cov_data.timeRemaining = cov_subscription->lifetime;
+    cov_data.timeRemaining = cov_lifetime_remaining(cov_subscription);
     /* encode the value list */
     cov_data.listOfValues = &value_list[0];
     value_list[0].next = &value_list[1];
@@ -335,7 +369,7 @@ static bool cov_send_request(
             goto COV_FAILED;
     }
     if (cov_subscription->issueConfirmedNotifications) {
-        invoke_id = tsm_next_free_invokeID();
+        invoke_id = tsm_next_free_invokeID(&cov_subscription->dest);
         if (invoke_id) {
             len =
                 ccov_notify_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
@@ -367,33 +401,19 @@ static bool cov_send_request(
 }
 
 /* note: worst case tasking: MS/TP with the ability to send only
-   one notification per task cycle */
+   one notification per task cycle.
+   Lifetimes expire on the timer wheel; this only polls for changes. */
 void handler_cov_task(
     uint32_t elapsed_seconds)
 {
     int index;
-    uint32_t lifetime_seconds;
     BACNET_OBJECT_ID object_id;
     bool status = false;
 
-
+    (void) elapsed_seconds;
     /* existing? - match Object ID and Process ID */
     for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
         if (COV_Subscriptions[index].valid) {
-            /* handle timeouts */
-            lifetime_seconds = COV_Subscriptions[index].lifetime;
-            if (lifetime_seconds >= elapsed_seconds) {
-                COV_Subscriptions[index].lifetime -= elapsed_seconds;
-#if 0
-                fprintf(stderr, "COVtask: subscription[%d].lifetime=%d\n",
-                    index, COV_Subscriptions[index].lifetime);
-#endif
-            } else {
-                COV_Subscriptions[index].lifetime = 0;
-            }
-            if (COV_Subscriptions[index].lifetime == 0) {
-                COV_Subscriptions[index].valid = false;
-            }
             /* handle COV notifications */
             object_id.type =
                 COV_Subscriptions[index].monitoredObjectIdentifier.type;
@@ -459,13 +479,11 @@ void handler_cov_subscribe(
     int bytes_sent = 0;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
-    BACNET_ADDRESS my_address;
 
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
         /* we don't support segmentation - send an abort */
@@ -106,7 +106,7 @@ void handler_get_event_information(
     error = true;
     len =
         getevent_ack_encode_apdu_init(&Handler_Transmit_Buffer[pdu_len],
-        sizeof(Handler_Transmit_Buffer) - pdu_len, service_data->invoke_id);
+        MAX_PDU - pdu_len, service_data->invoke_id);
     if (len <= 0) {
         error = true;
         goto GET_EVENT_ERROR;
@@ -119,7 +119,7 @@ void handler_get_event_information(
                 if (valid_event > 0) {
                     len =
                         getevent_ack_encode_apdu_data(&Handler_Transmit_Buffer
-                        [pdu_len], sizeof(Handler_Transmit_Buffer) - pdu_len,
+                        [pdu_len], MAX_PDU - pdu_len,
                         &getevent_data);
                     if (len <= 0) {
                         error = true;
@@ -134,7 +134,7 @@ void handler_get_event_information(
     }
     len =
         getevent_ack_encode_apdu_end(&Handler_Transmit_Buffer[pdu_len],
-        sizeof(Handler_Transmit_Buffer) - pdu_len, false);
+        MAX_PDU - pdu_len, false);
     if (len <= 0) {
         error = true;
         goto GET_EVENT_ERROR;
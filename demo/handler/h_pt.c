@@ -210,7 +210,6 @@ void handler_conf_private_trans(
     bool error;
     int bytes_sent;
     BACNET_NPDU_DATA npdu_data;
-    BACNET_ADDRESS my_address;
     BACNET_ERROR_CLASS error_class;
     BACNET_ERROR_CODE error_code;
 
@@ -227,10 +226,9 @@ void handler_conf_private_trans(
     /* encode the NPDU portion of the response packet as it will be needed */
     /* no matter what the outcome. */
 
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
 
     if (service_data->segmented_message) {
@@ -36,8 +36,7 @@
 #include "npdu.h"
 #include "abort.h"
 #include "rp.h"
-
-static uint8_t Temp_Buf[MAX_APDU] = { 0 };
+#include "segment.h"
 
 static read_property_function Read_Property[MAX_BACNET_OBJECT_TYPE];
 
@@ -55,9 +54,11 @@ void handler_read_property_object_set(
 }
 
 /* Encodes the property APDU and returns the length,
-   or sets the error, and returns -1 */
+   or sets the error, and returns -1,
+   or returns -2 if it would not fit into max_apdu */
 int Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     BACNET_OBJECT_TYPE object_type,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
@@ -79,8 +80,8 @@ int Encode_Property_APDU(
     }
     if (object_rp && object_valid && object_valid(object_instance)) {
         apdu_len =
-            object_rp(&apdu[0], object_instance, property, array_index,
-            error_class, error_code);
+            object_rp(&apdu[0], max_apdu, object_instance, property,
+            array_index, error_class, error_code);
     } else {
         *error_class = ERROR_CLASS_OBJECT;
         *error_code = ERROR_CODE_UNSUPPORTED_OBJECT_TYPE;
@@ -96,6 +97,7 @@ void handler_read_property(
     BACNET_CONFIRMED_SERVICE_DATA * service_data)
 {
     BACNET_READ_PROPERTY_DATA data;
+    BACNET_APDU_CURSOR cursor;
     int len = 0;
     int pdu_len = 0;
     BACNET_NPDU_DATA npdu_data;
@@ -103,16 +105,15 @@ void handler_read_property(
     int bytes_sent = 0;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
-    BACNET_ADDRESS my_address;
 
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
-        /* we don't support segmentation - send an abort */
+        /* segments are put back together before they get here,
+           so this one is stray - send an abort */
         len =
             abort_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
             service_data->invoke_id, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED,
@@ -141,29 +142,39 @@ void handler_read_property(
 
     /* assume that there is an error */
     error = true;
+    /* the ACK is encoded in place: its header, then the value
+       straight after it, then the closing tag */
+    apdu_cursor_init(&cursor, &Handler_Transmit_Buffer[0], pdu_len,
+        pdu_len + segment_reply_max_apdu(service_data));
+    apdu_cursor_advance(&cursor,
+        rp_ack_encode_apdu_init(apdu_cursor_position(&cursor),
+            service_data->invoke_id, &data));
     len =
-        Encode_Property_APDU(&Temp_Buf[0], data.object_type,
-        data.object_instance, data.object_property, data.array_index,
-        &error_class, &error_code);
+        Encode_Property_APDU(apdu_cursor_position(&cursor),
+        apdu_cursor_room(&cursor), data.object_type, data.object_instance,
+        data.object_property, data.array_index, &error_class, &error_code);
     if (len >= 0) {
-        /* encode the APDU portion of the packet */
-        data.application_data = &Temp_Buf[0];
-        data.application_data_len = len;
-        /* FIXME: probably need a length limitation sent with encode */
-        len =
-            rp_ack_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
-            service_data->invoke_id, &data);
+        if (apdu_cursor_advance(&cursor, len) &&
+            apdu_cursor_advance(&cursor,
+                rp_ack_encode_apdu_object_property_end(apdu_cursor_position
+                    (&cursor)))) {
+            len = cursor.offset - pdu_len;
 #if PRINT_ENABLED
-        fprintf(stderr, "RP: Sending Ack!\n");
+            fprintf(stderr, "RP: Sending Ack!\n");
 #endif
-        error = false;
+            error = false;
+        } else {
+            len = -2;
+        }
     }
     if (error) {
         if (len == -2) {
-            /* BACnet APDU too small to fit data, so proper response is Abort */
+            /* too big even in segments, so proper response is Abort */
             len =
                 abort_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
                 service_data->invoke_id,
+                service_data->segmented_response_accepted ?
+                ABORT_REASON_BUFFER_OVERFLOW :
                 ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
 #if PRINT_ENABLED
             fprintf(stderr, "RP: Reply too big to fit into APDU!\n");
@@ -179,10 +190,10 @@ void handler_read_property(
         }
     }
   RP_ABORT:
-    pdu_len += len;
+    /* a long ACK goes out in segments */
     bytes_sent =
-        datalink_send_pdu(src, &npdu_data, &Handler_Transmit_Buffer[0],
-        pdu_len);
+        segment_send_pdu(src, &npdu_data, service_data,
+        &Handler_Transmit_Buffer[0], pdu_len, len);
 #if PRINT_ENABLED
     if (bytes_sent <= 0)
         fprintf(stderr, "Failed to send PDU (%s)!\n", strerror(errno));
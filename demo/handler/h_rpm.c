@@ -30,17 +30,15 @@
 #include <string.h>
 #include "config.h"
 #include "txbuf.h"
-#include "memcopy.h"
 #include "bacdef.h"
 #include "bacdcode.h"
 #include "apdu.h"
 #include "npdu.h"
 #include "abort.h"
 #include "rpm.h"
+#include "segment.h"
 #include "handlers.h"
 
-static uint8_t Temp_Buf[MAX_APDU] = { 0 };
-
 static rpm_property_lists_function RPM_Lists[MAX_BACNET_OBJECT_TYPE];
 
 struct property_list_t {
@@ -171,56 +169,51 @@ static unsigned RPM_Object_Property_Count(
     return count;
 }
 
-/* Encode the RPM property returning the length of the encoding,
-   or 0 if there is no room to fit the encoding.  */
-int RPM_Encode_Property(
-    uint8_t * apdu,
-    uint16_t offset,
-    uint16_t max_apdu,
+/* Encode the RPM property in place at the cursor, returning false
+   if there is no room left in the reply to fit the encoding. */
+static bool RPM_Encode_Property(
+    BACNET_APDU_CURSOR * cursor,
     BACNET_OBJECT_TYPE object_type,
     uint32_t object_instance,
     BACNET_PROPERTY_ID object_property,
     int32_t array_index)
 {
     int len = 0;
-    size_t copy_len = 0;
-    int apdu_len = 0;
+    unsigned value_offset = 0;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
 
     len =
-        rpm_ack_encode_apdu_object_property(&Temp_Buf[0], object_property,
-        array_index);
-    copy_len = memcopy(&apdu[0], &Temp_Buf[0], offset, len, max_apdu);
-    if (copy_len == 0) {
-        return 0;
+        rpm_ack_encode_apdu_object_property(apdu_cursor_position(cursor),
+        object_property, array_index);
+    if (!apdu_cursor_advance(cursor, len)) {
+        return false;
+    }
+    /* the value goes straight after its opening tag */
+    value_offset = cursor->offset;
+    len = encode_opening_tag(apdu_cursor_position(cursor), 4);
+    if (!apdu_cursor_advance(cursor, len)) {
+        return false;
     }
-    apdu_len += len;
     len =
-        Encode_Property_APDU(&Temp_Buf[0], object_type, object_instance,
+        Encode_Property_APDU(apdu_cursor_position(cursor),
+        apdu_cursor_room(cursor), object_type, object_instance,
         object_property, array_index, &error_class, &error_code);
-    if (len < 0) {
+    if (len == -1) {
         /* error was returned - encode that for the response */
+        cursor->offset = value_offset;
         len =
-            rpm_ack_encode_apdu_object_property_error(&Temp_Buf[0],
-            error_class, error_code);
-        copy_len =
-            memcopy(&apdu[0], &Temp_Buf[0], offset + apdu_len, len, max_apdu);
-        if (copy_len == 0) {
-            return 0;
-        }
-    } else if ((offset + apdu_len + 1 + len + 1) < max_apdu) {
-        /* enough room to fit the property value and tags */
-        len =
-            rpm_ack_encode_apdu_object_property_value(&apdu[offset + apdu_len],
-            &Temp_Buf[0], len);
-    } else {
+            rpm_ack_encode_apdu_object_property_error(apdu_cursor_position
+            (cursor), error_class, error_code);
+        return apdu_cursor_advance(cursor, len);
+    }
+    if (!apdu_cursor_advance(cursor, len)) {
         /* not enough room - abort! */
-        return 0;
+        return false;
     }
-    apdu_len += len;
+    len = encode_closing_tag(apdu_cursor_position(cursor), 4);
 
-    return apdu_len;
+    return apdu_cursor_advance(cursor, len);
 }
 
 void handler_read_property_multiple(
@@ -230,26 +223,22 @@ void handler_read_property_multiple(
     BACNET_CONFIRMED_SERVICE_DATA * service_data)
 {
     int len = 0;
-    int copy_len = 0;
     int decode_len = 0;
-    int pdu_len = 0;
     BACNET_NPDU_DATA npdu_data;
+    BACNET_APDU_CURSOR cursor;
     int bytes_sent;
-    BACNET_ADDRESS my_address;
     BACNET_OBJECT_TYPE object_type;
     uint32_t object_instance = 0;
     int apdu_len = 0;
     int npdu_len = 0;
     BACNET_PROPERTY_ID object_property;
     int32_t array_index = 0;
+    uint8_t abort_reason = ABORT_REASON_SEGMENTATION_NOT_SUPPORTED;
 
-    /* jps_debug - see if we are utilizing all the buffer */
-    /* memset(&Handler_Transmit_Buffer[0], 0xff, sizeof(Handler_Transmit_Buffer)); */
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     npdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
         apdu_len =
@@ -261,11 +250,19 @@ void handler_read_property_multiple(
 #endif
         goto RPM_ABORT;
     }
+    /* the reply is encoded in place, and may run to as many
+       segments as the client takes */
+    apdu_cursor_init(&cursor, &Handler_Transmit_Buffer[0], npdu_len,
+        npdu_len + segment_reply_max_apdu(service_data));
+    if (service_data->segmented_response_accepted) {
+        abort_reason = ABORT_REASON_BUFFER_OVERFLOW;
+    }
     /* decode apdu request & encode apdu reply
        encode complex ack, invoke id, service choice */
-    apdu_len =
-        rpm_ack_encode_apdu_init(&Handler_Transmit_Buffer[npdu_len],
+    len =
+        rpm_ack_encode_apdu_init(apdu_cursor_position(&cursor),
         service_data->invoke_id);
+    apdu_cursor_advance(&cursor, len);
     do {
         len =
             rpm_decode_object_id(&service_request[decode_len],
@@ -279,18 +276,11 @@ void handler_read_property_multiple(
                 service_len - decode_len);
             if (len == 1) {
                 decode_len++;
-                len = rpm_ack_encode_apdu_object_end(&Temp_Buf[0]);
-                copy_len =
-                    memcopy(&Handler_Transmit_Buffer[npdu_len], &Temp_Buf[0],
-                    apdu_len, len, sizeof(Handler_Transmit_Buffer));
-                if (!copy_len) {
-                    apdu_len =
-                        abort_encode_apdu(&Handler_Transmit_Buffer[npdu_len],
-                        service_data->invoke_id,
-                        ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-                    goto RPM_ABORT;
-                } else {
-                    apdu_len += copy_len;
+                len =
+                    rpm_ack_encode_apdu_object_end(apdu_cursor_position
+                    (&cursor));
+                if (!apdu_cursor_advance(&cursor, len)) {
+                    goto RPM_OVERFLOW;
                 }
             } else {
                 apdu_len =
@@ -301,19 +291,10 @@ void handler_read_property_multiple(
             break;
         }
         len =
-            rpm_ack_encode_apdu_object_begin(&Temp_Buf[0], object_type,
-            object_instance);
-        copy_len =
-            memcopy(&Handler_Transmit_Buffer[npdu_len], &Temp_Buf[0], apdu_len,
-            len, sizeof(Handler_Transmit_Buffer));
-        if (!copy_len) {
-            apdu_len =
-                abort_encode_apdu(&Handler_Transmit_Buffer[npdu_len],
-                service_data->invoke_id,
-                ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-            goto RPM_ABORT;
-        } else {
-            apdu_len += copy_len;
+            rpm_ack_encode_apdu_object_begin(apdu_cursor_position(&cursor),
+            object_type, object_instance);
+        if (!apdu_cursor_advance(&cursor, len)) {
+            goto RPM_OVERFLOW;
         }
         /* do each property of this object of the RPM request */
         do {
@@ -329,19 +310,11 @@ void handler_read_property_multiple(
                     service_len - decode_len);
                 if (len == 1) {
                     decode_len++;
-                    len = rpm_ack_encode_apdu_object_end(&Temp_Buf[0]);
-                    copy_len =
-                        memcopy(&Handler_Transmit_Buffer[npdu_len],
-                        &Temp_Buf[0], apdu_len, len,
-                        sizeof(Handler_Transmit_Buffer));
-                    if (!copy_len) {
-                        apdu_len =
-                            abort_encode_apdu(&Handler_Transmit_Buffer
-                            [npdu_len], service_data->invoke_id,
-                            ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-                        goto RPM_ABORT;
-                    } else {
-                        apdu_len += copy_len;
+                    len =
+                        rpm_ack_encode_apdu_object_end(apdu_cursor_position
+                        (&cursor));
+                    if (!apdu_cursor_advance(&cursor, len)) {
+                        goto RPM_OVERFLOW;
                     }
                 } else {
                     apdu_len =
@@ -368,54 +341,27 @@ void handler_read_property_multiple(
                     special_object_property);
                 if (property_count == 0) {
                     /* handle the error code - but use the special property */
-                    len =
-                        RPM_Encode_Property(&Handler_Transmit_Buffer[0],
-                        npdu_len + apdu_len, MAX_APDU, object_type,
-                        object_instance, object_property, array_index);
-                    if (len > 0) {
-                        apdu_len += len;
-                    } else {
-                        apdu_len =
-                            abort_encode_apdu(&Handler_Transmit_Buffer
-                            [npdu_len], service_data->invoke_id,
-                            ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-                        goto RPM_ABORT;
+                    if (!RPM_Encode_Property(&cursor, object_type,
+                            object_instance, object_property, array_index)) {
+                        goto RPM_OVERFLOW;
                     }
                 } else {
                     for (index = 0; index < property_count; index++) {
                         object_property =
                             RPM_Object_Property(&property_list,
                             special_object_property, index);
-                        len =
-                            RPM_Encode_Property(&Handler_Transmit_Buffer[0],
-                            npdu_len + apdu_len, MAX_APDU, object_type,
-                            object_instance, object_property, array_index);
-                        if (len > 0) {
-                            apdu_len += len;
-                        } else {
-                            apdu_len =
-                                abort_encode_apdu(&Handler_Transmit_Buffer
-                                [npdu_len], service_data->invoke_id,
-                                ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-                            goto RPM_ABORT;
+                        if (!RPM_Encode_Property(&cursor, object_type,
+                                object_instance, object_property,
+                                array_index)) {
+                            goto RPM_OVERFLOW;
                         }
                     }
                 }
             } else {
                 /* handle an individual property */
-                len =
-                    RPM_Encode_Property(&Handler_Transmit_Buffer[0],
-                    npdu_len + apdu_len, sizeof(Handler_Transmit_Buffer),
-                    object_type, object_instance, object_property,
-                    array_index);
-                if (len > 0) {
-                    apdu_len += len;
-                } else {
-                    apdu_len =
-                        abort_encode_apdu(&Handler_Transmit_Buffer[npdu_len],
-                        service_data->invoke_id,
-                        ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
-                    goto RPM_ABORT;
+                if (!RPM_Encode_Property(&cursor, object_type,
+                        object_instance, object_property, array_index)) {
+                    goto RPM_OVERFLOW;
                 }
             }
         } while (1);
@@ -423,9 +369,15 @@ void handler_read_property_multiple(
             break;
         }
     } while (1);
+    apdu_len = cursor.offset - npdu_len;
+    goto RPM_ABORT;
+  RPM_OVERFLOW:
+    apdu_len =
+        abort_encode_apdu(&Handler_Transmit_Buffer[npdu_len],
+        service_data->invoke_id, abort_reason, true);
   RPM_ABORT:
-    pdu_len = apdu_len + npdu_len;
+    /* a long ACK goes out in segments */
     bytes_sent =
-        datalink_send_pdu(src, &npdu_data, &Handler_Transmit_Buffer[0],
-        pdu_len);
+        segment_send_pdu(src, &npdu_data, service_data,
+        &Handler_Transmit_Buffer[0], npdu_len, apdu_len);
 }
@@ -36,13 +36,21 @@
 #include "npdu.h"
 #include "abort.h"
 #include "readrange.h"
+#include "segment.h"
 
-static uint8_t Temp_Buf[MAX_APDU] = { 0 };
+/* ComplexACK header, object, property, array index, result flags,
+   item count, the tags around the items and the first sequence */
+#define RR_ACK_OVERHEAD (3 + 5 + 5 + 5 + 4 + 5 + 1 + 1 + 5)
+
+/* items on their way into a possibly segmented ACK */
+static uint8_t Temp_Buf[MAX_APDU_SEGMENTED] = { 0 };
 
 /* Encodes the property APDU and returns the length,
-   or sets the error, and returns -1 */
+   or sets the error, and returns -1,
+   or returns -2 if it would not fit into max_apdu */
 int Encode_RR_payload(
     uint8_t * apdu,
+    unsigned max_apdu,
     BACNET_READ_RANGE_DATA * pRequest,
     BACNET_ERROR_CLASS * error_class,
     BACNET_ERROR_CODE * error_code)
@@ -54,6 +62,9 @@ int Encode_RR_payload(
      * and see how we can do this for real. 
      */
 
+    /* six small unsigned values */
+    if (max_apdu < (6 * 2))
+        return -2;
     pRequest->ItemCount = 6;
     bitstring_init(&pRequest->ResultFlags);
     bitstring_set_bit(&pRequest->ResultFlags, RESULT_FLAG_FIRST_ITEM, true);
@@ -84,18 +95,18 @@ void handler_read_range(
     BACNET_NPDU_DATA npdu_data;
     bool error = false;
     int bytes_sent = 0;
+    unsigned max_apdu = 0;
     BACNET_ERROR_CLASS error_class = ERROR_CLASS_OBJECT;
     BACNET_ERROR_CODE error_code = ERROR_CODE_UNKNOWN_OBJECT;
-    BACNET_ADDRESS my_address;
 
     /* encode the NPDU portion of the packet */
-    datalink_get_my_address(&my_address);
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], src, &my_address,
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], src,
         &npdu_data);
     if (service_data->segmented_message) {
-        /* we don't support segmentation - send an abort */
+        /* segments are put back together before they get here,
+           so this one is stray - send an abort */
         len =
             abort_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
             service_data->invoke_id, ABORT_REASON_SEGMENTATION_NOT_SUPPORTED,
@@ -124,12 +135,20 @@ void handler_read_range(
 
     /* assume that there is an error */
     error = true;
-    len = Encode_RR_payload(&Temp_Buf[0], &data, &error_class, &error_code);
+    /* the items get whatever the ACK around them leaves, in segments
+       if the requester takes them */
+    max_apdu = segment_reply_max_apdu(service_data);
+    if (max_apdu > RR_ACK_OVERHEAD)
+        max_apdu -= RR_ACK_OVERHEAD;
+    else
+        max_apdu = 0;
+    len =
+        Encode_RR_payload(&Temp_Buf[0], max_apdu, &data, &error_class,
+        &error_code);
     if (len >= 0) {
         /* encode the APDU portion of the packet */
         data.application_data = &Temp_Buf[0];
         data.application_data_len = len;
-        /* FIXME: probably need a length limitation sent with encode */
         len =
             rr_ack_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
             service_data->invoke_id, &data);
@@ -140,10 +159,12 @@ void handler_read_range(
     }
     if (error) {
         if (len == -2) {
-            /* BACnet APDU too small to fit data, so proper response is Abort */
+            /* too big even in segments, so proper response is Abort */
             len =
                 abort_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
                 service_data->invoke_id,
+                service_data->segmented_response_accepted ?
+                ABORT_REASON_BUFFER_OVERFLOW :
                 ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, true);
 #if PRINT_ENABLED
             fprintf(stderr, "RR: Reply too big to fit into APDU!\n");
@@ -159,10 +180,10 @@ void handler_read_range(
         }
     }
   RR_ABORT:
-    pdu_len += len;
+    /* a long ACK goes out in segments */
     bytes_sent =
-        datalink_send_pdu(src, &npdu_data, &Handler_Transmit_Buffer[0],
-        pdu_len);
+        segment_send_pdu(src, &npdu_data, service_data,
+        &Handler_Transmit_Buffer[0], pdu_len, len);
 #if PRINT_ENABLED
     if (bytes_sent <= 0)
         fprintf(stderr, "Failed to send PDU (%s)!\n", strerror(errno));
@@ -53,7 +53,7 @@ int ucov_notify_encode_pdu(
     datalink_get_broadcast_address(dest);
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(npdu_data, false, MESSAGE_PRIORITY_NORMAL);
-    pdu_len = npdu_encode_pdu(&buffer[0], dest, NULL, npdu_data);
+    pdu_len = npdu_encode_apdu_header(&buffer[0], dest, npdu_data);
     /* encode the APDU portion of the packet */
     len = ucov_notify_encode_apdu(&buffer[pdu_len], cov_data);
     pdu_len += len;
@@ -52,11 +52,12 @@ int iam_encode_pdu(
     datalink_get_broadcast_address(dest);
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(npdu_data, false, MESSAGE_PRIORITY_NORMAL);
-    pdu_len = npdu_encode_pdu(&buffer[0], dest, NULL, npdu_data);
+    pdu_len = npdu_encode_apdu_header(&buffer[0], dest, npdu_data);
     /* encode the APDU portion of the packet */
     len =
         iam_encode_apdu(&buffer[pdu_len], Device_Object_Instance_Number(),
-        MAX_APDU, SEGMENTATION_NONE, Device_Vendor_Identifier());
+        MAX_APDU, Device_Segmentation_Supported(),
+        Device_Vendor_Identifier());
     pdu_len += len;
 
     return pdu_len;
@@ -40,7 +40,7 @@ int Send_UEvent_Notify(
 
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
-    pdu_len = npdu_encode_pdu(buffer, dest, NULL, &npdu_data);
+    pdu_len = npdu_encode_apdu_header(buffer, dest, &npdu_data);
     /* encode the APDU portion of the packet */
     len = uevent_notify_encode_apdu(&buffer[pdu_len], data);
     pdu_len += len;
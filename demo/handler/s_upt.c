@@ -58,7 +58,7 @@ void Send_UnconfirmedPrivateTransfer(
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], dest, NULL, &npdu_data);
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], dest, &npdu_data);
     /* encode the APDU portion of the packet */
     len =
         uptransfer_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
@@ -64,7 +64,8 @@ void Send_WhoHas_Name(
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], &dest, NULL, &npdu_data);
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], &dest,
+        &npdu_data);
     /* encode the APDU portion of the packet */
     data.low_limit = low_limit;
     data.high_limit = high_limit;
@@ -105,7 +106,8 @@ void Send_WhoHas_Object(
     /* encode the NPDU portion of the packet */
     npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
     pdu_len =
-        npdu_encode_pdu(&Handler_Transmit_Buffer[0], &dest, NULL, &npdu_data);
+        npdu_encode_apdu_header(&Handler_Transmit_Buffer[0], &dest,
+        &npdu_data);
     /* encode the APDU portion of the packet */
     data.low_limit = low_limit;
     data.high_limit = high_limit;
@@ -26,5 +26,6 @@
 #include <stdint.h>
 #include "config.h"
 #include "datalink.h"
+#include "txbuf.h"
 
-uint8_t Handler_Transmit_Buffer[MAX_PDU] = { 0 };
+uint8_t Handler_Transmit_Buffer[MAX_TRANSMIT_BUFFER] = { 0 };
@@ -37,19 +37,165 @@
 #include "bacdef.h"
 #include "bacdcode.h"
 #include "bacenum.h"
+#include "datetime.h"
 #include "config.h"     /* the custom stuff */
-
-#ifndef MAX_ANALOG_INPUTS
-#define MAX_ANALOG_INPUTS 45
-#endif
+#include "ai.h"
 
 #define MAXFLDSIZE 10   /* longest possible field + 1 = 31 byte field */
 #define MAXFLDS 200     /* maximum possible number of fields */
 
 
-static float Present_Value[MAX_ANALOG_INPUTS]={0};
+/* Two generations of the point table. Readers use whichever one Table
+   points at without locking; a writer fills the other one and publishes
+   it with a single pointer swap. Before a writer reuses a generation it
+   waits for the readers still inside it to leave. */
+static ANALOG_INPUT_TABLE Tables[2] = {
+    {{0}, {0}, ANALOG_INPUTS_PER_LOCATION},
+    {{0}, {0}, ANALOG_INPUTS_PER_LOCATION}
+};
+static ANALOG_INPUT_TABLE *Table = &Tables[0];
+/* readers currently inside each generation */
+static unsigned Table_Readers[2];
+/* only one writer at a time */
+static int Table_Writer;
+
+/* enters the published generation; pair with Analog_Input_Table_Release */
+static const ANALOG_INPUT_TABLE *Analog_Input_Table_Acquire(
+    void)
+{
+    ANALOG_INPUT_TABLE *table;
+    unsigned index;
+
+    for (;;) {
+        table = __atomic_load_n(&Table, __ATOMIC_SEQ_CST);
+        index = (unsigned) (table - &Tables[0]);
+        __atomic_add_fetch(&Table_Readers[index], 1, __ATOMIC_SEQ_CST);
+        /* still published? then no writer can start reusing it */
+        if (table == __atomic_load_n(&Table, __ATOMIC_SEQ_CST))
+            return table;
+        __atomic_sub_fetch(&Table_Readers[index], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void Analog_Input_Table_Release(
+    const ANALOG_INPUT_TABLE * table)
+{
+    __atomic_sub_fetch(&Table_Readers[table - &Tables[0]], 1,
+        __ATOMIC_SEQ_CST);
+}
+
+/* encodes a BACnetDateTime, all wildcards (0xFF) for a time of 0 */
+static int Analog_Input_Encode_Update_Time(
+    uint8_t * apdu,
+    time_t update_time)
+{
+    BACNET_DATE bdate = { 1900 + 0xFF, 0xFF, 0xFF, 0xFF };
+    BACNET_TIME btime = { 0xFF, 0xFF, 0xFF, 0xFF };
+    struct tm tm_time;
+    int len = 0;
+
+    if (update_time && localtime_r(&update_time, &tm_time)) {
+        datetime_set_date(&bdate, (uint16_t) (1900 + tm_time.tm_year),
+            (uint8_t) (tm_time.tm_mon + 1), (uint8_t) tm_time.tm_mday);
+        datetime_set_time(&btime, (uint8_t) tm_time.tm_hour,
+            (uint8_t) tm_time.tm_min, (uint8_t) tm_time.tm_sec, 0);
+    }
+    len = encode_application_date(&apdu[0], &bdate);
+    len += encode_application_time(&apdu[len], &btime);
+
+    return len;
+}
+
+/* brings the encoded values of next up to date with the points that
+   changed since current, or were never encoded at all */
+static void Analog_Input_Encode_Changes(
+    ANALOG_INPUT_TABLE * next,
+    const ANALOG_INPUT_TABLE * current)
+{
+    unsigned i;
+
+    for (i = 0; i < MAX_ANALOG_INPUTS; i++) {
+        if ((next->Present_Value_APDU[i][0] == 0) ||
+            memcmp(&next->Present_Value[i], &current->Present_Value[i],
+                sizeof(next->Present_Value[i]))) {
+            encode_application_real(&next->Present_Value_APDU[i][0],
+                next->Present_Value[i]);
+        }
+        if ((next->Update_Time_APDU[i][0] == 0) ||
+            (next->Update_Time[i] != current->Update_Time[i])) {
+            Analog_Input_Encode_Update_Time(&next->Update_Time_APDU[i][0],
+                next->Update_Time[i]);
+        }
+    }
+}
+
+ANALOG_INPUT_TABLE *Analog_Input_Update_Begin(
+    void)
+{
+    ANALOG_INPUT_TABLE *next;
+    unsigned index;
+
+    ANALOG_INPUT_TABLE *current;
+
+    while (__atomic_exchange_n(&Table_Writer, 1, __ATOMIC_ACQUIRE)) {
+        /* another writer is busy */
+    }
+    /* only writers store Table, and we are the only writer */
+    current = __atomic_load_n(&Table, __ATOMIC_RELAXED);
+    next = (current == &Tables[0]) ? &Tables[1] : &Tables[0];
+    index = (unsigned) (next - &Tables[0]);
+    /* wait out readers that entered before the last swap */
+    while (__atomic_load_n(&Table_Readers[index], __ATOMIC_SEQ_CST)) {
+        /* they only copy a value out */
+    }
+    memcpy(next, current, sizeof(ANALOG_INPUT_TABLE));
+
+    return next;
+}
+
+void Analog_Input_Update_Commit(
+    ANALOG_INPUT_TABLE * next)
+{
+    if (next->Instances > MAX_ANALOG_INPUTS) {
+        next->Instances = MAX_ANALOG_INPUTS;
+    }
+    /* only writers store Table, and we are the only writer */
+    Analog_Input_Encode_Changes(next, __atomic_load_n(&Table,
+            __ATOMIC_RELAXED));
+    __atomic_store_n(&Table, next, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&Table_Writer, 0, __ATOMIC_RELEASE);
+}
 
+/* an encoded property value that never changes once
+   Analog_Input_Init has made it */
+typedef struct Analog_Input_APDU {
+    uint8_t len;
+    uint8_t apdu[ANALOG_INPUT_NAME_SIZE + 3];   /* room for a name */
+} ANALOG_INPUT_APDU;
+
+/* the same for every point */
+static ANALOG_INPUT_APDU Object_Type_APDU;
+static ANALOG_INPUT_APDU Status_Flags_APDU;
+static ANALOG_INPUT_APDU Event_State_APDU;
+static ANALOG_INPUT_APDU Out_Of_Service_APDU;
+static ANALOG_INPUT_APDU Test_Real_APDU;
+static ANALOG_INPUT_APDU Test_Unsigned_APDU;
+static ANALOG_INPUT_APDU Test_Signed_APDU;
+/* the same for the same point of every location */
+static ANALOG_INPUT_APDU Description_APDU[ANALOG_INPUTS_PER_LOCATION];
+static ANALOG_INPUT_APDU Units_APDU[ANALOG_INPUTS_PER_LOCATION];
+static ANALOG_INPUT_APDU COV_Increment_APDU[ANALOG_INPUTS_PER_LOCATION];
+/* each instance's name */
+static ANALOG_INPUT_APDU Name_APDU[MAX_ANALOG_INPUTS];
+
+static int Analog_Input_Copy_APDU(
+    uint8_t * apdu,
+    const ANALOG_INPUT_APDU * encoded)
+{
+    memcpy(&apdu[0], &encoded->apdu[0], encoded->len);
 
+    return encoded->len;
+}
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Properties_Required[] = {
@@ -66,10 +212,12 @@ static const int Properties_Required[] = {
 
 static const int Properties_Optional[] = {
     PROP_DESCRIPTION,
+    PROP_COV_INCREMENT,
     -1
 };
 
 static const int Properties_Proprietary[] = {
+    PROP_AI_UPDATE_TIME,
     9997,
     9998,
     9999,
@@ -97,7 +245,7 @@ void Analog_Input_Property_Lists(
 bool Analog_Input_Valid_Instance(
     uint32_t object_instance)
 {
-    if (object_instance < MAX_ANALOG_INPUTS)
+    if (object_instance < Analog_Input_Count())
         return true;
 
     return false;
@@ -108,7 +256,29 @@ bool Analog_Input_Valid_Instance(
 unsigned Analog_Input_Count(
     void)
 {
-    return MAX_ANALOG_INPUTS;
+    const ANALOG_INPUT_TABLE *table;
+    unsigned count;
+
+    table = Analog_Input_Table_Acquire();
+    count = table->Instances;
+    Analog_Input_Table_Release(table);
+
+    return count;
+}
+
+bool Analog_Input_Count_Set(
+    unsigned count)
+{
+    ANALOG_INPUT_TABLE *next;
+
+    if (count <= MAX_ANALOG_INPUTS) {
+        next = Analog_Input_Update_Begin();
+        next->Instances = count;
+        Analog_Input_Update_Commit(next);
+        return true;
+    }
+
+    return false;
 }
 
 /* we simply have 0-n object instances.  Yours might be */
@@ -122,161 +292,155 @@ uint32_t Analog_Input_Index_To_Instance(
 
 float Analog_Input_Present_Value (uint32_t object_instance)
 {
+	const ANALOG_INPUT_TABLE *table;
 	float value = 0;
 	/*TODO: Report Error if false*/
     	if (object_instance < MAX_ANALOG_INPUTS) {
-        value = Present_Value[object_instance];
+        table = Analog_Input_Table_Acquire();
+        value = table->Present_Value[object_instance];
+        Analog_Input_Table_Release(table);
     	}
 
     	return value;
 }
 
+/* publishes a whole generation for one value - use
+   Analog_Input_Update_Begin to change many at once */
 void Analog_Input_Present_Value_Set(
     uint32_t object_instance,
     float value)
 {
+    ANALOG_INPUT_TABLE *next;
+
     if (object_instance < MAX_ANALOG_INPUTS) {
-        Present_Value[object_instance] = value;
+        next = Analog_Input_Update_Begin();
+        next->Present_Value[object_instance] = value;
+        Analog_Input_Update_Commit(next);
     }
 }
 
-char *Analog_Input_Name(
+time_t Analog_Input_Update_Time(
+    uint32_t object_instance)
+{
+    const ANALOG_INPUT_TABLE *table;
+    time_t update_time = 0;
+
+    if (object_instance < MAX_ANALOG_INPUTS) {
+        table = Analog_Input_Table_Acquire();
+        update_time = table->Update_Time[object_instance];
+        Analog_Input_Table_Release(table);
+    }
+
+    return update_time;
+}
+
+void Analog_Input_Update_Time_Set(
+    uint32_t object_instance,
+    time_t update_time)
+{
+    ANALOG_INPUT_TABLE *next;
+
+    if (object_instance < MAX_ANALOG_INPUTS) {
+        next = Analog_Input_Update_Begin();
+        next->Update_Time[object_instance] = update_time;
+        Analog_Input_Update_Commit(next);
+    }
+}
+
+/* the forecast for one day, which repeats for each day fetched */
+#define ANALOG_INPUT_FORECAST(day, label) \
+    {"TWCi Day" label " High Temp", "Forecast high, day " #day, \
+        UNITS_DEGREES_FAHRENHEIT, 1.0f}, \
+    {"TWCi Day" label " Low Temp", "Forecast low, day " #day, \
+        UNITS_DEGREES_FAHRENHEIT, 1.0f}, \
+    {"TWCi Day" label " Chance of Percip", \
+        "Chance of precipitation, day " #day, UNITS_PERCENT, 5.0f}, \
+    {"TWCi Night" label " Chance of Percip", \
+        "Chance of precipitation, night " #day, UNITS_PERCENT, 5.0f}, \
+    {"TWCi Day" label " Wind Speed", "Wind speed, day " #day, \
+        UNITS_MILES_PER_HOUR, 1.0f}, \
+    {"TWCi Night" label " Wind Speed", "Wind speed, night " #day, \
+        UNITS_MILES_PER_HOUR, 1.0f}
+
+/* every location's block of points, in ANALOG_INPUT_POINT_INDEX
+   order (standard units) */
+static const ANALOG_INPUT_POINT Points[ANALOG_INPUTS_PER_LOCATION] = {
+    {"TWCi CC Temp", "Current temperature", UNITS_DEGREES_FAHRENHEIT, 1.0f},
+    {"TWCi CC Feels", "Current feels like temperature",
+        UNITS_DEGREES_FAHRENHEIT, 1.0f},
+    {"TWCi CC Humidity", "Current relative humidity",
+        UNITS_PERCENT_RELATIVE_HUMIDITY, 1.0f},
+    {"TWCi CC Visibility", "Current visibility in miles", UNITS_NO_UNITS,
+        1.0f},
+    {"TWCi CC Dewpoint", "Current dewpoint", UNITS_DEGREES_FAHRENHEIT, 1.0f},
+    {"TWCi CC Barometric", "Current barometric pressure",
+        UNITS_INCHES_OF_MERCURY, 0.01f},
+    {"TWCi CC UV Index", "Current UV index", UNITS_NO_UNITS, 1.0f},
+    {"TWCi CC Wind", "Current wind speed", UNITS_MILES_PER_HOUR, 1.0f},
+    {"TWCi CC Gust", "Current wind gust", UNITS_MILES_PER_HOUR, 1.0f},
+    {"TWCi CC Direction", "Current wind direction", UNITS_DEGREES_ANGULAR,
+        10.0f},
+    {"TWCi Rain Last Day", "Rain in the last day", UNITS_INCHES, 0.01f},
+    {"TWCi Rain Last Hour", "Rain in the last hour", UNITS_INCHES, 0.01f},
+    {"TWCi Updated Hour", "Hour of the last refresh", UNITS_HOURS, 1.0f},
+    {"TWCi Updated Minute", "Minute of the last refresh", UNITS_MINUTES,
+        1.0f},
+    {"TWCi Updated Month", "Month of the last refresh, from 0",
+        UNITS_NO_UNITS, 1.0f},
+    {"TWCi Updated Day", "Day of the last refresh", UNITS_NO_UNITS, 1.0f},
+    {"TWCi Updated Year", "Year of the last refresh", UNITS_NO_UNITS, 1.0f},
+    ANALOG_INPUT_FORECAST(0, ""),
+    ANALOG_INPUT_FORECAST(1, " 1"),
+    ANALOG_INPUT_FORECAST(2, " 2"),
+    ANALOG_INPUT_FORECAST(3, " 3"),
+    ANALOG_INPUT_FORECAST(4, " 4"),
+    {"TWCi Spare", "Not used", UNITS_NO_UNITS, 1.0f}
+};
+
+/* each instance's name, made once by Analog_Input_Init */
+static char Names[MAX_ANALOG_INPUTS][ANALOG_INPUT_NAME_SIZE];
+
+const ANALOG_INPUT_POINT *Analog_Input_Point(
     uint32_t object_instance)
 {
-    static char text_string[32] = "";   /* okay for single thread */
+    if (object_instance < MAX_ANALOG_INPUTS) {
+        return &Points[object_instance % ANALOG_INPUTS_PER_LOCATION];
+    }
+
+    return NULL;
+}
 
+char *Analog_Input_Name(
+    uint32_t object_instance)
+{
     if (object_instance < MAX_ANALOG_INPUTS) {
-        if (object_instance == 0){
-		sprintf(text_string, "TWCi CC Temp %u", object_instance);
-		}
-        if (object_instance == 1){
-		sprintf(text_string, "TWCi CC Feels %u", object_instance);
-		}
-        if (object_instance == 2){
-		sprintf(text_string, "TWCi CC Humidity %u", object_instance);
-		}
-        if (object_instance == 3){
-		sprintf(text_string, "TWCi CC Visibility %u", object_instance);
-		}
-        if (object_instance == 4){
-		sprintf(text_string, "TWCi Dewpoint %u", object_instance);
-		}
-        if (object_instance == 5){
-		sprintf(text_string, "TWCi Barometric %u", object_instance);
-		}
-		if (object_instance == 6){
-		sprintf(text_string, "TWCi Wind %u", object_instance);
-		}
-        if (object_instance == 7){
-		sprintf(text_string, "TWCi Wind %u", object_instance);
-		}
-        if (object_instance == 7){
-		sprintf(text_string, "TWCi Gust %u", object_instance);
-		}
-        if (object_instance == 9){
-		sprintf(text_string, "TWCi Direction %u", object_instance);
-		}
-        if (object_instance == 10){
-		sprintf(text_string, "TWCi Day High Temp %u", object_instance);
-		}
-        if (object_instance == 11){
-		sprintf(text_string, "TWCi Day Low Temp %u", object_instance);
-		}
-        if (object_instance == 12){
-		sprintf(text_string, "TWCi Day Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 13){
-		sprintf(text_string, "TWCi Night Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 14){
-		sprintf(text_string, "TWCi Day Wind Speed %u", object_instance);
-		}
-        if (object_instance == 15){
-		sprintf(text_string, "TWCi Night Wind Speed %u", object_instance);
-		}
-        if (object_instance == 16){
-		sprintf(text_string, "TWCi Day 1 High Temp %u", object_instance);
-		}
-        if (object_instance == 17){
-		sprintf(text_string, "TWCi Day 1 Low Temp %u", object_instance);
-		}
-        if (object_instance == 18){
-		sprintf(text_string, "TWCi Day 1 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 19){
-		sprintf(text_string, "TWCi Night 1 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 20){
-		sprintf(text_string, "TWCi Day 1 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 21){
-		sprintf(text_string, "TWCi Night 1 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 22){
-		sprintf(text_string, "TWCi Day 2 High Temp %u", object_instance);
-		}
-        if (object_instance == 23){
-		sprintf(text_string, "TWCi Day 2 Low Temp %u", object_instance);
-		}
-        if (object_instance == 24){
-		sprintf(text_string, "TWCi Day 2 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 25){
-		sprintf(text_string, "TWCi Night 2 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 26){
-		sprintf(text_string, "TWCi Day 2 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 27){
-		sprintf(text_string, "TWCi Night 2 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 28){
-		sprintf(text_string, "TWCi Day 3 High Temp %u", object_instance);
-		}
-        if (object_instance == 29){
-		sprintf(text_string, "TWCi Day 3 Low Temp %u", object_instance);
-		}
-        if (object_instance == 30){
-		sprintf(text_string, "TWCi Day 3 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 31){
-		sprintf(text_string, "TWCi Night 3 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 32){
-		sprintf(text_string, "TWCi Day 3 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 33){
-		sprintf(text_string, "TWCi Night 3 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 34){
-		sprintf(text_string, "TWCi Day 4 High Temp %u", object_instance);
-		}
-        if (object_instance == 35){
-		sprintf(text_string, "TWCi Day 4 Low Temp %u", object_instance);
-		}
-        if (object_instance == 36){
-		sprintf(text_string, "TWCi Day 4 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 37){
-		sprintf(text_string, "TWCi Night 4 Chance of Percip %u", object_instance);
-		}
-        if (object_instance == 38){
-		sprintf(text_string, "TWCi Day 4 Wind Speed %u", object_instance);
-		}
-        if (object_instance == 39){
-		sprintf(text_string, "TWCi Night 4 Wind Speed %u", object_instance);
-		}
-
-        return text_string;
+        return Names[object_instance];
     }
 
     return NULL;
 }
 
+char *Analog_Input_Description(
+    uint32_t object_instance)
+{
+    const ANALOG_INPUT_POINT *point = Analog_Input_Point(object_instance);
+
+    return point ? (char *) point->description : NULL;
+}
+
+uint32_t Analog_Input_Units(
+    uint32_t object_instance)
+{
+    const ANALOG_INPUT_POINT *point = Analog_Input_Point(object_instance);
+
+    return point ? point->units : UNITS_NO_UNITS;
+}
+
 /* return apdu length, or -1 on error */
 /* assumption - object has already exists */
 int Analog_Input_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -284,59 +448,80 @@ int Analog_Input_Encode_Property_APDU(
     BACNET_ERROR_CODE * error_code)
 {
     int apdu_len = 0;   /* return value */
-    BACNET_BIT_STRING bit_string;
-    BACNET_CHARACTER_STRING char_string;
+    const ANALOG_INPUT_TABLE *table;
 
     (void) array_index;
-    switch (property) {
+    (void) max_apdu;
+    if (object_instance >= MAX_ANALOG_INPUTS) {
+        *error_class = ERROR_CLASS_OBJECT;
+        *error_code = ERROR_CODE_UNKNOWN_OBJECT;
+        return -1;
+    }
+    /* all but the identifier were encoded ahead of time */
+    /* proprietary properties are outside the enumeration */
+    switch ((int) property) {
         case PROP_OBJECT_IDENTIFIER:
             apdu_len =
                 encode_application_object_id(&apdu[0], OBJECT_ANALOG_INPUT,
                 object_instance);
             break;
         case PROP_OBJECT_NAME:
+            apdu_len =
+                Analog_Input_Copy_APDU(&apdu[0], &Name_APDU[object_instance]);
+            break;
         case PROP_DESCRIPTION:
-            characterstring_init_ansi(&char_string,
-                Analog_Input_Name(object_instance));
             apdu_len =
-                encode_application_character_string(&apdu[0], &char_string);
+                Analog_Input_Copy_APDU(&apdu[0],
+                &Description_APDU[object_instance %
+                    ANALOG_INPUTS_PER_LOCATION]);
             break;
         case PROP_OBJECT_TYPE:
-            apdu_len =
-                encode_application_enumerated(&apdu[0], OBJECT_ANALOG_INPUT);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Object_Type_APDU);
             break;
         case PROP_PRESENT_VALUE:
-            apdu_len =
-                encode_application_real(&apdu[0],
-                Analog_Input_Present_Value(object_instance));
+            table = Analog_Input_Table_Acquire();
+            memcpy(&apdu[0], &table->Present_Value_APDU[object_instance][0],
+                ANALOG_INPUT_VALUE_APDU_LEN);
+            Analog_Input_Table_Release(table);
+            apdu_len = ANALOG_INPUT_VALUE_APDU_LEN;
             break;
         case PROP_STATUS_FLAGS:
-            bitstring_init(&bit_string);
-            bitstring_set_bit(&bit_string, STATUS_FLAG_IN_ALARM, false);
-            bitstring_set_bit(&bit_string, STATUS_FLAG_FAULT, false);
-            bitstring_set_bit(&bit_string, STATUS_FLAG_OVERRIDDEN, false);
-            bitstring_set_bit(&bit_string, STATUS_FLAG_OUT_OF_SERVICE, false);
-            apdu_len = encode_application_bitstring(&apdu[0], &bit_string);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Status_Flags_APDU);
             break;
         case PROP_EVENT_STATE:
-            apdu_len =
-                encode_application_enumerated(&apdu[0], EVENT_STATE_NORMAL);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Event_State_APDU);
             break;
         case PROP_OUT_OF_SERVICE:
-            apdu_len = encode_application_boolean(&apdu[0], false);
+            apdu_len =
+                Analog_Input_Copy_APDU(&apdu[0], &Out_Of_Service_APDU);
             break;
         case PROP_UNITS:
-            apdu_len = encode_application_enumerated(&apdu[0], UNITS_PERCENT);
+            apdu_len =
+                Analog_Input_Copy_APDU(&apdu[0],
+                &Units_APDU[object_instance % ANALOG_INPUTS_PER_LOCATION]);
+            break;
+        case PROP_COV_INCREMENT:
+            apdu_len =
+                Analog_Input_Copy_APDU(&apdu[0],
+                &COV_Increment_APDU[object_instance %
+                    ANALOG_INPUTS_PER_LOCATION]);
+            break;
+        case PROP_AI_UPDATE_TIME:
+            table = Analog_Input_Table_Acquire();
+            memcpy(&apdu[0], &table->Update_Time_APDU[object_instance][0],
+                ANALOG_INPUT_UPDATE_TIME_APDU_LEN);
+            Analog_Input_Table_Release(table);
+            apdu_len = ANALOG_INPUT_UPDATE_TIME_APDU_LEN;
             break;
         case 9997:
-            apdu_len = encode_application_real(&apdu[0], (float) 90.510);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Test_Real_APDU);
             break;
         case 9998:
-            apdu_len = encode_application_unsigned(&apdu[0], 90);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Test_Unsigned_APDU);
             break;
             /* test case for signed encoding-decoding negative value correctly */
         case 9999:
-            apdu_len = encode_application_signed(&apdu[0], -200);
+            apdu_len = Analog_Input_Copy_APDU(&apdu[0], &Test_Signed_APDU);
             break;
         default:
             *error_class = ERROR_CLASS_PROPERTY;
@@ -348,9 +533,72 @@ int Analog_Input_Encode_Property_APDU(
     return apdu_len;
 }
 
+/* encodes text, cut to fit a name if it is longer */
+static void Analog_Input_Encode_Text(
+    ANALOG_INPUT_APDU * encoded,
+    const char *text)
+{
+    char buffer[ANALOG_INPUT_NAME_SIZE];
+    BACNET_CHARACTER_STRING char_string;
+
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    characterstring_init_ansi(&char_string, buffer);
+    encoded->len =
+        encode_application_character_string(&encoded->apdu[0],
+        &char_string);
+}
+
+/* names every instance after its point, encodes everything that never
+   changes, and publishes a first generation so that every point has
+   its values encoded */
 void Analog_Input_Init(
     void)
 {
+    BACNET_BIT_STRING bit_string;
+    const ANALOG_INPUT_POINT *point;
+    ANALOG_INPUT_TABLE *next;
+    uint32_t i;
+
+    Object_Type_APDU.len =
+        encode_application_enumerated(&Object_Type_APDU.apdu[0],
+        OBJECT_ANALOG_INPUT);
+    bitstring_init(&bit_string);
+    bitstring_set_bit(&bit_string, STATUS_FLAG_IN_ALARM, false);
+    bitstring_set_bit(&bit_string, STATUS_FLAG_FAULT, false);
+    bitstring_set_bit(&bit_string, STATUS_FLAG_OVERRIDDEN, false);
+    bitstring_set_bit(&bit_string, STATUS_FLAG_OUT_OF_SERVICE, false);
+    Status_Flags_APDU.len =
+        encode_application_bitstring(&Status_Flags_APDU.apdu[0],
+        &bit_string);
+    Event_State_APDU.len =
+        encode_application_enumerated(&Event_State_APDU.apdu[0],
+        EVENT_STATE_NORMAL);
+    Out_Of_Service_APDU.len =
+        encode_application_boolean(&Out_Of_Service_APDU.apdu[0], false);
+    Test_Real_APDU.len =
+        encode_application_real(&Test_Real_APDU.apdu[0], (float) 90.510);
+    Test_Unsigned_APDU.len =
+        encode_application_unsigned(&Test_Unsigned_APDU.apdu[0], 90);
+    Test_Signed_APDU.len =
+        encode_application_signed(&Test_Signed_APDU.apdu[0], -200);
+    for (i = 0; i < ANALOG_INPUTS_PER_LOCATION; i++) {
+        Analog_Input_Encode_Text(&Description_APDU[i],
+            Points[i].description);
+        Units_APDU[i].len =
+            encode_application_enumerated(&Units_APDU[i].apdu[0],
+            Points[i].units);
+        COV_Increment_APDU[i].len =
+            encode_application_real(&COV_Increment_APDU[i].apdu[0],
+            Points[i].cov_increment);
+    }
+    for (i = 0; i < MAX_ANALOG_INPUTS; i++) {
+        point = Analog_Input_Point(i);
+        snprintf(Names[i], sizeof(Names[i]), "%s %u", point->name,
+            (unsigned) i);
+        Analog_Input_Encode_Text(&Name_APDU[i], Names[i]);
+    }
+    next = Analog_Input_Update_Begin();
+    Analog_Input_Update_Commit(next);
 }
 
 #ifdef TEST
@@ -368,13 +616,17 @@ void testAnalogInput(
     BACNET_OBJECT_TYPE decoded_type = OBJECT_ANALOG_OUTPUT;
     uint32_t decoded_instance = 0;
     uint32_t instance = 123;
+    ANALOG_INPUT_TABLE *table;
     BACNET_ERROR_CLASS error_class;
     BACNET_ERROR_CODE error_code;
+    BACNET_CHARACTER_STRING char_string;
+    float real_value = 0;
+    uint32_t i, j;
 
-
+    Analog_Input_Init();
     /* FIXME: we should do a lot more testing here... */
     len =
-        Analog_Input_Encode_Property_APDU(&apdu[0], instance,
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len >= 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
@@ -384,6 +636,118 @@ void testAnalogInput(
     ct_test(pTest, decoded_type == OBJECT_ANALOG_INPUT);
     ct_test(pTest, decoded_instance == instance);
 
+    /* never updated: date and time are both wildcards */
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_AI_UPDATE_TIME, BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len == 10);
+    ct_test(pTest, apdu[1] == 0xFF);
+    Analog_Input_Update_Time_Set(instance, 86400 * 545);
+    ct_test(pTest, Analog_Input_Update_Time(instance) == 86400 * 545);
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_AI_UPDATE_TIME, BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len == 10);
+    len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
+    ct_test(pTest, tag_number == BACNET_APPLICATION_TAG_DATE);
+    ct_test(pTest, apdu[1] == 71);      /* 1971 */
+
+    /* a new generation is invisible until it is committed */
+    Analog_Input_Present_Value_Set(instance, 1.0f);
+    table = Analog_Input_Update_Begin();
+    ct_test(pTest, table->Present_Value[instance] == 1.0f);
+    table->Present_Value[instance] = 2.0f;
+    table->Instances = instance + 1;
+    ct_test(pTest, Analog_Input_Present_Value(instance) == 1.0f);
+    ct_test(pTest, Analog_Input_Count() != instance + 1);
+    Analog_Input_Update_Commit(table);
+    ct_test(pTest, Analog_Input_Present_Value(instance) == 2.0f);
+    ct_test(pTest, Analog_Input_Count() == instance + 1);
+    ct_test(pTest, Analog_Input_Valid_Instance(instance));
+    ct_test(pTest, !Analog_Input_Valid_Instance(instance + 1));
+    /* the next writer starts from what was committed */
+    table = Analog_Input_Update_Begin();
+    ct_test(pTest, table->Present_Value[instance] == 2.0f);
+    Analog_Input_Update_Commit(table);
+
+    /* values come out as they were encoded at the last commit */
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_PRESENT_VALUE, BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len == 5);
+    len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
+    ct_test(pTest, tag_number == BACNET_APPLICATION_TAG_REAL);
+    decode_real(&apdu[len], &real_value);
+    ct_test(pTest, real_value == 2.0f);
+    Analog_Input_Present_Value_Set(instance, -3.5f);
+    Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_PRESENT_VALUE, BACNET_ARRAY_ALL, &error_class, &error_code);
+    decode_real(&apdu[1], &real_value);
+    ct_test(pTest, real_value == -3.5f);
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_OBJECT_NAME, BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len > 0);
+    len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
+    ct_test(pTest, tag_number == BACNET_APPLICATION_TAG_CHARACTER_STRING);
+    decode_character_string(&apdu[len], len_value, &char_string);
+    ct_test(pTest, characterstring_ansi_same(&char_string,
+            Analog_Input_Name(instance)));
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
+        PROP_UNITS, BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len == 2);
+    ct_test(pTest, apdu[1] == Analog_Input_Units(instance));
+
+    /* names and units come from the point table */
+    ct_test(pTest, strcmp(Analog_Input_Name(0), "TWCi CC Temp 0") == 0);
+    ct_test(pTest, Analog_Input_Units(0) == UNITS_DEGREES_FAHRENHEIT);
+    ct_test(pTest, Analog_Input_Units(ANALOG_INPUTS_PER_LOCATION + 2) ==
+        UNITS_PERCENT_RELATIVE_HUMIDITY);
+    ct_test(pTest, Analog_Input_Name(MAX_ANALOG_INPUTS) == NULL);
+    /* the table is in the order the refresh stores points */
+    ct_test(pTest, ANALOG_INPUT_POINTS == ANALOG_INPUTS_PER_LOCATION);
+    ct_test(pTest, strcmp(Analog_Input_Point(ANALOG_INPUT_UPDATED_YEAR)->name,
+            "TWCi Updated Year") == 0);
+    ct_test(pTest, strcmp(Analog_Input_Point(ANALOG_INPUT_FORECAST_POINT(4,
+                    ANALOG_INPUT_NIGHT_WIND))->name,
+            "TWCi Night 4 Wind Speed") == 0);
+    ct_test(pTest, strcmp(Analog_Input_Point(ANALOG_INPUT_SPARE)->name,
+            "TWCi Spare") == 0);
+    /* and COV increments come from it too */
+    len =
+        Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu),
+        ANALOG_INPUT_CC_BAROMETRIC, PROP_COV_INCREMENT, BACNET_ARRAY_ALL,
+        &error_class, &error_code);
+    ct_test(pTest, len == 5);
+    len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
+    ct_test(pTest, tag_number == BACNET_APPLICATION_TAG_REAL);
+    decode_real(&apdu[len], &real_value);
+    ct_test(pTest, real_value == 0.01f);
+    for (i = 0; i < ANALOG_INPUTS_PER_LOCATION; i++) {
+        ct_test(pTest, Analog_Input_Point(i)->name != NULL);
+        /* every description fits whole */
+        len =
+            Analog_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), i,
+            PROP_DESCRIPTION, BACNET_ARRAY_ALL, &error_class, &error_code);
+        len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
+        decode_character_string(&apdu[len], len_value, &char_string);
+        ct_test(pTest, characterstring_ansi_same(&char_string,
+                Analog_Input_Description(i)));
+        /* and no two points of a location share a name */
+        for (j = 0; j < i; j++) {
+            ct_test(pTest, strcmp(Analog_Input_Name(i),
+                    Analog_Input_Name(j)) != 0);
+        }
+    }
+    /* the longest name, with the largest instance, fits whole */
+    instance = MAX_ANALOG_INPUTS - ANALOG_INPUTS_PER_LOCATION + 26;
+    ct_test(pTest, strncmp(Analog_Input_Name(instance),
+            Analog_Input_Point(instance)->name,
+            strlen(Analog_Input_Point(instance)->name)) == 0);
+    ct_test(pTest, strlen(Analog_Input_Name(instance)) ==
+        strlen(Analog_Input_Point(instance)->name) + 5);
+
     return;
 }
 
@@ -12,6 +12,7 @@ SRCS = ai.c \
 	$(SRC_DIR)/bacint.c \
 	$(SRC_DIR)/bacstr.c \
 	$(SRC_DIR)/bacreal.c \
+	$(SRC_DIR)/datetime.c \
 	$(TEST_DIR)/ctest.c
 
 TARGET = analog_input
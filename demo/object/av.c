@@ -225,6 +225,7 @@ char *Analog_Value_Name(
 /* return apdu len, or -1 on error */
 int Analog_Value_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -303,7 +304,7 @@ int Analog_Value_Encode_Property_APDU(
                             real_value);
                     }
                     /* add it if we have room */
-                    if ((apdu_len + len) < MAX_APDU)
+                    if ((apdu_len + len) < max_apdu)
                         apdu_len += len;
                     else {
                         *error_class = ERROR_CLASS_SERVICES;
@@ -455,7 +456,7 @@ void testAnalog_Value(
 
 
     len =
-        Analog_Value_Encode_Property_APDU(&apdu[0], instance,
+        Analog_Value_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len != 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
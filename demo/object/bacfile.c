@@ -183,6 +183,7 @@ static unsigned bacfile_file_size(
 /* return the number of bytes used, or -1 on error */
 int bacfile_encode_property_apdu(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -359,6 +360,7 @@ uint32_t bacfile_instance(
 /* invokeID and file instance in a list or table */
 /* when the request was sent */
 uint32_t bacfile_instance_from_tsm(
+    BACNET_ADDRESS * src,       /* the device that sent the ACK */
     uint8_t invokeID)
 {
     BACNET_NPDU_DATA npdu_data = { 0 }; /* dummy for getting npdu length */
@@ -366,7 +368,6 @@ uint32_t bacfile_instance_from_tsm(
     uint8_t service_choice = 0;
     uint8_t *service_request = NULL;
     uint16_t service_request_len = 0;
-    BACNET_ADDRESS dest;        /* where the original packet was destined */
     uint8_t apdu[MAX_PDU] = { 0 };      /* original APDU packet */
     uint16_t apdu_len = 0;      /* original APDU packet length */
     uint16_t len = 0;   /* apdu header length */
@@ -375,7 +376,7 @@ uint32_t bacfile_instance_from_tsm(
     bool found = false;
 
     found =
-        tsm_get_transaction_pdu(invokeID, &dest, &npdu_data, &apdu[0],
+        tsm_get_transaction_pdu(invokeID, src, &npdu_data, &apdu[0],
         &apdu_len);
     if (found) {
         if (!npdu_data.network_layer_message && npdu_data.data_expecting_reply
@@ -400,37 +401,47 @@ uint32_t bacfile_instance_from_tsm(
 }
 #endif
 
-bool bacfile_read_data(
-    BACNET_ATOMIC_READ_FILE_DATA * data)
+bool bacfile_read_stream_data(
+    uint32_t object_instance,
+    int32_t start_position,
+    uint8_t * buffer,
+    size_t requested,
+    size_t * length,
+    bool * end_of_file)
 {
     char *pFilename = NULL;
     bool found = false;
     FILE *pFile = NULL;
     size_t len = 0;
 
-    pFilename = bacfile_name(data->object_instance);
+    pFilename = bacfile_name(object_instance);
     if (pFilename) {
         found = true;
         pFile = fopen(pFilename, "rb");
         if (pFile) {
-            (void) fseek(pFile, data->type.stream.fileStartPosition, SEEK_SET);
-            len =
-                fread(octetstring_value(&data->fileData), 1,
-                data->type.stream.requestedOctetCount, pFile);
-            if (len < data->type.stream.requestedOctetCount)
-                data->endOfFile = true;
-            else
-                data->endOfFile = false;
-            octetstring_truncate(&data->fileData, len);
+            (void) fseek(pFile, start_position, SEEK_SET);
+            len = fread(buffer, 1, requested, pFile);
             fclose(pFile);
-        } else {
-            octetstring_truncate(&data->fileData, 0);
-            data->endOfFile = true;
         }
-    } else {
-        octetstring_truncate(&data->fileData, 0);
-        data->endOfFile = true;
     }
+    *length = len;
+    *end_of_file = (len < requested);
+
+    return found;
+}
+
+bool bacfile_read_data(
+    BACNET_ATOMIC_READ_FILE_DATA * data)
+{
+    bool found = false;
+    size_t len = 0;
+
+    found =
+        bacfile_read_stream_data(data->object_instance,
+        data->type.stream.fileStartPosition,
+        octetstring_value(&data->fileData),
+        data->type.stream.requestedOctetCount, &len, &data->endOfFile);
+    octetstring_truncate(&data->fileData, len);
 
     return found;
 }
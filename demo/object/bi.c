@@ -290,6 +290,7 @@ char *Binary_Input_Name(
 /* assumption - object already exists, and has been bounds checked */
 int Binary_Input_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -441,7 +442,7 @@ void testBinaryInput(
 
     /* FIXME: we should do a lot more testing here... */
     len =
-        Binary_Input_Encode_Property_APDU(&apdu[0], instance,
+        Binary_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len >= 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
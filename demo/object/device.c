@@ -25,6 +25,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>     /* for memmove */
 #include "bacdef.h"
 #include "bacdcode.h"
@@ -37,6 +38,7 @@
 #include "device.h"     /* me */
 #include "handlers.h"
 #include "datalink.h"
+#include "segment.h"
 #include "address.h"
 #if defined(BACFILE)
 #include "bacfile.h"    /* object list dependency */
@@ -47,6 +49,23 @@ static object_index_to_instance_function
     Object_Index_To_Instance[MAX_BACNET_OBJECT_TYPE];
 static object_name_function Object_Name[MAX_BACNET_OBJECT_TYPE];
 
+/* The object list as one dense array, and an index into it by object
+   name, built from the functions above.  They are rebuilt when the
+   database revision moves on, or the device itself is renamed or
+   renumbered, so looking up an object does not walk every type. */
+typedef struct object_list_entry {
+    uint32_t instance;
+    uint16_t object_type;
+} OBJECT_LIST_ENTRY;
+static OBJECT_LIST_ENTRY *Object_List = NULL;
+static unsigned Object_List_Size = 0;   /* entries allocated */
+static unsigned Object_List_Entries = 0;        /* entries in use */
+/* open addressing: a slot is an Object_List position plus one, or 0 */
+static unsigned *Object_Name_Hash = NULL;
+static unsigned Object_Name_Hash_Size = 0;      /* a power of two */
+static bool Object_List_Valid = false;
+static uint8_t Object_List_Revision = 0;
+
 void Device_Object_Function_Set(
     BACNET_OBJECT_TYPE object_type,
     object_count_function count_function,
@@ -57,6 +76,7 @@ void Device_Object_Function_Set(
         Object_Count[object_type] = count_function;
         Object_Index_To_Instance[object_type] = index_function;
         Object_Name[object_type] = name_function;
+        Object_List_Valid = false;
     }
 }
 
@@ -80,6 +100,11 @@ static const int Device_Properties_Required[] = {
     PROP_SEGMENTATION_SUPPORTED,
     PROP_APDU_TIMEOUT,
     PROP_NUMBER_OF_APDU_RETRIES,
+#if (MAX_SEGMENTS_ACCEPTED > 1)
+    /* required of a device that supports segmentation */
+    PROP_MAX_SEGMENTS_ACCEPTED,
+    PROP_APDU_SEGMENT_TIMEOUT,
+#endif
 #if defined(BACDL_MSTP)
     PROP_MAX_MASTER,
     PROP_MAX_INFO_FRAMES,
@@ -102,6 +127,8 @@ static const int Device_Properties_Optional[] = {
 };
 
 static const int Device_Properties_Proprietary[] = {
+    PROP_DEVICE_REFRESH_DURATION,
+    PROP_DEVICE_REFRESH_SUCCESS,
     -1
 };
 
@@ -143,6 +170,9 @@ BACNET_DATE Local_Date; /* rely on OS, if there is one */
 static int32_t UTC_Offset = 5 * 60;
 static bool Daylight_Savings_Status = false;    /* rely on OS */
 static uint8_t Database_Revision = 0;
+/* nothing has been refreshed until the first refresh is applied */
+static bool Last_Refresh_Success = false;
+static uint32_t Last_Refresh_Duration = 0;      /* milliseconds */
 
 /* methods to manipulate the data */
 uint32_t Device_Object_Instance_Number(
@@ -156,9 +186,10 @@ bool Device_Set_Object_Instance_Number(
 {
     bool status = true; /* return value */
 
-    if (object_id <= BACNET_MAX_INSTANCE)
+    if (object_id <= BACNET_MAX_INSTANCE) {
         Object_Instance_Number = object_id;
-    else
+        Object_List_Valid = false;
+    } else
         status = false;
 
     return status;
@@ -190,6 +221,7 @@ bool Device_Set_Object_Name(
     if (length < sizeof(My_Object_Name)) {
         memmove(My_Object_Name, name, length);
         My_Object_Name[length] = 0;
+        Object_List_Valid = false;
         status = true;
     }
 
@@ -332,7 +364,11 @@ uint8_t Device_Protocol_Revision(
 BACNET_SEGMENTATION Device_Segmentation_Supported(
     void)
 {
+#if (MAX_SEGMENTS_ACCEPTED > 1)
+    return SEGMENTATION_BOTH;
+#else
     return SEGMENTATION_NONE;
+#endif
 }
 
 uint8_t Device_Database_Revision(
@@ -347,16 +383,36 @@ void Device_Set_Database_Revision(
     Database_Revision = revision;
 }
 
-/* Since many network clients depend on the object list */
-/* for discovery, it must be consistent! */
-unsigned Device_Object_List_Count(
+void Device_Set_Last_Refresh(
+    bool success,
+    uint32_t duration_ms)
+{
+    Last_Refresh_Success = success;
+    Last_Refresh_Duration = duration_ms;
+}
+
+static unsigned Device_Object_Name_Hash(
+    const char *name)
+{
+    unsigned hash = 2166136261u;        /* FNV-1a */
+
+    while (*name) {
+        hash ^= (uint8_t) * name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/* how many objects the object functions have between them */
+static unsigned Device_Object_Total(
     void)
 {
     unsigned count = 1; /* 1 for the device object */
     unsigned i = 0;     /* loop counter */
 
     for (i = 0; i < MAX_BACNET_OBJECT_TYPE; i++) {
-        if (Object_Count[i]) {
+        if (Object_Count[i] && Object_Index_To_Instance[i]) {
             count += Object_Count[i] ();
         }
     }
@@ -364,47 +420,112 @@ unsigned Device_Object_List_Count(
     return count;
 }
 
-bool Device_Object_List_Identifier(
-    unsigned array_index,
-    int *object_type,
-    uint32_t * instance)
+static void Device_Object_List_Build(
+    void)
 {
-    bool status = false;
-    unsigned object_index = 0;
+    OBJECT_LIST_ENTRY *list;
+    unsigned *hash;
+    unsigned hash_size = 16;
+    unsigned entries = 0;
     unsigned count = 0;
+    unsigned slot = 0;
+    unsigned index = 0;
     unsigned i = 0;     /* loop counter */
+    char *name = NULL;
 
-    if (array_index == 0) {
-        return status;
+    count = Device_Object_Total();
+    if (count > Object_List_Size) {
+        list = realloc(Object_List, count * sizeof(OBJECT_LIST_ENTRY));
+        if (!list) {
+            return;
+        }
+        Object_List = list;
+        Object_List_Size = count;
     }
-    /* device object */
-    if (array_index == 1) {
-        *object_type = OBJECT_DEVICE;
-        *instance = Object_Instance_Number;
-        status = true;
+    /* no more than half full */
+    while (hash_size < (2 * Object_List_Size)) {
+        hash_size *= 2;
     }
-
-    if (!status) {
-        /* array index starts at 1, and if we are this far,
-           we are not the device object, so array_index must
-           be at least 2. */
-        object_index = array_index - 2;
-        /* look through the objects to find the right index */
-        for (i = 0; i < MAX_BACNET_OBJECT_TYPE; i++) {
-            if (Object_Count[i] && Object_Index_To_Instance[i]) {
-                object_index -= count;
-                count = Object_Count[i] ();
-                if (object_index < count) {
-                    *object_type = i;
-                    *instance = Object_Index_To_Instance[i] (object_index);
-                    status = true;
+    if (hash_size > Object_Name_Hash_Size) {
+        hash = realloc(Object_Name_Hash, hash_size * sizeof(unsigned));
+        if (!hash) {
+            return;
+        }
+        Object_Name_Hash = hash;
+        Object_Name_Hash_Size = hash_size;
+    }
+    /* the device object first, then each type in turn */
+    Object_List[entries].object_type = OBJECT_DEVICE;
+    Object_List[entries].instance = Object_Instance_Number;
+    entries++;
+    for (i = 0; i < MAX_BACNET_OBJECT_TYPE; i++) {
+        if (Object_Count[i] && Object_Index_To_Instance[i]) {
+            count = Object_Count[i] ();
+            for (index = 0; index < count; index++) {
+                if (entries >= Object_List_Size) {
                     break;
                 }
+                Object_List[entries].object_type = (uint16_t) i;
+                Object_List[entries].instance =
+                    Object_Index_To_Instance[i] (index);
+                entries++;
+            }
+        }
+    }
+    memset(Object_Name_Hash, 0, Object_Name_Hash_Size * sizeof(unsigned));
+    for (i = 0; i < entries; i++) {
+        name =
+            Device_Valid_Object_Id(Object_List[i].object_type,
+            Object_List[i].instance);
+        if (name) {
+            slot = Device_Object_Name_Hash(name) & (Object_Name_Hash_Size - 1);
+            while (Object_Name_Hash[slot]) {
+                slot = (slot + 1) & (Object_Name_Hash_Size - 1);
             }
+            Object_Name_Hash[slot] = i + 1;
         }
     }
+    Object_List_Entries = entries;
+    Object_List_Revision = Database_Revision;
+    Object_List_Valid = true;
+}
 
-    return status;
+static void Device_Object_List_Refresh(
+    void)
+{
+    if (!Object_List_Valid || (Object_List_Revision != Database_Revision)) {
+        Device_Object_List_Build();
+    }
+}
+
+/* Since many network clients depend on the object list */
+/* for discovery, it must be consistent! */
+unsigned Device_Object_List_Count(
+    void)
+{
+    /* objects can come and go without the revision changing */
+    if (Device_Object_Total() != Object_List_Entries) {
+        Object_List_Valid = false;
+    }
+    Device_Object_List_Refresh();
+
+    return Object_List_Entries;
+}
+
+bool Device_Object_List_Identifier(
+    unsigned array_index,
+    int *object_type,
+    uint32_t * instance)
+{
+    Device_Object_List_Refresh();
+    /* array index starts at 1, with the device object */
+    if ((array_index == 0) || (array_index > Object_List_Entries)) {
+        return false;
+    }
+    *object_type = Object_List[array_index - 1].object_type;
+    *instance = Object_List[array_index - 1].instance;
+
+    return true;
 }
 
 bool Device_Valid_Object_Name(
@@ -412,32 +533,31 @@ bool Device_Valid_Object_Name(
     int *object_type,
     uint32_t * object_instance)
 {
-    bool found = false;
-    int type = 0;
-    uint32_t instance;
-    unsigned max_objects = 0, i = 0;
-    bool check_id = false;
+    OBJECT_LIST_ENTRY *entry = NULL;
+    unsigned slot = 0;
     char *name = NULL;
 
-    max_objects = Device_Object_List_Count();
-    for (i = 0; i < max_objects; i++) {
-        check_id = Device_Object_List_Identifier(i, &type, &instance);
-        if (check_id) {
-            name = Device_Valid_Object_Id(type, instance);
-            if (strcmp(name, object_name) == 0) {
-                found = true;
-                if (object_type) {
-                    *object_type = type;
-                }
-                if (object_instance) {
-                    *object_instance = instance;
-                }
-                break;
+    Device_Object_List_Refresh();
+    if (!Object_List_Entries) {
+        return false;
+    }
+    slot = Device_Object_Name_Hash(object_name) & (Object_Name_Hash_Size - 1);
+    while (Object_Name_Hash[slot]) {
+        entry = &Object_List[Object_Name_Hash[slot] - 1];
+        name = Device_Valid_Object_Id(entry->object_type, entry->instance);
+        if (name && (strcmp(name, object_name) == 0)) {
+            if (object_type) {
+                *object_type = entry->object_type;
+            }
+            if (object_instance) {
+                *object_instance = entry->instance;
             }
+            return true;
         }
+        slot = (slot + 1) & (Object_Name_Hash_Size - 1);
     }
 
-    return found;
+    return false;
 }
 
 /* returns the name or NULL if not found */
@@ -467,6 +587,7 @@ char *Device_Valid_Object_Id(
    -2 for abort message */
 int Device_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -483,7 +604,8 @@ int Device_Encode_Property_APDU(
     unsigned count = 0;
 
     object_instance = object_instance;
-    switch (property) {
+    /* proprietary properties are outside the enumeration */
+    switch ((int) property) {
         case PROP_OBJECT_IDENTIFIER:
             apdu_len =
                 encode_application_object_id(&apdu[0], OBJECT_DEVICE,
@@ -605,9 +727,9 @@ int Device_Encode_Property_APDU(
             if (array_index == 0)
                 apdu_len = encode_application_unsigned(&apdu[0], count);
             /* if no index was specified, then try to encode the entire list */
-            /* into one packet.  Note that more than likely you will have */
-            /* to return an error if the number of encoded objects exceeds */
-            /* your maximum APDU size. */
+            /* into one reply, which is sent in segments when it needs to be. */
+            /* An error is returned if the number of encoded objects exceeds */
+            /* the room left in the reply. */
             else if (array_index == BACNET_ARRAY_ALL) {
                 for (i = 1; i <= count; i++) {
                     if (Device_Object_List_Identifier(i, &object_type,
@@ -618,7 +740,7 @@ int Device_Encode_Property_APDU(
                         apdu_len += len;
                         /* assume next one is the same size as this one */
                         /* can we all fit into the APDU? */
-                        if ((apdu_len + len) >= MAX_APDU) {
+                        if ((apdu_len + len) >= max_apdu) {
                             /* reject message */
                             apdu_len = -2;
                             break;
@@ -658,9 +780,18 @@ int Device_Encode_Property_APDU(
         case PROP_NUMBER_OF_APDU_RETRIES:
             apdu_len = encode_application_unsigned(&apdu[0], apdu_retries());
             break;
+#if (MAX_SEGMENTS_ACCEPTED > 1)
+        case PROP_MAX_SEGMENTS_ACCEPTED:
+            apdu_len =
+                encode_application_unsigned(&apdu[0], MAX_SEGMENTS_ACCEPTED);
+            break;
+        case PROP_APDU_SEGMENT_TIMEOUT:
+            apdu_len =
+                encode_application_unsigned(&apdu[0], segment_timeout());
+            break;
+#endif
         case PROP_DEVICE_ADDRESS_BINDING:
-            /* FIXME: the real max apdu remaining should be passed into function */
-            apdu_len = address_list_encode(&apdu[0], MAX_APDU);
+            apdu_len = address_list_encode(&apdu[0], max_apdu);
             break;
         case PROP_DATABASE_REVISION:
             apdu_len =
@@ -678,8 +809,15 @@ int Device_Encode_Property_APDU(
             break;
 #endif
         case PROP_ACTIVE_COV_SUBSCRIPTIONS:
-            /* FIXME: the real max apdu should be passed into function */
-            apdu_len = handler_cov_encode_subscriptions(&apdu[0], MAX_APDU);
+            apdu_len = handler_cov_encode_subscriptions(&apdu[0], max_apdu);
+            break;
+        case PROP_DEVICE_REFRESH_DURATION:
+            apdu_len =
+                encode_application_unsigned(&apdu[0], Last_Refresh_Duration);
+            break;
+        case PROP_DEVICE_REFRESH_SUCCESS:
+            apdu_len =
+                encode_application_boolean(&apdu[0], Last_Refresh_Success);
             break;
         default:
             *error_class = ERROR_CLASS_PROPERTY;
@@ -845,11 +983,39 @@ void Device_Init(
 #include <string.h>
 #include "ctest.h"
 
+static char *Test_Names[] = { "Alpha", "Bravo", "Charlie" };
+
+static unsigned Test_Count(
+    void)
+{
+    return 3;
+}
+
+static uint32_t Test_Index_To_Instance(
+    unsigned index)
+{
+    return index + 10;
+}
+
+static char *Test_Name(
+    uint32_t instance)
+{
+    return (instance >= 10 && instance < 13) ? Test_Names[instance - 10] :
+        NULL;
+}
+
 void testDevice(
     Test * pTest)
 {
     bool status = false;
     const char *name = "Patricia";
+    int object_type = 0;
+    uint32_t instance = 0;
+    uint8_t apdu[MAX_APDU] = { 0 };
+    int len = 0;
+    BACNET_APPLICATION_DATA_VALUE value;
+    BACNET_ERROR_CLASS error_class;
+    BACNET_ERROR_CODE error_code;
 
     status = Device_Set_Object_Instance_Number(0);
     ct_test(pTest, Device_Object_Instance_Number() == 0);
@@ -875,6 +1041,70 @@ void testDevice(
     Device_Set_Model_Name(name, strlen(name));
     ct_test(pTest, strcmp(Device_Model_Name(), name) == 0);
 
+    /* the object list and its name index */
+    Device_Object_Function_Set(OBJECT_ANALOG_VALUE, Test_Count,
+        Test_Index_To_Instance, Test_Name);
+    ct_test(pTest, Device_Object_List_Count() == 4);
+    ct_test(pTest, !Device_Object_List_Identifier(0, &object_type,
+            &instance));
+    ct_test(pTest, Device_Object_List_Identifier(1, &object_type,
+            &instance));
+    ct_test(pTest, object_type == OBJECT_DEVICE);
+    ct_test(pTest, instance == Device_Object_Instance_Number());
+    ct_test(pTest, Device_Object_List_Identifier(4, &object_type,
+            &instance));
+    ct_test(pTest, object_type == OBJECT_ANALOG_VALUE);
+    ct_test(pTest, instance == 12);
+    ct_test(pTest, !Device_Object_List_Identifier(5, &object_type,
+            &instance));
+    /* the last object is found by name too */
+    ct_test(pTest, Device_Valid_Object_Name("Charlie", &object_type,
+            &instance));
+    ct_test(pTest, instance == 12);
+    ct_test(pTest, Device_Valid_Object_Name("Alpha", NULL, &instance));
+    ct_test(pTest, instance == 10);
+    ct_test(pTest, !Device_Valid_Object_Name("Delta", NULL, NULL));
+    /* a renamed device is found by its new name */
+    Device_Set_Object_Name("Weather", strlen("Weather"));
+    ct_test(pTest, Device_Valid_Object_Name("Weather", &object_type,
+            &instance));
+    ct_test(pTest, object_type == OBJECT_DEVICE);
+    /* a change under a new revision shows up */
+    Test_Names[1] = "Bravissimo";
+    Device_Set_Database_Revision(Device_Database_Revision() + 1);
+    ct_test(pTest, Device_Valid_Object_Name("Bravissimo", NULL, &instance));
+    ct_test(pTest, instance == 11);
+    ct_test(pTest, !Device_Valid_Object_Name("Bravo", NULL, NULL));
+    /* segmentation, as segment.c does it */
+    len = Device_Encode_Property_APDU(&apdu[0], sizeof(apdu),
+        Device_Object_Instance_Number(), PROP_MAX_SEGMENTS_ACCEPTED,
+        BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len > 0);
+    len = bacapp_decode_application_data(&apdu[0], len, &value);
+    ct_test(pTest, value.type.Unsigned_Int == MAX_SEGMENTS_ACCEPTED);
+    len = Device_Encode_Property_APDU(&apdu[0], sizeof(apdu),
+        Device_Object_Instance_Number(), PROP_APDU_SEGMENT_TIMEOUT,
+        BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len > 0);
+    len = bacapp_decode_application_data(&apdu[0], len, &value);
+    ct_test(pTest, value.type.Unsigned_Int == segment_timeout());
+    /* the status of the last refresh */
+    Device_Set_Last_Refresh(true, 1234);
+    len = Device_Encode_Property_APDU(&apdu[0], sizeof(apdu),
+        Device_Object_Instance_Number(), PROP_DEVICE_REFRESH_DURATION,
+        BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len > 0);
+    len = bacapp_decode_application_data(&apdu[0], len, &value);
+    ct_test(pTest, value.tag == BACNET_APPLICATION_TAG_UNSIGNED_INT);
+    ct_test(pTest, value.type.Unsigned_Int == 1234);
+    len = Device_Encode_Property_APDU(&apdu[0], sizeof(apdu),
+        Device_Object_Instance_Number(), PROP_DEVICE_REFRESH_SUCCESS,
+        BACNET_ARRAY_ALL, &error_class, &error_code);
+    ct_test(pTest, len > 0);
+    len = bacapp_decode_application_data(&apdu[0], len, &value);
+    ct_test(pTest, value.tag == BACNET_APPLICATION_TAG_BOOLEAN);
+    ct_test(pTest, value.type.Boolean == true);
+
     return;
 }
 
@@ -690,6 +690,7 @@ void Load_Control_State_Machine_Handler(
 /* return apdu len, or -1 on error */
 int Load_Control_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -853,7 +854,7 @@ int Load_Control_Encode_Property_APDU(
                         encode_application_unsigned(&apdu[apdu_len],
                         Shed_Levels[object_index][i]);
                     /* add it if we have room */
-                    if ((apdu_len + len) < MAX_APDU)
+                    if ((apdu_len + len) < max_apdu)
                         apdu_len += len;
                     else {
                         *error_class = ERROR_CLASS_SERVICES;
@@ -891,7 +892,7 @@ int Load_Control_Encode_Property_APDU(
                         encode_application_character_string(&apdu[apdu_len],
                         &char_string);
                     /* add it if we have room */
-                    if ((apdu_len + len) < MAX_APDU)
+                    if ((apdu_len + len) < max_apdu)
                         apdu_len += len;
                     else {
                         *error_class = ERROR_CLASS_SERVICES;
@@ -1468,7 +1469,7 @@ void testLoadControl(
     BACNET_ERROR_CODE error_code;
 
     len =
-        Load_Control_Encode_Property_APDU(&apdu[0], instance,
+        Load_Control_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len != 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
@@ -189,6 +189,7 @@ char *Life_Safety_Point_Name(
 /* return apdu len, or -1 on error */
 int Life_Safety_Point_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -374,7 +375,7 @@ void testLifeSafetyPoint(
 
 
     len =
-        Life_Safety_Point_Encode_Property_APDU(&apdu[0], instance,
+        Life_Safety_Point_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len != 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
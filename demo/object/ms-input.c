@@ -315,6 +315,7 @@ bool Multistate_Input_State_Text_Set(
 /* return apdu len, or -1 on error */
 int Multistate_Input_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -397,12 +398,12 @@ int Multistate_Input_Encode_Property_APDU(
                 for (i = 0; i < MULTISTATE_NUMBER_OF_STATES; i++) {
                     characterstring_init_ansi(&char_string,
                         Multistate_Input_State_Text(object_instance, i));
-                    /* FIXME: this might go beyond MAX_APDU length! */
+                    /* FIXME: this might go beyond max_apdu length! */
                     len =
                         encode_application_character_string(&apdu[apdu_len],
                         &char_string);
                     /* add it if we have room */
-                    if ((apdu_len + len) < MAX_APDU) {
+                    if ((apdu_len + len) < max_apdu) {
                         apdu_len += len;
                     } else {
                         *error_class = ERROR_CLASS_SERVICES;
@@ -523,7 +524,7 @@ void testMultistateInput(
     BACNET_ERROR_CODE error_code;
 
     len =
-        Multistate_Input_Encode_Property_APDU(&apdu[0], instance,
+        Multistate_Input_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len != 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
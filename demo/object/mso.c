@@ -192,6 +192,7 @@ char *Multistate_Output_Name(
 /* return apdu len, or -1 on error */
 int Multistate_Output_Encode_Property_APDU(
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -275,7 +276,7 @@ int Multistate_Output_Encode_Property_APDU(
                             present_value);
                     }
                     /* add it if we have room */
-                    if ((apdu_len + len) < MAX_APDU)
+                    if ((apdu_len + len) < max_apdu)
                         apdu_len += len;
                     else {
                         *error_class = ERROR_CLASS_SERVICES;
@@ -454,7 +455,7 @@ void testMultistateOutput(
 
 
     len =
-        Multistate_Output_Encode_Property_APDU(&apdu[0], instance,
+        Multistate_Output_Encode_Property_APDU(&apdu[0], sizeof(apdu), instance,
         PROP_OBJECT_IDENTIFIER, BACNET_ARRAY_ALL, &error_class, &error_code);
     ct_test(pTest, len != 0);
     len = decode_tag_number_and_value(&apdu[0], &tag_number, &len_value);
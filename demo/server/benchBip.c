@@ -0,0 +1,200 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Measures how fast the BACnet/IP datalink moves datagrams over loopback,
+ * one per call (bip_receive_view, bip_send_mpdu) against batched
+ * (bip_receive_batch with recvmmsg, bip_send_batch_begin with sendmmsg).
+ * A generator thread blasts Who-Is requests at the receiving socket the
+ * way a site full of devices would after a broadcast.
+ * Build the library first, then use benchBip.make.
+ *
+ * usage: benchBip [packets]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "bip.h"
+#include "bvlc.h"
+#include "benchCommon.h"
+
+#define BENCH_PORT 47900
+#define SINK_PORT 47901
+/* datagrams per generator sendmmsg, so the receiver is the bottleneck */
+#define GENERATOR_BURST 64
+/* Original-Broadcast-NPDU carrying a Who-Is */
+static const uint8_t Who_Is[] = { 0x81, 0x0b, 0x00, 0x08,
+   0x01, 0x20, 0x10, 0x08 };
+
+typedef struct {
+   double seconds;
+   unsigned received;
+   unsigned calls;       /* receive calls that returned a datagram */
+} result;
+
+static unsigned Packets = 200000;
+static volatile int Generator_Done = 0;
+
+/* the packet generator: sends Packets datagrams as fast as it can */
+static void *generator(void *arg)
+{
+   struct mmsghdr msgs[GENERATOR_BURST];
+   struct iovec iov;
+   struct sockaddr_in dest;
+   int fd = benchSocket(0);
+   unsigned sent = 0;
+   unsigned burst;
+   int rv;
+
+   (void) arg;
+   memset(&dest, 0, sizeof(dest));
+   dest.sin_family = AF_INET;
+   dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   dest.sin_port = htons(BENCH_PORT);
+   iov.iov_base = (void *) Who_Is;
+   iov.iov_len = sizeof(Who_Is);
+   memset(msgs, 0, sizeof(msgs));
+   for (burst = 0; burst < GENERATOR_BURST; burst++) {
+      msgs[burst].msg_hdr.msg_name = &dest;
+      msgs[burst].msg_hdr.msg_namelen = sizeof(dest);
+      msgs[burst].msg_hdr.msg_iov = &iov;
+      msgs[burst].msg_hdr.msg_iovlen = 1;
+   }
+   while (sent < Packets) {
+      burst = Packets - sent;
+      if (burst > GENERATOR_BURST)
+         burst = GENERATOR_BURST;
+      rv = sendmmsg(fd, msgs, burst, 0);
+      if (rv <= 0)
+         break;
+      sent += rv;
+   }
+   close(fd);
+   Generator_Done = 1;
+   return NULL;
+}
+
+static result benchReceive(int batched)
+{
+   static BIP_MPDU mpdus[BIP_BATCH_SIZE];
+   uint8_t mpdu[MAX_MPDU];
+   BACNET_ADDRESS src;
+   uint8_t *npdu;
+   pthread_t thread;
+   struct timespec start;
+   result r = { 0, 0, 0 };
+   int count;
+   int i;
+
+   Generator_Done = 0;
+   pthread_create(&thread, NULL, generator, NULL);
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (;;) {
+      if (batched) {
+         count = bip_receive_batch(mpdus, BIP_BATCH_SIZE, 100);
+         for (i = 0; i < count; i++) {
+            if (bip_handle_mpdu(&src, &mpdus[i], &npdu))
+               r.received++;
+         }
+      } else {
+         count = bip_receive_view(&src, mpdu, sizeof(mpdu), &npdu, 100) ?
+            1 : 0;
+         r.received += count;
+      }
+      if (count)
+         r.calls++;
+      /* stop once the generator is done and the socket is empty */
+      else if (Generator_Done)
+         break;
+   }
+   r.seconds = benchSeconds(&start);
+   pthread_join(thread, NULL);
+   return r;
+}
+
+static double benchSend(int batched)
+{
+   struct sockaddr_in dest;
+   struct timespec start;
+   uint8_t mtu[sizeof(Who_Is)];
+   int sink = benchSocket(SINK_PORT);
+   unsigned i;
+
+   memcpy(mtu, Who_Is, sizeof(Who_Is));
+   memset(&dest, 0, sizeof(dest));
+   dest.sin_family = AF_INET;
+   dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   dest.sin_port = htons(SINK_PORT);
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < Packets; i++) {
+      if (batched && (i % BIP_BATCH_SIZE) == 0)
+         bip_send_batch_begin();
+      bip_send_mpdu(&dest, mtu, sizeof(mtu));
+      if (batched && (i % BIP_BATCH_SIZE) == BIP_BATCH_SIZE - 1)
+         bip_send_batch_end();
+   }
+   if (batched && (Packets % BIP_BATCH_SIZE))
+      bip_send_batch_end();
+   close(sink);
+   return benchSeconds(&start);
+}
+
+int main(int argc, char *argv[])
+{
+   result r;
+   double elapsed;
+   int batched;
+   int fd;
+
+   if (argc > 1)
+      Packets = strtoul(argv[1], NULL, 0);
+   fd = benchSocket(BENCH_PORT);
+   if (fd < 0) {
+      perror("bind");
+      return 1;
+   }
+   bip_set_socket(fd);
+   /* nothing should be discarded as coming from ourselves */
+   bip_set_addr(htonl(INADDR_LOOPBACK));
+   bip_set_port(BENCH_PORT + 2);
+   printf("%u Who-Is datagrams over loopback, batch of %u\n", Packets,
+      BIP_BATCH_SIZE);
+   for (batched = 0; batched < 2; batched++) {
+      r = benchReceive(batched);
+      printf("receive %-8s %8u received (%5.1f%%) %10.0f/s %6.2f per call\n",
+         batched ? "recvmmsg" : "recvfrom", r.received,
+         100.0 * r.received / Packets, r.received / r.seconds,
+         r.calls ? (double) r.received / r.calls : 0.0);
+   }
+   for (batched = 0; batched < 2; batched++) {
+      elapsed = benchSend(batched);
+      printf("send    %-8s %8u sent %21.0f/s\n",
+         batched ? "sendmmsg" : "sendto", Packets, Packets / elapsed);
+   }
+   bip_cleanup();
+   return 0;
+}
@@ -0,0 +1,213 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "config.h"
+#include "bits.h"
+#include "bacdef.h"
+#include "apdu.h"
+#include "npdu.h"
+#include "bip.h"
+#include "tsm.h"
+#include "segment.h"
+#include "handlers.h"
+#include "benchCommon.h"
+
+static volatile int Server_Done = 0;
+static struct sockaddr_in Server;
+static pthread_t Server_Thread;
+
+double benchSeconds(const struct timespec *start)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - start->tv_sec) +
+      (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int benchSocket(uint16_t port)
+{
+   struct sockaddr_in sin;
+   int size = 4 * 1024 * 1024;
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+   if (fd < 0)
+      return -1;
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+   memset(&sin, 0, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   sin.sin_port = htons(port);
+   if (port && bind(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+/* the device: answers whatever handlers are set off its own socket */
+static void *server(void *arg)
+{
+   static uint8_t mpdu[MAX_MPDU];
+   BACNET_ADDRESS src;
+   struct timespec last;
+   struct timespec now;
+   uint8_t *npdu;
+   uint16_t len;
+
+   (void) arg;
+   clock_gettime(CLOCK_MONOTONIC, &last);
+   while (!Server_Done) {
+      len = bip_receive_view(&src, mpdu, sizeof(mpdu), &npdu, 10);
+      if (len)
+         npdu_handler(&src, npdu, len);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (now.tv_sec != last.tv_sec || now.tv_nsec / 1000000 !=
+         last.tv_nsec / 1000000) {
+         tsm_timer_milliseconds((uint16_t) ((now.tv_sec - last.tv_sec) *
+               1000 + now.tv_nsec / 1000000 - last.tv_nsec / 1000000));
+         last = now;
+      }
+   }
+   return NULL;
+}
+
+int benchServerStart(uint16_t port)
+{
+   int serverFd = benchSocket(port);
+   int fd = benchSocket(0);
+
+   if (serverFd < 0 || fd < 0) {
+      if (serverFd >= 0)
+         close(serverFd);
+      if (fd >= 0)
+         close(fd);
+      return -1;
+   }
+   bip_set_socket(serverFd);
+   bip_set_addr(htonl(INADDR_LOOPBACK));
+   bip_set_port(port);
+   memset(&Server, 0, sizeof(Server));
+   Server.sin_family = AF_INET;
+   Server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   Server.sin_port = htons(port);
+   Server_Done = 0;
+   pthread_create(&Server_Thread, NULL, server, NULL);
+   return fd;
+}
+
+void benchServerStop(int fd)
+{
+   Server_Done = 1;
+   pthread_join(Server_Thread, NULL);
+   close(fd);
+   bip_cleanup();
+}
+
+void benchSendApdu(int fd, uint8_t *apdu, unsigned apduLen, bool reply)
+{
+   uint8_t mtu[MAX_MPDU];
+   BACNET_NPDU_DATA npduData;
+   BACNET_ADDRESS dest;
+   unsigned len;
+
+   memset(&dest, 0, sizeof(dest));
+   npdu_encode_npdu_data(&npduData, reply, MESSAGE_PRIORITY_NORMAL);
+   len = 4 + npdu_encode_pdu(&mtu[4], &dest, NULL, &npduData);
+   memcpy(&mtu[len], apdu, apduLen);
+   len += apduLen;
+   mtu[0] = BVLL_TYPE_BACNET_IP;
+   mtu[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+   mtu[2] = (uint8_t) (len >> 8);
+   mtu[3] = (uint8_t) len;
+   sendto(fd, mtu, len, 0, (struct sockaddr *) &Server, sizeof(Server));
+}
+
+uint8_t *benchReceiveApdu(int fd, uint8_t *mtu, unsigned *apduLen)
+{
+   BACNET_NPDU_DATA npduData;
+   BACNET_ADDRESS dest;
+   BACNET_ADDRESS src;
+   ssize_t len;
+   int npduLen;
+
+   len = recv(fd, mtu, MAX_MPDU, 0);
+   if (len <= 4)
+      return NULL;
+   npduLen = npdu_decode(&mtu[4], &dest, &src, &npduData);
+   if (npduLen <= 0 || (unsigned) len <= 4 + npduLen)
+      return NULL;
+   *apduLen = len - 4 - npduLen;
+   return &mtu[4 + npduLen];
+}
+
+unsigned benchTransact(int fd, uint8_t *request, unsigned requestLen,
+   uint8_t invokeID, unsigned window, uint8_t *message, benchResult *r)
+{
+   static uint8_t mtu[MAX_MPDU];
+   uint8_t ack[4];
+   uint8_t *apdu;
+   unsigned apduLen;
+   unsigned messageLen = 0;
+   unsigned sequence = 0;
+   unsigned received = 0;
+
+   benchSendApdu(fd, request, requestLen, true);
+   r->requests++;
+   for (;;) {
+      apdu = benchReceiveApdu(fd, mtu, &apduLen);
+      if (!apdu || (apdu[0] & 0xF0) != PDU_TYPE_COMPLEX_ACK) {
+         fprintf(stderr, "no ACK for request %u\n", r->requests);
+         exit(1);
+      }
+      if (!(apdu[0] & BIT3)) {
+         memcpy(message, &apdu[3], apduLen - 3);
+         messageLen = apduLen - 3;
+         break;
+      }
+      if (apdu[2] != (uint8_t) sequence) {
+         fprintf(stderr, "segment %u lost\n", sequence);
+         exit(1);
+      }
+      memcpy(&message[messageLen], &apdu[5], apduLen - 5);
+      messageLen += apduLen - 5;
+      r->segments++;
+      received++;
+      if (sequence == 0 || received == window || !(apdu[0] & BIT2)) {
+         benchSendApdu(fd, ack, segment_ack_encode_apdu(ack, false, false,
+               invokeID, (uint8_t) sequence, (uint8_t) window), false);
+         received = 0;
+      }
+      sequence++;
+      if (!(apdu[0] & BIT2))
+         break;
+   }
+   return messageLen;
+}
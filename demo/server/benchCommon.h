@@ -0,0 +1,99 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#ifndef BENCHCOMMON_H
+#define BENCHCOMMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ *Loopback harness shared by the benchmarks. The device side runs in a
+ *thread on its own BACnet/IP socket; the client side sends and receives
+ *bare APDUs on another one.
+ */
+
+typedef struct {
+   double seconds;
+   unsigned requests;
+   unsigned segments;
+   unsigned long octets;
+} benchResult;
+
+/*
+ *RETURN: seconds since start on the monotonic clock
+*/
+double benchSeconds(
+   const struct timespec *start);
+/*
+ *Opens a UDP socket on loopback with a large receive buffer, bound to
+ *port unless it is 0.
+ *RETURN: the socket, or -1
+*/
+int benchSocket(
+   uint16_t port);
+/*
+ *Binds the device to port and starts the thread that serves it; the
+ *handlers it needs must be set up by the caller.
+ *RETURN: a client socket to talk to it through, or -1
+*/
+int benchServerStart(
+   uint16_t port);
+/*
+ *Stops the device thread and closes both sockets.
+*/
+void benchServerStop(
+   int fd);
+/*
+ *Sends apdu to the device in an original unicast.
+*/
+void benchSendApdu(
+   int fd,
+   uint8_t *apdu,
+   unsigned apduLen,
+   bool reply);
+/*
+ *RETURN: the APDU of the next datagram in mtu, or NULL if none came
+*/
+uint8_t *benchReceiveApdu(
+   int fd,
+   uint8_t *mtu,
+   unsigned *apduLen);
+/*
+ *Sends one confirmed request and collects its ComplexACK into message,
+ *acking the first segment, every window of segments and the last.
+ *Exits if no ACK comes or a segment is lost.
+ *RETURN: the service data length
+*/
+unsigned benchTransact(
+   int fd,
+   uint8_t *request,
+   unsigned requestLen,
+   uint8_t invokeID,
+   unsigned window,
+   uint8_t *message,
+   benchResult *r);
+
+#endif
@@ -0,0 +1,360 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Measures tag decoding, the old way and through a decode cursor, on
+ * the payloads the server sees most:
+ *   rp   - a ReadProperty request
+ *   rpm  - a ReadPropertyMultiple request, property ALL of many objects
+ *   cov  - an UnconfirmedCOVNotification carrying a value and flags
+ * Each payload is walked tag by tag, once with the original decoders
+ * and once through the cursor; the two must agree.  The ReadProperty
+ * request is also run through rp_decode_service_request, against its
+ * previous version kept here.
+ * Build the library first, then use benchDecode.make.
+ *
+ * usage: benchDecode [passes]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "bits.h"
+#include "bacdef.h"
+#include "bacdcode.h"
+#include "rp.h"
+#include "benchCommon.h"
+
+#define RPM_OBJECTS 45
+
+typedef struct {
+   const char *name;
+   uint8_t apdu[MAX_APDU];
+   unsigned len;
+} payload;
+
+static unsigned Passes = 1000000;
+static payload Payloads[3];
+
+/* the service request parts, as they arrive after the APDU header */
+static void buildPayloads(void)
+{
+   payload *p;
+   uint8_t *apdu;
+   BACNET_BIT_STRING flags;
+   unsigned i;
+   int len;
+
+   p = &Payloads[0];
+   p->name = "rp";
+   apdu = p->apdu;
+   len = encode_context_object_id(&apdu[0], 0, OBJECT_ANALOG_INPUT, 12);
+   len += encode_context_enumerated(&apdu[len], 1, PROP_PRESENT_VALUE);
+   p->len = len;
+
+   p = &Payloads[1];
+   p->name = "rpm";
+   apdu = p->apdu;
+   len = 0;
+   for (i = 0; i < RPM_OBJECTS; i++) {
+      len += encode_context_object_id(&apdu[len], 0, OBJECT_ANALOG_INPUT, i);
+      len += encode_opening_tag(&apdu[len], 1);
+      len += encode_context_enumerated(&apdu[len], 0, PROP_ALL);
+      len += encode_closing_tag(&apdu[len], 1);
+   }
+   p->len = len;
+
+   p = &Payloads[2];
+   p->name = "cov";
+   apdu = p->apdu;
+   bitstring_init(&flags);
+   bitstring_set_bit(&flags, STATUS_FLAG_IN_ALARM, false);
+   bitstring_set_bit(&flags, STATUS_FLAG_FAULT, false);
+   bitstring_set_bit(&flags, STATUS_FLAG_OVERRIDDEN, false);
+   bitstring_set_bit(&flags, STATUS_FLAG_OUT_OF_SERVICE, false);
+   len = encode_context_unsigned(&apdu[0], 0, 7);
+   len += encode_context_object_id(&apdu[len], 1, OBJECT_DEVICE, 260001);
+   len += encode_context_object_id(&apdu[len], 2, OBJECT_ANALOG_INPUT, 3);
+   len += encode_context_unsigned(&apdu[len], 3, 300);
+   len += encode_opening_tag(&apdu[len], 4);
+   len += encode_context_enumerated(&apdu[len], 0, PROP_PRESENT_VALUE);
+   len += encode_opening_tag(&apdu[len], 2);
+   len += encode_application_real(&apdu[len], 21.5f);
+   len += encode_closing_tag(&apdu[len], 2);
+   len += encode_context_enumerated(&apdu[len], 0, PROP_STATUS_FLAGS);
+   len += encode_opening_tag(&apdu[len], 2);
+   len += encode_application_bitstring(&apdu[len], &flags);
+   len += encode_closing_tag(&apdu[len], 2);
+   len += encode_closing_tag(&apdu[len], 4);
+   p->len = len;
+}
+
+/* every tag and primitive value, with decode_tag_number_and_value and
+   the decoder for each type; the length is only checked between tags */
+static uint32_t walkOld(uint8_t *apdu, unsigned apdu_len)
+{
+   unsigned len = 0;
+   unsigned start;
+   uint8_t tag;
+   uint32_t lvt;
+   uint32_t sum = 0;
+   uint32_t unsignedValue;
+   int32_t signedValue;
+   float realValue;
+   uint16_t type;
+   uint32_t instance;
+
+   while (len < apdu_len) {
+      start = len;
+      len += decode_tag_number_and_value(&apdu[len], &tag, &lvt);
+      if (IS_CONTEXT_SPECIFIC(apdu[start])) {
+         if (decode_is_opening_tag(&apdu[start]) ||
+            decode_is_closing_tag(&apdu[start])) {
+            sum += tag;
+         } else if (lvt <= 4) {
+            len += decode_unsigned(&apdu[len], lvt, &unsignedValue);
+            sum += unsignedValue;
+         } else {
+            len += lvt;
+         }
+         continue;
+      }
+      switch (tag) {
+      case BACNET_APPLICATION_TAG_BOOLEAN:
+         sum += lvt;
+         break;
+      case BACNET_APPLICATION_TAG_UNSIGNED_INT:
+      case BACNET_APPLICATION_TAG_ENUMERATED:
+         len += decode_unsigned(&apdu[len], lvt, &unsignedValue);
+         sum += unsignedValue;
+         break;
+      case BACNET_APPLICATION_TAG_SIGNED_INT:
+         len += decode_signed(&apdu[len], lvt, &signedValue);
+         sum += (uint32_t) signedValue;
+         break;
+      case BACNET_APPLICATION_TAG_REAL:
+         len += decode_real(&apdu[len], &realValue);
+         sum += (uint32_t) realValue;
+         break;
+      case BACNET_APPLICATION_TAG_OBJECT_ID:
+         len += decode_object_id(&apdu[len], &type, &instance);
+         sum += type + instance;
+         break;
+      default:
+         len += lvt;
+         break;
+      }
+   }
+   return sum;
+}
+
+/* the same walk through a cursor, which refuses to read past the end */
+static uint32_t walkCursor(const uint8_t *apdu, unsigned apdu_len)
+{
+   BACNET_DECODE_CURSOR cursor;
+   BACNET_TAG tag;
+   uint32_t sum = 0;
+   uint32_t unsignedValue = 0;
+   int32_t signedValue = 0;
+   float realValue = 0;
+   int type = 0;
+   uint32_t instance = 0;
+
+   decode_cursor_init(&cursor, apdu, apdu_len);
+   while (decode_cursor_remaining(&cursor) && !cursor.error) {
+      if (!decode_cursor_tag(&cursor, &tag))
+         break;
+      if (tag.kind & (BACNET_TAG_OPENING | BACNET_TAG_CLOSING)) {
+         sum += tag.number;
+         continue;
+      }
+      if (tag.kind & BACNET_TAG_CONTEXT) {
+         if (tag.len_value_type <= 4) {
+            if (decode_cursor_unsigned(&cursor, tag.len_value_type,
+                  &unsignedValue))
+               sum += unsignedValue;
+         } else {
+            decode_cursor_skip(&cursor, tag.len_value_type);
+         }
+         continue;
+      }
+      switch (tag.number) {
+      case BACNET_APPLICATION_TAG_BOOLEAN:
+         sum += tag.len_value_type;
+         break;
+      case BACNET_APPLICATION_TAG_UNSIGNED_INT:
+      case BACNET_APPLICATION_TAG_ENUMERATED:
+         if (decode_cursor_unsigned(&cursor, tag.len_value_type,
+               &unsignedValue))
+            sum += unsignedValue;
+         break;
+      case BACNET_APPLICATION_TAG_SIGNED_INT:
+         if (decode_cursor_signed(&cursor, tag.len_value_type, &signedValue))
+            sum += (uint32_t) signedValue;
+         break;
+      case BACNET_APPLICATION_TAG_REAL:
+         if (decode_cursor_real(&cursor, tag.len_value_type, &realValue))
+            sum += (uint32_t) realValue;
+         break;
+      case BACNET_APPLICATION_TAG_OBJECT_ID:
+         if (decode_cursor_object_id(&cursor, tag.len_value_type, &type,
+               &instance))
+            sum += type + instance;
+         break;
+      default:
+         decode_cursor_skip(&cursor, tag.len_value_type);
+         break;
+      }
+   }
+   return cursor.error ? 0 : sum;
+}
+
+/* rp_decode_service_request as it was before the cursor */
+static int rpDecodeOld(uint8_t *apdu, unsigned apdu_len,
+   BACNET_READ_PROPERTY_DATA *rpdata)
+{
+   unsigned len = 0;
+   uint8_t tag_number = 0;
+   uint32_t len_value_type = 0;
+   uint16_t type = 0;
+   uint32_t property = 0;
+   uint32_t array_value = 0;
+
+   if (apdu_len && rpdata) {
+      if (!decode_is_context_tag(&apdu[len++], 0))
+         return -1;
+      len += decode_object_id(&apdu[len], &type, &rpdata->object_instance);
+      rpdata->object_type = (BACNET_OBJECT_TYPE) type;
+      len += decode_tag_number_and_value(&apdu[len], &tag_number,
+         &len_value_type);
+      if (tag_number != 1)
+         return -1;
+      len += decode_enumerated(&apdu[len], len_value_type, &property);
+      rpdata->object_property = (BACNET_PROPERTY_ID) property;
+      if (len < apdu_len) {
+         len += decode_tag_number_and_value(&apdu[len], &tag_number,
+            &len_value_type);
+         if (tag_number == 2) {
+            len += decode_unsigned(&apdu[len], len_value_type, &array_value);
+            rpdata->array_index = array_value;
+         } else
+            rpdata->array_index = BACNET_ARRAY_ALL;
+      } else
+         rpdata->array_index = BACNET_ARRAY_ALL;
+   }
+   return (int) len;
+}
+
+static void report(const char *name, const char *how, unsigned tags,
+   double elapsed)
+{
+   printf("%-4s %-7s %8.1f ns/payload %6.2f ns/tag\n", name, how,
+      1e9 * elapsed / Passes, 1e9 * elapsed / Passes / tags);
+}
+
+/* tags in a payload, counted the old way */
+static unsigned countTags(uint8_t *apdu, unsigned apdu_len)
+{
+   unsigned len = 0;
+   unsigned tags = 0;
+   uint8_t tag;
+   uint32_t lvt;
+
+   while (len < apdu_len) {
+      if (decode_is_opening_tag(&apdu[len]) ||
+         decode_is_closing_tag(&apdu[len]))
+         len += decode_tag_number_and_value(&apdu[len], &tag, &lvt);
+      else {
+         len += decode_tag_number_and_value(&apdu[len], &tag, &lvt);
+         len += lvt;
+      }
+      tags++;
+   }
+   return tags;
+}
+
+int main(int argc, char *argv[])
+{
+   BACNET_READ_PROPERTY_DATA rpdata;
+   struct timespec start;
+   volatile uint32_t sink = 0;
+   uint32_t oldSum, cursorSum;
+   payload *p;
+   unsigned tags;
+   unsigned i, j;
+   int failed = 0;
+
+   if (argc > 1)
+      Passes = strtoul(argv[1], NULL, 0);
+   if (Passes < 1) {
+      fprintf(stderr, "usage: benchDecode [passes]\n");
+      return 1;
+   }
+   buildPayloads();
+   printf("decoding, %u passes\n", Passes);
+   for (i = 0; i < sizeof(Payloads) / sizeof(Payloads[0]); i++) {
+      p = &Payloads[i];
+      tags = countTags(p->apdu, p->len);
+      oldSum = walkOld(p->apdu, p->len);
+      cursorSum = walkCursor(p->apdu, p->len);
+      if (oldSum != cursorSum) {
+         fprintf(stderr, "%s: old %u cursor %u\n", p->name, oldSum,
+            cursorSum);
+         failed = 1;
+      }
+      /* a payload cut anywhere never passes for the whole one */
+      for (j = 1; j < p->len; j++) {
+         if (walkCursor(p->apdu, j) == cursorSum) {
+            fprintf(stderr, "%s: cut at %u not noticed\n", p->name, j);
+            failed = 1;
+         }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (j = 0; j < Passes; j++)
+         sink += walkOld(p->apdu, p->len);
+      report(p->name, "old", tags, benchSeconds(&start));
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (j = 0; j < Passes; j++)
+         sink += walkCursor(p->apdu, p->len);
+      report(p->name, "cursor", tags, benchSeconds(&start));
+   }
+   p = &Payloads[0];
+   if (rpDecodeOld(p->apdu, p->len, &rpdata) !=
+      rp_decode_service_request(p->apdu, p->len, &rpdata)) {
+      fprintf(stderr, "rp: decoded lengths differ\n");
+      failed = 1;
+   }
+   tags = countTags(p->apdu, p->len);
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (j = 0; j < Passes; j++)
+      sink += rpDecodeOld(p->apdu, p->len, &rpdata);
+   report("rp", "decode", tags, benchSeconds(&start));
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (j = 0; j < Passes; j++)
+      sink += rp_decode_service_request(p->apdu, p->len, &rpdata);
+   report("rp", "cursor", tags, benchSeconds(&start));
+   return failed;
+}
@@ -0,0 +1,205 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Measures ReadPropertyMultiple with property ALL across the Analog
+ * Inputs of a weather device:
+ *   encode  - every property of every object straight through
+ *             Encode_Property_APDU, with no network in the way
+ *   single  - one RPM per object over loopback
+ *   all     - one RPM for every object, its ComplexACK in segments
+ * The server runs in a thread on its own BACnet/IP socket, set up by
+ * benchCommon.c.
+ * Build the library first, then use benchRpm.make.
+ *
+ * usage: benchRpm [objects] [passes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacdcode.h"
+#include "apdu.h"
+#include "rpm.h"
+#include "segment.h"
+#include "ai.h"
+#include "handlers.h"
+#include "benchCommon.h"
+
+#define BENCH_PORT 47911
+
+static unsigned Objects = 45;
+static unsigned Passes = 2000;
+static uint8_t Message[MAX_APDU_SEGMENTED];
+
+/* an RPM for property ALL of objects first to first + count - 1 */
+static unsigned rpmRequest(uint8_t *apdu, uint8_t invokeID, unsigned first,
+   unsigned count)
+{
+   unsigned len;
+   unsigned i;
+
+   len = rpm_encode_apdu_init(apdu, invokeID);
+   apdu[0] |= BIT1;
+   apdu[1] = encode_max_segs_max_apdu(MAX_SEGMENTS_ACCEPTED, MAX_APDU);
+   for (i = first; i < first + count; i++) {
+      len += rpm_encode_apdu_object_begin(&apdu[len], OBJECT_ANALOG_INPUT,
+         i);
+      len += rpm_encode_apdu_object_property(&apdu[len], PROP_ALL,
+         BACNET_ARRAY_ALL);
+      len += rpm_encode_apdu_object_end(&apdu[len]);
+   }
+   return len;
+}
+
+static benchResult readSingle(int fd)
+{
+   struct timespec start;
+   benchResult r = { 0, 0, 0, 0 };
+   uint8_t request[MAX_APDU];
+   uint8_t invokeID = 0;
+   unsigned pass;
+   unsigned i;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (pass = 0; pass < Passes; pass++) {
+      for (i = 0; i < Objects; i++) {
+         invokeID++;
+         r.octets += benchTransact(fd, request,
+            rpmRequest(request, invokeID, i, 1), invokeID,
+            SEGMENT_WINDOW_SIZE, Message, &r);
+      }
+   }
+   r.seconds = benchSeconds(&start);
+   return r;
+}
+
+static benchResult readAll(int fd)
+{
+   struct timespec start;
+   benchResult r = { 0, 0, 0, 0 };
+   uint8_t request[MAX_APDU];
+   uint8_t invokeID = 0;
+   unsigned pass;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (pass = 0; pass < Passes; pass++) {
+      invokeID++;
+      r.octets += benchTransact(fd, request,
+         rpmRequest(request, invokeID, 0, Objects), invokeID,
+         SEGMENT_WINDOW_SIZE, Message, &r);
+   }
+   r.seconds = benchSeconds(&start);
+   return r;
+}
+
+/* every property of the RPM ALL lists, without the handler or network */
+static benchResult encodeAll(void)
+{
+   static uint8_t apdu[MAX_APDU];
+   const int *lists[3];
+   BACNET_ERROR_CLASS errorClass;
+   BACNET_ERROR_CODE errorCode;
+   struct timespec start;
+   benchResult r = { 0, 0, 0, 0 };
+   unsigned pass;
+   unsigned i;
+   unsigned l;
+   const int *p;
+   int len;
+
+   Analog_Input_Property_Lists(&lists[0], &lists[1], &lists[2]);
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (pass = 0; pass < Passes; pass++) {
+      for (i = 0; i < Objects; i++) {
+         for (l = 0; l < 3; l++) {
+            for (p = lists[l]; *p != -1; p++) {
+               len = Encode_Property_APDU(apdu, sizeof(apdu),
+                  OBJECT_ANALOG_INPUT, i, (BACNET_PROPERTY_ID) *p,
+                  BACNET_ARRAY_ALL, &errorClass, &errorCode);
+               if (len > 0)
+                  r.octets += len;
+            }
+         }
+         r.requests++;
+      }
+   }
+   r.seconds = benchSeconds(&start);
+   return r;
+}
+
+static void report(const char *name, benchResult *r)
+{
+   printf("%-8s %9.0f requests/s %8.2f us/request %6lu octets %3u segments\n",
+      name, r->requests / r->seconds, 1e6 * r->seconds / r->requests,
+      r->octets / r->requests, r->segments / r->requests);
+}
+
+int main(int argc, char *argv[])
+{
+   ANALOG_INPUT_TABLE *table;
+   benchResult r;
+   unsigned i;
+   int fd;
+
+   if (argc > 1)
+      Objects = strtoul(argv[1], NULL, 0);
+   if (argc > 2)
+      Passes = strtoul(argv[2], NULL, 0);
+   if (Objects < 1 || Objects > MAX_ANALOG_INPUTS || Passes < 1) {
+      fprintf(stderr, "usage: benchRpm [objects] [passes]\n");
+      return 1;
+   }
+   Analog_Input_Init();
+   /* a refresh's worth of values */
+   table = Analog_Input_Update_Begin();
+   table->Instances = Objects;
+   for (i = 0; i < Objects; i++) {
+      table->Present_Value[i] = 12.5f + i;
+      table->Update_Time[i] = time(NULL);
+   }
+   Analog_Input_Update_Commit(table);
+   handler_read_property_object_set(OBJECT_ANALOG_INPUT,
+      Analog_Input_Encode_Property_APDU, Analog_Input_Valid_Instance);
+   handler_read_property_multiple_list_set(OBJECT_ANALOG_INPUT,
+      Analog_Input_Property_Lists);
+   apdu_set_confirmed_handler(SERVICE_CONFIRMED_READ_PROP_MULTIPLE,
+      handler_read_property_multiple);
+   fd = benchServerStart(BENCH_PORT);
+   if (fd < 0) {
+      perror("bind");
+      return 1;
+   }
+   printf("RPM ALL of %u Analog Inputs, %u passes\n", Objects, Passes);
+   r = encodeAll();
+   report("encode", &r);
+   r = readSingle(fd);
+   report("single", &r);
+   r = readAll(fd);
+   report("all", &r);
+   benchServerStop(fd);
+   return 0;
+}
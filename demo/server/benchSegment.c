@@ -0,0 +1,182 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Measures how fast a file comes off the server with AtomicReadFile,
+ * asked for in one unsegmented chunk per request against a few large
+ * requests whose ComplexACKs come back in windows of segments.
+ * The server runs in a thread on its own BACnet/IP socket; the client
+ * reads temp_0.txt, which is written to the current directory first.
+ * Build the library first, then use benchSegment.make.
+ *
+ * usage: benchSegment [file size] [window] [passes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "bits.h"
+#include "bacdef.h"
+#include "bacdcode.h"
+#include "apdu.h"
+#include "arf.h"
+#include "segment.h"
+#include "wp.h"
+#include "bacfile.h"
+#include "handlers.h"
+#include "benchCommon.h"
+
+#define BENCH_PORT 47910
+#define BENCH_FILE "temp_0.txt"
+/* ComplexACK header, end of file, start position and file data tags */
+#define ARF_ACK_OVERHEAD 16
+
+static unsigned File_Size = 4 * 1024 * 1024;
+static unsigned Window = SEGMENT_WINDOW_SIZE;
+static unsigned Passes = 5;
+static uint8_t Message[MAX_APDU_SEGMENTED];
+
+/* octets of file data in an AtomicReadFile-ACK's service data */
+static unsigned fileOctets(uint8_t *service, unsigned len, bool *eof)
+{
+   uint8_t tag;
+   uint32_t value;
+   unsigned offset = 0;
+
+   offset += decode_tag_number_and_value(&service[offset], &tag, &value);
+   *eof = value ? true : false;
+   /* opening tag, then the start position */
+   offset++;
+   offset += decode_tag_number_and_value(&service[offset], &tag, &value);
+   offset += value;
+   decode_tag_number_and_value(&service[offset], &tag, &value);
+   return (offset < len) ? value : 0;
+}
+
+/* reads the whole file, chunk octets at a time */
+static benchResult readFile(int fd, unsigned chunk, bool segmented)
+{
+   BACNET_ATOMIC_READ_FILE_DATA data;
+   struct timespec start;
+   benchResult r = { 0, 0, 0, 0 };
+   uint8_t request[MAX_APDU];
+   uint8_t invokeID = 0;
+   unsigned apduLen;
+   unsigned messageLen;
+   bool eof = false;
+
+   memset(&data, 0, sizeof(data));
+   data.object_type = OBJECT_FILE;
+   data.object_instance = 0;
+   data.access = FILE_STREAM_ACCESS;
+   data.type.stream.requestedOctetCount = chunk;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   while (!eof) {
+      invokeID++;
+      data.type.stream.fileStartPosition = r.octets;
+      apduLen = arf_encode_apdu(request, invokeID, &data);
+      if (segmented) {
+         request[0] |= BIT1;
+         request[1] = encode_max_segs_max_apdu(MAX_SEGMENTS_ACCEPTED,
+            MAX_APDU);
+      }
+      messageLen = benchTransact(fd, request, apduLen, invokeID, Window,
+         Message, &r);
+      r.octets += fileOctets(Message, messageLen, &eof);
+   }
+   r.seconds = benchSeconds(&start);
+   return r;
+}
+
+static void report(const char *name, benchResult *r, unsigned passes)
+{
+   printf("%-10s %7u requests %8u segments %8.1f MB/s %8.2f ms/pass\n",
+      name, r->requests / passes, r->segments / passes,
+      r->octets / r->seconds / 1e6, 1000.0 * r->seconds / passes);
+}
+
+int main(int argc, char *argv[])
+{
+   benchResult total[2];
+   benchResult r;
+   FILE *pFile;
+   unsigned chunk[2];
+   unsigned pass;
+   unsigned i;
+   int fd;
+
+   if (argc > 1)
+      File_Size = strtoul(argv[1], NULL, 0);
+   if (argc > 2)
+      Window = strtoul(argv[2], NULL, 0);
+   if (argc > 3)
+      Passes = strtoul(argv[3], NULL, 0);
+   if (Window < 1 || Window > 127 || Passes < 1) {
+      fprintf(stderr, "usage: benchSegment [file size] [window] [passes]\n");
+      return 1;
+   }
+   pFile = fopen(BENCH_FILE, "wb");
+   if (!pFile) {
+      perror(BENCH_FILE);
+      return 1;
+   }
+   for (i = 0; i < File_Size; i++)
+      fputc(i & 0xFF, pFile);
+   fclose(pFile);
+   bacfile_init();
+   apdu_set_confirmed_handler(SERVICE_CONFIRMED_ATOMIC_READ_FILE,
+      handler_atomic_read_file);
+   segment_window_size_set((uint8_t) Window);
+   fd = benchServerStart(BENCH_PORT);
+   if (fd < 0) {
+      perror("bind");
+      return 1;
+   }
+   /* the most one message, and one segmented transaction, can carry */
+   chunk[0] = MAX_APDU - ARF_ACK_OVERHEAD;
+   chunk[1] = MAX_SEGMENTS_ACCEPTED * (MAX_APDU - 5) + 3 - ARF_ACK_OVERHEAD;
+   printf("%u octet file over loopback, window %u, %u passes\n", File_Size,
+      Window, Passes);
+   memset(total, 0, sizeof(total));
+   for (pass = 0; pass < Passes; pass++) {
+      for (i = 0; i < 2; i++) {
+         r = readFile(fd, chunk[i], i == 1);
+         if (r.octets != File_Size) {
+            fprintf(stderr, "read %lu of %u octets\n", r.octets, File_Size);
+            return 1;
+         }
+         total[i].seconds += r.seconds;
+         total[i].requests += r.requests;
+         total[i].segments += r.segments;
+         total[i].octets += r.octets;
+      }
+   }
+   report("repeated", &total[0], Passes);
+   report("segmented", &total[1], Passes);
+   benchServerStop(fd);
+   unlink(BENCH_FILE);
+   return 0;
+}
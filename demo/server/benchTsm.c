@@ -0,0 +1,179 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Measures confirmed request throughput through the transaction state
+ * machine with a full house of outstanding transactions spread over a
+ * number of peers: each request allocates an invoke ID, stores the APDU,
+ * looks up an earlier one as if its ACK came back, and frees it. The
+ * linear scan the TSM used before is reproduced on a bare invoke ID table
+ * for comparison; it could only ever hold 255.
+ * Build the library first, then use benchTsm.make, which builds the TSM
+ * with room for 4096 transactions.
+ *
+ * usage: benchTsm [requests] [outstanding] [peers]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "bacdef.h"
+#include "tsm.h"
+#include "benchCommon.h"
+
+static unsigned Requests = 1000000;
+static unsigned Outstanding = 250;
+static unsigned Peers = 1;
+/* the old table only ever had 255 spots */
+#define LINEAR_TRANSACTIONS 255
+
+/* the scan tsm_next_free_invokeID used to do, on invoke IDs alone */
+static uint8_t Linear_ID[LINEAR_TRANSACTIONS];
+
+static unsigned linearFind(uint8_t invokeID)
+{
+   unsigned i;
+
+   for (i = 0; i < LINEAR_TRANSACTIONS; i++) {
+      if (Linear_ID[i] == invokeID)
+         return i;
+   }
+   return LINEAR_TRANSACTIONS;
+}
+
+static uint8_t linearNext(void)
+{
+   static uint8_t current = 1;
+   unsigned index;
+
+   if (linearFind(0) == LINEAR_TRANSACTIONS)
+      return 0;
+   while (linearFind(current) != LINEAR_TRANSACTIONS) {
+      if (++current == 0)
+         current = 1;
+   }
+   index = linearFind(0);
+   Linear_ID[index] = current;
+   if (++current == 0)
+      current = 1;
+   return Linear_ID[index];
+}
+
+static double benchLinear(unsigned outstanding)
+{
+   uint8_t window[LINEAR_TRANSACTIONS];
+   struct timespec start;
+   unsigned i;
+
+   for (i = 0; i < outstanding; i++)
+      window[i] = linearNext();
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < Requests; i++) {
+      /* the oldest request is answered, a new one goes out */
+      Linear_ID[linearFind(window[i % outstanding])] = 0;
+      window[i % outstanding] = linearNext();
+   }
+   return benchSeconds(&start);
+}
+
+/* request n goes to peer n % Peers */
+static BACNET_ADDRESS *peerAddress(unsigned n)
+{
+   static BACNET_ADDRESS peer;
+
+   memset(&peer, 0, sizeof(peer));
+   peer.mac_len = 6;
+   peer.mac[0] = 10;
+   peer.mac[2] = (uint8_t) ((n % Peers) >> 8);
+   peer.mac[3] = (uint8_t) (n % Peers);
+   peer.mac[4] = 0xBA;
+   peer.mac[5] = 0xC0;
+   return &peer;
+}
+
+static double benchTsm(void)
+{
+   static uint8_t window[MAX_TSM_TRANSACTIONS];
+   uint8_t apdu[MAX_PDU] = { 0 };
+   uint16_t apdu_len = 0;
+   BACNET_ADDRESS *dest;
+   BACNET_NPDU_DATA npdu_data = { 0 };
+   struct timespec start;
+   unsigned slot;
+   unsigned i;
+
+   for (i = 0; i < Outstanding; i++) {
+      dest = peerAddress(i);
+      window[i] = tsm_next_free_invokeID(dest);
+      tsm_set_confirmed_unsegmented_transaction(window[i], dest,
+         &npdu_data, apdu, 20);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < Requests; i++) {
+      /* the oldest request is answered, a new one goes to the same peer */
+      slot = i % Outstanding;
+      dest = peerAddress(slot);
+      tsm_get_transaction_pdu(window[slot], dest, &npdu_data, apdu,
+         &apdu_len);
+      tsm_free_invoke_id(dest, window[slot]);
+      window[slot] = tsm_next_free_invokeID(dest);
+      if (window[slot] == 0) {
+         fprintf(stderr, "out of invoke IDs after %u requests\n", i);
+         break;
+      }
+      tsm_set_confirmed_unsegmented_transaction(window[slot], dest,
+         &npdu_data, apdu, 20);
+   }
+   return benchSeconds(&start);
+}
+
+int main(int argc, char *argv[])
+{
+   double elapsed;
+
+   if (argc > 1)
+      Requests = strtoul(argv[1], NULL, 0);
+   if (argc > 2)
+      Outstanding = strtoul(argv[2], NULL, 0);
+   if (argc > 3)
+      Peers = strtoul(argv[3], NULL, 0);
+   if (Outstanding == 0 || Outstanding > MAX_TSM_TRANSACTIONS)
+      Outstanding = MAX_TSM_TRANSACTIONS;
+   if (Peers == 0 || Peers > Outstanding)
+      Peers = Outstanding;
+   /* every peer gets an even share of the window */
+   tsm_peer_window_set((Outstanding + Peers - 1) / Peers > 255 ? 255 :
+      (Outstanding + Peers - 1) / Peers);
+   printf("%u requests, %u outstanding of %u over %u peers\n", Requests,
+      Outstanding, MAX_TSM_TRANSACTIONS, Peers);
+   if (Outstanding <= LINEAR_TRANSACTIONS) {
+      elapsed = benchLinear(Outstanding);
+      printf("linear scan %12.0f requests/s\n", Requests / elapsed);
+   }
+   elapsed = benchTsm();
+   printf("tsm         %12.0f requests/s (with APDU copy and lookup)\n",
+      Requests / elapsed);
+   return 0;
+}
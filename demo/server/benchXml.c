@@ -0,0 +1,292 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Compares the DOM parse (buffer the whole body, then xmlReadMemory) with
+ * the streaming parse (xmlParseChunk as each chunk arrives) on the XML
+ * fixtures. The body is handed over in chunks the way curl would.
+ * Every allocation made by libxoapweather and libxml2 is counted; build
+ * with benchXml.make so malloc and friends are wrapped.
+ *
+ * usage: benchXml [iterations] [chunk size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xoapweather.h"
+
+typedef struct {
+   const char *file;
+   xoap_weather_fetch_type fetch;
+} fixture;
+
+static const fixture Fixtures[] = {
+   { "fixtures/twci_dayf1.xml", XOAP_WEATHER_FETCH_DAYF1 },
+   { "fixtures/twci_dayf5.xml", XOAP_WEATHER_FETCH_DAYF5 }
+};
+
+typedef struct {
+   double seconds;
+   size_t allocated;     /* bytes requested over all iterations */
+   size_t peak;          /* most bytes live at once during one parse */
+} result;
+
+/* allocation accounting - every block carries its size in front */
+#define HEADER_SIZE 16
+static size_t Live_Bytes = 0;
+static size_t Peak_Bytes = 0;
+static size_t Total_Bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+   char *block = __real_malloc(size + HEADER_SIZE);
+   if (block == NULL)
+      return NULL;
+   *(size_t *)block = size;
+   Live_Bytes += size;
+   Total_Bytes += size;
+   if (Live_Bytes > Peak_Bytes)
+      Peak_Bytes = Live_Bytes;
+   return block + HEADER_SIZE;
+}
+
+void __wrap_free(void *ptr)
+{
+   char *block;
+   if (ptr == NULL)
+      return;
+   block = (char *)ptr - HEADER_SIZE;
+   Live_Bytes -= *(size_t *)block;
+   __real_free(block);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+   char *block;
+   size_t old_size;
+   if (ptr == NULL)
+      return __wrap_malloc(size);
+   block = (char *)ptr - HEADER_SIZE;
+   old_size = *(size_t *)block;
+   block = __real_realloc(block, size + HEADER_SIZE);
+   if (block == NULL)
+      return NULL;
+   *(size_t *)block = size;
+   Live_Bytes = Live_Bytes - old_size + size;
+   if (size > old_size)
+      Total_Bytes += size - old_size;
+   if (Live_Bytes > Peak_Bytes)
+      Peak_Bytes = Live_Bytes;
+   return block + HEADER_SIZE;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+   void *ptr = __wrap_malloc(nmemb * size);
+   if (ptr)
+      memset(ptr, 0, nmemb * size);
+   return ptr;
+}
+
+char *__wrap_strdup(const char *s)
+{
+   size_t len = strlen(s) + 1;
+   char *copy = __wrap_malloc(len);
+   if (copy)
+      memcpy(copy, s, len);
+   return copy;
+}
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *readFixture(const char *file, size_t *size)
+{
+   FILE *fp = fopen(file, "rb");
+   char *body;
+   long length;
+   if (fp == NULL)
+      return NULL;
+   fseek(fp, 0, SEEK_END);
+   length = ftell(fp);
+   rewind(fp);
+   body = __real_malloc(length);
+   *size = fread(body, 1, length, fp);
+   fclose(fp);
+   return body;
+}
+
+static xoap_weather_forecast *parseDom(const xoap_weather_handle *h,
+   char *body, size_t size, size_t chunk)
+{
+   struct xoap_weather_memory xml = { NULL, 0 };
+   xoap_weather_forecast *forecast;
+   size_t offset;
+   for (offset = 0; offset < size; offset += chunk)
+      xoap_weather_memory_callback(body + offset, 1,
+         (size - offset < chunk) ? size - offset : chunk, &xml);
+   forecast = xoap_weather_parse_memory(h, &xml);
+   XOAPW_FREE(xml.memory);
+   return forecast;
+}
+
+static xoap_weather_forecast *parseStream(const xoap_weather_handle *h,
+   char *body, size_t size, size_t chunk)
+{
+   xoap_weather_forecast *forecast = xoap_weather_forecast_new(h);
+   xoap_weather_stream *stream =
+      xoap_weather_stream_new(XOAP_WEATHER_STREAM_FORECAST, forecast);
+   size_t offset;
+   for (offset = 0; offset < size; offset += chunk)
+      xoap_weather_stream_callback(body + offset, 1,
+         (size - offset < chunk) ? size - offset : chunk, stream);
+   if (xoap_weather_stream_finish(stream) != 0) {
+      xoap_weather_free_forecast(forecast);
+      return NULL;
+   }
+   return forecast;
+}
+
+static int sameString(const char *a, const char *b)
+{
+   if (a == NULL || b == NULL)
+      return a == b;
+   return strcmp(a, b) == 0;
+}
+
+/* RETURN: 1 if both parses produced the same forecast */
+static int sameForecast(const xoap_weather_forecast *a,
+   const xoap_weather_forecast *b)
+{
+   int i;
+   if (a == NULL || b == NULL || a->total_days != b->total_days)
+      return 0;
+   if (!sameString(a->name, b->name) || !sameString(a->id, b->id) ||
+      !sameString(a->links[3].link, b->links[3].link) ||
+      a->cc->temp != b->cc->temp || a->cc->barp != b->cc->barp ||
+      a->cc->wind.direction_n != b->cc->wind.direction_n ||
+      !sameString(a->cc->wind.speed, b->cc->wind.speed) ||
+      !sameString(a->cc->moon_name, b->cc->moon_name))
+      return 0;
+   for (i = 0; i < a->total_days; i++) {
+      if (a->days[i].high != b->days[i].high ||
+         a->days[i].low != b->days[i].low ||
+         a->days[i].day.chance_precipitation !=
+         b->days[i].day.chance_precipitation ||
+         a->days[i].night.chance_precipitation !=
+         b->days[i].night.chance_precipitation ||
+         !sameString(a->days[i].week_day, b->days[i].week_day) ||
+         !sameString(a->days[i].night.wind.speed, b->days[i].night.wind.speed))
+         return 0;
+   }
+   return 1;
+}
+
+static result bench(xoap_weather_forecast *(*parse)(const xoap_weather_handle *,
+      char *, size_t, size_t), const xoap_weather_handle *h,
+   char *body, size_t size, size_t chunk, int iterations)
+{
+   result r = { 0, 0, 0 };
+   xoap_weather_forecast *forecast;
+   size_t live;
+   double start;
+   int i;
+
+   for (i = 0; i < iterations; i++) {
+      live = Live_Bytes;
+      Peak_Bytes = Live_Bytes;
+      Total_Bytes = 0;
+      start = now();
+      forecast = parse(h, body, size, chunk);
+      xoap_weather_free_forecast(forecast);
+      r.seconds += now() - start;
+      r.allocated += Total_Bytes;
+      if (Peak_Bytes - live > r.peak)
+         r.peak = Peak_Bytes - live;
+   }
+   return r;
+}
+
+int main(int argc, char *argv[])
+{
+   int iterations = (argc > 1) ? atoi(argv[1]) : 2000;
+   size_t chunk = (argc > 2) ? (size_t)atoi(argv[2]) : 1460;
+   unsigned i;
+   int status = 0;
+
+   if (iterations <= 0 || chunk == 0) {
+      fprintf(stderr, "usage: %s [iterations] [chunk size]\n", argv[0]);
+      return 1;
+   }
+   xmlMemSetup(__wrap_free, __wrap_malloc, __wrap_realloc, __wrap_strdup);
+   xmlInitParser();
+   printf("%d iterations, %u byte chunks\n", iterations, (unsigned)chunk);
+   printf("%-24s %-7s %10s %14s %12s\n", "fixture", "parser", "us/parse",
+      "bytes/parse", "peak bytes");
+   for (i = 0; i < sizeof(Fixtures) / sizeof(Fixtures[0]); i++) {
+      size_t size = 0;
+      char *body = readFixture(Fixtures[i].file, &size);
+      xoap_weather_handle *h;
+      xoap_weather_forecast *dom, *stream;
+      result r;
+
+      if (body == NULL) {
+         fprintf(stderr, "Couldn't read %s\n", Fixtures[i].file);
+         status = 1;
+         continue;
+      }
+      h = xoap_weather_handle_new();
+      xoap_weather_setopt(h, XOAP_WEATHER_OPT_FETCH, Fixtures[i].fetch);
+      /* both parsers have to agree before the timing means anything */
+      dom = parseDom(h, body, size, chunk);
+      stream = parseStream(h, body, size, chunk);
+      if (!sameForecast(dom, stream)) {
+         fprintf(stderr, "%s: DOM and stream results differ\n",
+            Fixtures[i].file);
+         status = 1;
+      }
+      xoap_weather_free_forecast(dom);
+      xoap_weather_free_forecast(stream);
+
+      r = bench(parseDom, h, body, size, chunk, iterations);
+      printf("%-24s %-7s %10.1f %14zu %12zu\n", Fixtures[i].file + 9, "dom",
+         r.seconds * 1e6 / iterations, r.allocated / iterations, r.peak);
+      r = bench(parseStream, h, body, size, chunk, iterations);
+      printf("%-24s %-7s %10.1f %14zu %12zu\n", Fixtures[i].file + 9,
+         "stream", r.seconds * 1e6 / iterations, r.allocated / iterations,
+         r.peak);
+      xoap_weather_handle_free(h);
+      __real_free(body);
+   }
+   return status;
+}
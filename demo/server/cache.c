@@ -0,0 +1,148 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+int cacheSave(const char *file, const weather_snapshot *snapshot)
+{
+   cache_header header;
+   cache_location *location;
+   size_t size;
+   char *temp;
+   unsigned i, point;
+   uint32_t index;
+   FILE *fp;
+   int rv = 0;
+
+   if (snapshot->locations == 0 || snapshot->locations > MAX_WEATHER_LOCATIONS)
+      return -1;
+   size = snapshot->locations * sizeof(cache_location);
+   location = calloc(1, size);
+   temp = malloc(strlen(file) + 5);
+   if (location == NULL || temp == NULL) {
+      free(location);
+      free(temp);
+      return -1;
+   }
+   memset(&header, 0, sizeof(header));
+   header.magic = CACHE_MAGIC;
+   header.version = CACHE_VERSION;
+   header.points = ANALOG_INPUTS_PER_LOCATION;
+   header.locations = snapshot->locations;
+   header.saved = time(NULL);
+   header.last_success = snapshot->last_success;
+   for (i = 0; i < snapshot->locations; i++) {
+      location[i].updated = snapshot->updated[i];
+      for (point = 0; point < ANALOG_INPUTS_PER_LOCATION; point++) {
+         index = i * ANALOG_INPUTS_PER_LOCATION + point;
+         if (snapshot->valid[index]) {
+            location[i].valid |= (uint64_t) 1 << point;
+            location[i].value[point] = snapshot->value[index];
+         }
+      }
+   }
+   sprintf(temp, "%s.new", file);
+   fp = fopen(temp, "wb");
+   if (fp == NULL) {
+      rv = -1;
+   } else {
+      if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+         fwrite(location, size, 1, fp) != 1)
+         rv = -1;
+      if (fclose(fp) != 0)
+         rv = -1;
+      if (rv == 0 && rename(temp, file) != 0)
+         rv = -1;
+      if (rv != 0)
+         unlink(temp);
+   }
+   if (rv != 0)
+      fprintf(stderr,"Couldn't write the weather cache %s: %s\n", file,
+         strerror(errno));
+   free(location);
+   free(temp);
+
+   return rv;
+}
+
+int cacheLoad(const char *file, weather_snapshot *snapshot)
+{
+   const cache_header *header;
+   const cache_location *location;
+   struct stat st;
+   void *map;
+   unsigned i, point;
+   uint32_t index;
+   int fd;
+   int rv = -1;
+
+   memset(snapshot, 0, sizeof(weather_snapshot));
+   fd = open(file, O_RDONLY);
+   if (fd < 0)
+      return -1;
+   if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(cache_header)) {
+      close(fd);
+      return -1;
+   }
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return -1;
+   header = map;
+   location = (const cache_location *) (header + 1);
+   if (header->magic == CACHE_MAGIC && header->version == CACHE_VERSION &&
+      header->points == ANALOG_INPUTS_PER_LOCATION &&
+      header->locations > 0 && header->locations <= MAX_WEATHER_LOCATIONS &&
+      st.st_size == (off_t) (sizeof(cache_header) +
+         header->locations * sizeof(cache_location))) {
+      for (i = 0; i < header->locations; i++) {
+         snapshot->updated[i] = location[i].updated;
+         for (point = 0; point < ANALOG_INPUTS_PER_LOCATION; point++) {
+            if (location[i].valid & ((uint64_t) 1 << point)) {
+               index = i * ANALOG_INPUTS_PER_LOCATION + point;
+               snapshot->value[index] = location[i].value[point];
+               snapshot->valid[index] = true;
+            }
+         }
+      }
+      snapshot->locations = header->locations;
+      snapshot->completed = header->saved;
+      snapshot->last_success = header->last_success;
+      snapshot->success = true;
+      rv = 0;
+   } else {
+      fprintf(stderr,"Ignoring the weather cache %s, it is not valid\n", file);
+   }
+   munmap(map, st.st_size);
+
+   return rv;
+}
@@ -0,0 +1,77 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "weather.h"
+
+/*
+ *The cache file is a header followed by one record per location:
+ *   cache_header
+ *   cache_location[locations]
+ *All fields are in host byte order; the file is only read back by the
+ *machine that wrote it.
+ */
+#define CACHE_MAGIC 0x43585742    /* "BWXC" */
+#define CACHE_VERSION 1
+
+typedef struct {
+   uint32_t magic;
+   uint16_t version;
+   uint16_t points;               /* ANALOG_INPUTS_PER_LOCATION when written */
+   uint32_t locations;
+   uint32_t reserved;
+   int64_t saved;                 /* wall clock time the file was written */
+   int64_t last_success;          /* last refresh where every location worked */
+} cache_header;
+
+#if ANALOG_INPUTS_PER_LOCATION > 64
+#error "cache_location.valid holds one bit per point"
+#endif
+
+typedef struct {
+   int64_t updated;               /* last good fetch of this location, or 0 */
+   uint64_t valid;                /* bit n set if value[n] has been filled */
+   float value[ANALOG_INPUTS_PER_LOCATION];
+} cache_location;
+
+/*
+ *Writes the points of snapshot to file. The file is replaced in one
+ *rename() so a reader never sees half of it.
+ *RETURN: 0 on success, -1 otherwise
+*/
+int cacheSave(
+   const char *file,
+   const weather_snapshot *snapshot);
+/*
+ *Maps file and fills snapshot from it. snapshot is cleared first, and is
+ *left empty if the file is missing, damaged or from another layout.
+ *RETURN: 0 on success, -1 otherwise
+*/
+int cacheLoad(
+   const char *file,
+   weather_snapshot *snapshot);
+
+#endif
@@ -32,8 +32,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <signal.h>
-#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
 #include "config.h"
 #include "address.h"
 #include "bacdef.h"
@@ -45,6 +48,7 @@
 #include "apdu.h"
 #include "iam.h"
 #include "tsm.h"
+#include "timerwheel.h"
 #include "device.h"
 #include "bacfile.h"
 #include "datalink.h"
@@ -61,10 +65,136 @@
 #include "mso.h"
 #include "bacfile.h"
 #include "weather.h"
+#include "reactor.h"
 
 
+/* how often the DCC and load control timers run and COV is polled */
+#define SECOND_TIMER_MS 1000
+/* learned bindings are kept here across restarts; BACNET_ADDRESS_FILE
+   overrides it */
+#define ADDRESS_BINDING_FILE "address_cache.bin"
+/* how often changed bindings are written out, in seconds */
+#define ADDRESS_SAVE_SECONDS 60
+
+static const char *Address_Binding_File = ADDRESS_BINDING_FILE;
+
 /* buffers used for receiving */
-static uint8_t Rx_Buf[MAX_MPDU] = { 0 };
+static BIP_MPDU Rx_Batch[BIP_BATCH_SIZE];
+
+/* the socket is readable: drain what is queued with one recvmmsg and
+   send the replies together with one sendmmsg */
+static void datalink_ready(
+    int fd,
+    void *context)
+{
+    BACNET_ADDRESS src = {
+        0
+    };  /* address where message came from */
+    uint8_t *npdu = NULL;
+    uint16_t pdu_len = 0;
+    int count = 0;
+    int i = 0;
+
+    (void) fd;
+    (void) context;
+    count = bip_receive_batch(&Rx_Batch[0], BIP_BATCH_SIZE, 0);
+    bip_send_batch_begin();
+    for (i = 0; i < count; i++) {
+        /* the NPDU is decoded where it landed, after the BVLC header */
+        pdu_len = datalink_handle_mpdu(&src, &Rx_Batch[i], &npdu);
+        if (pdu_len) {
+            npdu_handler(&src, npdu, pdu_len);
+        }
+    }
+    bip_send_batch_end();
+}
+
+/* TSM retries, COV lifetimes, address cache and FDT expiry all run
+   from the timer wheel; sleep only until its next expiry */
+static int wheel_clock(
+    uint32_t elapsed_milliseconds,
+    void *context)
+{
+    uint32_t next;
+
+    (void) context;
+    timer_wheel_milliseconds(elapsed_milliseconds);
+    next = timer_wheel_next();
+    if (next == TIMER_WHEEL_IDLE)
+        return -1;
+
+    return (next > INT_MAX) ? INT_MAX : (int) next;
+}
+
+static void second_timer(
+    uint32_t elapsed_milliseconds,
+    void *context)
+{
+    static uint32_t save_seconds = 0;
+    uint32_t elapsed_seconds = elapsed_milliseconds / 1000;
+
+    (void) context;
+    dcc_timer_seconds(elapsed_seconds);
+    Load_Control_State_Machine_Handler();
+    handler_cov_task(elapsed_seconds);
+    save_seconds += elapsed_seconds;
+    if (save_seconds >= ADDRESS_SAVE_SECONDS) {
+        save_seconds = 0;
+        if (address_binding_changed())
+            address_binding_save(Address_Binding_File);
+    }
+}
+
+/* pick up a finished weather refresh */
+static void snapshot_ready(
+    int fd,
+    void *context)
+{
+    (void) fd;
+    (void) context;
+    weatherSnapshotApply();
+}
+
+static void config_changed(
+    int fd,
+    void *context)
+{
+    (void) context;
+    if (weatherConfigChanged(fd))
+        weatherConfigReload();
+}
+
+static void bbmd_stats_print(
+    void)
+{
+    BVLC_FORWARD_STATS stats;
+
+    bvlc_forward_stats(&stats);
+    fprintf(stderr,
+        "BBMD: %u forwarded, %u queued, %u direct, queue %u (max %u)\n",
+        stats.forwarded, stats.queued, stats.direct, stats.depth,
+        stats.max_depth);
+}
+
+/* re-read the config on SIGHUP and print the BBMD counters on SIGUSR1;
+   SIGTERM and SIGINT stop the loop so the bindings are saved on the
+   way out */
+static void signal_ready(
+    int fd,
+    void *context)
+{
+    struct signalfd_siginfo info;
+
+    (void) context;
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGHUP)
+            weatherConfigReload();
+        else if (info.ssi_signo == SIGUSR1)
+            bbmd_stats_print();
+        else
+            reactorStop();
+    }
+}
 
 static void Init_Object(
     BACNET_OBJECT_TYPE object_type,
@@ -148,6 +278,12 @@ static void Init_Service_Handlers(
 static void cleanup(
     void)
 {
+    weatherWorkerStop();
+    reactorCleanup();
+    if (address_binding_changed())
+        address_binding_save(Address_Binding_File);
+    /* flush the forwarding queue while the socket is still open */
+    bvlc_forward_stop();
     datalink_cleanup();
 }
 
@@ -155,19 +291,9 @@ int main(
     int argc,
     char *argv[])
 {
-    BACNET_ADDRESS src = {
-        0
-    };  /* address where message came from */
-    uint16_t pdu_len = 0;
-    unsigned timeout = 1000;    /* milliseconds */
-    time_t last_seconds = 0;
-    time_t current_seconds = 0;
-    time_t last_reset = 0;
-    struct tm *last_reset_tm;
-    uint32_t time_reset = 0;
-    uint32_t weather_time = 3600; //one hour in seconds: get weather update every hour
-    uint32_t elapsed_seconds = 0;
-    uint32_t elapsed_milliseconds = 0;
+    sigset_t signals;
+    int signal_fd = -1;
+    char *pEnv = NULL;
 
     /* allow the device ID to be set */
     if (argc > 1)
@@ -179,53 +305,43 @@ int main(
     Init_Objects();
     Init_Service_Handlers();
     dlenv_init();
+    /* pick up the bindings from the last run rather than rediscover them */
+    pEnv = getenv("BACNET_ADDRESS_FILE");
+    if (pEnv)
+        Address_Binding_File = pEnv;
+    address_binding_load(Address_Binding_File);
     atexit(cleanup);
-    /* configure the timeout values */
-    last_seconds = time(NULL);
+    /* signals are read from a signalfd; block them before the worker
+       thread starts so the thread inherits the mask */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    /* BBMD fan-out overlaps request handling when BACNET_BBMD_THREAD
+       is set */
+    pEnv = getenv("BACNET_BBMD_THREAD");
+    if (pEnv && strtol(pEnv, NULL, 0) && !bvlc_forward_start())
+        fprintf(stderr, "Couldn't start the BBMD forwarding thread\n");
+    /* the weather is fetched in the background so we never stall here */
+    if (weatherWorkerStart() != 0)
+        return 1;
+    if (reactorInit() != 0)
+        return 1;
+    /* every source wakes the loop itself; nothing is polled */
+    reactorSetClock(wheel_clock, NULL);
+    if (reactorAddDescriptor(bip_socket(), datalink_ready, NULL) != 0 ||
+        reactorAddTimer(SECOND_TIMER_MS, second_timer, NULL) != 0 ||
+        reactorAddDescriptor(weatherSnapshotEvent(), snapshot_ready,
+            NULL) != 0)
+        return 1;
+    /* re-read the config when it changes or on SIGHUP */
+    reactorAddDescriptor(weatherConfigWatch(), config_changed, NULL);
+    reactorAddDescriptor(signal_fd, signal_ready, NULL);
     /* broadcast an I-Am on startup */
     Send_I_Am(&Handler_Transmit_Buffer[0]);
     /* loop forever */
-    for (;;) {
-        /* input */
-        current_seconds = time(NULL);
-
-        /* returns 0 bytes on timeout */
-        pdu_len = datalink_receive(&src, &Rx_Buf[0], MAX_MPDU, timeout);
-
-        /* process */
-        if (pdu_len) {
-            npdu_handler(&src, &Rx_Buf[0], pdu_len);
-        }
-        /* at least one second has passed */
-        elapsed_seconds = current_seconds - last_seconds;
-        if (elapsed_seconds) {
-            last_seconds = current_seconds;
-            dcc_timer_seconds(elapsed_seconds);
-#if defined(BACDL_BIP) && BBMD_ENABLED
-            bvlc_maintenance_timer(elapsed_seconds);
-#endif
-            Load_Control_State_Machine_Handler();
-            elapsed_milliseconds = elapsed_seconds * 1000;
-            handler_cov_task(elapsed_seconds);
-            tsm_timer_milliseconds(elapsed_milliseconds);
-        }
-	      time_reset = current_seconds - last_reset;
-
-	      last_reset_tm = localtime(&last_reset);
-	      float weather_since_hr = (float) last_reset_tm->tm_hour;
-         float weather_since_min = (float) last_reset_tm->tm_min;
-         float weather_since_month = (float) last_reset_tm->tm_mon;
-         float weather_since_day= (float) last_reset_tm->tm_mday;
-         float weather_since_year = (float) last_reset_tm->tm_year;
-	      Analog_Input_Present_Value_Set(12,weather_since_hr);
-         Analog_Input_Present_Value_Set(13,weather_since_min);
-         Analog_Input_Present_Value_Set(14,weather_since_month);
-         Analog_Input_Present_Value_Set(15,weather_since_day);
-         Analog_Input_Present_Value_Set(16,1900 + weather_since_year);
-	      if (time_reset >= weather_time) { 
-	          if (updateWeather() ==0)
-               last_reset = current_seconds; //reset timer
-         }
-	 
-    }
+    return (reactorRun() == 0) ? 0 : 1;
 }
@@ -27,14 +27,51 @@
 #include <string.h>
 #include "parser.h"
 
-int parseValue(parse_handle *h,char* testString,char* space);
+/* one call per "OPTION value" line; return non-zero to stop reading */
+typedef int (*parse_option)(void *data, const char *option, const char *value);
+
+/*
+ *Reads every line of fp once, skipping blank lines and lines that
+ *start with #, and hands each option and value to found
+ *RETURN: number of options found
+*/
+static int parseLines(FILE *fp, parse_option found, void *data)
+{
+   char *buffer = NULL;
+   size_t size = 0;
+   ssize_t length;
+   char *option;
+   char *value;
+   int count = 0;
+
+   rewind(fp);
+   while ((length = getline(&buffer, &size, fp)) != -1) {
+      while (length > 0 && strchr(" \t\r\n", buffer[length-1]))
+         buffer[--length] = '\0';
+      option = buffer + strspn(buffer, " \t");
+      if (*option == '\0' || *option == '#')
+         continue;
+      value = option + strcspn(option, " \t");
+      if (*value != '\0') {
+         *value++ = '\0';
+         value += strspn(value, " \t");
+      }
+      count++;
+      if (found(data, option, value))
+         break;
+   }
+   free(buffer);
+   return count;
+}
 
 parse_handle* parseInit(char *file)
 {
    parse_handle *h = malloc(sizeof(parse_handle) );
    FILE *fp=fopen(file,"r");
-   if (fp==NULL)
+   if (fp==NULL) {
+      free(h);
       return NULL;
+   }
    h->fp=fp;
    return h;
 }
@@ -45,6 +82,7 @@ int parseGetNumberLines(parse_handle *h)
    char *pbuffer;
    int counter = 0;
    pbuffer = calloc(LINE_LENGTH,sizeof(char) ); 
+   rewind(fp);
    while (fgets(pbuffer,LINE_LENGTH,fp) ) {           
        counter++;
    }
@@ -52,64 +90,95 @@ int parseGetNumberLines(parse_handle *h)
    return counter;
 }
 
+/* keeps the first value of each option */
+static int parseOptionsFound(void *data, const char *option, const char *value)
+{
+   parse_line *line = data;
+   char **target = NULL;
+
+   if (strcmp(option,"PID") == 0)
+      target = &line->PID;
+   else if (strcmp(option,"LKEY") == 0)
+      target = &line->LKEY;
+   else if (strcmp(option,"LOCID") == 0)
+      target = &line->LOCID;
+   else if (strcmp(option,"FORECASTED_DAYS") == 0)
+      target = &line->FORECASTED_DAYS;
+   if (target && *target == NULL)
+      *target = strdup(value);
+   return 0;
+}
+
 parse_line* parseOptions(parse_handle *h)
 {
-   parse_line *line = malloc(sizeof(parse_line) );
-   line->PID = malloc(sizeof(char)*LINE_LENGTH);
-   line->LOCID = malloc(sizeof(char)*LINE_LENGTH);
-   line->LKEY = malloc(sizeof(char)*LINE_LENGTH);
-   line->FORECASTED_DAYS = malloc(sizeof(char)*LINE_LENGTH);
-   parseValue(h,"PID",line->PID);
-   parseValue(h,"LOCID",line->LOCID);
-   parseValue(h,"LKEY",line->LKEY);
-   parseValue(h,"FORECASETED_DAYS",line->FORECASTED_DAYS);
+   parse_line *line = calloc(1,sizeof(parse_line) );
+   if (line == NULL)
+      return NULL;
+   parseLines(h->fp,parseOptionsFound,line);
    return line;
 }
 
-int parseValue(parse_handle *h,char* testString,char* value) {
-   FILE *fp = h->fp;   
-   char *pbuffer;
-   char *name;
-   char *before;
-   char *space;
-   pbuffer = calloc(LINE_LENGTH,sizeof(char) );
-   name = calloc(LINE_LENGTH,sizeof(char) );
-   before = calloc(LINE_LENGTH,sizeof(char) );
-   rewind(fp);
-   while (fgets(pbuffer,LINE_LENGTH,fp) ) {
-     if (strchr(pbuffer, '#') ) {
-	   continue;
-     }
-     space=strchr(pbuffer,' ');
-     if (space!=NULL) {
-       strncpy(before,pbuffer,space-pbuffer+1);
-       size_t length = strlen(before);
-       *(before+length) = '\0';
-       if ( strncmp(before,testString,3) == 0 ) {
-         length = space-pbuffer+1;
-         //this gets the value of the option
-         size_t index=0;
-         while (length<strlen(pbuffer)) {
-	         *(name+index)=*(pbuffer+length);
-	         index++;
-	         length++;
-         }
-         *(name+index-1) = '\0';//replaces newline with null
-         strcpy(value,name);
-         free(pbuffer);
-         free(name);
-         free(before);
+/* fills a parse_config; a repeated option other than LOCID replaces
+   the earlier value */
+static int parseConfigFound(void *data, const char *option, const char *value)
+{
+   parse_config *config = data;
+   char **target = NULL;
+   char **grown;
+
+   if (strcmp(option,"LOCID") == 0) {
+      if (*value == '\0')
          return 0;
-       }
-     }
+      grown = realloc(config->LOCID,(config->locations+1)*sizeof(char *) );
+      if (grown == NULL)
+         return 1;
+      config->LOCID = grown;
+      config->LOCID[config->locations++] = strdup(value);
+      return 0;
    }
-   fprintf(stderr,"We couldn't fine %s anywhere\n",testString);
-   free(pbuffer);
-   free(name);
-   free(before);
-   return -1; 
- }
- 
+   if (strcmp(option,"PID") == 0)
+      target = &config->PID;
+   else if (strcmp(option,"LKEY") == 0)
+      target = &config->LKEY;
+   else if (strcmp(option,"FORECASTED_DAYS") == 0)
+      target = &config->FORECASTED_DAYS;
+   else
+      fprintf(stderr,"Unknown option %s\n",option);
+   if (target) {
+      free(*target);
+      *target = strdup(value);
+   }
+   return 0;
+}
+
+parse_config* parseConfig(const char *file)
+{
+   parse_config *config;
+   FILE *fp = fopen(file,"r");
+   if (fp == NULL) {
+      fprintf(stderr,"Couldn't find the file %s\n",file);
+      return NULL;
+   }
+   config = calloc(1,sizeof(parse_config) );
+   if (config == NULL) {
+      fclose(fp);
+      return NULL;
+   }
+   parseLines(fp,parseConfigFound,config);
+   fclose(fp);
+   if (config->PID == NULL || config->LKEY == NULL) {
+      fprintf(stderr,"PID and LKEY must be set in %s\n",file);
+      freeParseConfig(config);
+      return NULL;
+   }
+   if (config->locations == 0) {
+      fprintf(stderr,"No LOCID set in %s\n",file);
+      freeParseConfig(config);
+      return NULL;
+   }
+   return config;
+}
+
 void freeParserHandle(parse_handle *h)
 {
    FILE *fp = h->fp;
@@ -126,16 +195,16 @@ void freeParseOptions(parse_line *line)
    free(line);
 }
 
-
-
-
-
-
-
-
-
-
-
-
-
-   
+void freeParseConfig(parse_config *config)
+{
+   int i;
+   if (config == NULL)
+      return;
+   for (i = 0; i < config->locations; i++)
+      free(config->LOCID[i]);
+   free(config->LOCID);
+   free(config->PID);
+   free(config->LKEY);
+   free(config->FORECASTED_DAYS);
+   free(config);
+}
@@ -22,6 +22,9 @@
 * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 *
 *********************************************************************/
+#ifndef PARSER_H
+#define PARSER_H
+
 #include <stdio.h>
 const static size_t LINE_LENGTH = 100;
 
@@ -36,6 +39,16 @@ typedef struct {
    char *FORECASTED_DAYS;
 } parse_line;
 
+/* Everything read from the config file. Never changed once loaded; a
+   reload builds a new one. */
+typedef struct {
+   char *PID;
+   char *LKEY;
+   char *FORECASTED_DAYS;
+   char **LOCID;           /* every LOCID line, in the order they appear */
+   int locations;
+} parse_config;
+
 /*
  *Initializes the parser
  *RETURN: pointer to struct, NULL if not initialized
@@ -49,11 +62,18 @@ parse_handle* parseInit(
 int parseGetNumberLines(
    parse_handle *h);
 /*
- *Search for option  
+ *Search for option, reading the file once. LOCID is the first one found.
  *RETURN: NULL if it doesn't parse, POINTER to lines struct otherwise
 */
 parse_line* parseOptions(
    parse_handle *h);
+/*
+ *Reads the whole config file in one pass
+ *RETURN: NULL if the file can't be read or has no PID, LKEY or LOCID,
+ *POINTER to the config otherwise
+*/
+parse_config* parseConfig(
+   const char *file);
 /*
  *Frees the memory used during parsing
 */
@@ -62,3 +82,8 @@ void freeParserHandle(
 
 void freeParseOptions(
    parse_line *line);
+
+void freeParseConfig(
+   parse_config *config);
+
+#endif
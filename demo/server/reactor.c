@@ -0,0 +1,211 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "reactor.h"
+
+typedef struct {
+   int fd;
+   bool timer;                    /* fd is a timerfd owned by the reactor */
+   uint32_t interval_ms;
+   reactor_handler handler;
+   reactor_timer_handler timer_handler;
+   void *context;
+} reactor_source;
+
+static int Epoll_Fd = -1;
+static reactor_source Sources[REACTOR_MAX_SOURCES];
+static unsigned Source_Count = 0;
+static bool Stop = false;
+static reactor_clock_handler Clock = NULL;
+static void *Clock_Context = NULL;
+
+int reactorInit(void)
+{
+   if (Epoll_Fd >= 0)
+      return 0;
+   Epoll_Fd = epoll_create1(EPOLL_CLOEXEC);
+   if (Epoll_Fd < 0) {
+      perror("epoll_create1");
+      return -1;
+   }
+   Source_Count = 0;
+   Stop = false;
+
+   return 0;
+}
+
+static reactor_source *reactorAdd(int fd)
+{
+   struct epoll_event event;
+   reactor_source *source;
+
+   if (Epoll_Fd < 0 || fd < 0 || Source_Count >= REACTOR_MAX_SOURCES)
+      return NULL;
+   source = &Sources[Source_Count];
+   memset(source, 0, sizeof(reactor_source));
+   source->fd = fd;
+   memset(&event, 0, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.ptr = source;
+   if (epoll_ctl(Epoll_Fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      perror("epoll_ctl");
+      return NULL;
+   }
+   Source_Count++;
+
+   return source;
+}
+
+int reactorAddDescriptor(int fd, reactor_handler handler, void *context)
+{
+   reactor_source *source = reactorAdd(fd);
+
+   if (source == NULL)
+      return -1;
+   source->handler = handler;
+   source->context = context;
+
+   return 0;
+}
+
+int reactorAddTimer(uint32_t interval_ms, reactor_timer_handler handler,
+   void *context)
+{
+   struct itimerspec spec;
+   reactor_source *source;
+   int fd;
+
+   if (interval_ms == 0)
+      return -1;
+   fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if (fd < 0) {
+      perror("timerfd_create");
+      return -1;
+   }
+   spec.it_interval.tv_sec = interval_ms / 1000;
+   spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+   spec.it_value = spec.it_interval;
+   source = reactorAdd(fd);
+   if (source == NULL || timerfd_settime(fd, 0, &spec, NULL) != 0) {
+      close(fd);
+      return -1;
+   }
+   source->timer = true;
+   source->interval_ms = interval_ms;
+   source->timer_handler = handler;
+   source->context = context;
+
+   return 0;
+}
+
+void reactorSetClock(reactor_clock_handler handler, void *context)
+{
+   Clock = handler;
+   Clock_Context = context;
+}
+
+static uint64_t reactorMilliseconds(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void reactorDispatch(reactor_source *source)
+{
+   uint64_t expirations = 0;
+
+   if (!source->timer) {
+      source->handler(source->fd, source->context);
+      return;
+   }
+   /* a late wakeup reports every interval that passed */
+   if (read(source->fd, &expirations, sizeof(expirations)) !=
+      sizeof(expirations) || expirations == 0)
+      return;
+   source->timer_handler((uint32_t) (expirations * source->interval_ms),
+      source->context);
+}
+
+int reactorRun(void)
+{
+   struct epoll_event events[REACTOR_MAX_SOURCES];
+   uint64_t last;
+   uint64_t now;
+   int timeout = -1;
+   int count;
+   int i;
+
+   if (Epoll_Fd < 0)
+      return -1;
+   Stop = false;
+   last = reactorMilliseconds();
+   while (!Stop) {
+      if (Clock) {
+         now = reactorMilliseconds();
+         timeout = Clock((uint32_t) (now - last), Clock_Context);
+         last = now;
+      }
+      count = epoll_wait(Epoll_Fd, events, REACTOR_MAX_SOURCES, timeout);
+      if (count < 0) {
+         if (errno == EINTR)
+            continue;
+         perror("epoll_wait");
+         return -1;
+      }
+      for (i = 0; i < count; i++)
+         reactorDispatch(events[i].data.ptr);
+   }
+
+   return 0;
+}
+
+void reactorStop(void)
+{
+   Stop = true;
+}
+
+void reactorCleanup(void)
+{
+   unsigned i;
+
+   for (i = 0; i < Source_Count; i++) {
+      if (Sources[i].timer)
+         close(Sources[i].fd);
+   }
+   Source_Count = 0;
+   Clock = NULL;
+   if (Epoll_Fd >= 0)
+      close(Epoll_Fd);
+   Epoll_Fd = -1;
+}
@@ -0,0 +1,95 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* most descriptors and timers one reactor watches */
+#define REACTOR_MAX_SOURCES 16
+
+/* called when fd is readable */
+typedef void (*reactor_handler)(
+   int fd,
+   void *context);
+/* called when a timer fires; elapsed_ms is the time since the last call,
+   including any expirations that were missed */
+typedef void (*reactor_timer_handler)(
+   uint32_t elapsed_ms,
+   void *context);
+/* called before each wait with the time since the last call;
+   returns the most milliseconds to wait, or -1 for no limit */
+typedef int (*reactor_clock_handler)(
+   uint32_t elapsed_ms,
+   void *context);
+
+/*
+ *Creates the epoll instance
+ *RETURN: 0 on success, -1 otherwise
+*/
+int reactorInit(
+   void);
+/*
+ *Calls handler each time fd is readable. The reactor does not read fd.
+ *RETURN: 0 on success, -1 otherwise
+*/
+int reactorAddDescriptor(
+   int fd,
+   reactor_handler handler,
+   void *context);
+/*
+ *Calls handler every interval_ms milliseconds from a timerfd
+ *RETURN: 0 on success, -1 otherwise
+*/
+int reactorAddTimer(
+   uint32_t interval_ms,
+   reactor_timer_handler handler,
+   void *context);
+/*
+ *Lets handler advance a software clock (e.g. a timer wheel) and bound
+ *how long each epoll_wait sleeps, instead of waking on a fixed timerfd
+*/
+void reactorSetClock(
+   reactor_clock_handler handler,
+   void *context);
+/*
+ *Waits for events and dispatches them until reactorStop is called
+ *RETURN: 0 after reactorStop, -1 if epoll fails
+*/
+int reactorRun(
+   void);
+/*
+ *Makes reactorRun return after the current dispatch
+*/
+void reactorStop(
+   void);
+/*
+ *Closes the epoll instance and every timer
+*/
+void reactorCleanup(
+   void);
+
+#endif
@@ -25,37 +25,25 @@
 #include "parser.h"
 #include <stdio.h>
 
-int main()
+int main(int argc, char *argv[])
 {
-   parse_handle *handle;
-   parse_line *line;
-   handle = parseInit("test.txt");
-   if ( handle == NULL )
+   parse_config *config;
+   int i;
+   config = parseConfig(argc > 1 ? argv[1] : "test.txt");
+   if ( config == NULL )
    {
-      printf("We got a null handle, sucks\n");
+      printf("We couldn't read the config\n");
       return -1;
    }
-   
-   printf("We managed to open the file\n");
 
-   line = parseOptions(handle);
-   if (line == NULL)
-      printf("Couldn't get line\n");
-   if (line->PID == NULL)
-      printf("We couldn't get PID\n");
-   else 
-      printf("PID is %s\n",line->PID);
-   if (line->LKEY == NULL)
-      printf("We couldn't get the LKEY\n");
+   printf("PID is %s\n",config->PID);
+   printf("LKEY is %s\n",config->LKEY);
+   for (i = 0; i < config->locations; i++)
+      printf("LOCID is %s\n",config->LOCID[i]);
+   if (config->FORECASTED_DAYS == NULL)
+      printf("We couldn't get the FORECASTED_DAYS\n");
    else
-      printf("LKEY is %s\n",line->LKEY);
-   if (line->LOCID == NULL)
-      printf("We couldn't get the LOCID\n");
-   else
-      printf("LOCID is %s\n",line->LOCID);
+      printf("FORECASTED_DAYS is %s\n",config->FORECASTED_DAYS);
+   freeParseConfig(config);
    return 0;
-   freeParserHandle(handle);
-   freeParserOptions(line);
 }
-   
-
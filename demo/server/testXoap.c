@@ -0,0 +1,394 @@
+/**************************************************************************
+*
+* Copyright (C) 2011 Blake Howell <beh9540@rit.edu>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+/*
+ * Tests xoap_weather_fetch_multi() against a stand-in for the TWCi and
+ * Weather Underground servers. The stand-in runs on a thread, listens on
+ * 127.0.0.1 and is given to libxoapweather as its HTTP proxy, so the real
+ * URLs are requested. It serves the XML fixtures with an ETag and answers
+ * 304 Not Modified when the ETag comes back. Last it stops answering, and
+ * a fetch stuck on it must give up once the context is stopped.
+ *
+ * usage: testXoap  (run from this directory so it can find the fixtures)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "xoapweather.h"
+
+#define MAX_CLIENTS 16
+#define REQUEST_SIZE 4096
+
+typedef struct {
+   const char *pattern;  /* served for URLs containing this */
+   const char *file;
+   char *body;
+   long size;
+} document;
+
+static document Documents[] = {
+   { "dayf=1&", "fixtures/twci_dayf1.xml", NULL, 0 },
+   { "dayf=5&", "fixtures/twci_dayf5.xml", NULL, 0 },
+   { "GeoLookupXML", "fixtures/wu_geolookup.xml", NULL, 0 },
+   { "WXCurrentObXML", "fixtures/wu_station.xml", NULL, 0 }
+};
+#define DOCUMENTS (sizeof(Documents) / sizeof(Documents[0]))
+
+/* stand-in server state, the counters are read once it is idle */
+static int Listen_Socket = -1;
+static int Stop_Pipe[2];
+static volatile int Version = 1;  /* part of every ETag */
+static volatile int Stalled = 0;  /* read requests but never answer */
+static int Connections = 0;
+static int Requests = 0;
+static int Not_Modified = 0;
+static int Conditional = 0;  /* requests with If-Modified-Since */
+
+static int Failures = 0;
+
+#define CHECK(cond) \
+   do { if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      Failures++; } } while (0)
+
+static char *readFile(const char *file, long *size)
+{
+   FILE *fp = fopen(file, "rb");
+   char *body;
+   if (fp == NULL)
+      return NULL;
+   fseek(fp, 0, SEEK_END);
+   *size = ftell(fp);
+   rewind(fp);
+   body = malloc(*size);
+   if (body)
+      *size = fread(body, 1, *size, fp);
+   fclose(fp);
+   return body;
+}
+
+static void sendAll(int fd, const char *data, size_t len)
+{
+   ssize_t sent;
+   while (len > 0 && (sent = send(fd, data, len, MSG_NOSIGNAL)) > 0) {
+      data += sent;
+      len -= sent;
+   }
+}
+
+/* value of header name in the request, or NULL */
+static const char *findHeader(const char *request, const char *name,
+   char *value, size_t size)
+{
+   const char *line = strstr(request, "\r\n");
+   size_t nameLen = strlen(name);
+   while (line && line[2] != '\r') {
+      line += 2;
+      if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+         const char *start = line + nameLen + 1;
+         const char *end = strstr(start, "\r\n");
+         while (*start == ' ')
+            start++;
+         if (end == NULL || (size_t)(end - start) >= size)
+            return NULL;
+         memcpy(value, start, end - start);
+         value[end - start] = 0;
+         return value;
+      }
+      line = strstr(line, "\r\n");
+   }
+   return NULL;
+}
+
+/* answers one complete request held in buffer */
+static void serveRequest(int fd, const char *request)
+{
+   char header[256];
+   char etag[64];
+   char match[64];
+   unsigned i;
+   int n;
+
+   Requests++;
+   if (Stalled)
+      return;
+   if (findHeader(request, "If-Modified-Since", match, sizeof(match)))
+      Conditional++;
+   for (i = 0; i < DOCUMENTS; i++) {
+      const char *eol = strstr(request, "\r\n");
+      const char *found = strstr(request, Documents[i].pattern);
+      if (found && eol && found < eol)
+         break;
+   }
+   if (i == DOCUMENTS) {
+      n = snprintf(header, sizeof(header),
+         "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+      sendAll(fd, header, n);
+      return;
+   }
+   snprintf(etag, sizeof(etag), "\"%d-%u\"", Version, i);
+   if (findHeader(request, "If-None-Match", match, sizeof(match)) &&
+      strcmp(match, etag) == 0) {
+      Not_Modified++;
+      n = snprintf(header, sizeof(header),
+         "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag);
+      sendAll(fd, header, n);
+      return;
+   }
+   n = snprintf(header, sizeof(header),
+      "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nETag: %s\r\n"
+      "Last-Modified: Fri, 14 Oct 2011 19:0%d:00 GMT\r\n"
+      "Content-Length: %ld\r\n\r\n", etag, Version % 10, Documents[i].size);
+   sendAll(fd, header, n);
+   sendAll(fd, Documents[i].body, Documents[i].size);
+}
+
+/* keep-alive HTTP/1.1 server, one poll() over every connection */
+static void *serverThread(void *arg)
+{
+   struct pollfd fds[MAX_CLIENTS + 2];
+   static char buffer[MAX_CLIENTS + 2][REQUEST_SIZE];
+   size_t used[MAX_CLIENTS + 2];
+   int count = 2;
+   int i;
+
+   (void)arg;
+   fds[0].fd = Listen_Socket;
+   fds[0].events = POLLIN;
+   fds[1].fd = Stop_Pipe[0];
+   fds[1].events = POLLIN;
+   for (;;) {
+      if (poll(fds, count, -1) < 0)
+         continue;
+      if (fds[1].revents)
+         break;
+      if ((fds[0].revents & POLLIN) && count < MAX_CLIENTS + 2) {
+         int fd = accept(Listen_Socket, NULL, NULL);
+         if (fd >= 0) {
+            Connections++;
+            fds[count].fd = fd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            used[count] = 0;
+            count++;
+         }
+      }
+      for (i = 2; i < count; i++) {
+         ssize_t got;
+         char *end;
+         if (!fds[i].revents)
+            continue;
+         got = recv(fds[i].fd, buffer[i] + used[i],
+            REQUEST_SIZE - 1 - used[i], 0);
+         if (got <= 0) {
+            /* closed, move the last connection into this slot */
+            close(fds[i].fd);
+            count--;
+            fds[i] = fds[count];
+            used[i] = used[count];
+            memcpy(buffer[i], buffer[count], used[i]);
+            i--;
+            continue;
+         }
+         used[i] += got;
+         buffer[i][used[i]] = 0;
+         while ((end = strstr(buffer[i], "\r\n\r\n")) != NULL) {
+            size_t length = end + 4 - buffer[i];
+            serveRequest(fds[i].fd, buffer[i]);
+            memmove(buffer[i], buffer[i] + length, used[i] - length + 1);
+            used[i] -= length;
+         }
+      }
+   }
+   for (i = 2; i < count; i++)
+      close(fds[i].fd);
+   return NULL;
+}
+
+static int serverStart(pthread_t *thread, char *proxy, size_t size)
+{
+   struct sockaddr_in addr;
+   socklen_t len = sizeof(addr);
+   unsigned i;
+
+   for (i = 0; i < DOCUMENTS; i++) {
+      Documents[i].body = readFile(Documents[i].file, &Documents[i].size);
+      if (Documents[i].body == NULL) {
+         fprintf(stderr, "Couldn't read %s\n", Documents[i].file);
+         return -1;
+      }
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   Listen_Socket = socket(AF_INET, SOCK_STREAM, 0);
+   if (Listen_Socket < 0 ||
+      bind(Listen_Socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(Listen_Socket, MAX_CLIENTS) < 0 ||
+      getsockname(Listen_Socket, (struct sockaddr *)&addr, &len) < 0 ||
+      pipe(Stop_Pipe) < 0) {
+      perror("stand-in server");
+      return -1;
+   }
+   snprintf(proxy, size, "http://127.0.0.1:%u", ntohs(addr.sin_port));
+   return pthread_create(thread, NULL, serverThread, NULL);
+}
+
+static void serverStop(pthread_t thread)
+{
+   unsigned i;
+   if (write(Stop_Pipe[1], "x", 1) != 1)
+      perror("stand-in server");
+   pthread_join(thread, NULL);
+   close(Listen_Socket);
+   close(Stop_Pipe[0]);
+   close(Stop_Pipe[1]);
+   for (i = 0; i < DOCUMENTS; i++)
+      free(Documents[i].body);
+}
+
+static void checkResults(xoap_weather_request *requests, int expectNotModified)
+{
+   CHECK(requests[0].forecast != NULL);
+   CHECK(requests[1].forecast != NULL);
+   if (requests[0].forecast && requests[1].forecast) {
+      CHECK(requests[0].forecast->total_days == 1);
+      CHECK(requests[1].forecast->total_days == 5);
+      CHECK(strcmp(requests[0].forecast->id, "14623") == 0);
+   }
+   CHECK(requests[0].rain != NULL);
+   CHECK(requests[1].rain == requests[0].rain);  /* same station */
+   if (requests[0].rain) {
+      CHECK(requests[0].rain->rain_last_hr == 0.02f);
+      CHECK(requests[0].rain->rain_last_day == 0.35f);
+      CHECK(strcmp(requests[0].rain->station_id, "KNYROCHE19") == 0);
+   }
+   CHECK(requests[0].not_modified == expectNotModified);
+   CHECK(requests[1].not_modified == expectNotModified);
+}
+
+/* stops the context from another thread while a fetch is stuck */
+static void *stopThread(void *arg)
+{
+   usleep(300000);
+   xoap_weather_context_stop(arg);
+   return NULL;
+}
+
+int main(void)
+{
+   pthread_t thread;
+   pthread_t stopper;
+   struct timespec start, end;
+   char proxy[64];
+   xoap_weather_handle *h;
+   xoap_weather_context *ctx;
+   xoap_weather_request requests[2];
+   xoap_weather_forecast *first;
+   int connections;
+   int failed;
+
+   if (serverStart(&thread, proxy, sizeof(proxy)) != 0)
+      return 1;
+   h = xoap_weather_init("partner", "license");
+   ctx = xoap_weather_context_new();
+   xoap_weather_context_proxy(ctx, proxy);
+   memset(requests, 0, sizeof(requests));
+   requests[0].hand = xoap_weather_handle_new();
+   xoap_weather_setopt(requests[0].hand, XOAP_WEATHER_OPT_ID, "14623");
+   xoap_weather_setopt(requests[0].hand, XOAP_WEATHER_OPT_FETCH,
+      XOAP_WEATHER_FETCH_DAYF1);
+   requests[1].hand = xoap_weather_handle_new();
+   xoap_weather_setopt(requests[1].hand, XOAP_WEATHER_OPT_ID, "14586");
+   xoap_weather_setopt(requests[1].hand, XOAP_WEATHER_OPT_FETCH,
+      XOAP_WEATHER_FETCH_DAYF5);
+
+   /* first fetch downloads everything: 2 forecasts, 2 lookups, 1 station */
+   failed = xoap_weather_fetch_multi(ctx, requests, 2);
+   CHECK(failed == 0);
+   CHECK(Requests == 5);
+   CHECK(Not_Modified == 0);
+   CHECK(Conditional == 0);
+   checkResults(requests, 0);
+   first = requests[0].forecast;
+   connections = Connections;
+
+   /* nothing changed: every reply is 304 over the connections we have */
+   failed = xoap_weather_fetch_multi(ctx, requests, 2);
+   CHECK(failed == 0);
+   CHECK(Requests == 10);
+   CHECK(Not_Modified == 5);
+   CHECK(Conditional == 5);
+   CHECK(Connections == connections);
+   checkResults(requests, 1);
+   CHECK(requests[0].forecast == first);
+
+   /* new documents on the server are downloaded and parsed again */
+   Version++;
+   failed = xoap_weather_fetch_multi(ctx, requests, 2);
+   CHECK(failed == 0);
+   CHECK(Requests == 15);
+   CHECK(Not_Modified == 5);
+   CHECK(Connections == connections);
+   checkResults(requests, 0);
+
+   /* a location that is no longer fetched is forgotten, and one the
+    * server doesn't know has no forecast */
+   xoap_weather_setopt(requests[1].hand, XOAP_WEATHER_OPT_FETCH,
+      XOAP_WEATHER_FETCH_LOC);
+   failed = xoap_weather_fetch_multi(ctx, requests, 2);
+   CHECK(failed == 1);
+   CHECK(requests[0].forecast != NULL && requests[0].not_modified);
+   CHECK(requests[1].forecast == NULL);
+
+   /* a server that stops answering holds the fetch only until it is
+    * stopped, and a stopped context fetches nothing more */
+   Stalled = 1;
+   Version++;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   pthread_create(&stopper, NULL, stopThread, ctx);
+   failed = xoap_weather_fetch_multi(ctx, requests, 2);
+   pthread_join(stopper, NULL);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   CHECK(failed == 2);
+   CHECK(end.tv_sec - start.tv_sec < 3);
+   CHECK(xoap_weather_fetch_multi(ctx, requests, 2) == -1);
+
+   xoap_weather_handle_free(requests[0].hand);
+   xoap_weather_handle_free(requests[1].hand);
+   xoap_weather_context_free(ctx);
+   xoap_weather_cleanup(h);
+   serverStop(thread);
+   printf("testXoap: %d requests on %d connections, %d not modified, %s\n",
+      Requests, Connections, Not_Modified, Failures ? "FAILED" : "passed");
+   return Failures ? 1 : 0;
+}
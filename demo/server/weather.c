@@ -22,104 +22,461 @@
 * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 *
 *********************************************************************/
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include "xoapweather.h"
 #include "ai.h"
+#include "device.h"
 #include "parser.h"
 #include "weather.h"
+#include "cache.h"
 
-int updateWeather() {
-   parse_handle *handle;
-   parse_line *line;
-   handle = parseInit(ETC_FILE);
-   if ( handle==NULL )
-   {
-      fprintf(stderr,"Couldn't find the file %s\n",ETC_FILE);
-      return -1;
-   }   
-   line = parseOptions(handle); 
-   char *PID=line->PID;
-   char *LKEY=line->LKEY;
-   char *LOCID=line->LOCID;
+/* snapshot waiting for the BACnet thread, exchanged atomically */
+static weather_snapshot *Pending_Snapshot = NULL;
+
+static pthread_t Worker_Thread;
+static pthread_mutex_t Worker_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Worker_Cond = PTHREAD_COND_INITIALIZER;
+static bool Worker_Running = false;
+static bool Worker_Stop = false;
+/* config waiting for the worker, exchanged atomically */
+static parse_config *Pending_Config = NULL;
+/* config in use, only touched by the worker once it runs */
+static parse_config *Worker_Config = NULL;
+/* set by weatherConfigReload to cut the wait before the next refresh */
+static bool Worker_Wake = false;
+/* values of the last refresh, only touched by the worker once it runs */
+static weather_snapshot Worker_Last;
+/* written by the worker each time it publishes a snapshot */
+static int Snapshot_Event = -1;
+/* kept between refreshes so connections and unchanged documents are
+ * reused, only touched by the worker thread */
+static xoap_weather_context *Fetch_Context = NULL;
+
+static void snapshotSet(weather_snapshot *snapshot, uint32_t index, float value)
+{
+   if (index < MAX_ANALOG_INPUTS) {
+      snapshot->value[index] = value;
+      snapshot->valid[index] = true;
+   }
+}
+
+static uint32_t elapsedMilliseconds(const struct timespec *start)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint32_t) ((now.tv_sec - start->tv_sec) * 1000 +
+      (now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+/* stores one point of the location whose block starts at base */
+static void snapshotPoint(weather_snapshot *snapshot, uint32_t base,
+   uint32_t offset, float value)
+{
+   if (offset < ANALOG_INPUTS_PER_LOCATION)
+      snapshotSet(snapshot, base + offset, value);
+}
+
+static xoap_weather_fetch_type forecastDays(const char *forecastDayString)
+{
+   int forecast_days = forecastDayString ? atoi(forecastDayString) : 1;
+   switch (forecast_days) {
+      case 2:
+         return XOAP_WEATHER_FETCH_DAYF2;
+      case 3:
+         return XOAP_WEATHER_FETCH_DAYF3;
+      case 4:
+         return XOAP_WEATHER_FETCH_DAYF4;
+      case 5:
+         return XOAP_WEATHER_FETCH_DAYF5;
+      default:
+         return XOAP_WEATHER_FETCH_DAYF1;
+   }
+}
+
+/* copies one location's results into its block of Analog Inputs */
+static void snapshotLocation(weather_snapshot *snapshot, uint32_t base,
+   xoap_weather_forecast *forecast, xoap_weather_rain *rain,
+   struct tm *updated)
+{
+   int i = 0; //counter
+   xoap_weather_day *day;
+
+   /*current weather*/
+   if (forecast->cc) {
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_TEMP,forecast->cc->temp);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_FEELS,forecast->cc->feels);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_HUMIDITY,
+         forecast->cc->humidity);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_VISIBILITY,
+         forecast->cc->visibility);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_DEWPOINT,forecast->cc->dewp);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_BAROMETRIC,
+         forecast->cc->barp);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_UV_INDEX,forecast->cc->uvi);
+      if (forecast->cc->wind.speed)
+         snapshotPoint(snapshot,base,ANALOG_INPUT_CC_WIND,
+            atof(forecast->cc->wind.speed) );
+      if (forecast->cc->wind.gust)
+         snapshotPoint(snapshot,base,ANALOG_INPUT_CC_GUST,
+            atof(forecast->cc->wind.gust) );
+      snapshotPoint(snapshot,base,ANALOG_INPUT_CC_DIRECTION,
+         forecast->cc->wind.direction_n);
+   }
+   if (rain) {
+      snapshotPoint(snapshot,base,ANALOG_INPUT_RAIN_LAST_DAY,
+         rain->rain_last_day);
+      snapshotPoint(snapshot,base,ANALOG_INPUT_RAIN_LAST_HOUR,
+         rain->rain_last_hr);
+   }
+   snapshotPoint(snapshot,base,ANALOG_INPUT_UPDATED_HOUR,updated->tm_hour);
+   snapshotPoint(snapshot,base,ANALOG_INPUT_UPDATED_MINUTE,updated->tm_min);
+   snapshotPoint(snapshot,base,ANALOG_INPUT_UPDATED_MONTH,updated->tm_mon);
+   snapshotPoint(snapshot,base,ANALOG_INPUT_UPDATED_DAY,updated->tm_mday);
+   snapshotPoint(snapshot,base,ANALOG_INPUT_UPDATED_YEAR,
+      1900 + updated->tm_year);
+   /*forecasted weather, five days*/
+   for (i=0; (i < forecast->total_days) &&
+      (i < ANALOG_INPUT_FORECAST_DAYS); ++i) {
+      day = &forecast->days[i];
+      snapshotPoint(snapshot,base,
+         ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_DAY_HIGH),day->high);
+      snapshotPoint(snapshot,base,
+         ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_DAY_LOW),day->low);
+      snapshotPoint(snapshot,base,
+         ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_DAY_PRECIP),
+         day->day.chance_precipitation);
+      snapshotPoint(snapshot,base,
+         ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_NIGHT_PRECIP),
+         day->night.chance_precipitation);
+      if (day->day.wind.speed)
+         snapshotPoint(snapshot,base,
+            ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_DAY_WIND),
+            atof(day->day.wind.speed) );
+      if (day->night.wind.speed)
+         snapshotPoint(snapshot,base,
+            ANALOG_INPUT_FORECAST_POINT(i,ANALOG_INPUT_NIGHT_WIND),
+            atof(day->night.wind.speed) );
+   }
+}
+
+int updateWeather(const parse_config *config, weather_snapshot *snapshot) {
+   char **locations = config->LOCID;
+   int count = config->locations;
    int i = 0; //counter
-   xoap_weather_forecast *forecast;
-	xoap_weather_handle *h;
-	xoap_weather_rain *rain;
-	/*First we have to initialize the XOAP Weather*/
-	h = xoap_weather_init(PID, LKEY);
-	if (h) {
-	    	/*Then we set the XOAP Options(5 Days Forecast, our Zip Code,
-	    	 * US Standard Units, and that's it*/
-         if ( line->FORECASTED_DAYS )
-         {
-            char *forecastDayString = line->FORECASTED_DAYS;
-            int forecast_days = atoi(forecastDayString);
-            switch (forecast_days) {
-               case 1:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF1);
-                  break;
-               case 2:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF2);
-                  break;
-               case 3:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF3);
-                  break;
-               case 4:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF4);
-                  break;
-               case 5:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF5);
-                  break;
-               default:
-                  xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF1);
-                  break;
-            }
-         }
-         else
-            xoap_weather_setopt(h,XOAP_WEATHER_OPT_FETCH,XOAP_WEATHER_FETCH_DAYF1);
-	    	xoap_weather_setopt(h, XOAP_WEATHER_OPT_ID,LOCID);
-	    	xoap_weather_setopt(h, XOAP_WEATHER_OPT_UNIT,XOAP_WEATHER_UNIT_STANDARD);
-  	    	/*get the forecasted data*/
-	    rain=xoap_weather_rain(h);
-		forecast=xoap_weather_fetch(h);
-		if (forecast) {
-	    		/*current weather*/
-		    	Analog_Input_Present_Value_Set(0,forecast->cc->temp);
-		    	Analog_Input_Present_Value_Set(1,forecast->cc->feels);
-		    	Analog_Input_Present_Value_Set(2,forecast->cc->humidity);
-		    	Analog_Input_Present_Value_Set(3,forecast->cc->visibility);
-		    	Analog_Input_Present_Value_Set(4,forecast->cc->dewp);
-		    	Analog_Input_Present_Value_Set(5,forecast->cc->barp);
-		    	Analog_Input_Present_Value_Set(6,forecast->cc->uvi);
-		    	Analog_Input_Present_Value_Set(7,atof(forecast->cc->wind.speed) );
-		    	Analog_Input_Present_Value_Set(8,atof(forecast->cc->wind.gust) );
-		    	Analog_Input_Present_Value_Set(9,forecast->cc->wind.direction_n);
-		    	Analog_Input_Present_Value_Set(10,rain->rain_last_day);
-		    	Analog_Input_Present_Value_Set(11,rain->rain_last_hr);
-		    	/*forecasted weather, five days*/
-		    	xoap_weather_day *day;
-		    	for (i=0; (i < forecast->total_days); ++i) {
-		    	   day = &forecast->days[i];
-		    	   Analog_Input_Present_Value_Set(6*i+17,day->high);
-		    	   Analog_Input_Present_Value_Set(6*i+18,day->low);
-		    	   Analog_Input_Present_Value_Set(6*i+19,day->day.chance_precipitation);
-		    	   Analog_Input_Present_Value_Set(6*i+20,day->night.chance_precipitation);
-		    	   Analog_Input_Present_Value_Set(6*i+21,atof(day->day.wind.speed) );
-		    	   Analog_Input_Present_Value_Set(6*i+22,atof(day->night.wind.speed) );
-			   }
-		}
-	  xoap_weather_free_rain(rain);
-      xoap_weather_free_forecast(forecast);	   
-   }
-   else
-   {
-      xoap_weather_cleanup(h);
-      freeParserHandle(handle);
-      freeParseOptions(line);
-      fprintf(stderr,"Could Not Update Weather");
+   int failed = 0;
+   time_t now;
+   struct tm updated;
+   xoap_weather_handle *h;
+   xoap_weather_request *requests;
+
+   if (count > MAX_WEATHER_LOCATIONS) {
+      fprintf(stderr,"Only the first %d locations will be served\n",
+         MAX_WEATHER_LOCATIONS);
+      count = MAX_WEATHER_LOCATIONS;
+   }
+   /*First we have to initialize the XOAP Weather*/
+   h = xoap_weather_init(config->PID, config->LKEY);
+   if (Fetch_Context == NULL)
+      Fetch_Context = xoap_weather_context_new();
+   requests = calloc(count, sizeof(xoap_weather_request));
+   if (h == NULL || Fetch_Context == NULL || requests == NULL) {
+      xoap_weather_handle_free(h);
+      free(requests);
+      fprintf(stderr,"Could Not Update Weather\n");
       return -1;
    }
-   xoap_weather_cleanup(h);
-   freeParserHandle(handle);
-   freeParseOptions(line);
-   return 0;
+   /*Then we set the XOAP Options for each location (forecast days,
+    * the location ID, US Standard Units, and that's it*/
+   for (i = 0; i < count; i++) {
+      requests[i].hand = xoap_weather_handle_new();
+      xoap_weather_setopt(requests[i].hand, XOAP_WEATHER_OPT_FETCH,
+         forecastDays(config->FORECASTED_DAYS));
+      xoap_weather_setopt(requests[i].hand, XOAP_WEATHER_OPT_ID, locations[i]);
+      xoap_weather_setopt(requests[i].hand, XOAP_WEATHER_OPT_UNIT,
+         XOAP_WEATHER_UNIT_STANDARD);
+   }
+   /*get the forecasted data for every location at once*/
+   failed = xoap_weather_fetch_multi(Fetch_Context, requests, count);
+   now = time(NULL);
+   localtime_r(&now, &updated);
+   for (i = 0; i < count; i++) {
+      if (requests[i].forecast) {
+         snapshotLocation(snapshot, i * ANALOG_INPUTS_PER_LOCATION,
+            requests[i].forecast, requests[i].rain, &updated);
+         snapshot->updated[i] = now;
+      } else
+         fprintf(stderr,"Could Not Update Weather for %s\n",locations[i]);
+      /* the forecast and rain belong to Fetch_Context */
+      xoap_weather_handle_free(requests[i].hand);
+   }
+   snapshot->locations = count;
+   snapshot->failures = (failed < 0) ? count : failed;
+   free(requests);
+   xoap_weather_handle_free(h);
+   return (snapshot->failures == 0) ? 0 : -1;
+}
+
+/* runs one refresh and hands the result to the BACnet thread */
+static bool weatherRefresh(weather_snapshot *last)
+{
+   weather_snapshot *snapshot;
+   weather_snapshot *stale;
+   struct timespec start;
+
+   snapshot = malloc(sizeof(weather_snapshot));
+   if (snapshot == NULL)
+      return false;
+   /* start from the previous values so a failure keeps serving them */
+   *snapshot = *last;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   snapshot->success = (updateWeather(Worker_Config, snapshot) == 0);
+   snapshot->duration_ms = elapsedMilliseconds(&start);
+   snapshot->completed = time(NULL);
+   if (snapshot->success)
+      snapshot->last_success = snapshot->completed;
+   /* keep the cache unless every location failed */
+   if (snapshot->failures < snapshot->locations)
+      cacheSave(CACHE_FILE, snapshot);
+   *last = *snapshot;
+   /* publish; free the previous one if the BACnet thread never took it */
+   stale = __sync_lock_test_and_set(&Pending_Snapshot, snapshot);
+   free(stale);
+   if (Snapshot_Event >= 0)
+      eventfd_write(Snapshot_Event, 1);
+
+   return last->success;
+}
+
+static void *weatherWorker(void *arg)
+{
+   parse_config *config;
+   struct timespec wakeup;
+   bool success;
+
+   (void) arg;
+   pthread_mutex_lock(&Worker_Mutex);
+   while (!Worker_Stop) {
+      Worker_Wake = false;
+      pthread_mutex_unlock(&Worker_Mutex);
+      config = __sync_lock_test_and_set(&Pending_Config, NULL);
+      if (config) {
+         freeParseConfig(Worker_Config);
+         Worker_Config = config;
+      }
+      /* without a config there is nothing to fetch until one is read */
+      success = Worker_Config ? weatherRefresh(&Worker_Last) : false;
+      pthread_mutex_lock(&Worker_Mutex);
+      clock_gettime(CLOCK_REALTIME, &wakeup);
+      wakeup.tv_sec +=
+         success ? WEATHER_REFRESH_SECONDS : WEATHER_RETRY_SECONDS;
+      while (!Worker_Stop && !Worker_Wake) {
+         if (Worker_Config == NULL)
+            pthread_cond_wait(&Worker_Cond, &Worker_Mutex);
+         else if (pthread_cond_timedwait(&Worker_Cond, &Worker_Mutex,
+               &wakeup) == ETIMEDOUT)
+            break;
+      }
+   }
+   pthread_mutex_unlock(&Worker_Mutex);
+
+   return NULL;
+}
+
+/* seeds Worker_Last from the cache file and applies it right away */
+static void weatherCacheRestore(void)
+{
+   weather_snapshot *snapshot;
+
+   if (cacheLoad(CACHE_FILE, &Worker_Last) != 0) {
+      memset(&Worker_Last, 0, sizeof(Worker_Last));
+      return;
+   }
+   snapshot = malloc(sizeof(weather_snapshot));
+   if (snapshot == NULL)
+      return;
+   *snapshot = Worker_Last;
+   free(__sync_lock_test_and_set(&Pending_Snapshot, snapshot));
+   weatherSnapshotApply();
+   fprintf(stderr,"Restored %u locations from %s\n",
+      Worker_Last.locations, CACHE_FILE);
+}
+
+int weatherWorkerStart(void)
+{
+   int rv = 0;
+
+   /* the device is served regardless; the config is picked up when it
+      is fixed, by SIGHUP or by the watch on ETC_FILE */
+   if (Worker_Config == NULL && Pending_Config == NULL &&
+      !weatherConfigReload())
+      fprintf(stderr,"No weather until %s can be read\n", ETC_FILE);
+   if (Snapshot_Event < 0)
+      Snapshot_Event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   /* made here so weatherWorkerStop can reach a fetch in progress */
+   if (Fetch_Context == NULL)
+      Fetch_Context = xoap_weather_context_new();
+   pthread_mutex_lock(&Worker_Mutex);
+   if (!Worker_Running) {
+      /* serve the cached values until the first refresh comes back */
+      weatherCacheRestore();
+      Worker_Stop = false;
+      if (pthread_create(&Worker_Thread, NULL, weatherWorker, NULL) == 0)
+         Worker_Running = true;
+      else {
+         fprintf(stderr,"Couldn't start the weather thread\n");
+         rv = -1;
+      }
+   }
+   pthread_mutex_unlock(&Worker_Mutex);
+
+   return rv;
+}
+
+void weatherWorkerStop(void)
+{
+   weather_snapshot *stale;
+
+   pthread_mutex_lock(&Worker_Mutex);
+   if (!Worker_Running) {
+      pthread_mutex_unlock(&Worker_Mutex);
+      return;
+   }
+   Worker_Stop = true;
+   pthread_cond_signal(&Worker_Cond);
+   pthread_mutex_unlock(&Worker_Mutex);
+   /* a refresh in progress gives up its transfers */
+   xoap_weather_context_stop(Fetch_Context);
+   pthread_join(Worker_Thread, NULL);
+   Worker_Running = false;
+   stale = __sync_lock_test_and_set(&Pending_Snapshot, NULL);
+   free(stale);
+   xoap_weather_context_free(Fetch_Context);
+   Fetch_Context = NULL;
+   freeParseConfig(__sync_lock_test_and_set(&Pending_Config, NULL));
+   freeParseConfig(Worker_Config);
+   Worker_Config = NULL;
+   xoap_weather_cleanup(NULL);
+   if (Snapshot_Event >= 0)
+      close(Snapshot_Event);
+   Snapshot_Event = -1;
+}
+
+int weatherSnapshotEvent(void)
+{
+   return Snapshot_Event;
+}
+
+bool weatherConfigReload(void)
+{
+   parse_config *config;
+
+   config = parseConfig(ETC_FILE);
+   if (config == NULL) {
+      fprintf(stderr,"Keeping the current settings\n");
+      return false;
+   }
+   /* the worker picks it up before its next refresh, which is now */
+   freeParseConfig(__sync_lock_test_and_set(&Pending_Config, config));
+   pthread_mutex_lock(&Worker_Mutex);
+   Worker_Wake = true;
+   pthread_cond_signal(&Worker_Cond);
+   pthread_mutex_unlock(&Worker_Mutex);
+
+   return true;
+}
+
+int weatherConfigWatch(void)
+{
+   char directory[] = ETC_FILE;
+   char *slash = strrchr(directory, '/');
+   int fd;
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd < 0)
+      return -1;
+   /* watch the directory: editors often replace the file with a new one */
+   if (slash)
+      *slash = '\0';
+   if (inotify_add_watch(fd, slash && slash != directory ? directory : "/",
+         IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+bool weatherConfigChanged(int fd)
+{
+   char buffer[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   const char *name = strrchr(ETC_FILE, '/');
+   const struct inotify_event *event;
+   bool changed = false;
+   ssize_t len;
+   char *ptr;
+
+   if (fd < 0)
+      return false;
+   name = name ? name + 1 : ETC_FILE;
+   while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (ptr = buffer; ptr < buffer + len;
+         ptr += sizeof(struct inotify_event) + event->len) {
+         event = (const struct inotify_event *) ptr;
+         if (event->len && strcmp(event->name, name) == 0)
+            changed = true;
+      }
+   }
+
+   return changed;
+}
+
+bool weatherSnapshotApply(void)
+{
+   weather_snapshot *snapshot;
+   ANALOG_INPUT_TABLE *table;
+   eventfd_t events;
+   bool resized;
+   unsigned count;
+   unsigned i;
+
+   /* clear the wakeup before taking the snapshot so a newer one rings again */
+   if (Snapshot_Event >= 0)
+      eventfd_read(Snapshot_Event, &events);
+   snapshot = __sync_lock_test_and_set(&Pending_Snapshot, NULL);
+   if (snapshot == NULL)
+      return false;
+   count = snapshot->locations * ANALOG_INPUTS_PER_LOCATION;
+   /* every point of the snapshot goes out in one generation */
+   table = Analog_Input_Update_Begin();
+   resized = count && (count != table->Instances);
+   if (resized)
+      table->Instances = count;
+   for (i = 0; i < MAX_ANALOG_INPUTS; i++) {
+      if (snapshot->valid[i]) {
+         table->Present_Value[i] = snapshot->value[i];
+         table->Update_Time[i] =
+            snapshot->updated[i / ANALOG_INPUTS_PER_LOCATION];
+      }
+   }
+   Analog_Input_Update_Commit(table);
+   if (resized) {
+      /* the object list changed with the location table */
+      Device_Set_Database_Revision(Device_Database_Revision() + 1);
+   }
+   /* served as proprietary properties of the Device */
+   Device_Set_Last_Refresh(snapshot->success, snapshot->duration_ms);
+   if (!snapshot->success)
+      fprintf(stderr,"Weather refresh failed for %u of %u locations after %u ms\n",
+         snapshot->failures, snapshot->locations,
+         (unsigned) snapshot->duration_ms);
+   free(snapshot);
+
+   return true;
 }
@@ -25,8 +25,90 @@
 #ifndef WEATHER_H
 #define WEATHER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "ai.h"
+#include "parser.h"
+
 #define ETC_FILE "/etc/bacnetwx"
+/* last good values, read back at startup so the points are never empty */
+#define CACHE_FILE "/var/cache/bacnetwx"
+
+/* seconds between successful refreshes, and between retries after a failure */
+#define WEATHER_REFRESH_SECONDS 3600
+#define WEATHER_RETRY_SECONDS 60
+
+/* A complete set of Analog Input values built by one refresh */
+typedef struct {
+   float value[MAX_ANALOG_INPUTS];
+   bool valid[MAX_ANALOG_INPUTS]; /* true if the point has ever been filled */
+   time_t updated[MAX_WEATHER_LOCATIONS]; /* last good fetch of each location */
+   unsigned locations;            /* locations in the config file */
+   unsigned failures;             /* locations that could not be fetched */
+   bool success;                  /* did every location succeed? */
+   time_t completed;              /* wall clock time the refresh finished */
+   time_t last_success;           /* wall clock time of the last good refresh */
+   uint32_t duration_ms;          /* how long the fetch and parse took */
+} weather_snapshot;
 
-int updateWeather();
+/*
+ *Fetches and parses the weather for every LOCID in config into snapshot,
+ *which must hold the values of the previous refresh so that points
+ *missing from this one are kept. Location n fills the Analog Inputs
+ *starting at instance n * ANALOG_INPUTS_PER_LOCATION.
+ *RETURN: 0 on success, -1 otherwise
+*/
+int updateWeather(
+   const parse_config *config,
+   weather_snapshot *snapshot);
+/*
+ *Reads ETC_FILE, loads the values saved in CACHE_FILE into the Analog
+ *Inputs, then starts the background thread that refreshes the weather. Every good refresh is
+ *saved back to CACHE_FILE. Must be called from the BACnet thread.
+ *Without a readable ETC_FILE the thread waits for weatherConfigReload.
+ *RETURN: 0 on success, -1 if the thread could not be created
+*/
+int weatherWorkerStart(
+   void);
+/*
+ *Stops the background thread and waits for it to finish
+*/
+void weatherWorkerStop(
+   void);
+/*
+ *Reads ETC_FILE again and hands the new settings to the background
+ *thread, which refreshes with them straight away. Nothing else reads the
+ *file. On an error the current settings are kept.
+ *RETURN: true if the file was read
+*/
+bool weatherConfigReload(
+   void);
+/*
+ *Watches ETC_FILE for changes
+ *RETURN: a non-blocking inotify descriptor, -1 if it can't be watched
+*/
+int weatherConfigWatch(
+   void);
+/*
+ *Reads the pending events of a weatherConfigWatch descriptor
+ *RETURN: true if ETC_FILE was written or replaced
+*/
+bool weatherConfigChanged(
+   int fd);
+/*
+ *Becomes readable each time the background thread publishes a snapshot;
+ *weatherSnapshotApply clears it
+ *RETURN: a non-blocking eventfd, -1 before weatherWorkerStart
+*/
+int weatherSnapshotEvent(
+   void);
+/*
+ *Copies the newest published snapshot into the Analog Inputs.
+ *Must be called from the BACnet thread.
+ *RETURN: true if a new snapshot was applied
+*/
+bool weatherSnapshotApply(
+   void);
 
 #endif
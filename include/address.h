@@ -49,6 +49,21 @@ extern "C" {
     void address_init_partial(
         void);
 
+    bool address_set_capacity(
+        unsigned capacity);
+
+    unsigned address_capacity(
+        void);
+
+    bool address_binding_save(
+        const char *pFilename);
+
+    bool address_binding_load(
+        const char *pFilename);
+
+    bool address_binding_changed(
+        void);
+
     void address_add(
         uint32_t device_id,
         unsigned max_apdu,
@@ -98,9 +113,6 @@ extern "C" {
         uint32_t TimeOut,
         bool StaticFlag);
 
-    void address_cache_timer(
-        uint16_t uSeconds);
-
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -27,8 +27,97 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 #include "bacdef.h"
 
+/* each weather location owns a block of this many instances */
+#ifndef ANALOG_INPUTS_PER_LOCATION
+#define ANALOG_INPUTS_PER_LOCATION 48
+#endif
+#ifndef MAX_WEATHER_LOCATIONS
+#define MAX_WEATHER_LOCATIONS 64
+#endif
+#ifndef MAX_ANALOG_INPUTS
+#define MAX_ANALOG_INPUTS (ANALOG_INPUTS_PER_LOCATION*MAX_WEATHER_LOCATIONS)
+#endif
+
+/* proprietary property - BACnetDateTime the present value was fetched,
+   or all wildcards if it never has been */
+#define PROP_AI_UPDATE_TIME 9996
+
+/* longest object name, with its terminator */
+#define ANALOG_INPUT_NAME_SIZE 40
+
+/* the points of one forecast day, from that day's first */
+typedef enum Analog_Input_Day_Point {
+    ANALOG_INPUT_DAY_HIGH,
+    ANALOG_INPUT_DAY_LOW,
+    ANALOG_INPUT_DAY_PRECIP,
+    ANALOG_INPUT_NIGHT_PRECIP,
+    ANALOG_INPUT_DAY_WIND,
+    ANALOG_INPUT_NIGHT_WIND,
+    ANALOG_INPUT_DAY_POINTS
+} ANALOG_INPUT_DAY_POINT;
+
+#define ANALOG_INPUT_FORECAST_DAYS 5
+
+/* the points of a location's block, in instance order; the weather
+   refresh stores each forecast field through these */
+typedef enum Analog_Input_Point_Index {
+    ANALOG_INPUT_CC_TEMP,
+    ANALOG_INPUT_CC_FEELS,
+    ANALOG_INPUT_CC_HUMIDITY,
+    ANALOG_INPUT_CC_VISIBILITY,
+    ANALOG_INPUT_CC_DEWPOINT,
+    ANALOG_INPUT_CC_BAROMETRIC,
+    ANALOG_INPUT_CC_UV_INDEX,
+    ANALOG_INPUT_CC_WIND,
+    ANALOG_INPUT_CC_GUST,
+    ANALOG_INPUT_CC_DIRECTION,
+    ANALOG_INPUT_RAIN_LAST_DAY,
+    ANALOG_INPUT_RAIN_LAST_HOUR,
+    /* the time of the last good refresh */
+    ANALOG_INPUT_UPDATED_HOUR,
+    ANALOG_INPUT_UPDATED_MINUTE,
+    ANALOG_INPUT_UPDATED_MONTH,
+    ANALOG_INPUT_UPDATED_DAY,
+    ANALOG_INPUT_UPDATED_YEAR,
+    /* ANALOG_INPUT_DAY_POINTS for each forecast day */
+    ANALOG_INPUT_FORECAST_FIRST,
+    ANALOG_INPUT_SPARE = ANALOG_INPUT_FORECAST_FIRST +
+        ANALOG_INPUT_FORECAST_DAYS * ANALOG_INPUT_DAY_POINTS,
+    ANALOG_INPUT_POINTS
+} ANALOG_INPUT_POINT_INDEX;
+
+/* each day's points, and the day itself, from 0 */
+#define ANALOG_INPUT_FORECAST_POINT(day, point) \
+    (ANALOG_INPUT_FORECAST_FIRST + (day) * ANALOG_INPUT_DAY_POINTS + (point))
+
+/* what one point of a location's block holds */
+typedef struct Analog_Input_Point {
+    const char *name;   /* the object name, less its instance number */
+    const char *description;
+    BACNET_ENGINEERING_UNITS units;
+    float cov_increment;
+} ANALOG_INPUT_POINT;
+
+/* an application tagged REAL, and a BACnetDateTime */
+#define ANALOG_INPUT_VALUE_APDU_LEN 5
+#define ANALOG_INPUT_UPDATE_TIME_APDU_LEN 10
+
+/* one generation of the Analog Input points */
+typedef struct Analog_Input_Table {
+    float Present_Value[MAX_ANALOG_INPUTS];
+    time_t Update_Time[MAX_ANALOG_INPUTS];  /* 0 if never fetched */
+    unsigned Instances; /* one block per configured weather location */
+    /* both of the above ready encoded, redone by
+       Analog_Input_Update_Commit for the points that changed */
+    uint8_t Present_Value_APDU[MAX_ANALOG_INPUTS]
+        [ANALOG_INPUT_VALUE_APDU_LEN];
+    uint8_t Update_Time_APDU[MAX_ANALOG_INPUTS]
+        [ANALOG_INPUT_UPDATE_TIME_APDU_LEN];
+} ANALOG_INPUT_TABLE;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -41,6 +130,8 @@ extern "C" {
         uint32_t object_instance);
     unsigned Analog_Input_Count(
         void);
+    bool Analog_Input_Count_Set(
+        unsigned count);
     uint32_t Analog_Input_Index_To_Instance(
         unsigned index);
     unsigned Analog_Input_Instance_To_Index(
@@ -48,6 +139,8 @@ extern "C" {
     bool Analog_Input_Object_Instance_Add(
         uint32_t instance);
 
+    const ANALOG_INPUT_POINT *Analog_Input_Point(
+        uint32_t object_instance);
     char *Analog_Input_Name(
         uint32_t object_instance);
     bool Analog_Input_Name_Set(
@@ -68,6 +161,7 @@ extern "C" {
 
     int Analog_Input_Encode_Property_APDU(
         uint8_t * apdu,
+        unsigned max_apdu,
         uint32_t object_instance,
         BACNET_PROPERTY_ID property,
         int32_t array_index,
@@ -78,6 +172,18 @@ extern "C" {
     void Analog_Input_Present_Value_Set(
         uint32_t object_instance,
         float value);
+    /* Returns a private copy of the current generation to change.
+       Readers never see it until Analog_Input_Update_Commit swaps it in;
+       only one update may be open at a time. */
+    ANALOG_INPUT_TABLE *Analog_Input_Update_Begin(
+        void);
+    void Analog_Input_Update_Commit(
+        ANALOG_INPUT_TABLE * next);
+    time_t Analog_Input_Update_Time(
+        uint32_t object_instance);
+    void Analog_Input_Update_Time_Set(
+        uint32_t object_instance,
+        time_t update_time);
     void Analog_Input_Init(
         void);
 
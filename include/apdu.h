@@ -58,6 +58,18 @@ typedef struct _confirmed_service_ack_data {
     uint8_t proposed_window_number;
 } BACNET_CONFIRMED_SERVICE_ACK_DATA;
 
+/* A reply being encoded in place.  Each piece is written at
+   &buffer[offset] and then taken with apdu_cursor_advance();
+   a piece that ends past max is left out and overflow is set.
+   The buffer must have MAX_APDU octets to spare past max, so that
+   a value can be written before it is known whether it fits. */
+typedef struct _apdu_cursor {
+    uint8_t *buffer;
+    unsigned offset;
+    unsigned max;
+    bool overflow;
+} BACNET_APDU_CURSOR;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -185,6 +197,19 @@ extern "C" {
     void apdu_retries_set(
         uint8_t value);
 
+    void apdu_cursor_init(
+        BACNET_APDU_CURSOR * cursor,
+        uint8_t * buffer,
+        unsigned offset,
+        unsigned max);
+    uint8_t *apdu_cursor_position(
+        BACNET_APDU_CURSOR * cursor);
+    unsigned apdu_cursor_room(
+        BACNET_APDU_CURSOR * cursor);
+    bool apdu_cursor_advance(
+        BACNET_APDU_CURSOR * cursor,
+        int len);
+
     void apdu_handler(
         BACNET_ADDRESS * src,   /* source address */
         uint8_t * apdu, /* APDU data */
@@ -88,6 +88,15 @@ extern "C" {
         uint8_t * apdu,
         uint8_t invoke_id,
         BACNET_ATOMIC_READ_FILE_DATA * data);
+/* stream access ACK for file data longer than fileData holds,
+   sent in segments */
+    int arf_ack_encode_stream_apdu(
+        uint8_t * apdu,
+        uint8_t invoke_id,
+        bool end_of_file,
+        int32_t start_position,
+        uint8_t * file_data,
+        uint32_t file_data_len);
 
 /* decode the service request only */
     int arf_ack_decode_service_request(
@@ -49,6 +49,8 @@ extern "C" {
     bool bacnet_address_same(
         BACNET_ADDRESS * dest,
         BACNET_ADDRESS * src);
+    uint32_t bacnet_address_hash(
+        BACNET_ADDRESS * address);
 
 #ifdef __cplusplus
 }
@@ -44,6 +44,29 @@
 #include "bacreal.h"
 #include "bits.h"
 
+/* A position in an APDU being decoded.  Nothing is ever read at or
+   past end: a read that would is refused, the cursor stays where it
+   was, and error is set. */
+typedef struct bacnet_decode_cursor {
+    const uint8_t *ptr;
+    const uint8_t *end;
+    bool error;
+} BACNET_DECODE_CURSOR;
+
+/* kinds of tag, which may be or'd together */
+#define BACNET_TAG_CONTEXT 0x01
+#define BACNET_TAG_OPENING 0x02
+#define BACNET_TAG_CLOSING 0x04
+/* more octets follow the first: an extended number or length */
+#define BACNET_TAG_EXTENDED 0x80
+
+/* one decoded tag */
+typedef struct bacnet_tag {
+    uint8_t number;
+    uint8_t kind;
+    uint32_t len_value_type;    /* length, or the value of a boolean */
+} BACNET_TAG;
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -393,6 +416,66 @@ extern "C" {
         uint8_t invoke_id,
         uint8_t service_choice);
 
+/* decoding through a cursor - each returns true if it decoded, or
+   false with the cursor where it was; the _safe decoders wrap these */
+    bool decode_cursor_skip(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len);
+/* any tag the one-octet table does not cover */
+    bool decode_cursor_tag_extended(
+        BACNET_DECODE_CURSOR * cursor,
+        BACNET_TAG * tag);
+/* the content octets of a primitive value of len_value octets */
+    bool decode_cursor_unsigned(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        uint32_t * value);
+    bool decode_cursor_signed(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        int32_t * value);
+    bool decode_cursor_real(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        float *value);
+    bool decode_cursor_double(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        double *value);
+    bool decode_cursor_date(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        BACNET_DATE * bdate);
+    bool decode_cursor_time(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        BACNET_TIME * btime);
+    bool decode_cursor_object_id(
+        BACNET_DECODE_CURSOR * cursor,
+        uint32_t len_value,
+        int *object_type,
+        uint32_t * instance);
+/* a tag and its value, only if the tag is the given one; a different
+   tag, or none at the end, is left for the caller and is not an error */
+    bool decode_cursor_opening_tag(
+        BACNET_DECODE_CURSOR * cursor,
+        uint8_t tag_number);
+    bool decode_cursor_closing_tag(
+        BACNET_DECODE_CURSOR * cursor,
+        uint8_t tag_number);
+    bool decode_cursor_context_unsigned(
+        BACNET_DECODE_CURSOR * cursor,
+        uint8_t tag_number,
+        uint32_t * value);
+    bool decode_cursor_context_object_id(
+        BACNET_DECODE_CURSOR * cursor,
+        uint8_t tag_number,
+        int *object_type,
+        uint32_t * instance);
+
+/* what the first octet of a tag says, for each value of it */
+    extern const BACNET_TAG bacnet_tag_table[256];
+
 /* from clause 20.2.1.3.2 Constructed Data */
 /* true if extended tag numbering is used */
 #define IS_EXTENDED_TAG_NUMBER(x) ((x & 0xF0) == 0xF0)
@@ -404,6 +487,41 @@ extern "C" {
 /* from clause 20.2.1.3.2 Constructed Data */
 /* true if the tag is context specific */
 #define IS_CONTEXT_SPECIFIC(x) ((x & BIT3) == BIT3)
+
+    static inline void decode_cursor_init(
+        BACNET_DECODE_CURSOR * cursor,
+        const uint8_t * apdu,
+        unsigned apdu_len)
+    {
+        cursor->ptr = apdu;
+        cursor->end = apdu + apdu_len;
+        cursor->error = false;
+    }
+
+    static inline unsigned decode_cursor_remaining(
+        const BACNET_DECODE_CURSOR * cursor)
+    {
+        return (unsigned) (cursor->end - cursor->ptr);
+    }
+
+/* Decodes a tag.  One octet tags, nearly all of them, come straight
+   from the table; the rest go the long way. */
+    static inline bool decode_cursor_tag(
+        BACNET_DECODE_CURSOR * cursor,
+        BACNET_TAG * tag)
+    {
+        const BACNET_TAG *entry;
+
+        if (cursor->ptr < cursor->end) {
+            entry = &bacnet_tag_table[*cursor->ptr];
+            if (!(entry->kind & BACNET_TAG_EXTENDED)) {
+                *tag = *entry;
+                cursor->ptr++;
+                return true;
+            }
+        }
+        return decode_cursor_tag_extended(cursor, tag);
+    }
 #ifdef __cplusplus
 
 }
@@ -66,11 +66,20 @@ extern "C" {
     /* invokeID and file instance in a list or table */
     /* when the request was sent */
     uint32_t bacfile_instance_from_tsm(
+        BACNET_ADDRESS * src,
         uint8_t invokeID);
 
     /* handler ACK helper */
     bool bacfile_read_data(
         BACNET_ATOMIC_READ_FILE_DATA * data);
+    /* reads up to requested octets into buffer */
+    bool bacfile_read_stream_data(
+        uint32_t object_instance,
+        int32_t start_position,
+        uint8_t * buffer,
+        size_t requested,
+        size_t * length,
+        bool * end_of_file);
     bool bacfile_write_stream_data(
         BACNET_ATOMIC_WRITE_FILE_DATA * data);
 
@@ -80,6 +89,7 @@ extern "C" {
 /* handling for read property service */
     int bacfile_encode_property_apdu(
         uint8_t * apdu,
+        unsigned max_apdu,
         uint32_t object_instance,
         BACNET_PROPERTY_ID property,
         int32_t array_index,
@@ -47,6 +47,18 @@
 
 #define BVLL_TYPE_BACNET_IP (0x81)
 
+/* most datagrams moved by one recvmmsg or sendmmsg call */
+#ifndef BIP_BATCH_SIZE
+#define BIP_BATCH_SIZE 16
+#endif
+
+/* one BVLL message as it came off the socket */
+typedef struct bip_mpdu {
+    struct sockaddr_in sin;     /* who sent it - network byte order */
+    uint16_t mpdu_len;
+    uint8_t mpdu[MAX_MPDU];
+} BIP_MPDU;
+
 extern bool BIP_Debug;
 
 #ifdef __cplusplus
@@ -81,6 +93,16 @@ extern "C" {
         uint8_t * pdu,  /* any data to be sent - may be null */
         unsigned pdu_len);      /* number of bytes of data */
 
+    /* receives a BACnet/IP packet into mpdu and points npdu at the NPDU
+       inside it, without copying */
+    /* returns the number of octets in the NPDU, or zero on failure */
+    uint16_t bip_receive_view(
+        BACNET_ADDRESS * src,   /* source address */
+        uint8_t * mpdu, /* buffer for the whole BVLL message */
+        uint16_t max_mpdu,      /* amount of space available in mpdu */
+        uint8_t ** npdu,        /* returns the start of the NPDU in mpdu */
+        unsigned timeout);      /* milliseconds to wait for a packet */
+
     /* receives a BACnet/IP packet */
     /* returns the number of octets in the PDU, or zero on failure */
     uint16_t bip_receive(
@@ -89,6 +111,50 @@ extern "C" {
         uint16_t max_pdu,       /* amount of space available in the PDU  */
         unsigned timeout);      /* milliseconds to wait for a packet */
 
+    /* receives every datagram already queued on the socket, up to count
+       (at most BIP_BATCH_SIZE), with one recvmmsg call */
+    /* returns the number of messages received */
+    int bip_receive_batch(
+        BIP_MPDU * mpdus,
+        unsigned count,
+        unsigned timeout);      /* milliseconds to wait for the first one */
+    /* finds the NPDU in a message from bip_receive_batch */
+    /* returns the number of octets in the NPDU, or zero if there is none */
+    uint16_t bip_handle_mpdu(
+        BACNET_ADDRESS * src,   /* source address */
+        BIP_MPDU * mpdu,
+        uint8_t ** npdu);       /* returns the start of the NPDU in mpdu */
+
+    /* sends a whole BVLL message; between bip_send_batch_begin and
+       bip_send_batch_end it is queued and sent with sendmmsg instead */
+    /* returns the number of bytes sent or queued, negative on failure */
+    int bip_send_mpdu(
+        struct sockaddr_in *dest,       /* network byte order */
+        uint8_t * mtu,
+        uint16_t mtu_len);
+    /* like bip_send_mpdu, with the BVLC header apart from the PDU;
+       outside a batch both go to sendmsg without being copied */
+    int bip_send_mpdu_header(
+        struct sockaddr_in *dest,       /* network byte order */
+        uint8_t * header,
+        uint16_t header_len,
+        uint8_t * pdu,
+        uint16_t pdu_len);
+    /* sends one message to every destination with sendmmsg; unlike
+       bip_send_mpdu it is safe to call from another thread */
+    /* returns the number of datagrams sent, negative on failure */
+    int bip_send_mpdu_fanout(
+        struct sockaddr_in *dests,      /* network byte order */
+        unsigned count,
+        uint8_t * mtu,
+        uint16_t mtu_len);
+    /* starts holding back datagrams; calls may nest */
+    void bip_send_batch_begin(
+        void);
+    /* sends what was held back once the outermost batch ends */
+    void bip_send_batch_end(
+        void);
+
     /* use host byte order for setting */
     void bip_set_port(
         uint16_t port);
@@ -40,24 +40,56 @@
 #include <time.h>
 #include "bacdef.h"
 #include "npdu.h"
+#include "bip.h"
+
+/* BBMD forwarding counters */
+typedef struct bvlc_forward_stats {
+    /* Forwarded-NPDUs sent, one per destination */
+    uint32_t forwarded;
+    /* messages handed to the forwarding thread */
+    uint32_t queued;
+    /* messages forwarded on the receiving thread instead */
+    uint32_t direct;
+    /* messages waiting for the forwarding thread now, and at most */
+    uint32_t depth;
+    uint32_t max_depth;
+} BVLC_FORWARD_STATS;
 
 #ifdef __cplusplus
 extern "C" {
 
 #endif /* __cplusplus */
 
-#if defined(BBMD_ENABLED) && BBMD_ENABLED
-    void bvlc_maintenance_timer(
-        time_t seconds);
-#else
-#define bvlc_maintenance_timer(x)
-#endif
     /* registers with a bbmd as a foreign device */
     void bvlc_register_with_bbmd(
         long bbmd_address,      /* in network byte order */
         uint16_t bbmd_port,
         uint16_t time_to_live_seconds);
 
+    /* moves BBMD fan-out to its own thread, so broadcasts are queued
+       rather than forwarded before bvlc_receive returns */
+    bool bvlc_forward_start(
+        void);
+    /* sends what is queued and stops the thread */
+    void bvlc_forward_stop(
+        void);
+    void bvlc_forward_stats(
+        BVLC_FORWARD_STATS * stats);
+
+    /* like bvlc_receive, but leaves the NPDU where it was received */
+    uint16_t bvlc_receive_view(
+        BACNET_ADDRESS * src,   /* returns the source address */
+        uint8_t * mpdu, /* buffer for the whole BVLL message */
+        uint16_t max_mpdu,      /* amount of space available in mpdu */
+        uint8_t ** npdu,        /* returns the start of the NPDU in mpdu */
+        unsigned timeout);      /* number of milliseconds to wait for a packet */
+
+    /* handles a message from bip_receive_batch like bvlc_receive_view */
+    uint16_t bvlc_handle_mpdu(
+        BACNET_ADDRESS * src,   /* returns the source address */
+        BIP_MPDU * mpdu,
+        uint8_t ** npdu);       /* returns the start of the NPDU in mpdu */
+
     uint16_t bvlc_receive(
         BACNET_ADDRESS * src,   /* returns the source address */
         uint8_t * npdu, /* returns the NPDU */
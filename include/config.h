@@ -77,14 +77,35 @@
 #endif
 #endif
 
+/* Number of MAX_APDU sized segments that a ComplexACK we send, or a */
+/* segmented message we reassemble, may span: 2, 4, 8, 16, 32 or 64. */
+/* Configure to 1 to turn segmentation off. */
+#if !defined(MAX_SEGMENTS_ACCEPTED)
+#define MAX_SEGMENTS_ACCEPTED 32
+#endif
+#define MAX_APDU_SEGMENTED (MAX_APDU * MAX_SEGMENTS_ACCEPTED)
+/* segmented transfers that may be in progress at one time */
+#if !defined(MAX_SEGMENT_TRANSACTIONS)
+#define MAX_SEGMENT_TRANSACTIONS 8
+#endif
+/* segments we send or accept before waiting for a SegmentACK */
+#if !defined(SEGMENT_WINDOW_SIZE)
+#define SEGMENT_WINDOW_SIZE 16
+#endif
+
 /* for confirmed messages, this is the number of transactions */
 /* that we hold in a queue waiting for timeout. */
 /* Configure to zero if you don't want any confirmed messages */
-/* Configure from 1..255 for number of outstanding confirmed */
-/* requests available. */
+/* Configure from 1..65535 for number of outstanding confirmed */
+/* requests available, across all the devices we talk to. */
 #if !defined(MAX_TSM_TRANSACTIONS)
 #define MAX_TSM_TRANSACTIONS 255
 #endif
+/* Invoke IDs are only unique per device, so each device we talk */
+/* to can have 1..255 outstanding confirmed requests of its own. */
+#if !defined(MAX_TSM_PEER_TRANSACTIONS)
+#define MAX_TSM_PEER_TRANSACTIONS 255
+#endif
 /* The address cache is used for binding to BACnet devices */
 /* The number of entries corresponds to the number of */
 /* devices that might respond to an I-Am on the network. */
@@ -75,9 +75,13 @@
 #if defined(BBMD_ENABLED) && BBMD_ENABLED
 #define datalink_send_pdu bvlc_send_pdu
 #define datalink_receive bvlc_receive
+#define datalink_receive_view bvlc_receive_view
+#define datalink_handle_mpdu bvlc_handle_mpdu
 #else
 #define datalink_send_pdu bip_send_pdu
 #define datalink_receive bip_receive
+#define datalink_receive_view bip_receive_view
+#define datalink_handle_mpdu bip_handle_mpdu
 #endif
 #define datalink_cleanup bip_cleanup
 #define datalink_get_broadcast_address bip_get_broadcast_address
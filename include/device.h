@@ -40,6 +40,11 @@
 #include "bacenum.h"
 #include "wp.h"
 
+/* proprietary properties - how long the last weather refresh took, in
+   milliseconds, and whether every location of it succeeded */
+#define PROP_DEVICE_REFRESH_DURATION 9994
+#define PROP_DEVICE_REFRESH_SUCCESS 9995
+
 typedef unsigned (
     *object_count_function) (
     void);
@@ -140,6 +145,10 @@ extern "C" {
     void Device_Set_Database_Revision(
         uint8_t revision);
 
+    void Device_Set_Last_Refresh(
+        bool success,
+        uint32_t duration_ms);
+
     bool Device_Valid_Object_Name(
         const char *object_name,
         int *object_type,
@@ -150,6 +159,7 @@ extern "C" {
 
     int Device_Encode_Property_APDU(
         uint8_t * apdu,
+        unsigned max_apdu,
         uint32_t object_instance,
         BACNET_PROPERTY_ID property,
         int32_t array_index,
@@ -167,6 +167,7 @@ extern "C" {
     /* resides in h_rp.c */
     int Encode_Property_APDU(
         uint8_t * apdu,
+        unsigned max_apdu,
         BACNET_OBJECT_TYPE object_type,
         uint32_t object_instance,
         BACNET_PROPERTY_ID property,
@@ -51,6 +51,7 @@ extern "C" {
 
     int Multistate_Input_Encode_Property_APDU(
         uint8_t * apdu,
+        unsigned max_apdu,
         uint32_t object_instance,
         BACNET_PROPERTY_ID property,
         int32_t array_index,
@@ -76,6 +76,12 @@ extern "C" {
         BACNET_ADDRESS * src,
         BACNET_NPDU_DATA * npdu_data);
 
+    /* same as npdu_encode_pdu with no src, from pre-encoded headers */
+    int npdu_encode_apdu_header(
+        uint8_t * npdu,
+        BACNET_ADDRESS * dest,
+        BACNET_NPDU_DATA * npdu_data);
+
     void npdu_encode_npdu_data(
         BACNET_NPDU_DATA * npdu,
         bool data_expecting_reply,
@@ -51,6 +51,7 @@ typedef struct BACnet_Read_Property_Data {
 typedef int (
     *read_property_function) (
     uint8_t * apdu,
+    unsigned max_apdu,
     uint32_t object_instance,
     BACNET_PROPERTY_ID property,
     int32_t array_index,
@@ -0,0 +1,114 @@
+/*####COPYRIGHTBEGIN####
+ -------------------------------------------
+ Copyright (C) 2006 Steve Karg
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to:
+ The Free Software Foundation, Inc.
+ 59 Temple Place - Suite 330
+ Boston, MA  02111-1307, USA.
+
+ As a special exception, if other files instantiate templates or
+ use macros or inline functions from this file, or you compile
+ this file and link it with other works to produce a work based
+ on this file, this file does not by itself cause the resulting
+ work to be covered by the GNU General Public License. However
+ the source code for this file must still be made available in
+ accordance with section (3) of the GNU General Public License.
+
+ This exception does not invalidate any other reasons why a work
+ based on this file might be covered by the GNU General Public
+ License.
+ -------------------------------------------
+####COPYRIGHTEND####*/
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bacdef.h"
+#include "apdu.h"
+#include "npdu.h"
+
+/* Windowed segmentation of APDUs (clause 5.2 and 5.4).
+   A ComplexACK longer than the requester takes in one message is
+   kept here and sent one window of segments at a time, moving on as
+   each SegmentACK comes back.  Segmented requests and ComplexACKs
+   that we receive are put back together and passed to apdu_handler()
+   as a single unsegmented APDU. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+    /* the segment timeout in milliseconds: how long a SegmentACK is
+       waited for before segments are sent again; a segmented message
+       being received is given up after four of them */
+    uint16_t segment_timeout(
+        void);
+
+    /* longest APDU that a reply to this request may be, across every
+       segment the requester said it would accept */
+    unsigned segment_reply_max_apdu(
+        BACNET_CONFIRMED_SERVICE_DATA * service_data);
+
+    /* sends the reply encoded at &pdu[npdu_len] after its NPDU header.
+       A ComplexACK too long for one message is sent in segments, or
+       replaced by an Abort if the requester can't take it that way */
+    /* returns the number of bytes sent, negative on failure */
+    int segment_send_pdu(
+        BACNET_ADDRESS * dest,
+        BACNET_NPDU_DATA * npdu_data,
+        BACNET_CONFIRMED_SERVICE_DATA * service_data,
+        uint8_t * pdu,
+        unsigned npdu_len,
+        unsigned apdu_len);
+
+    /* a segment of a ConfirmedRequest or ComplexACK */
+    void segment_receive(
+        BACNET_ADDRESS * src,
+        uint8_t * apdu,
+        uint16_t apdu_len);
+
+    void segment_ack_handler(
+        BACNET_ADDRESS * src,
+        uint8_t * apdu,
+        uint16_t apdu_len);
+
+    /* an Abort ends any transfer with that peer and invoke ID */
+    void segment_abort_handler(
+        BACNET_ADDRESS * src,
+        uint8_t invoke_id,
+        bool server);
+
+    int segment_ack_encode_apdu(
+        uint8_t * apdu,
+        bool negative_ack,
+        bool server,
+        uint8_t invoke_id,
+        uint8_t sequence_number,
+        uint8_t actual_window_size);
+
+    /* segments sent, or accepted, before a SegmentACK: 1..127 */
+    void segment_window_size_set(
+        uint8_t window);
+    uint8_t segment_window_size(
+        void);
+
+    unsigned segment_transactions_active(
+        void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif
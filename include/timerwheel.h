@@ -0,0 +1,105 @@
+/*####COPYRIGHTBEGIN####
+ -------------------------------------------
+ Copyright (C) 2006 Steve Karg
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to:
+ The Free Software Foundation, Inc.
+ 59 Temple Place - Suite 330
+ Boston, MA  02111-1307, USA.
+
+ As a special exception, if other files instantiate templates or
+ use macros or inline functions from this file, or you compile
+ this file and link it with other works to produce a work based
+ on this file, this file does not by itself cause the resulting
+ work to be covered by the GNU General Public License. However
+ the source code for this file must still be made available in
+ accordance with section (3) of the GNU General Public License.
+
+ This exception does not invalidate any other reasons why a work
+ based on this file might be covered by the GNU General Public
+ License.
+ -------------------------------------------
+####COPYRIGHTEND####*/
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Hierarchical timing wheel with a one millisecond tick.
+   Every level has 64 slots; a timer lives in the lowest level
+   whose span still covers its expiry and is cascaded down as the
+   wheel turns, so advancing the clock only costs the timers that
+   fire (plus one cascade every 64 ticks per level in use). */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 5
+/* returned by timer_wheel_next() when nothing is scheduled */
+#define TIMER_WHEEL_IDLE UINT32_MAX
+
+struct bacnet_timer;
+typedef void (
+    *timer_wheel_callback) (
+    struct bacnet_timer * timer);
+
+/* embed one per object that needs a timeout; it is zeroed
+   (inactive) when declared static */
+typedef struct bacnet_timer {
+    struct bacnet_timer *next;
+    struct bacnet_timer *prev;
+    /* absolute expiry on the wheel clock, in milliseconds */
+    uint64_t expires;
+    timer_wheel_callback callback;
+    uint8_t level;
+    uint8_t slot;
+    bool active;
+} BACNET_TIMER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+    /* (re)starts the timer so that callback runs once the
+       wheel has advanced by at least milliseconds */
+    void timer_wheel_start(
+        BACNET_TIMER * timer,
+        uint32_t milliseconds,
+        timer_wheel_callback callback);
+
+    void timer_wheel_stop(
+        BACNET_TIMER * timer);
+
+    bool timer_wheel_active(
+        BACNET_TIMER * timer);
+
+    /* milliseconds left before the timer fires, 0 if inactive */
+    uint32_t timer_wheel_remaining(
+        BACNET_TIMER * timer);
+
+    /* advances the clock and runs every timer that expires */
+    void timer_wheel_milliseconds(
+        uint32_t milliseconds);
+
+    /* milliseconds the clock can advance before a timer
+       may fire, or TIMER_WHEEL_IDLE if none are running */
+    uint32_t timer_wheel_next(
+        void);
+
+    uint64_t timer_wheel_now(
+        void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif
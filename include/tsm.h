@@ -39,11 +39,12 @@
 #include <stddef.h>
 #include "bacdef.h"
 #include "npdu.h"
+#include "timerwheel.h"
 
 /* note: TSM functionality is optional - only needed if we are 
    doing client requests */
 #if (!MAX_TSM_TRANSACTIONS)
-#define tsm_free_invoke_id(x) (void)x;
+#define tsm_free_invoke_id(x,y) (void)y;
 #else
 typedef enum {
     TSM_STATE_IDLE,
@@ -75,8 +76,7 @@ typedef struct BACnet_TSM_Data {
     /*  used to perform timeout on PDU segments */
     /*uint8_t SegmentTimer; */
     /* used to perform timeout on Confirmed Requests */
-    /* in milliseconds */
-    uint16_t RequestTimer;
+    BACNET_TIMER RequestTimer;
     /* unique id */
     uint8_t InvokeID;
     /* state that the TSM is in */
@@ -96,16 +96,25 @@ extern "C" {
 
     bool tsm_transaction_available(
         void);
-    uint8_t tsm_transaction_idle_count(
+    uint16_t tsm_transaction_idle_count(
         void);
     void tsm_timer_milliseconds(
         uint16_t milliseconds);
+/* most transactions one peer may have outstanding, 1..255 */
+    void tsm_peer_window_set(
+        uint8_t window);
+    uint8_t tsm_peer_window(
+        void);
+/* invoke IDs are unique per peer, so every call takes the peer address:
+   the destination of the request, or the source of the reply */
 /* free the invoke ID when the reply comes back */
     void tsm_free_invoke_id(
+        BACNET_ADDRESS * src,
         uint8_t invokeID);
 /* use these in tandem */
+/* returns 0 if the table is full or the peer's window is */
     uint8_t tsm_next_free_invokeID(
-        void);
+        BACNET_ADDRESS * dest);
 /* returns the same invoke ID that was given */
     void tsm_set_confirmed_unsegmented_transaction(
         uint8_t invokeID,
@@ -113,7 +122,7 @@ extern "C" {
         BACNET_NPDU_DATA * ndpu_data,
         uint8_t * apdu,
         uint16_t apdu_len);
-/* returns true if transaction is found */
+/* returns true if transaction is found; dest is the peer it was sent to */
     bool tsm_get_transaction_pdu(
         uint8_t invokeID,
         BACNET_ADDRESS * dest,
@@ -122,8 +131,10 @@ extern "C" {
         uint16_t * apdu_len);
 
     bool tsm_invoke_id_free(
+        BACNET_ADDRESS * dest,
         uint8_t invokeID);
     bool tsm_invoke_id_failed(
+        BACNET_ADDRESS * dest,
         uint8_t invokeID);
 
 #ifdef __cplusplus
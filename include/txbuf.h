@@ -30,6 +30,10 @@
 #include "config.h"
 #include "datalink.h"
 
-extern uint8_t Handler_Transmit_Buffer[MAX_PDU];
+/* replies are encoded in place, with room for one more value past
+   the largest segmented PDU in case it does not fit */
+#define MAX_TRANSMIT_BUFFER (MAX_PDU_SEGMENTED + MAX_APDU)
+
+extern uint8_t Handler_Transmit_Buffer[MAX_TRANSMIT_BUFFER];
 
 #endif
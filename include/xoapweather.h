@@ -40,6 +40,7 @@
 #include <curl/curl.h>
 #include <curl/types.h>
 #include <curl/easy.h>
+#include <curl/multi.h>
 #ifdef macos
 #include <libxml2/libxml/xmlmemory.h>
 #include <libxml2/libxml/parser.h>
@@ -105,6 +106,23 @@
 	(v) = ((float)atof((char *)con)); \
 	XOAPW_SE_END
 
+/** Macro: Storing streamed element content (STRING) */
+#define XOAPW_STS(n, s, t, v) \
+	if (!strcmp((n), (s))) { \
+		XOAPW_FREE(v); \
+		(v) = strdup((t)); \
+	}
+
+/** Macro: Storing streamed element content (SHORT) */
+#define XOAPW_STI(n, s, t, v) \
+	if (!strcmp((n), (s))) \
+		(v) = ((short)atoi((t)));
+
+/** Macro: Storing streamed element content (FLOAT) */
+#define XOAPW_STF(n, s, t, v) \
+	if (!strcmp((n), (s))) \
+		(v) = ((float)atof((t)));
+
 /** Macro: test before attempting to free */
 #define XOAPW_FREE(o) \
 	if((o)) \
@@ -261,6 +279,30 @@ typedef struct {
 	char *station_id;
 } xoap_weather_rain;
 
+/** Kinds of document the streaming parser understands */
+typedef enum {
+	/** TWCi local weather, result is a xoap_weather_forecast */
+	XOAP_WEATHER_STREAM_FORECAST,
+	/** Weather Underground geo lookup, result is a xoap_weather_rain */
+	XOAP_WEATHER_STREAM_RAIN_STATIONS,
+	/** Weather Underground observation, result is a xoap_weather_rain */
+	XOAP_WEATHER_STREAM_RAIN_OBS
+} xoap_weather_stream_type;
+
+/** Streaming parser state (opaque) */
+typedef struct xoap_weather_stream xoap_weather_stream;
+
+/** One location for xoap_weather_fetch_multi() */
+typedef struct {
+	xoap_weather_handle *hand;		// location and options to fetch
+	xoap_weather_forecast *forecast;	// result, NULL if the fetch failed
+	xoap_weather_rain *rain;		// result, NULL if the fetch failed
+	int not_modified;			// forecast unchanged since the last fetch
+} xoap_weather_request;
+
+/** Connections, validators and last results kept between fetches (opaque) */
+typedef struct xoap_weather_context xoap_weather_context;
+
 /** Used only for when storing the fetched xml document in memory */
 struct xoap_weather_memory {
 	char *memory;
@@ -276,6 +318,19 @@ struct xoap_weather_memory {
  */
 xoap_weather_handle* xoap_weather_init(const char *ptID, const char *lkey);
 
+/**
+ * Create another handle that shares the partner ID and license key
+ * given to xoap_weather_init(), e.g. one per location
+ * RETURN: [failed: NULL] [success: a xoap_weather_handle object]
+ */
+xoap_weather_handle* xoap_weather_handle_new(void);
+
+/**
+ * Frees a handle made by xoap_weather_handle_new()
+ * RETURN: NONE
+ */
+void xoap_weather_handle_free(xoap_weather_handle *hand);
+
 /**
  * Use to set options for the handle object
  * RETURN: [failed: 1] [success: 0]
@@ -293,13 +348,92 @@ xoap_weather_locs* xoap_weather_search(const char *loc);
  * Get the rain conditions from Weather Underground
  * RETURN: [failed: NULL] [success: a xoap_weather_rain object]
  */
-xoap_weather_rain* xoap_weather_rain(xoap_weather_handle *hand);
+xoap_weather_rain* xoap_weather_fetch_rain(const xoap_weather_handle *hand);
 /**
  * Fetch the forecast for a LocID (set in the handle object)
  * RETURN: [failed: NULL] [success: a xoap_weather_forecast object]
  */
 xoap_weather_forecast* xoap_weather_fetch(const xoap_weather_handle *hand);
 
+/**
+ * Create a context for xoap_weather_fetch_multi(). Keep it for the life of
+ * the program so connections are reused and unchanged documents are not
+ * downloaded again.
+ * RETURN: [failed: NULL] [success: a xoap_weather_context object]
+ */
+xoap_weather_context* xoap_weather_context_new(void);
+
+/**
+ * Send every request through an HTTP proxy, e.g. "http://127.0.0.1:3128".
+ * NULL goes back to a direct connection.
+ * RETURN: NONE
+ */
+void xoap_weather_context_proxy(xoap_weather_context *ctx, const char *proxy);
+
+/**
+ * Makes a fetch running on the context in another thread give up within
+ * a second, and every later fetch fail at once. Safe from any thread.
+ * RETURN: NONE
+ */
+void xoap_weather_context_stop(xoap_weather_context *ctx);
+
+/**
+ * Frees a context and every result it holds
+ * RETURN: NONE
+ */
+void xoap_weather_context_free(xoap_weather_context *ctx);
+
+/**
+ * Fetch the forecast and rain for many locations at once. All transfers
+ * run concurrently on the context's curl multi handle, so the time taken
+ * does not grow with the number of locations. Each request is sent with
+ * the ETag and Last-Modified of the last reply; on 304 Not Modified the
+ * last result is reused and not_modified is set.
+ * Results belong to the context and stay valid until the next fetch with
+ * it or xoap_weather_context_free(); do not free them.
+ * RETURN: [failed: -1] [success: number of locations without a forecast]
+ */
+int xoap_weather_fetch_multi(xoap_weather_context *ctx, xoap_weather_request *req, int count);
+
+/**
+ * Allocate an empty forecast sized for the fetch type set in the handle
+ * RETURN: [failed: NULL] [success: a xoap_weather_forecast object]
+ */
+xoap_weather_forecast* xoap_weather_forecast_new(const xoap_weather_handle *hand);
+
+/**
+ * Parse a forecast document already held in memory (builds a DOM tree)
+ * RETURN: [failed: NULL] [success: a xoap_weather_forecast object]
+ */
+xoap_weather_forecast* xoap_weather_parse_memory(const xoap_weather_handle *hand, const struct xoap_weather_memory *xml);
+
+/**
+ * curl write callback that appends each chunk to a xoap_weather_memory
+ * RETURN: number of bytes stored
+ */
+size_t xoap_weather_memory_callback(void *ptr, size_t size, size_t nmemb, void *data);
+
+/**
+ * Start a streaming parse that stores each element into result as soon as
+ * it has been read, so the document is never held in memory. result is a
+ * xoap_weather_forecast from xoap_weather_forecast_new() or a
+ * xoap_weather_rain, as given by type.
+ * RETURN: [failed: NULL] [success: a xoap_weather_stream object]
+ */
+xoap_weather_stream* xoap_weather_stream_new(xoap_weather_stream_type type, void *result);
+
+/**
+ * curl write callback that feeds each chunk to a xoap_weather_stream
+ * RETURN: number of bytes consumed, 0 to abort the transfer on error
+ */
+size_t xoap_weather_stream_callback(void *ptr, size_t size, size_t nmemb, void *data);
+
+/**
+ * Ends the document and frees the stream
+ * RETURN: [failed: 1] [success: 0]
+ */
+int xoap_weather_stream_finish(xoap_weather_stream *stream);
+
 /**
  * Frees any memory that may have been used by globals
  * RETURN: NONE
@@ -229,8 +229,10 @@ int ethernet_send_pdu(
     int i = 0;  /* counter */
     int bytes = 0;
     BACNET_ADDRESS src = { 0 }; /* source address for npdu */
-    uint8_t mtu[MAX_MPDU] = { 0 };      /* our buffer */
+    uint8_t mtu[17] = { 0 };    /* MAC and LLC header */
     int mtu_len = 0;
+    struct msghdr msg = { 0 };
+    struct iovec iov[2];
 
     (void) npdu_data;
     /* load the BACnet address for NPDU data */
@@ -272,15 +274,19 @@ int ethernet_send_pdu(
         fprintf(stderr, "ethernet: PDU is too big to send!\n");
         return -4;
     }
-    memcpy(&mtu[mtu_len], pdu, pdu_len);
-    mtu_len += pdu_len;
     /* packet length - only the logical portion, not the address */
     encode_unsigned16(&mtu[12], 3 + pdu_len);
 
-    /* Send the packet */
-    bytes =
-        sendto(eth802_sockfd, &mtu, mtu_len, 0, (struct sockaddr *) &eth_addr,
-        sizeof(struct sockaddr));
+    /* Send the packet - the PDU is not copied behind the header */
+    iov[0].iov_base = mtu;
+    iov[0].iov_len = mtu_len;
+    iov[1].iov_base = pdu;
+    iov[1].iov_len = pdu_len;
+    msg.msg_name = &eth_addr;
+    msg.msg_namelen = sizeof(struct sockaddr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    bytes = sendmsg(eth802_sockfd, &msg, 0);
     /* did it get sent? */
     if (bytes < 0)
         fprintf(stderr, "ethernet: Error sending packet: %s\n",
@@ -36,23 +36,69 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "config.h"
 #include "bacaddr.h"
 #include "address.h"
 #include "bacdef.h"
 #include "bacdcode.h"
+#include "timerwheel.h"
 
 /* This module is used to handle the address binding that */
 /* occurs in BACnet.  A device id is bound to a MAC address. */
 /* The normal method is using Who-Is, and using the data from I-Am */
 
-static struct Address_Cache_Entry {
+/* Entries are found through two hash indexes, one on the device id
+   and one on the bound address, and the entries that may be dropped
+   to make room sit on least recently used lists, so no operation has
+   to scan the table. Links hold an entry index plus one; 0 is none. */
+struct Address_Cache_Entry {
     uint8_t Flags;
     uint32_t device_id;
     unsigned max_apdu;
     BACNET_ADDRESS address;
-    uint32_t TimeToLive;
-} Address_Cache[MAX_ADDRESS_CACHE];
+    /* time to live; stopped for entries that never expire */
+    BACNET_TIMER TimeToLive;
+    unsigned device_next;
+    unsigned mac_next;
+    unsigned lru_prev;
+    /* also links the free list */
+    unsigned lru_next;
+};
+
+static struct Address_Cache_Entry Address_Cache_Default[MAX_ADDRESS_CACHE];
+static unsigned Address_Device_Hash_Default[MAX_ADDRESS_CACHE];
+static unsigned Address_MAC_Hash_Default[MAX_ADDRESS_CACHE];
+
+/* the table can be resized with address_set_capacity() */
+static struct Address_Cache_Entry *Address_Cache = Address_Cache_Default;
+static unsigned *Address_Device_Hash = Address_Device_Hash_Default;
+static unsigned *Address_MAC_Hash = Address_MAC_Hash_Default;
+static unsigned Address_Cache_Size = MAX_ADDRESS_CACHE;
+/* entries above this have never been used */
+static unsigned Address_Cache_High = 0;
+static unsigned Address_Cache_Free = 0;
+static unsigned Address_Bound_Count = 0;
+/* set whenever a binding is added, changed or dropped */
+static bool Address_Binding_Changed = false;
+
+/* oldest first: bound entries are dropped before bind requests,
+   static entries are never dropped */
+#define ADDRESS_LRU_BOUND    0
+#define ADDRESS_LRU_BIND_REQ 1
+#define ADDRESS_LRU_NONE     2
+static struct {
+    unsigned head;
+    unsigned tail;
+} Address_LRU[ADDRESS_LRU_NONE];
+
+#define ADDRESS_INDEX(p) ((unsigned) ((p) - Address_Cache) + 1)
+#define ADDRESS_ENTRY(i) (&Address_Cache[(i) - 1])
 
 /* State flags for cache entries */
 
@@ -60,7 +106,6 @@ static struct Address_Cache_Entry {
 #define BAC_ADDR_BIND_REQ  2    /* Bind request outstanding for entry */
 #define BAC_ADDR_STATIC    4    /* Static address mapping - does not expire */
 #define BAC_ADDR_SHORT_TTL 8    /* Oppertunistaclly added address with short TTL */
-#define BAC_ADDR_RESERVED  128  /* Freed up but held for caller to fill */
 
 #define BAC_ADDR_SECS_1HOUR 3600        /* 60x60 */
 #define BAC_ADDR_SECS_1DAY  86400       /* 60x60x24 */
@@ -69,6 +114,254 @@ static struct Address_Cache_Entry {
 #define BAC_ADDR_SHORT_TIME BAC_ADDR_SECS_1HOUR
 #define BAC_ADDR_FOREVER    0xFFFFFFFF  /* Permenant entry */
 
+static void address_release(
+    struct Address_Cache_Entry *pMatch);
+
+/* The time to live runs on the timer wheel, so an entry is only
+   visited when it expires rather than on every scan of the cache. */
+static void address_ttl_expired(
+    BACNET_TIMER * timer)
+{
+    struct Address_Cache_Entry *pMatch;
+
+    pMatch = (struct Address_Cache_Entry *) ((uint8_t *) timer -
+        offsetof(struct Address_Cache_Entry, TimeToLive));
+    if ((pMatch->Flags & BAC_ADDR_STATIC) == 0)
+        address_release(pMatch);
+}
+
+static void address_set_ttl(
+    struct Address_Cache_Entry *pMatch,
+    uint32_t seconds)
+{
+    if (seconds == BAC_ADDR_FOREVER) {
+        timer_wheel_stop(&pMatch->TimeToLive);
+    } else {
+        /* the wheel counts up to about 49 days in milliseconds */
+        if (seconds > (UINT32_MAX / 1000))
+            seconds = UINT32_MAX / 1000;
+        timer_wheel_start(&pMatch->TimeToLive, seconds * 1000,
+            address_ttl_expired);
+    }
+}
+
+/* seconds left to live, rounded up */
+static uint32_t address_ttl(
+    struct Address_Cache_Entry *pMatch)
+{
+    if (!timer_wheel_active(&pMatch->TimeToLive))
+        return BAC_ADDR_FOREVER;
+
+    return (timer_wheel_remaining(&pMatch->TimeToLive) + 999) / 1000;
+}
+
+static unsigned address_device_bucket(
+    uint32_t device_id)
+{
+    return (unsigned) ((device_id * 2654435761u) % Address_Cache_Size);
+}
+
+static unsigned address_mac_bucket(
+    BACNET_ADDRESS * src)
+{
+    return (unsigned) (bacnet_address_hash(src) % Address_Cache_Size);
+}
+
+static bool address_is_bound(
+    struct Address_Cache_Entry *pMatch)
+{
+    return ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
+        BAC_ADDR_IN_USE);
+}
+
+static unsigned address_lru_list(
+    struct Address_Cache_Entry *pMatch)
+{
+    if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_STATIC)) !=
+        BAC_ADDR_IN_USE)
+        return ADDRESS_LRU_NONE;
+    if ((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0)
+        return ADDRESS_LRU_BIND_REQ;
+
+    return ADDRESS_LRU_BOUND;
+}
+
+/* Takes the entry out of the MAC index and its LRU list as they
+   stand for its current flags. Pair with address_link() around any
+   change to the flags or the address. */
+static void address_unlink(
+    struct Address_Cache_Entry *pMatch)
+{
+    unsigned index = ADDRESS_INDEX(pMatch);
+    unsigned list = address_lru_list(pMatch);
+    unsigned *link;
+
+    if (address_is_bound(pMatch)) {
+        link = &Address_MAC_Hash[address_mac_bucket(&pMatch->address)];
+        while (*link != index)
+            link = &ADDRESS_ENTRY(*link)->mac_next;
+        *link = pMatch->mac_next;
+        pMatch->mac_next = 0;
+        Address_Bound_Count--;
+    }
+    if (list != ADDRESS_LRU_NONE) {
+        if (pMatch->lru_prev)
+            ADDRESS_ENTRY(pMatch->lru_prev)->lru_next = pMatch->lru_next;
+        else
+            Address_LRU[list].head = pMatch->lru_next;
+        if (pMatch->lru_next)
+            ADDRESS_ENTRY(pMatch->lru_next)->lru_prev = pMatch->lru_prev;
+        else
+            Address_LRU[list].tail = pMatch->lru_prev;
+        pMatch->lru_prev = 0;
+        pMatch->lru_next = 0;
+    }
+}
+
+/* files the entry for its current flags as the most recently used */
+static void address_link(
+    struct Address_Cache_Entry *pMatch)
+{
+    unsigned index = ADDRESS_INDEX(pMatch);
+    unsigned list = address_lru_list(pMatch);
+    unsigned bucket;
+
+    if (address_is_bound(pMatch)) {
+        bucket = address_mac_bucket(&pMatch->address);
+        pMatch->mac_next = Address_MAC_Hash[bucket];
+        Address_MAC_Hash[bucket] = index;
+        Address_Bound_Count++;
+        Address_Binding_Changed = true;
+    }
+    if (list != ADDRESS_LRU_NONE) {
+        pMatch->lru_next = 0;
+        pMatch->lru_prev = Address_LRU[list].tail;
+        if (Address_LRU[list].tail)
+            ADDRESS_ENTRY(Address_LRU[list].tail)->lru_next = index;
+        else
+            Address_LRU[list].head = index;
+        Address_LRU[list].tail = index;
+    }
+}
+
+/* marks the entry most recently used; not a change to the binding */
+static void address_touch(
+    struct Address_Cache_Entry *pMatch)
+{
+    bool changed = Address_Binding_Changed;
+
+    address_unlink(pMatch);
+    address_link(pMatch);
+    Address_Binding_Changed = changed;
+}
+
+static struct Address_Cache_Entry *address_find_device(
+    uint32_t device_id)
+{
+    unsigned index;
+
+    index = Address_Device_Hash[address_device_bucket(device_id)];
+    while (index) {
+        if (ADDRESS_ENTRY(index)->device_id == device_id)
+            return ADDRESS_ENTRY(index);
+        index = ADDRESS_ENTRY(index)->device_next;
+    }
+
+    return NULL;
+}
+
+/* only bound entries are in the MAC index */
+static struct Address_Cache_Entry *address_find_mac(
+    BACNET_ADDRESS * src)
+{
+    unsigned index;
+
+    index = Address_MAC_Hash[address_mac_bucket(src)];
+    while (index) {
+        if (bacnet_address_same(&ADDRESS_ENTRY(index)->address, src))
+            return ADDRESS_ENTRY(index);
+        index = ADDRESS_ENTRY(index)->mac_next;
+    }
+
+    return NULL;
+}
+
+/* removes the entry from every index and puts it on the free list */
+static void address_release(
+    struct Address_Cache_Entry *pMatch)
+{
+    unsigned index = ADDRESS_INDEX(pMatch);
+    unsigned *link;
+
+    address_unlink(pMatch);
+    link = &Address_Device_Hash[address_device_bucket(pMatch->device_id)];
+    while (*link != index)
+        link = &ADDRESS_ENTRY(*link)->device_next;
+    *link = pMatch->device_next;
+    pMatch->device_next = 0;
+    timer_wheel_stop(&pMatch->TimeToLive);
+    if (address_is_bound(pMatch))
+        Address_Binding_Changed = true;
+    pMatch->Flags = 0;
+    pMatch->lru_next = Address_Cache_Free;
+    Address_Cache_Free = index;
+}
+
+/*****************************************************************************
+ * Drop the least recently used entry to make room. Bound entries go before  *
+ * outstanding bind requests and static entries are never dropped. Returns   *
+ * false if there is nothing that can be dropped.                            *
+ *****************************************************************************/
+
+static bool address_remove_oldest(
+    void)
+{
+    unsigned index;
+
+    index = Address_LRU[ADDRESS_LRU_BOUND].head;
+    if (index == 0)
+        index = Address_LRU[ADDRESS_LRU_BIND_REQ].head;
+    if (index == 0)
+        return false;
+    address_release(ADDRESS_ENTRY(index));
+
+    return true;
+}
+
+/* Takes a free entry, dropping the oldest if the cache is full, and
+   indexes it under device_id. The caller sets the rest of the entry
+   and then calls address_link(). */
+static struct Address_Cache_Entry *address_alloc(
+    uint32_t device_id)
+{
+    struct Address_Cache_Entry *pMatch;
+    unsigned index;
+    unsigned bucket;
+
+    if ((Address_Cache_Free == 0) &&
+        (Address_Cache_High >= Address_Cache_Size)) {
+        if (!address_remove_oldest())
+            return NULL;
+    }
+    if (Address_Cache_Free) {
+        index = Address_Cache_Free;
+        Address_Cache_Free = ADDRESS_ENTRY(index)->lru_next;
+    } else {
+        index = ++Address_Cache_High;
+    }
+    pMatch = ADDRESS_ENTRY(index);
+    pMatch->Flags = BAC_ADDR_IN_USE;
+    pMatch->device_id = device_id;
+    pMatch->lru_prev = 0;
+    pMatch->lru_next = 0;
+    pMatch->mac_next = 0;
+    bucket = address_device_bucket(device_id);
+    pMatch->device_next = Address_Device_Hash[bucket];
+    Address_Device_Hash[bucket] = index;
+
+    return pMatch;
+}
+
 bool address_match(
     BACNET_ADDRESS * dest,
     BACNET_ADDRESS * src)
@@ -110,83 +403,13 @@ void address_remove_device(
 {
     struct Address_Cache_Entry *pMatch;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            pMatch->Flags = 0;
-            break;
-        }
-        pMatch++;
-    }
+    pMatch = address_find_device(device_id);
+    if (pMatch != NULL)
+        address_release(pMatch);
 
     return;
 }
 
-/*****************************************************************************
- * Search the cache for the entry nearest expiry and delete it. Mark the     *
- * entry as reserved with a 1 hour TTL and return a pointer to the reserved  *
- * entry. Will not delete a static entry and returns NULL pointer if no      *
- * entry available to free up. Does not check for free entries as it is      *
- * assumed we are calling this due to the lack of those.                     *
- *****************************************************************************/
-
-
-struct Address_Cache_Entry *address_remove_oldest(
-    void)
-{
-    struct Address_Cache_Entry *pMatch;
-    struct Address_Cache_Entry *pCandidate;
-    uint32_t ulTime;
-
-    pCandidate = NULL;
-    ulTime = BAC_ADDR_FOREVER - 1;      /* Longest possible non static time to live */
-
-    /* First pass - try only in use and bound entries */
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->
-                Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ |
-                    BAC_ADDR_STATIC)) == BAC_ADDR_IN_USE) {
-            if (pMatch->TimeToLive <= ulTime) { /* Shorter lived entry found */
-                ulTime = pMatch->TimeToLive;
-                pCandidate = pMatch;
-            }
-        }
-        pMatch++;
-    }
-
-    if (pCandidate != NULL) {   /* Found something to free up */
-        pCandidate->Flags = BAC_ADDR_RESERVED;
-        pCandidate->TimeToLive = BAC_ADDR_SHORT_TIME;   /* only reserve it for a short while */
-        return (pCandidate);
-    }
-
-    /* Second pass - try in use and un bound as last resort */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->
-                Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ |
-                    BAC_ADDR_STATIC)) ==
-            (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) {
-            if (pMatch->TimeToLive <= ulTime) { /* Shorter lived entry found */
-                ulTime = pMatch->TimeToLive;
-                pCandidate = pMatch;
-            }
-        }
-        pMatch++;
-    }
-
-    if (pCandidate != NULL) {   /* Found something to free up */
-        pCandidate->Flags = BAC_ADDR_RESERVED;
-        pCandidate->TimeToLive = BAC_ADDR_SHORT_TIME;   /* only reserve it for a short while */
-    }
-
-    return (pCandidate);
-}
-
-
 /* File format:
 DeviceID MAC SNET SADR MAX-APDU
 4194303 05 0 0 50
@@ -250,6 +473,23 @@ void address_file_init(
 }
 
 
+static void address_cache_clear(
+    void)
+{
+    unsigned i;
+
+    for (i = 0; i < Address_Cache_High; i++) {
+        timer_wheel_stop(&Address_Cache[i].TimeToLive);
+        Address_Cache[i].Flags = 0;
+    }
+    memset(Address_Device_Hash, 0, Address_Cache_Size * sizeof(unsigned));
+    memset(Address_MAC_Hash, 0, Address_Cache_Size * sizeof(unsigned));
+    memset(Address_LRU, 0, sizeof(Address_LRU));
+    Address_Cache_High = 0;
+    Address_Cache_Free = 0;
+    Address_Bound_Count = 0;
+}
+
 /****************************************************************************
  * Clear down the cache and make sure the full complement of entries are    *
  * available. Assume no persistance of memory.                              *
@@ -258,20 +498,14 @@ void address_file_init(
 void address_init(
     void)
 {
-    struct Address_Cache_Entry *pMatch;
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        pMatch->Flags = 0;
-        pMatch++;
-    }
+    address_cache_clear();
     address_file_init(Address_Cache_Filename);
 
     return;
 }
 
 /****************************************************************************
- * Clear down the cache of any non bound, expired  or reserved entries.     *
+ * Clear down the cache of any non bound or expired entries.                *
  * Leave static and unexpired bound entries alone. For use where the cache  *
  * is held in persistant memory which can survive a reset or power cycle.   *
  * This reduces the network traffic on restarts as the cache will have much *
@@ -282,26 +516,127 @@ void address_init_partial(
     void)
 {
     struct Address_Cache_Entry *pMatch;
+    unsigned i;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
+    for (i = 0; i < Address_Cache_High; i++) {
+        pMatch = &Address_Cache[i];
         if ((pMatch->Flags & BAC_ADDR_IN_USE) != 0) {   /* It's in use so let's check further */
             if (((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0) ||
-                (pMatch->TimeToLive == 0))
-                pMatch->Flags = 0;
-        }
-
-        if ((pMatch->Flags & BAC_ADDR_RESERVED) != 0) { /* Reserved entries should be cleared */
-            pMatch->Flags = 0;
+                (address_ttl(pMatch) == 0))
+                address_release(pMatch);
         }
-
-        pMatch++;
     }
     address_file_init(Address_Cache_Filename);
 
     return;
 }
 
+/* copies an entry from the table being replaced into the current one */
+static void address_move(
+    struct Address_Cache_Entry *pOld)
+{
+    struct Address_Cache_Entry *pMatch;
+    bool active = timer_wheel_active(&pOld->TimeToLive);
+    uint32_t remaining = timer_wheel_remaining(&pOld->TimeToLive);
+
+    timer_wheel_stop(&pOld->TimeToLive);
+    pMatch = address_alloc(pOld->device_id);
+    if (pMatch == NULL)
+        return;
+    pMatch->Flags = pOld->Flags;
+    pMatch->max_apdu = pOld->max_apdu;
+    pMatch->address = pOld->address;
+    if (active)
+        timer_wheel_start(&pMatch->TimeToLive, remaining, address_ttl_expired);
+    address_link(pMatch);
+}
+
+/****************************************************************************
+ * Change how many devices the cache holds. The entries already cached are *
+ * kept, along with their time to live and how recently they were used.    *
+ * Fails if more entries are in use than the new capacity or if memory     *
+ * cannot be allocated, in which case the cache is left as it was.         *
+ ****************************************************************************/
+
+bool address_set_capacity(
+    unsigned capacity)
+{
+    struct Address_Cache_Entry *old_cache = Address_Cache;
+    unsigned *old_device_hash = Address_Device_Hash;
+    unsigned *old_mac_hash = Address_MAC_Hash;
+    unsigned old_high = Address_Cache_High;
+    unsigned old_head[ADDRESS_LRU_NONE];
+    struct Address_Cache_Entry *cache = NULL;
+    unsigned *device_hash = NULL;
+    unsigned *mac_hash = NULL;
+    unsigned count = 0;
+    unsigned list;
+    unsigned index;
+    unsigned i;
+
+    if (capacity == 0)
+        return false;
+    if (capacity == Address_Cache_Size)
+        return true;
+    for (i = 0; i < old_high; i++) {
+        if ((old_cache[i].Flags & BAC_ADDR_IN_USE) != 0)
+            count++;
+    }
+    if (count > capacity)
+        return false;
+    if (capacity == MAX_ADDRESS_CACHE) {
+        cache = Address_Cache_Default;
+        device_hash = Address_Device_Hash_Default;
+        mac_hash = Address_MAC_Hash_Default;
+        memset(cache, 0, sizeof(Address_Cache_Default));
+    } else {
+        cache = calloc(capacity, sizeof(struct Address_Cache_Entry));
+        device_hash = calloc(capacity, sizeof(unsigned));
+        mac_hash = calloc(capacity, sizeof(unsigned));
+        if ((cache == NULL) || (device_hash == NULL) || (mac_hash == NULL)) {
+            free(cache);
+            free(device_hash);
+            free(mac_hash);
+            return false;
+        }
+    }
+    for (list = 0; list < ADDRESS_LRU_NONE; list++) {
+        old_head[list] = Address_LRU[list].head;
+    }
+    Address_Cache = cache;
+    Address_Device_Hash = device_hash;
+    Address_MAC_Hash = mac_hash;
+    Address_Cache_Size = capacity;
+    Address_Cache_High = 0;
+    address_cache_clear();
+    /* static entries first, then each list oldest first, so the
+       least recently used entries are still dropped first */
+    for (i = 0; i < old_high; i++) {
+        if (((old_cache[i].Flags & BAC_ADDR_IN_USE) != 0) &&
+            (address_lru_list(&old_cache[i]) == ADDRESS_LRU_NONE))
+            address_move(&old_cache[i]);
+    }
+    for (list = 0; list < ADDRESS_LRU_NONE; list++) {
+        for (index = old_head[list]; index != 0;
+            index = old_cache[index - 1].lru_next) {
+            address_move(&old_cache[index - 1]);
+        }
+    }
+    if (old_cache != Address_Cache_Default) {
+        free(old_cache);
+        free(old_device_hash);
+        free(old_mac_hash);
+    }
+
+    return true;
+}
+
+unsigned address_capacity(
+    void)
+{
+    return Address_Cache_Size;
+}
+
 
 /****************************************************************************
  * Set the TTL info for the given device entry. If it is a bound entry we   *
@@ -317,24 +652,21 @@ void address_set_device_TTL(
 {
     struct Address_Cache_Entry *pMatch;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* If bound then we have either static or normaal */
-                if (StaticFlag) {
-                    pMatch->Flags |= BAC_ADDR_STATIC;
-                    pMatch->TimeToLive = BAC_ADDR_FOREVER;
-                } else {
-                    pMatch->Flags &= ~BAC_ADDR_STATIC;
-                    pMatch->TimeToLive = TimeOut;
-                }
+    pMatch = address_find_device(device_id);
+    if (pMatch != NULL) {
+        address_unlink(pMatch);
+        if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) { /* If bound then we have either static or normaal */
+            if (StaticFlag) {
+                pMatch->Flags |= BAC_ADDR_STATIC;
+                address_set_ttl(pMatch, BAC_ADDR_FOREVER);
             } else {
-                pMatch->TimeToLive = TimeOut;   /* For unbound we can only set the time to live */
+                pMatch->Flags &= ~BAC_ADDR_STATIC;
+                address_set_ttl(pMatch, TimeOut);
             }
-            break;      /* Exit now if found at all - bound or unbound */
+        } else {
+            address_set_ttl(pMatch, TimeOut);   /* For unbound we can only set the time to live */
         }
-        pMatch++;
+        address_link(pMatch);
     }
 }
 
@@ -347,18 +679,12 @@ bool address_get_by_device(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* If bound then fetch data */
-                *src = pMatch->address;
-                *max_apdu = pMatch->max_apdu;
-                found = true;   /* Prove we found it */
-            }
-            break;      /* Exit now if found at all - bound or unbound */
-        }
-        pMatch++;
+    pMatch = address_find_device(device_id);
+    if ((pMatch != NULL) && address_is_bound(pMatch)) { /* If bound then fetch data */
+        *src = pMatch->address;
+        *max_apdu = pMatch->max_apdu;
+        found = true;   /* Prove we found it */
+        address_touch(pMatch);
     }
 
     return found;
@@ -373,18 +699,13 @@ bool address_get_device_id(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) == BAC_ADDR_IN_USE) {       /* If bound */
-            if (bacnet_address_same(&pMatch->address, src)) {
-                if (device_id) {
-                    *device_id = pMatch->device_id;
-                }
-                found = true;
-                break;
-            }
+    pMatch = address_find_mac(src);
+    if (pMatch != NULL) {
+        if (device_id) {
+            *device_id = pMatch->device_id;
         }
-        pMatch++;
+        found = true;
+        address_touch(pMatch);
     }
 
     return found;
@@ -395,7 +716,6 @@ void address_add(
     unsigned max_apdu,
     BACNET_ADDRESS * src)
 {
-    bool found = false; /* return value */
     struct Address_Cache_Entry *pMatch;
 
     /* Note: Previously this function would ignore bind request
@@ -405,58 +725,35 @@ void address_add(
        bind request if it exists */
 
     /* existing device or bind request outstanding - update address */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            pMatch->address = *src;
-            pMatch->max_apdu = max_apdu;
-
-            /* Pick the right time to live */
-
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0)       /* Bind requested so long time */
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;
-            else if ((pMatch->Flags & BAC_ADDR_STATIC) != 0)    /* Static already so make sure it never expires */
-                pMatch->TimeToLive = BAC_ADDR_FOREVER;
-            else if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) /* Opportunistic entry so leave on short fuse */
-                pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;
-            else
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;        /* Renewing existing entry */
-
-            pMatch->Flags &= ~BAC_ADDR_BIND_REQ;        /* Clear bind request flag just in case */
-            found = true;
-            break;
-        }
-        pMatch++;
-    }
-
-    /* new device - add to cache if there is room */
-    if (!found) {
-        pMatch = Address_Cache;
-        while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-            if ((pMatch->Flags & BAC_ADDR_IN_USE) == 0) {
-                pMatch->Flags = BAC_ADDR_IN_USE;
-                pMatch->device_id = device_id;
-                pMatch->max_apdu = max_apdu;
-                pMatch->address = *src;
-                pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;       /* Opportunistic entry so leave on short fuse */
-                found = true;
-                break;
-            }
-            pMatch++;
-        }
+    pMatch = address_find_device(device_id);
+    if (pMatch != NULL) {
+        address_unlink(pMatch);
+        pMatch->address = *src;
+        pMatch->max_apdu = max_apdu;
+
+        /* Pick the right time to live */
+
+        if ((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0)   /* Bind requested so long time */
+            address_set_ttl(pMatch, BAC_ADDR_LONG_TIME);
+        else if ((pMatch->Flags & BAC_ADDR_STATIC) != 0)        /* Static already so make sure it never expires */
+            address_set_ttl(pMatch, BAC_ADDR_FOREVER);
+        else if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0)     /* Opportunistic entry so leave on short fuse */
+            address_set_ttl(pMatch, BAC_ADDR_SHORT_TIME);
+        else
+            address_set_ttl(pMatch, BAC_ADDR_LONG_TIME);        /* Renewing existing entry */
+
+        pMatch->Flags &= ~BAC_ADDR_BIND_REQ;    /* Clear bind request flag just in case */
+        address_link(pMatch);
+        return;
     }
 
-    /* See if we can squeeze it in */
-    if (!found) {
-        pMatch = address_remove_oldest();
-        if (pMatch != NULL) {
-            pMatch->Flags = BAC_ADDR_IN_USE;
-            pMatch->device_id = device_id;
-            pMatch->max_apdu = max_apdu;
-            pMatch->address = *src;
-            pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;   /* Opportunistic entry so leave on short fuse */
-        }
+    /* new device - add to cache, squeezing it in if there is no room */
+    pMatch = address_alloc(device_id);
+    if (pMatch != NULL) {
+        pMatch->max_apdu = max_apdu;
+        pMatch->address = *src;
+        address_set_ttl(pMatch, BAC_ADDR_SHORT_TIME);   /* Opportunistic entry so leave on short fuse */
+        address_link(pMatch);
     }
     return;
 }
@@ -472,43 +769,28 @@ bool address_bind_request(
     struct Address_Cache_Entry *pMatch;
 
     /* existing device - update address info if currently bound */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* Already bound */
-                found = true;
-                *src = pMatch->address;
-                *max_apdu = pMatch->max_apdu;
-                if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) {        /* Was picked up opportunistacilly */
-                    pMatch->Flags &= ~BAC_ADDR_SHORT_TTL;       /* Convert to normal entry  */
-                    pMatch->TimeToLive = BAC_ADDR_LONG_TIME;    /* And give it a decent time to live */
-                }
+    pMatch = address_find_device(device_id);
+    if (pMatch != NULL) {
+        if (address_is_bound(pMatch)) { /* Already bound */
+            found = true;
+            *src = pMatch->address;
+            *max_apdu = pMatch->max_apdu;
+            if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) {    /* Was picked up opportunistacilly */
+                pMatch->Flags &= ~BAC_ADDR_SHORT_TTL;   /* Convert to normal entry  */
+                address_set_ttl(pMatch, BAC_ADDR_LONG_TIME);    /* And give it a decent time to live */
             }
-            return (found);     /* True if bound, false if bind request outstanding */
-        }
-        pMatch++;
-    }
-
-    /* Not there already so look for a free entry to put it in */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_RESERVED)) == 0) {
-            pMatch->Flags = BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ;        /* In use and awaiting binding */
-            pMatch->device_id = device_id;
-            pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;   /* No point in leaving bind requests in for long haul */
-            /* now would be a good time to do a Who-Is request */
-            return (false);
+            address_touch(pMatch);
         }
-        pMatch++;
+        return (found); /* True if bound, false if bind request outstanding */
     }
 
-    /* No free entries, See if we can squeeze it in by dropping an existing one */
-    pMatch = address_remove_oldest();
+    /* Not there already so take a free entry, or drop an existing one */
+    pMatch = address_alloc(device_id);
     if (pMatch != NULL) {
-        pMatch->Flags = BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ;
-        pMatch->device_id = device_id;
-        pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;       /* No point in leaving bind requests in for long haul */
+        pMatch->Flags = BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ;    /* In use and awaiting binding */
+        address_set_ttl(pMatch, BAC_ADDR_SHORT_TIME);   /* No point in leaving bind requests in for long haul */
+        address_link(pMatch);
+        /* now would be a good time to do a Who-Is request */
     }
     return (false);
 }
@@ -522,18 +804,15 @@ void address_add_binding(
     struct Address_Cache_Entry *pMatch;
 
     /* existing device or bind request - update address */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            pMatch->address = *src;
-            pMatch->max_apdu = max_apdu;
-            pMatch->Flags &= ~BAC_ADDR_BIND_REQ;        /* Clear bind request flag in case it was set */
-            if ((pMatch->Flags & BAC_ADDR_STATIC) == 0) /* Only update TTL if not static */
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;        /* and set it on a long fuse */
-            break;
-        }
-        pMatch++;
+    pMatch = address_find_device(device_id);
+    if (pMatch != NULL) {
+        address_unlink(pMatch);
+        pMatch->address = *src;
+        pMatch->max_apdu = max_apdu;
+        pMatch->Flags &= ~BAC_ADDR_BIND_REQ;    /* Clear bind request flag in case it was set */
+        if ((pMatch->Flags & BAC_ADDR_STATIC) == 0)     /* Only update TTL if not static */
+            address_set_ttl(pMatch, BAC_ADDR_LONG_TIME);        /* and set it on a long fuse */
+        address_link(pMatch);
     }
     return;
 }
@@ -547,10 +826,9 @@ bool address_get_by_index(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    if (index < MAX_ADDRESS_CACHE) {
+    if (index < Address_Cache_High) {
         pMatch = &Address_Cache[index];
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
-            BAC_ADDR_IN_USE) {
+        if (address_is_bound(pMatch)) {
             *src = pMatch->address;
             *device_id = pMatch->device_id;
             *max_apdu = pMatch->max_apdu;
@@ -561,21 +839,11 @@ bool address_get_by_index(
     return found;
 }
 
+/* Only counts bound entries */
 unsigned address_count(
     void)
 {
-    struct Address_Cache_Entry *pMatch;
-    unsigned count = 0; /* return value */
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) == BAC_ADDR_IN_USE) /* Only count bound entries */
-            count++;
-
-        pMatch++;
-    }
-
-    return count;
+    return Address_Bound_Count;
 }
 
 /****************************************************************************
@@ -588,38 +856,39 @@ int address_list_encode(
     unsigned apdu_len)
 {
     int iLen = 0;
+    int len = 0;
     struct Address_Cache_Entry *pMatch;
     BACNET_OCTET_STRING MAC_Address;
+    /* object id, network number and tagged MAC of one binding */
+    uint8_t entry[5 + 5 + 2 + MAX_MAC_LEN];
+    unsigned i;
 
-    /* FIXME: I really shouild check the length remaining here but it is 
-       fairly pointless until we have the true length remaining in
-       the packet to work with as at the moment it is just MAX_APDU */
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
-            BAC_ADDR_IN_USE) {
-            iLen +=
-                encode_application_object_id(&apdu[iLen], OBJECT_DEVICE,
+    for (i = 0; i < Address_Cache_High; i++) {
+        pMatch = &Address_Cache[i];
+        if (address_is_bound(pMatch)) {
+            len =
+                encode_application_object_id(&entry[0], OBJECT_DEVICE,
                 pMatch->device_id);
-            iLen +=
-                encode_application_unsigned(&apdu[iLen], pMatch->address.net);
+            len += encode_application_unsigned(&entry[len],
+                pMatch->address.net);
 
             /* pick the appropriate type of entry from the cache */
 
             if (pMatch->address.len != 0) {
                 octetstring_init(&MAC_Address, pMatch->address.adr,
                     pMatch->address.len);
-                iLen +=
-                    encode_application_octet_string(&apdu[iLen], &MAC_Address);
             } else {
                 octetstring_init(&MAC_Address, pMatch->address.mac,
                     pMatch->address.mac_len);
-                iLen +=
-                    encode_application_octet_string(&apdu[iLen], &MAC_Address);
             }
+            len += encode_application_octet_string(&entry[len], &MAC_Address);
+            /* the cache can hold far more bindings than one APDU */
+            if ((unsigned) (iLen + len) > apdu_len) {
+                return -2;
+            }
+            memcpy(&apdu[iLen], entry, len);
+            iLen += len;
         }
-        pMatch++;
     }
 
     return (iLen);
@@ -627,31 +896,182 @@ int address_list_encode(
 
 
 /****************************************************************************
- * Scan the cache and eliminate any expired entries. Should be called       *
- * periodically to ensure the cache is managed correctly. If this function  *
- * is never called at all the whole cache is effectivly rendered static and *
- * entries never expire unless explicetly deleted.                          *    
+ * Binary binding file. Learned bindings are written out so a restart can   *
+ * pick them straight back up instead of rediscovering every device. The    *
+ * file is a header followed by fixed size records, written to             *
+ * a temporary file and renamed into place, and mapped read-only to load.   *
+ * A file with another magic, version or record size is ignored.            *
  ****************************************************************************/
 
-void address_cache_timer(
-    uint16_t uSeconds)
-{       /* Approximate number of seconds since last call to this function */
+#define ADDRESS_BINDING_MAGIC   0x41434142UL    /* "BACA" */
+#define ADDRESS_BINDING_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t reserved;
+} ADDRESS_BINDING_HEADER;
+
+typedef struct {
+    /* wall clock expiry */
+    int64_t expires;
+    uint32_t device_id;
+    uint32_t max_apdu;
+    uint16_t net;
+    uint8_t flags;
+    uint8_t mac_len;
+    uint8_t len;
+    uint8_t mac[MAX_MAC_LEN];
+    uint8_t adr[MAX_MAC_LEN];
+} ADDRESS_BINDING_RECORD;
+
+
+static bool address_binding_write(
+    FILE * pFile,
+    struct Address_Cache_Entry *pMatch,
+    time_t now)
+{
+    ADDRESS_BINDING_RECORD record;
+
+    memset(&record, 0, sizeof(record));
+    record.expires = (int64_t) now + address_ttl(pMatch);
+    record.device_id = pMatch->device_id;
+    record.max_apdu = pMatch->max_apdu;
+    record.net = pMatch->address.net;
+    record.flags = pMatch->Flags & BAC_ADDR_SHORT_TTL;
+    record.mac_len = pMatch->address.mac_len;
+    record.len = pMatch->address.len;
+    memcpy(record.mac, pMatch->address.mac, MAX_MAC_LEN);
+    memcpy(record.adr, pMatch->address.adr, MAX_MAC_LEN);
+
+    return (fwrite(&record, sizeof(record), 1, pFile) == 1);
+}
+
+/* Writes every learned binding; bind requests are not kept, and static
+   entries are left to the address file so removing one there sticks.
+   Entries go out least recently used first so loading them keeps the
+   same order. */
+bool address_binding_save(
+    const char *pFilename)
+{
+    ADDRESS_BINDING_HEADER header;
+    char temp_name[256];
+    FILE *pFile = NULL;
+    time_t now = time(NULL);
+    unsigned index;
+    bool status = true;
+
+    if (snprintf(temp_name, sizeof(temp_name), "%s.tmp",
+            pFilename) >= (int) sizeof(temp_name))
+        return false;
+    pFile = fopen(temp_name, "wb");
+    if (pFile == NULL)
+        return false;
+    memset(&header, 0, sizeof(header));
+    header.magic = ADDRESS_BINDING_MAGIC;
+    header.version = ADDRESS_BINDING_VERSION;
+    header.record_size = sizeof(ADDRESS_BINDING_RECORD);
+    status = (fwrite(&header, sizeof(header), 1, pFile) == 1);
+    for (index = Address_LRU[ADDRESS_LRU_BOUND].head; status && index;
+        index = ADDRESS_ENTRY(index)->lru_next) {
+        status = address_binding_write(pFile, ADDRESS_ENTRY(index), now);
+        header.count++;
+    }
+    /* the count is only known once the records are out */
+    if (status)
+        status = (fseek(pFile, 0, SEEK_SET) == 0) &&
+            (fwrite(&header, sizeof(header), 1, pFile) == 1);
+    if (fclose(pFile) != 0)
+        status = false;
+    if (status)
+        status = (rename(temp_name, pFilename) == 0);
+    if (!status)
+        remove(temp_name);
+    else
+        Address_Binding_Changed = false;
+
+    return status;
+}
+
+static void address_binding_read(
+    const ADDRESS_BINDING_RECORD * record,
+    time_t now)
+{
     struct Address_Cache_Entry *pMatch;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_RESERVED)) != 0)
-            && ((pMatch->Flags & BAC_ADDR_STATIC) != 0)) {      /* Check all entries holding a slot except statics */
-            if (pMatch->TimeToLive >= uSeconds)
-                pMatch->TimeToLive -= uSeconds;
-            else
-                pMatch->Flags = 0;
-        }
+    if (record->expires <= (int64_t) now)
+        return;
+    /* a damaged file must not overrun mac[] or adr[] */
+    if ((record->mac_len > MAX_MAC_LEN) || (record->len > MAX_MAC_LEN))
+        return;
+    /* bindings already made this run are newer */
+    if (address_find_device(record->device_id) != NULL)
+        return;
+    pMatch = address_alloc(record->device_id);
+    if (pMatch == NULL)
+        return;
+    pMatch->Flags |= record->flags & BAC_ADDR_SHORT_TTL;
+    pMatch->max_apdu = record->max_apdu;
+    pMatch->address.net = record->net;
+    pMatch->address.mac_len = record->mac_len;
+    pMatch->address.len = record->len;
+    memcpy(pMatch->address.mac, record->mac, MAX_MAC_LEN);
+    memcpy(pMatch->address.adr, record->adr, MAX_MAC_LEN);
+    address_set_ttl(pMatch, (uint32_t) (record->expires - now));
+    address_link(pMatch);
+}
 
-        pMatch++;
+/* Loads a file written by address_binding_save(), dropping anything
+   that expired while we were down. Returns false if there was no
+   usable file. */
+bool address_binding_load(
+    const char *pFilename)
+{
+    const ADDRESS_BINDING_HEADER *header;
+    const ADDRESS_BINDING_RECORD *record;
+    struct stat info;
+    void *map = MAP_FAILED;
+    time_t now = time(NULL);
+    uint32_t i;
+    int fd;
+    bool status = false;
+
+    fd = open(pFilename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    if ((fstat(fd, &info) == 0) &&
+        (info.st_size >= (off_t) sizeof(ADDRESS_BINDING_HEADER)))
+        map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd,
+            0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    header = (const ADDRESS_BINDING_HEADER *) map;
+    if ((header->magic == ADDRESS_BINDING_MAGIC) &&
+        (header->version == ADDRESS_BINDING_VERSION) &&
+        (header->record_size == sizeof(ADDRESS_BINDING_RECORD)) &&
+        (header->count <= ((info.st_size - sizeof(ADDRESS_BINDING_HEADER)) /
+                sizeof(ADDRESS_BINDING_RECORD)))) {
+        record = (const ADDRESS_BINDING_RECORD *) (header + 1);
+        for (i = 0; i < header->count; i++) {
+            address_binding_read(&record[i], now);
+        }
+        status = true;
     }
+    munmap(map, (size_t) info.st_size);
+    Address_Binding_Changed = false;
+
+    return status;
 }
 
+/* true if the bindings changed since they were last saved or loaded */
+bool address_binding_changed(
+    void)
+{
+    return Address_Binding_Changed;
+}
 
 
 #ifdef TEST
@@ -805,6 +1225,157 @@ void testAddress(
         count = address_count();
         ct_test(pTest, count == (MAX_ADDRESS_CACHE - i - 1));
     }
+
+    /* entries expire on the timer wheel unless they are static */
+    set_address(0, &src);
+    address_add(1, max_apdu, &src);
+    set_address(1, &src);
+    address_add(2, max_apdu, &src);
+    address_set_device_TTL(1, 5, false);
+    address_set_device_TTL(2, 5, true);
+    timer_wheel_milliseconds(4999);
+    ct_test(pTest, address_count() == 2);
+    timer_wheel_milliseconds(1);
+    ct_test(pTest, address_count() == 1);
+    ct_test(pTest, address_get_by_device(2, &test_max_apdu, &test_address));
+    address_remove_device(2);
+    ct_test(pTest, address_count() == 0);
+}
+
+void testAddressCapacity(
+    Test * pTest)
+{
+    BACNET_ADDRESS src;
+    BACNET_ADDRESS test_address;
+    unsigned max_apdu = 480;
+    unsigned test_max_apdu = 0;
+    uint32_t test_device_id = 0;
+    static uint8_t apdu[1000 * (5 + 5 + 2 + MAX_MAC_LEN)];
+    unsigned i;
+
+    ct_test(pTest, address_set_capacity(4));
+    ct_test(pTest, address_capacity() == 4);
+    for (i = 0; i < 4; i++) {
+        set_address(i, &src);
+        address_add(i + 1, max_apdu, &src);
+    }
+    ct_test(pTest, address_count() == 4);
+    /* a lookup makes device 1 the most recently used */
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    set_address(4, &src);
+    address_add(5, max_apdu, &src);
+    ct_test(pTest, address_count() == 4);
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    ct_test(pTest, !address_get_by_device(2, &test_max_apdu, &test_address));
+    /* found by MAC, and only under the new one once it moves */
+    ct_test(pTest, address_get_device_id(&src, &test_device_id));
+    ct_test(pTest, test_device_id == 5);
+    set_address(9, &src);
+    address_add(5, max_apdu, &src);
+    ct_test(pTest, address_get_device_id(&src, &test_device_id));
+    ct_test(pTest, test_device_id == 5);
+    set_address(4, &src);
+    ct_test(pTest, !address_get_device_id(&src, NULL));
+    /* growing keeps every entry */
+    ct_test(pTest, address_set_capacity(1000));
+    ct_test(pTest, address_count() == 4);
+    ct_test(pTest, address_get_by_device(5, &test_max_apdu, &test_address));
+    for (i = 0; i < 1000; i++) {
+        set_address(i, &src);
+        src.net = (uint16_t) i;
+        address_add(100 + i, max_apdu, &src);
+    }
+    ct_test(pTest, address_count() == 1000);
+    ct_test(pTest, !address_get_by_device(5, &test_max_apdu, &test_address));
+    /* 1000 bindings do not fit in one APDU */
+    ct_test(pTest, address_list_encode(apdu, MAX_APDU) == -2);
+    ct_test(pTest, address_list_encode(apdu, sizeof(apdu)) > MAX_APDU);
+    ct_test(pTest, address_get_device_id(&src, &test_device_id));
+    ct_test(pTest, test_device_id == 1099);
+    /* it will not shrink below what is in use */
+    ct_test(pTest, !address_set_capacity(MAX_ADDRESS_CACHE));
+    for (i = 0; i < 1000; i++) {
+        address_remove_device(100 + i);
+    }
+    ct_test(pTest, address_count() == 0);
+    ct_test(pTest, address_set_capacity(MAX_ADDRESS_CACHE));
+}
+
+void testAddressBinding(
+    Test * pTest)
+{
+    const char *pFilename = "address_test.bin";
+    BACNET_ADDRESS src;
+    BACNET_ADDRESS test_address;
+    unsigned max_apdu = 480;
+    unsigned test_max_apdu = 0;
+    uint32_t test_device_id = 0;
+    FILE *pFile = NULL;
+    unsigned i;
+
+    for (i = 0; i < 3; i++) {
+        set_address(i, &src);
+        address_add(i + 1, max_apdu + i, &src);
+    }
+    address_set_device_TTL(2, 0, true);
+    address_set_device_TTL(3, 5, false);
+    /* a bind request is not saved */
+    ct_test(pTest, !address_bind_request(4, &test_max_apdu, &test_address));
+    ct_test(pTest, address_binding_changed());
+    ct_test(pTest, address_binding_save(pFilename));
+    ct_test(pTest, !address_binding_changed());
+    /* lookups do not count as changes */
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    ct_test(pTest, !address_binding_changed());
+    for (i = 0; i < 4; i++) {
+        address_remove_device(i + 1);
+    }
+    ct_test(pTest, address_count() == 0);
+    ct_test(pTest, address_binding_load(pFilename));
+    /* static entries come from the address file, not the binding file */
+    ct_test(pTest, address_count() == 2);
+    ct_test(pTest, !address_get_by_device(2, &test_max_apdu, &test_address));
+    for (i = 0; i < 3; i += 2) {
+        set_address(i, &src);
+        ct_test(pTest, address_get_by_device(i + 1, &test_max_apdu,
+                &test_address));
+        ct_test(pTest, test_max_apdu == (max_apdu + i));
+        ct_test(pTest, bacnet_address_same(&test_address, &src));
+        ct_test(pTest, address_get_device_id(&src, &test_device_id));
+        ct_test(pTest, test_device_id == (i + 1));
+    }
+    ct_test(pTest, !address_get_by_device(4, &test_max_apdu, &test_address));
+    /* the short lived entry still expires */
+    timer_wheel_milliseconds(5000);
+    ct_test(pTest, !address_get_by_device(3, &test_max_apdu, &test_address));
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    /* a record with an impossible MAC length is dropped */
+    ct_test(pTest, address_binding_save(pFilename));
+    address_remove_device(1);
+    pFile = fopen(pFilename, "r+b");
+    if (pFile) {
+        fseek(pFile, sizeof(ADDRESS_BINDING_HEADER) +
+            offsetof(ADDRESS_BINDING_RECORD, mac_len), SEEK_SET);
+        fputc(MAX_MAC_LEN + 1, pFile);
+        fclose(pFile);
+    }
+    ct_test(pTest, address_binding_load(pFilename));
+    ct_test(pTest, address_count() == 0);
+    ct_test(pTest, !address_get_by_device(1, &test_max_apdu, &test_address));
+    for (i = 0; i < 3; i++) {
+        address_remove_device(i + 1);
+    }
+    /* files from another version are ignored */
+    pFile = fopen(pFilename, "r+b");
+    if (pFile) {
+        fseek(pFile, 4, SEEK_SET);
+        fputc(ADDRESS_BINDING_VERSION + 1, pFile);
+        fclose(pFile);
+    }
+    ct_test(pTest, !address_binding_load(pFilename));
+    ct_test(pTest, address_count() == 0);
+    remove(pFilename);
+    ct_test(pTest, !address_binding_load(pFilename));
 }
 
 #ifdef TEST_ADDRESS
@@ -818,6 +1389,10 @@ int main(
     /* individual tests */
     rc = ct_addTestFunction(pTest, testAddress);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testAddressCapacity);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testAddressBinding);
+    assert(rc);
     rc = ct_addTestFunction(pTest, testAddressFile);
     assert(rc);
 
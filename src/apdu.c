@@ -42,6 +42,7 @@
 #include "tsm.h"
 #include "dcc.h"
 #include "iam.h"
+#include "segment.h"
 
 /* APDU Timeout in Milliseconds */
 static uint16_t Timeout_Milliseconds = 3000;
@@ -309,6 +310,56 @@ void apdu_retries_set(
     Number_Of_Retries = value;
 }
 
+void apdu_cursor_init(
+    BACNET_APDU_CURSOR * cursor,
+    uint8_t * buffer,
+    unsigned offset,
+    unsigned max)
+{
+    cursor->buffer = buffer;
+    cursor->offset = offset;
+    cursor->max = max;
+    cursor->overflow = false;
+}
+
+uint8_t *apdu_cursor_position(
+    BACNET_APDU_CURSOR * cursor)
+{
+    return &cursor->buffer[cursor->offset];
+}
+
+/* room for the next piece: what is left before max, but never less
+   than MAX_APDU since any single value may be written into the slack */
+unsigned apdu_cursor_room(
+    BACNET_APDU_CURSOR * cursor)
+{
+    unsigned room = 0;
+
+    if (cursor->offset < cursor->max) {
+        room = cursor->max - cursor->offset;
+    }
+    if (room < MAX_APDU) {
+        room = MAX_APDU;
+    }
+
+    return room;
+}
+
+/* takes the len octets just written at the position,
+   or returns false if they do not fit before max */
+bool apdu_cursor_advance(
+    BACNET_APDU_CURSOR * cursor,
+    int len)
+{
+    if ((len < 0) || ((cursor->offset + (unsigned) len) > cursor->max)) {
+        cursor->overflow = true;
+        return false;
+    }
+    cursor->offset += len;
+
+    return true;
+}
+
 void apdu_handler(
     BACNET_ADDRESS * src,
     uint8_t * apdu,     /* APDU data */
@@ -332,6 +383,11 @@ void apdu_handler(
         /* PDU Type */
         switch (apdu[0] & 0xF0) {
             case PDU_TYPE_CONFIRMED_SERVICE_REQUEST:
+                if (apdu[0] & BIT3) {
+                    /* comes back here once every segment is in */
+                    segment_receive(src, apdu, apdu_len);
+                    break;
+                }
                 len = apdu_decode_confirmed_service_request(&apdu[0],   /* APDU data */
                     apdu_len, &service_data, &service_choice, &service_request,
                     &service_request_len);
@@ -393,13 +449,17 @@ void apdu_handler(
                                 Confirmed_ACK_Function[service_choice]) (src,
                                 invoke_id);
                         }
-                        tsm_free_invoke_id(invoke_id);
+                        tsm_free_invoke_id(src, invoke_id);
                         break;
                     default:
                         break;
                 }
                 break;
             case PDU_TYPE_COMPLEX_ACK:
+                if (apdu[0] & BIT3) {
+                    segment_receive(src, apdu, apdu_len);
+                    break;
+                }
                 service_ack_data.segmented_message =
                     (apdu[0] & BIT3) ? true : false;
                 service_ack_data.more_follows =
@@ -438,16 +498,16 @@ void apdu_handler(
                                 (service_request, service_request_len, src,
                                 &service_ack_data);
                         }
-                        tsm_free_invoke_id(invoke_id);
+                        tsm_free_invoke_id(src, invoke_id);
                         break;
                     default:
                         break;
                 }
                 break;
             case PDU_TYPE_SEGMENT_ACK:
-                /* FIXME: what about a denial of service attack here?
-                   we could check src to see if that matched the tsm */
-                tsm_free_invoke_id(invoke_id);
+                /* only moves a transfer on when src and invoke ID
+                   match one we are sending */
+                segment_ack_handler(src, apdu, apdu_len);
                 break;
             case PDU_TYPE_ERROR:
                 invoke_id = apdu[1];
@@ -486,14 +546,14 @@ void apdu_handler(
                             (BACNET_ERROR_CLASS) error_class,
                             (BACNET_ERROR_CODE) error_code);
                 }
-                tsm_free_invoke_id(invoke_id);
+                tsm_free_invoke_id(src, invoke_id);
                 break;
             case PDU_TYPE_REJECT:
                 invoke_id = apdu[1];
                 reason = apdu[2];
                 if (Reject_Function)
                     Reject_Function(src, invoke_id, reason);
-                tsm_free_invoke_id(invoke_id);
+                tsm_free_invoke_id(src, invoke_id);
                 break;
             case PDU_TYPE_ABORT:
                 server = apdu[0] & 0x01;
@@ -501,7 +561,8 @@ void apdu_handler(
                 reason = apdu[2];
                 if (Abort_Function)
                     Abort_Function(src, invoke_id, reason, server);
-                tsm_free_invoke_id(invoke_id);
+                segment_abort_handler(src, invoke_id, server);
+                tsm_free_invoke_id(src, invoke_id);
                 break;
             default:
                 break;
@@ -32,6 +32,7 @@
  -------------------------------------------
 ####COPYRIGHTEND####*/
 #include <stdint.h>
+#include <string.h>
 #include "bacenum.h"
 #include "bacdcode.h"
 #include "bacdef.h"
@@ -245,6 +246,35 @@ int arf_ack_encode_apdu(
     return apdu_len;
 }
 
+int arf_ack_encode_stream_apdu(
+    uint8_t * apdu,
+    uint8_t invoke_id,
+    bool end_of_file,
+    int32_t start_position,
+    uint8_t * file_data,
+    uint32_t file_data_len)
+{
+    int apdu_len = 0;   /* total length of the apdu, return value */
+
+    if (apdu) {
+        apdu[0] = PDU_TYPE_COMPLEX_ACK;
+        apdu[1] = invoke_id;
+        apdu[2] = SERVICE_CONFIRMED_ATOMIC_READ_FILE;   /* service choice */
+        apdu_len = 3;
+        apdu_len += encode_application_boolean(&apdu[apdu_len], end_of_file);
+        apdu_len += encode_opening_tag(&apdu[apdu_len], 0);
+        apdu_len += encode_application_signed(&apdu[apdu_len], start_position);
+        apdu_len +=
+            encode_tag(&apdu[apdu_len], BACNET_APPLICATION_TAG_OCTET_STRING,
+            false, file_data_len);
+        memcpy(&apdu[apdu_len], file_data, file_data_len);
+        apdu_len += file_data_len;
+        apdu_len += encode_closing_tag(&apdu[apdu_len], 0);
+    }
+
+    return apdu_len;
+}
+
 /* decode the service request only */
 int arf_ack_decode_service_request(
     uint8_t * apdu,
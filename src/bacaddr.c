@@ -87,3 +87,29 @@ bool bacnet_address_same(
 
     return match;
 }
+
+/* FNV-1a over the parts of the address bacnet_address_same compares */
+uint32_t bacnet_address_hash(
+    BACNET_ADDRESS * address)
+{
+    uint32_t hash = 2166136261u;
+    uint8_t i = 0;
+    uint8_t mac_len = address->mac_len;
+    uint8_t len = address->len;
+
+    if (mac_len > MAX_MAC_LEN)
+        mac_len = MAX_MAC_LEN;
+    if (len > MAX_MAC_LEN)
+        len = MAX_MAC_LEN;
+    for (i = 0; i < mac_len; i++) {
+        hash = (hash ^ address->mac[i]) * 16777619u;
+    }
+    hash = (hash ^ (address->net & 0xFF)) * 16777619u;
+    hash = (hash ^ (address->net >> 8)) * 16777619u;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ address->adr[i]) * 16777619u;
+    }
+
+    return hash ^ (hash >> 16);
+}
+
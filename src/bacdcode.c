@@ -322,33 +322,6 @@ int decode_tag_number(
     return len;
 }
 
-/* Same as function above, but will safely fail is packet has been truncated */
-int decode_tag_number_safe(
-    uint8_t * apdu,
-    uint32_t apdu_len_remaining,
-    uint8_t * tag_number)
-{
-    int len = 0;        /* return value */
-
-    /* decode the tag number first */
-    if (apdu_len_remaining >= 1) {
-        if (IS_EXTENDED_TAG_NUMBER(apdu[0]) && apdu_len_remaining >= 2) {
-            /* extended tag */
-            if (tag_number) {
-                *tag_number = apdu[1];
-            }
-            len = 2;
-        } else {
-            if (tag_number) {
-                *tag_number = (uint8_t) (apdu[0] >> 4);
-            }
-            len = 1;
-        }
-    }
-    return len;
-}
-
-
 bool decode_is_opening_tag(
     uint8_t * apdu)
 {
@@ -419,52 +392,22 @@ int decode_tag_number_and_value_safe(
     uint8_t * tag_number,
     uint32_t * value)
 {
-    int len = 0;
-
-    len = decode_tag_number_safe(&apdu[0], apdu_len_remaining, tag_number);
+    BACNET_DECODE_CURSOR cursor;
+    BACNET_TAG tag;
 
-    if (len > 0) {
-        apdu_len_remaining -= len;
-        if (IS_EXTENDED_VALUE(apdu[0])) {
-            /* tagged as uint32_t */
-            if (apdu[len] == 255 && apdu_len_remaining >= 5) {
-                uint32_t value32;
-                len++;
-                len += decode_unsigned32(&apdu[len], &value32);
-                if (value) {
-                    *value = value32;
-                }
-            }
-            /* tagged as uint16_t */
-            else if (apdu[len] == 254 && apdu_len_remaining >= 3) {
-                uint16_t value16;
-                len++;
-                len += decode_unsigned16(&apdu[len], &value16);
-                if (value) {
-                    *value = value16;
-                }
-            }
-            /* no tag - must be uint8_t */
-            else if (apdu[len] < 254 && apdu_len_remaining >= 1) {
-                if (value) {
-                    *value = apdu[len];
-                }
-                len++;
-            } else {
-                /* packet is truncated */
-                len = 0;
-            }
-        } else if (decode_is_opening_tag(&apdu[0]) && value) {
-            *value = 0;
-        } else if (decode_is_closing_tag(&apdu[0]) && value) {
-            /* closing tag */
-            *value = 0;
-        } else if (value) {
-            /* small value */
-            *value = apdu[0] & 0x07;
-        }
+    decode_cursor_init(&cursor, apdu, apdu_len_remaining);
+    if (!decode_cursor_tag(&cursor, &tag)) {
+        /* packet is truncated */
+        return 0;
     }
-    return len;
+    if (tag_number) {
+        *tag_number = tag.number;
+    }
+    if (value) {
+        *value = tag.len_value_type;
+    }
+
+    return (int) (apdu_len_remaining - decode_cursor_remaining(&cursor));
 }
 
 /* from clause 20.2.1.3.2 Constructed Data */
@@ -789,11 +732,16 @@ int decode_object_id_safe(
     uint16_t * object_type,
     uint32_t * instance)
 {
-    if (len_value != 4) {
+    BACNET_DECODE_CURSOR cursor;
+    int type = 0;
+
+    decode_cursor_init(&cursor, apdu, len_value);
+    if (!decode_cursor_object_id(&cursor, len_value, &type, instance)) {
         return 0;
-    } else {
-        return decode_object_id(apdu, object_type, instance);
     }
+    *object_type = (uint16_t) type;
+
+    return 4;
 }
 
 int decode_context_object_id(
@@ -1561,15 +1509,18 @@ int decode_bacnet_time_safe(
     uint32_t len_value,
     BACNET_TIME * btime)
 {
-    if (len_value != 4) {
+    BACNET_DECODE_CURSOR cursor;
+
+    decode_cursor_init(&cursor, apdu, len_value);
+    if (!decode_cursor_time(&cursor, len_value, btime)) {
         btime->hour = 0;
         btime->hundredths = 0;
         btime->min = 0;
         btime->sec = 0;
         return len_value;
-    } else {
-        return decode_bacnet_time(apdu, btime);
     }
+
+    return 4;
 }
 
 int decode_application_time(
@@ -1694,15 +1645,18 @@ int decode_date_safe(
     uint32_t len_value,
     BACNET_DATE * bdate)
 {
-    if (len_value != 4) {
+    BACNET_DECODE_CURSOR cursor;
+
+    decode_cursor_init(&cursor, apdu, len_value);
+    if (!decode_cursor_date(&cursor, len_value, bdate)) {
         bdate->day = 0;
         bdate->month = 0;
         bdate->wday = 0;
         bdate->year = 0;
         return len_value;
-    } else {
-        return decode_date(apdu, bdate);
     }
+
+    return 4;
 }
 
 
@@ -1753,6 +1707,371 @@ int encode_simple_ack(
     return 3;
 }
 
+/* what the first octet of a tag says: its number, unless extended
+   (0xF_), its kind, and its length/value/type, unless extended (5) */
+#define TAG_KIND(x) \
+    ((((x) & 0x08) ? BACNET_TAG_CONTEXT : 0) | \
+    ((((x) & 0x07) == 6) ? BACNET_TAG_OPENING : 0) | \
+    ((((x) & 0x07) == 7) ? BACNET_TAG_CLOSING : 0) | \
+    (((((x) & 0xF0) == 0xF0) || (((x) & 0x07) == 5)) ? \
+    BACNET_TAG_EXTENDED : 0))
+#define TAG_ENTRY(x) \
+    { (uint8_t) ((x) >> 4), (uint8_t) TAG_KIND(x), \
+    (((x) & 0x07) < 5) ? ((x) & 0x07) : 0 }
+#define TAG_ENTRY4(x) \
+    TAG_ENTRY(x), TAG_ENTRY((x) + 1), TAG_ENTRY((x) + 2), TAG_ENTRY((x) + 3)
+#define TAG_ENTRY16(x) \
+    TAG_ENTRY4(x), TAG_ENTRY4((x) + 4), TAG_ENTRY4((x) + 8), \
+    TAG_ENTRY4((x) + 12)
+#define TAG_ENTRY64(x) \
+    TAG_ENTRY16(x), TAG_ENTRY16((x) + 16), TAG_ENTRY16((x) + 32), \
+    TAG_ENTRY16((x) + 48)
+
+const BACNET_TAG bacnet_tag_table[256] = {
+    TAG_ENTRY64(0), TAG_ENTRY64(64), TAG_ENTRY64(128), TAG_ENTRY64(192)
+};
+
+bool decode_cursor_skip(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len)
+{
+    if (len > decode_cursor_remaining(cursor)) {
+        cursor->error = true;
+        return false;
+    }
+    cursor->ptr += len;
+
+    return true;
+}
+
+/* from clause 20.2.1 General Rules for Encoding BACnet Tags */
+bool decode_cursor_tag_extended(
+    BACNET_DECODE_CURSOR * cursor,
+    BACNET_TAG * tag)
+{
+    const uint8_t *ptr = cursor->ptr;
+    const uint8_t *end = cursor->end;
+    BACNET_TAG decoded;
+    uint8_t octet;
+
+    if (ptr >= end) {
+        cursor->error = true;
+        return false;
+    }
+    octet = *ptr++;
+    decoded = bacnet_tag_table[octet];
+    decoded.kind &= ~BACNET_TAG_EXTENDED;
+    if (IS_EXTENDED_TAG_NUMBER(octet)) {
+        if (ptr >= end) {
+            cursor->error = true;
+            return false;
+        }
+        decoded.number = *ptr++;
+    }
+    if (IS_EXTENDED_VALUE(octet)) {
+        if (ptr >= end) {
+            cursor->error = true;
+            return false;
+        }
+        if (*ptr == 255) {
+            /* tagged as uint32_t */
+            if ((end - ptr) < 5) {
+                cursor->error = true;
+                return false;
+            }
+            decoded.len_value_type =
+                ((uint32_t) ptr[1] << 24) | ((uint32_t) ptr[2] << 16) |
+                ((uint32_t) ptr[3] << 8) | ptr[4];
+            ptr += 5;
+        } else if (*ptr == 254) {
+            /* tagged as uint16_t */
+            if ((end - ptr) < 3) {
+                cursor->error = true;
+                return false;
+            }
+            decoded.len_value_type = ((uint32_t) ptr[1] << 8) | ptr[2];
+            ptr += 3;
+        } else {
+            /* no tag - must be uint8_t */
+            decoded.len_value_type = *ptr++;
+        }
+    }
+    *tag = decoded;
+    cursor->ptr = ptr;
+
+    return true;
+}
+
+/* from clause 20.2.4 Encoding of an Unsigned Integer Value */
+bool decode_cursor_unsigned(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    uint32_t * value)
+{
+    const uint8_t *ptr = cursor->ptr;
+    uint32_t result = 0;
+
+    if ((len_value > 4) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    while (len_value--) {
+        result = (result << 8) | *ptr++;
+    }
+    cursor->ptr = ptr;
+    *value = result;
+
+    return true;
+}
+
+/* from clause 20.2.5 Encoding of a Signed Integer Value */
+bool decode_cursor_signed(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    int32_t * value)
+{
+    const uint8_t *ptr = cursor->ptr;
+    uint32_t result = 0;
+
+    if ((len_value > 4) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    if (len_value) {
+        /* the first octet carries the sign */
+        result = (uint32_t) (int32_t) (int8_t) * ptr++;
+        len_value--;
+    }
+    while (len_value--) {
+        result = (result << 8) | *ptr++;
+    }
+    cursor->ptr = ptr;
+    *value = (int32_t) result;
+
+    return true;
+}
+
+/* from clause 20.2.6 Encoding of a Real Number Value */
+bool decode_cursor_real(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    float *value)
+{
+    if ((len_value != 4) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    decode_real((uint8_t *) cursor->ptr, value);
+    cursor->ptr += 4;
+
+    return true;
+}
+
+/* from clause 20.2.7 Encoding of a Double Precision Real Number Value */
+bool decode_cursor_double(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    double *value)
+{
+    if ((len_value != 8) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    decode_double((uint8_t *) cursor->ptr, value);
+    cursor->ptr += 8;
+
+    return true;
+}
+
+/* from clause 20.2.12 Encoding of a Date Value */
+bool decode_cursor_date(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    BACNET_DATE * bdate)
+{
+    if ((len_value != 4) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    decode_date((uint8_t *) cursor->ptr, bdate);
+    cursor->ptr += 4;
+
+    return true;
+}
+
+/* from clause 20.2.13 Encoding of a Time Value */
+bool decode_cursor_time(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    BACNET_TIME * btime)
+{
+    if ((len_value != 4) || (len_value > decode_cursor_remaining(cursor))) {
+        cursor->error = true;
+        return false;
+    }
+    decode_bacnet_time((uint8_t *) cursor->ptr, btime);
+    cursor->ptr += 4;
+
+    return true;
+}
+
+/* from clause 20.2.14 Encoding of an Object Identifier Value */
+bool decode_cursor_object_id(
+    BACNET_DECODE_CURSOR * cursor,
+    uint32_t len_value,
+    int *object_type,
+    uint32_t * instance)
+{
+    uint32_t value = 0;
+
+    if (len_value != 4) {
+        cursor->error = true;
+        return false;
+    }
+    if (!decode_cursor_unsigned(cursor, len_value, &value)) {
+        return false;
+    }
+    *object_type = (int) ((value >> BACNET_INSTANCE_BITS) & BACNET_MAX_OBJECT);
+    *instance = value & BACNET_MAX_INSTANCE;
+
+    return true;
+}
+
+/* takes the tag only if it is the given kind and number */
+static inline bool decode_cursor_tag_match(
+    BACNET_DECODE_CURSOR * cursor,
+    uint8_t kind,
+    uint8_t tag_number,
+    BACNET_TAG * tag)
+{
+    const uint8_t *start = cursor->ptr;
+
+    if (start >= cursor->end) {
+        /* no tag at all - an optional one left out */
+        return false;
+    }
+    if (!decode_cursor_tag(cursor, tag)) {
+        return false;
+    }
+    if ((tag->kind != kind) || (tag->number != tag_number)) {
+        cursor->ptr = start;
+        return false;
+    }
+
+    return true;
+}
+
+bool decode_cursor_opening_tag(
+    BACNET_DECODE_CURSOR * cursor,
+    uint8_t tag_number)
+{
+    BACNET_TAG tag;
+
+    return decode_cursor_tag_match(cursor,
+        BACNET_TAG_CONTEXT | BACNET_TAG_OPENING, tag_number, &tag);
+}
+
+bool decode_cursor_closing_tag(
+    BACNET_DECODE_CURSOR * cursor,
+    uint8_t tag_number)
+{
+    BACNET_TAG tag;
+
+    return decode_cursor_tag_match(cursor,
+        BACNET_TAG_CONTEXT | BACNET_TAG_CLOSING, tag_number, &tag);
+}
+
+bool decode_cursor_context_unsigned(
+    BACNET_DECODE_CURSOR * cursor,
+    uint8_t tag_number,
+    uint32_t * value)
+{
+    const uint8_t *start = cursor->ptr;
+    const BACNET_TAG *entry;
+    BACNET_TAG tag;
+    uint32_t len = 0;
+    uint32_t result = 0;
+
+    if (start >= cursor->end) {
+        return false;
+    }
+    entry = &bacnet_tag_table[*start];
+    if (!(entry->kind & BACNET_TAG_EXTENDED)) {
+        /* a one octet tag, so a value of four octets at most */
+        if ((entry->kind != BACNET_TAG_CONTEXT) ||
+            (entry->number != tag_number)) {
+            return false;
+        }
+        len = entry->len_value_type;
+        if (len >= (uint32_t) (cursor->end - start)) {
+            cursor->error = true;
+            return false;
+        }
+        cursor->ptr = start + 1;
+        while (len--) {
+            result = (result << 8) | *cursor->ptr++;
+        }
+        *value = result;
+        return true;
+    }
+    if (!decode_cursor_tag_match(cursor, BACNET_TAG_CONTEXT, tag_number,
+            &tag)) {
+        return false;
+    }
+    if (!decode_cursor_unsigned(cursor, tag.len_value_type, value)) {
+        cursor->ptr = start;
+        return false;
+    }
+
+    return true;
+}
+
+bool decode_cursor_context_object_id(
+    BACNET_DECODE_CURSOR * cursor,
+    uint8_t tag_number,
+    int *object_type,
+    uint32_t * instance)
+{
+    const uint8_t *start = cursor->ptr;
+    const BACNET_TAG *entry;
+    BACNET_TAG tag;
+    uint32_t value = 0;
+
+    if (start >= cursor->end) {
+        return false;
+    }
+    entry = &bacnet_tag_table[*start];
+    if (!(entry->kind & BACNET_TAG_EXTENDED)) {
+        if ((entry->kind != BACNET_TAG_CONTEXT) ||
+            (entry->number != tag_number)) {
+            return false;
+        }
+        if ((entry->len_value_type != 4) || ((cursor->end - start) < 5)) {
+            cursor->error = true;
+            return false;
+        }
+        value =
+            ((uint32_t) start[1] << 24) | ((uint32_t) start[2] << 16) |
+            ((uint32_t) start[3] << 8) | start[4];
+        cursor->ptr = start + 5;
+        *object_type =
+            (int) ((value >> BACNET_INSTANCE_BITS) & BACNET_MAX_OBJECT);
+        *instance = value & BACNET_MAX_INSTANCE;
+        return true;
+    }
+    if (!decode_cursor_tag_match(cursor, BACNET_TAG_CONTEXT, tag_number,
+            &tag)) {
+        return false;
+    }
+    if (!decode_cursor_object_id(cursor, tag.len_value_type, object_type,
+            instance)) {
+        cursor->ptr = start;
+        return false;
+    }
+
+    return true;
+}
+
 /* end of decoding_encoding.c */
 #ifdef TEST
 #include <assert.h>
@@ -1884,6 +2203,140 @@ void testBACDCodeTags(
     return;
 }
 
+void testBACDCodeCursor(
+    Test * pTest)
+{
+    uint8_t apdu[MAX_APDU] = { 0 };
+    BACNET_DECODE_CURSOR cursor;
+    BACNET_TAG tag;
+    uint8_t tag_number = 0;
+    uint32_t value = 0, test_value = 0;
+    int32_t signed_value = 0;
+    float real_value = 0.0;
+    int object_type = 0;
+    uint32_t instance = 0;
+    int len = 0, test_len = 0, id_len = 0;
+    unsigned octet = 0;
+    unsigned i = 0;
+
+    /* every first octet agrees with the long way, or is left to it */
+    for (octet = 0; octet < 256; octet++) {
+        memset(apdu, 0, sizeof(apdu));
+        apdu[0] = (uint8_t) octet;
+        len = decode_tag_number_and_value(&apdu[0], &tag_number, &value);
+        decode_cursor_init(&cursor, &apdu[0], sizeof(apdu));
+        ct_test(pTest, decode_cursor_tag(&cursor, &tag));
+        ct_test(pTest, cursor.error == false);
+        ct_test(pTest, (cursor.ptr - &apdu[0]) == len);
+        ct_test(pTest, tag.number == tag_number);
+        ct_test(pTest, !(tag.kind & BACNET_TAG_EXTENDED));
+        ct_test(pTest, ((tag.kind & BACNET_TAG_CONTEXT) != 0) ==
+            IS_CONTEXT_SPECIFIC(apdu[0]));
+        ct_test(pTest, ((tag.kind & BACNET_TAG_OPENING) != 0) ==
+            decode_is_opening_tag(&apdu[0]));
+        ct_test(pTest, ((tag.kind & BACNET_TAG_CLOSING) != 0) ==
+            decode_is_closing_tag(&apdu[0]));
+        if (!(tag.kind & (BACNET_TAG_OPENING | BACNET_TAG_CLOSING))) {
+            ct_test(pTest, tag.len_value_type == value);
+        }
+    }
+    /* extended numbers and lengths */
+    for (tag_number = 0;; tag_number++) {
+        for (value = 1;; value = value << 1) {
+            len = encode_tag(&apdu[0], tag_number, true, value);
+            decode_cursor_init(&cursor, &apdu[0], len);
+            ct_test(pTest, decode_cursor_tag(&cursor, &tag));
+            ct_test(pTest, decode_cursor_remaining(&cursor) == 0);
+            ct_test(pTest, tag.number == tag_number);
+            ct_test(pTest, tag.kind == BACNET_TAG_CONTEXT);
+            ct_test(pTest, tag.len_value_type == value);
+            /* and every truncation of it is refused */
+            for (test_len = 0; test_len < len; test_len++) {
+                decode_cursor_init(&cursor, &apdu[0], test_len);
+                ct_test(pTest, decode_cursor_tag(&cursor, &tag) == false);
+                ct_test(pTest, cursor.error == true);
+                ct_test(pTest, cursor.ptr == &apdu[0]);
+            }
+            if (value & BIT31) {
+                break;
+            }
+        }
+        if (tag_number == 255) {
+            break;
+        }
+    }
+    /* values */
+    for (i = 0; i < 31; i++) {
+        value = (uint32_t) 1 << i;
+        len = encode_bacnet_unsigned(&apdu[0], value);
+        decode_cursor_init(&cursor, &apdu[0], len);
+        ct_test(pTest, decode_cursor_unsigned(&cursor, len, &test_value));
+        ct_test(pTest, test_value == value);
+        decode_cursor_init(&cursor, &apdu[0], len - 1);
+        ct_test(pTest, decode_cursor_unsigned(&cursor, len,
+                &test_value) == false);
+        ct_test(pTest, cursor.error == true);
+        len = encode_bacnet_signed(&apdu[0], -(int32_t) value);
+        decode_cursor_init(&cursor, &apdu[0], len);
+        ct_test(pTest, decode_cursor_signed(&cursor, len, &signed_value));
+        ct_test(pTest, signed_value == -(int32_t) value);
+    }
+    len = encode_bacnet_real(-12.5, &apdu[0]);
+    decode_cursor_init(&cursor, &apdu[0], len);
+    ct_test(pTest, decode_cursor_real(&cursor, len, &real_value));
+    ct_test(pTest, real_value == -12.5);
+    decode_cursor_init(&cursor, &apdu[0], len - 1);
+    ct_test(pTest, decode_cursor_real(&cursor, len, &real_value) == false);
+    ct_test(pTest, cursor.error == true);
+    /* the _safe decoders are the cursor underneath */
+    ct_test(pTest, decode_real_safe(&apdu[0], len - 1, &real_value) == 3);
+    ct_test(pTest, real_value == 0.0);
+    len = encode_tag(&apdu[0], 3, true, 300);
+    ct_test(pTest, decode_tag_number_and_value_safe(&apdu[0], len,
+            &tag_number, &value) == len);
+    ct_test(pTest, (tag_number == 3) && (value == 300));
+    ct_test(pTest, decode_tag_number_and_value_safe(&apdu[0], len - 1,
+            &tag_number, &value) == 0);
+    /* a read property request, whole and cut short */
+    len = encode_context_object_id(&apdu[0], 0, OBJECT_ANALOG_INPUT, 1234);
+    id_len = len;
+    len += encode_context_enumerated(&apdu[len], 1, PROP_PRESENT_VALUE);
+    test_len = len;
+    len += encode_opening_tag(&apdu[len], 3);
+    len += encode_closing_tag(&apdu[len], 3);
+    decode_cursor_init(&cursor, &apdu[0], len);
+    ct_test(pTest, decode_cursor_context_object_id(&cursor, 1, &object_type,
+            &instance) == false);
+    ct_test(pTest, cursor.error == false);
+    ct_test(pTest, decode_cursor_context_object_id(&cursor, 0, &object_type,
+            &instance));
+    ct_test(pTest, object_type == OBJECT_ANALOG_INPUT);
+    ct_test(pTest, instance == 1234);
+    ct_test(pTest, decode_cursor_context_unsigned(&cursor, 1, &value));
+    ct_test(pTest, value == PROP_PRESENT_VALUE);
+    ct_test(pTest, decode_cursor_context_unsigned(&cursor, 2,
+            &value) == false);
+    ct_test(pTest, decode_cursor_closing_tag(&cursor, 3) == false);
+    ct_test(pTest, decode_cursor_opening_tag(&cursor, 3));
+    ct_test(pTest, decode_cursor_closing_tag(&cursor, 3));
+    ct_test(pTest, decode_cursor_remaining(&cursor) == 0);
+    ct_test(pTest, decode_cursor_context_unsigned(&cursor, 2,
+            &value) == false);
+    ct_test(pTest, cursor.error == false);
+    for (len = 0; len < test_len; len++) {
+        decode_cursor_init(&cursor, &apdu[0], len);
+        if (decode_cursor_context_object_id(&cursor, 0, &object_type,
+                &instance)) {
+            ct_test(pTest, decode_cursor_context_unsigned(&cursor, 1,
+                    &value) == false);
+        }
+        /* only a cut between the two leaves no partial tag */
+        ct_test(pTest, cursor.error == ((len > 0) && (len != id_len)));
+    }
+
+    return;
+}
+
 void testBACDCodeEnumerated(
     Test * pTest)
 {
@@ -2998,6 +3451,8 @@ int main(
     /* individual tests */
     rc = ct_addTestFunction(pTest, testBACDCodeTags);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testBACDCodeCursor);
+    assert(rc);
     rc = ct_addTestFunction(pTest, testBACDCodeReal);
     assert(rc);
     rc = ct_addTestFunction(pTest, testBACDCodeUnsigned);
@@ -82,12 +82,15 @@ int decode_real_safe(
     uint32_t len_value,
     float *real_value)
 {
-    if (len_value != 4) {
+    BACNET_DECODE_CURSOR cursor;
+
+    decode_cursor_init(&cursor, apdu, len_value);
+    if (!decode_cursor_real(&cursor, len_value, real_value)) {
         *real_value = 0.0f;
         return len_value;
-    } else {
-        return decode_real(apdu, real_value);
     }
+
+    return 4;
 }
 
 int decode_context_real(
@@ -178,12 +181,15 @@ int decode_double_safe(
     uint32_t len_value,
     double *double_value)
 {
-    if (len_value != 8) {
+    BACNET_DECODE_CURSOR cursor;
+
+    decode_cursor_init(&cursor, apdu, len_value);
+    if (!decode_cursor_double(&cursor, len_value, double_value)) {
         *double_value = 0.0;
         return len_value;
-    } else {
-        return decode_double(apdu, double_value);
     }
+
+    return 8;
 }
 
 /* from clause 20.2.7 Encoding of a Double Precision Real Number Value */
@@ -32,8 +32,12 @@
  -------------------------------------------
 ####COPYRIGHTEND####*/
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for recvmmsg and sendmmsg */
+#endif
 #include <stdint.h>     /* for standard integer types uint8_t etc. */
 #include <stdbool.h>    /* for the standard bool type. */
+#include <string.h>
 #include "bacdcode.h"
 #include "bacint.h"
 #include "bip.h"
@@ -48,6 +52,12 @@ static uint16_t BIP_Port = 0xBAC0;
 static struct in_addr BIP_Address;
 /* Broadcast Address - stored in host byte order */
 static struct in_addr BIP_Broadcast_Address;
+/* datagrams held back by bip_send_batch_begin */
+static struct sockaddr_in BIP_Send_Dest[BIP_BATCH_SIZE];
+static uint8_t BIP_Send_Mtu[BIP_BATCH_SIZE][MAX_MPDU];
+static uint16_t BIP_Send_Len[BIP_BATCH_SIZE];
+static unsigned BIP_Send_Count = 0;
+static unsigned BIP_Send_Depth = 0;
 
 void bip_set_socket(
     int sock_fd)
@@ -146,8 +156,7 @@ int bip_send_pdu(
     unsigned pdu_len)
 {       /* number of bytes of data */
     struct sockaddr_in bip_dest;
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    int mtu_len = 0;
+    uint8_t header[MAX_HEADER];
     int bytes_sent = 0;
     /* addr and port in host format */
     struct in_addr address;
@@ -159,16 +168,16 @@ int bip_send_pdu(
     if (BIP_Socket < 0)
         return BIP_Socket;
 
-    mtu[0] = BVLL_TYPE_BACNET_IP;
+    header[0] = BVLL_TYPE_BACNET_IP;
     bip_dest.sin_family = AF_INET;
     if (dest->net == BACNET_BROADCAST_NETWORK) {
         /* broadcast */
         address.s_addr = BIP_Broadcast_Address.s_addr;
         port = BIP_Port;
-        mtu[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
+        header[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
     } else if (dest->mac_len == 6) {
         bip_decode_bip_address(&dest->mac[0], &address, &port);
-        mtu[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+        header[1] = BVLC_ORIGINAL_UNICAST_NPDU;
     } else {
         /* invalid address */
         return -1;
@@ -176,78 +185,238 @@ int bip_send_pdu(
     bip_dest.sin_addr.s_addr = htonl(address.s_addr);
     bip_dest.sin_port = htons(port);
     memset(&(bip_dest.sin_zero), '\0', 8);
-    mtu_len = 2;
-    mtu_len +=
-        encode_unsigned16(&mtu[mtu_len],
-        (uint16_t) (pdu_len + 4 /*inclusive */ ));
-    memcpy(&mtu[mtu_len], pdu, pdu_len);
-    mtu_len += pdu_len;
-
-    /* Send the packet */
+    encode_unsigned16(&header[2], (uint16_t) (pdu_len + 4 /*inclusive */ ));
+
+    /* Send the packet - the PDU goes out from where it was encoded */
     bytes_sent =
-        sendto(BIP_Socket, (char *) mtu, mtu_len, 0,
-        (struct sockaddr *) &bip_dest, sizeof(struct sockaddr));
+        bip_send_mpdu_header(&bip_dest, header, sizeof(header), pdu,
+        (uint16_t) pdu_len);
 
     return bytes_sent;
 }
 
-/* receives a BACnet/IP packet */
-/* returns the number of octets in the PDU, or zero on failure */
-uint16_t bip_receive(
-    BACNET_ADDRESS * src,       /* source address */
-    uint8_t * pdu,      /* PDU data */
-    uint16_t max_pdu,   /* amount of space available in the PDU  */
-    unsigned timeout)
-{       /* number of milliseconds to wait for a packet */
-    int received_bytes = 0;
-    uint16_t pdu_len = 0;       /* return value */
-    fd_set read_fds;
-    int max = 0;
-    struct timeval select_timeout;
-    struct sockaddr_in sin = { 0 };
-    socklen_t sin_len = sizeof(sin);
-    uint16_t i = 0;
+/* sends every datagram held in the batch queue */
+static int bip_send_batch_flush(
+    void)
+{
+    int sent = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[BIP_BATCH_SIZE];
+    struct iovec iov[BIP_BATCH_SIZE];
+    unsigned i = 0;
+    int rv = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < BIP_Send_Count; i++) {
+        iov[i].iov_base = BIP_Send_Mtu[i];
+        iov[i].iov_len = BIP_Send_Len[i];
+        msgs[i].msg_hdr.msg_name = &BIP_Send_Dest[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    /* a datagram that can't be sent is skipped, as sendto would drop it */
+    while (sent < (int) BIP_Send_Count) {
+        rv = sendmmsg(BIP_Socket, &msgs[sent], BIP_Send_Count - sent, 0);
+        if (rv > 0)
+            sent += rv;
+        else if ((rv < 0) && (errno == EINTR))
+            continue;
+        else
+            sent++;
+    }
+#else
+    for (sent = 0; sent < (int) BIP_Send_Count; sent++) {
+        sendto(BIP_Socket, (char *) BIP_Send_Mtu[sent], BIP_Send_Len[sent], 0,
+            (struct sockaddr *) &BIP_Send_Dest[sent],
+            sizeof(struct sockaddr));
+    }
+#endif
+    BIP_Send_Count = 0;
 
-    /* Make sure the socket is open */
+    return sent;
+}
+
+void bip_send_batch_begin(
+    void)
+{
+    BIP_Send_Depth++;
+}
+
+void bip_send_batch_end(
+    void)
+{
+    if (BIP_Send_Depth == 0)
+        return;
+    BIP_Send_Depth--;
+    if ((BIP_Send_Depth == 0) && (BIP_Send_Count > 0))
+        bip_send_batch_flush();
+}
+
+int bip_send_mpdu(
+    struct sockaddr_in *dest,
+    uint8_t * mtu,
+    uint16_t mtu_len)
+{
     if (BIP_Socket < 0)
-        return 0;
+        return BIP_Socket;
+    if (BIP_Send_Depth == 0) {
+        return sendto(BIP_Socket, (char *) mtu, mtu_len, 0,
+            (struct sockaddr *) dest, sizeof(struct sockaddr));
+    }
+    if (mtu_len > MAX_MPDU)
+        return -1;
+    if (BIP_Send_Count == BIP_BATCH_SIZE)
+        bip_send_batch_flush();
+    BIP_Send_Dest[BIP_Send_Count] = *dest;
+    memcpy(BIP_Send_Mtu[BIP_Send_Count], mtu, mtu_len);
+    BIP_Send_Len[BIP_Send_Count] = mtu_len;
+    BIP_Send_Count++;
+
+    return mtu_len;
+}
 
-    /* we could just use a non-blocking socket, but that consumes all
-       the CPU time.  We can use a timeout; it is only supported as
-       a select. */
-    if (timeout >= 1000) {
-        select_timeout.tv_sec = timeout / 1000;
-        select_timeout.tv_usec =
-            1000 * (timeout - select_timeout.tv_sec * 1000);
+int bip_send_mpdu_header(
+    struct sockaddr_in *dest,
+    uint8_t * header,
+    uint16_t header_len,
+    uint8_t * pdu,
+    uint16_t pdu_len)
+{
+    uint8_t *mtu;
+#if defined(__linux__)
+    struct msghdr msg;
+    struct iovec iov[2];
+#else
+    uint8_t buffer[MAX_MPDU];
+#endif
+
+    if (BIP_Socket < 0)
+        return BIP_Socket;
+    if ((header_len + pdu_len) > MAX_MPDU)
+        return -1;
+    if (BIP_Send_Depth == 0) {
+#if defined(__linux__)
+        iov[0].iov_base = header;
+        iov[0].iov_len = header_len;
+        iov[1].iov_base = pdu;
+        iov[1].iov_len = pdu_len;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = dest;
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        return sendmsg(BIP_Socket, &msg, 0);
+#else
+        mtu = buffer;
+#endif
     } else {
-        select_timeout.tv_sec = 0;
-        select_timeout.tv_usec = 1000 * timeout;
+        /* the caller reuses its buffer, so a held datagram is copied,
+           straight into its slot */
+        if (BIP_Send_Count == BIP_BATCH_SIZE)
+            bip_send_batch_flush();
+        BIP_Send_Dest[BIP_Send_Count] = *dest;
+        BIP_Send_Len[BIP_Send_Count] = header_len + pdu_len;
+        mtu = BIP_Send_Mtu[BIP_Send_Count];
+        BIP_Send_Count++;
     }
-    FD_ZERO(&read_fds);
-    FD_SET(BIP_Socket, &read_fds);
-    max = BIP_Socket;
-    /* see if there is a packet for us */
-    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0)
-        received_bytes =
-            recvfrom(BIP_Socket, (char *) &pdu[0], max_pdu, 0,
-            (struct sockaddr *) &sin, &sin_len);
-    else
-        return 0;
+    memcpy(&mtu[0], header, header_len);
+    memcpy(&mtu[header_len], pdu, pdu_len);
+#if !defined(__linux__)
+    if (BIP_Send_Depth == 0)
+        return sendto(BIP_Socket, (char *) mtu, header_len + pdu_len, 0,
+            (struct sockaddr *) dest, sizeof(struct sockaddr));
+#endif
 
-    /* See if there is a problem */
-    if (received_bytes < 0) {
-        return 0;
+    return header_len + pdu_len;
+}
+
+/* sends the same message to each destination; nothing is shared with
+   the batch queue, so another thread may call this */
+int bip_send_mpdu_fanout(
+    struct sockaddr_in *dests,
+    unsigned count,
+    uint8_t * mtu,
+    uint16_t mtu_len)
+{
+    int sent = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[BIP_BATCH_SIZE];
+    struct iovec iov;
+    unsigned chunk = 0;
+    unsigned done = 0;
+    unsigned i = 0;
+    int rv = 0;
+
+    if (BIP_Socket < 0)
+        return BIP_Socket;
+    iov.iov_base = mtu;
+    iov.iov_len = mtu_len;
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < BIP_BATCH_SIZE; i++) {
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (count > 0) {
+        chunk = (count > BIP_BATCH_SIZE) ? BIP_BATCH_SIZE : count;
+        for (i = 0; i < chunk; i++)
+            msgs[i].msg_hdr.msg_name = &dests[i];
+        done = 0;
+        while (done < chunk) {
+            rv = sendmmsg(BIP_Socket, &msgs[done], chunk - done, 0);
+            if (rv > 0) {
+                done += rv;
+                sent += rv;
+            } else if ((rv < 0) && (errno == EINTR))
+                continue;
+            else
+                done++;
+        }
+        dests += chunk;
+        count -= chunk;
+    }
+#else
+    unsigned i = 0;
+
+    if (BIP_Socket < 0)
+        return BIP_Socket;
+    for (i = 0; i < count; i++) {
+        if (sendto(BIP_Socket, (char *) mtu, mtu_len, 0,
+                (struct sockaddr *) &dests[i], sizeof(struct sockaddr)) > 0)
+            sent++;
     }
+#endif
+
+    return sent;
+}
 
+/* checks one received BVLL message and finds the NPDU in it */
+static uint16_t bip_handle_message(
+    BACNET_ADDRESS * src,
+    struct sockaddr_in *from,
+    uint8_t * mpdu,
+    int received_bytes,
+    uint8_t ** npdu)
+{
+    uint16_t pdu_len = 0;       /* return value */
+    struct sockaddr_in sin = *from;
+
+    *npdu = NULL;
     /* no problem, just no bytes */
     if (received_bytes == 0)
         return 0;
 
     /* the signature of a BACnet/IP packet */
-    if (pdu[0] != BVLL_TYPE_BACNET_IP)
+    if ((received_bytes < 4) || (mpdu[0] != BVLL_TYPE_BACNET_IP))
         return 0;
-    if ((pdu[1] == BVLC_ORIGINAL_UNICAST_NPDU) ||
-        (pdu[1] == BVLC_ORIGINAL_BROADCAST_NPDU)) {
+    /* decode the length of the PDU - length is inclusive of BVLC */
+    (void) decode_unsigned16(&mpdu[2], &pdu_len);
+    /* ignore messages that claim more than was received */
+    if ((pdu_len < 4) || (pdu_len > received_bytes))
+        return 0;
+    if ((mpdu[1] == BVLC_ORIGINAL_UNICAST_NPDU) ||
+        (mpdu[1] == BVLC_ORIGINAL_BROADCAST_NPDU)) {
         /* ignore messages from me */
         if ((sin.sin_addr.s_addr == htonl(BIP_Address.s_addr)) &&
             (sin.sin_port == htons(BIP_Port))) {
@@ -262,37 +431,13 @@ uint16_t bip_receive(
             (void) encode_unsigned16(&src->mac[4], htons(sin.sin_port));
             /* FIXME: check destination address */
             /* see if it is broadcast or for us */
-            /* decode the length of the PDU - length is inclusive of BVLC */
-            (void) decode_unsigned16(&pdu[2], &pdu_len);
             /* subtract off the BVLC header */
             pdu_len -= 4;
-            if (pdu_len < max_pdu) {
-#if 0
-                fprintf(stderr, "BIP: NPDU[%hu]:", pdu_len);
-#endif
-                /* shift the buffer to return a valid PDU */
-                for (i = 0; i < pdu_len; i++) {
-                    pdu[i] = pdu[4 + i];
-#if 0
-                    fprintf(stderr, "%02X ", pdu[i]);
-#endif
-                }
-#if 0
-                fprintf(stderr, "\n");
-#endif
-            }
-            /* ignore packets that are too large */
-            /* clients should check my max-apdu first */
-            else {
-                pdu_len = 0;
-#if PRINT_ENABLED
-                fprintf(stderr, "BIP: PDU too large. Discarded!.\n");
-#endif
-            }
+            *npdu = &mpdu[4];
         }
-    } else if (pdu[1] == BVLC_FORWARDED_NPDU) {
-        (void) decode_unsigned32(&pdu[4], (uint32_t *) & sin.sin_addr.s_addr);
-        (void) decode_unsigned16(&pdu[8], &sin.sin_port);
+    } else if ((mpdu[1] == BVLC_FORWARDED_NPDU) && (pdu_len >= 10)) {
+        (void) decode_unsigned32(&mpdu[4], (uint32_t *) & sin.sin_addr.s_addr);
+        (void) decode_unsigned16(&mpdu[8], &sin.sin_port);
         if ((sin.sin_addr.s_addr == htonl(BIP_Address.s_addr)) &&
             (sin.sin_port == htons(BIP_Port))) {
             /* ignore messages from me */
@@ -304,30 +449,159 @@ uint16_t bip_receive(
             (void) encode_unsigned16(&src->mac[4], htons(sin.sin_port));
             /* FIXME: check destination address */
             /* see if it is broadcast or for us */
-            /* decode the length of the PDU - length is inclusive of BVLC */
-            (void) decode_unsigned16(&pdu[2], &pdu_len);
             /* subtract off the BVLC header */
             pdu_len -= 10;
-            if (pdu_len < max_pdu) {
-                /* shift the buffer to return a valid PDU */
-                for (i = 0; i < pdu_len; i++) {
-                    pdu[i] = pdu[4 + 6 + i];
-                }
-            } else {
-                /* ignore packets that are too large */
-                /* clients should check my max-apdu first */
-                pdu_len = 0;
-            }
+            *npdu = &mpdu[4 + 6];
         }
     } else {
 #if PRINT_ENABLED
         fprintf(stderr, "BIP: BVLC discarded!\n");
 #endif
     }
+    if (*npdu == NULL)
+        pdu_len = 0;
 
     return pdu_len;
 }
 
+/* receives a BACnet/IP packet into mpdu */
+/* returns the number of octets in the NPDU, or zero on failure;
+   *npdu points at the NPDU inside mpdu */
+uint16_t bip_receive_view(
+    BACNET_ADDRESS * src,       /* source address */
+    uint8_t * mpdu,     /* buffer for the whole BVLL message */
+    uint16_t max_mpdu,  /* amount of space available in mpdu */
+    uint8_t ** npdu,    /* returns the start of the NPDU in mpdu */
+    unsigned timeout)
+{       /* number of milliseconds to wait for a packet */
+    int received_bytes = 0;
+    fd_set read_fds;
+    int max = 0;
+    struct timeval select_timeout;
+    struct sockaddr_in sin = { 0 };
+    socklen_t sin_len = sizeof(sin);
+
+    *npdu = NULL;
+    /* Make sure the socket is open */
+    if (BIP_Socket < 0)
+        return 0;
+
+    /* we could just use a non-blocking socket, but that consumes all
+       the CPU time.  We can use a timeout; it is only supported as
+       a select. */
+    if (timeout >= 1000) {
+        select_timeout.tv_sec = timeout / 1000;
+        select_timeout.tv_usec =
+            1000 * (timeout - select_timeout.tv_sec * 1000);
+    } else {
+        select_timeout.tv_sec = 0;
+        select_timeout.tv_usec = 1000 * timeout;
+    }
+    FD_ZERO(&read_fds);
+    FD_SET(BIP_Socket, &read_fds);
+    max = BIP_Socket;
+    /* see if there is a packet for us */
+    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0)
+        received_bytes =
+            recvfrom(BIP_Socket, (char *) &mpdu[0], max_mpdu, 0,
+            (struct sockaddr *) &sin, &sin_len);
+    else
+        return 0;
+
+    /* See if there is a problem */
+    if (received_bytes < 0) {
+        return 0;
+    }
+
+    return bip_handle_message(src, &sin, mpdu, received_bytes, npdu);
+}
+
+/* receives a BACnet/IP packet */
+/* returns the number of octets in the PDU, or zero on failure */
+uint16_t bip_receive(
+    BACNET_ADDRESS * src,       /* source address */
+    uint8_t * pdu,      /* PDU data */
+    uint16_t max_pdu,   /* amount of space available in the PDU  */
+    unsigned timeout)
+{       /* number of milliseconds to wait for a packet */
+    uint8_t *npdu = NULL;
+    uint16_t pdu_len = 0;
+
+    pdu_len = bip_receive_view(src, pdu, max_pdu, &npdu, timeout);
+    /* the NPDU follows the BVLC header in the same buffer */
+    if (pdu_len)
+        memmove(pdu, npdu, pdu_len);
+
+    return pdu_len;
+}
+
+int bip_receive_batch(
+    BIP_MPDU * mpdus,
+    unsigned count,
+    unsigned timeout)
+{
+    fd_set read_fds;
+    struct timeval select_timeout;
+    int received = 0;
+#if defined(__linux__)
+    struct mmsghdr msgs[BIP_BATCH_SIZE];
+    struct iovec iov[BIP_BATCH_SIZE];
+    unsigned i = 0;
+#else
+    socklen_t sin_len = sizeof(struct sockaddr_in);
+#endif
+
+    if ((BIP_Socket < 0) || (count == 0))
+        return 0;
+    if (timeout) {
+        select_timeout.tv_sec = timeout / 1000;
+        select_timeout.tv_usec = 1000 * (timeout % 1000);
+        FD_ZERO(&read_fds);
+        FD_SET(BIP_Socket, &read_fds);
+        if (select(BIP_Socket + 1, &read_fds, NULL, NULL,
+                &select_timeout) <= 0)
+            return 0;
+    }
+#if defined(__linux__)
+    if (count > BIP_BATCH_SIZE)
+        count = BIP_BATCH_SIZE;
+    memset(msgs, 0, sizeof(struct mmsghdr) * count);
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = mpdus[i].mpdu;
+        iov[i].iov_len = sizeof(mpdus[i].mpdu);
+        msgs[i].msg_hdr.msg_name = &mpdus[i].sin;
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    /* take whatever is queued, without waiting for the rest */
+    received = recvmmsg(BIP_Socket, msgs, count, MSG_DONTWAIT, NULL);
+    if (received < 0)
+        return 0;
+    for (i = 0; i < (unsigned) received; i++)
+        mpdus[i].mpdu_len = (uint16_t) msgs[i].msg_len;
+#else
+    /* one datagram per call without recvmmsg */
+    received = recvfrom(BIP_Socket, (char *) mpdus[0].mpdu,
+        sizeof(mpdus[0].mpdu), 0, (struct sockaddr *) &mpdus[0].sin, &sin_len);
+    if (received < 0)
+        return 0;
+    mpdus[0].mpdu_len = (uint16_t) received;
+    received = 1;
+#endif
+
+    return received;
+}
+
+uint16_t bip_handle_mpdu(
+    BACNET_ADDRESS * src,
+    BIP_MPDU * mpdu,
+    uint8_t ** npdu)
+{
+    return bip_handle_message(src, &mpdu->sin, mpdu->mpdu, mpdu->mpdu_len,
+        npdu);
+}
+
 void bip_get_my_address(
     BACNET_ADDRESS * my_address)
 {
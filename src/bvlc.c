@@ -35,11 +35,15 @@
 #include <stdint.h>     /* for standard integer types uint8_t etc. */
 #include <stdbool.h>    /* for the standard bool type. */
 #include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "bacenum.h"
 #include "bacdcode.h"
 #include "bacint.h"
 #include "bvlc.h"
 #include "bip.h"
+#include "timerwheel.h"
 #ifndef DEBUG_ENABLED
 #define DEBUG_ENABLED 0
 #endif
@@ -50,18 +54,22 @@
    Broadcast Distribution Table, and
    Foreign Device Registration */
 typedef struct {
-    /* true if valid entry - false if not */
-    bool valid;
     /* BACnet/IP address */
     struct in_addr dest_address;
     /* BACnet/IP port number - not always 47808=BAC0h */
     uint16_t dest_port;
     /* Broadcast Distribution Mask - stored in host byte order */
     struct in_addr broadcast_mask;
+    /* where Forwarded-NPDUs go, resolved when the BDT is written */
+    struct sockaddr_in forward_dest;
+    /* true if forward_dest is our own address or broadcast address */
+    bool self;
 } BBMD_TABLE_ENTRY;
 
-#define MAX_BBMD_ENTRIES 128
-static BBMD_TABLE_ENTRY BBMD_Table[MAX_BBMD_ENTRIES];
+/* the BDT holds only the entries written - no empty slots */
+static BBMD_TABLE_ENTRY *BBMD_Table;
+static unsigned BBMD_Table_Count;
+static unsigned BBMD_Table_Size;
 
 /*Each device that registers as a foreign device shall be placed
 in an entry in the BBMD's Foreign Device Table (FDT). Each
@@ -72,20 +80,39 @@ seconds remaining before the BBMD will purge the registrant's FDT
 entry if no re-registration occurs. This value will be initialized
 to the 2-octet Time-to-Live value supplied at the time of
 registration.*/
-typedef struct {
-    bool valid;
+typedef struct fd_table_entry {
     /* BACnet/IP address */
     struct in_addr dest_address;
     /* BACnet/IP port number - not always 47808=BAC0h */
     uint16_t dest_port;
     /* seconds for valid entry lifetime */
     uint16_t time_to_live;
-    /* our counter */
-    time_t seconds_remaining;   /* includes 30 second grace period */
+    /* purges the entry; includes the 30 second grace period */
+    BACNET_TIMER timer;
+    /* the registrant in network byte order, ready for sending */
+    struct sockaddr_in dest;
+    /* position in FD_Active */
+    unsigned active;
+    /* next entry in the same FD_Hash bucket, or on the free list */
+    struct fd_table_entry *next;
 } FD_TABLE_ENTRY;
 
-#define MAX_FD_ENTRIES 128
-static FD_TABLE_ENTRY FD_Table[MAX_FD_ENTRIES];
+/* registrations beyond this are NAKed */
+#ifndef MAX_FD_ENTRIES
+#define MAX_FD_ENTRIES 1024
+#endif
+/* power of two; chains stay short up to MAX_FD_ENTRIES */
+#ifndef FD_HASH_SIZE
+#define FD_HASH_SIZE 256
+#endif
+/* Entries are allocated one at a time so the timer inside them never
+   moves; FD_Active is the compact list of registered entries that the
+   forwarding loop walks, and FD_Hash finds a registrant by address. */
+static FD_TABLE_ENTRY **FD_Active;
+static unsigned FD_Active_Count;
+static unsigned FD_Active_Size;
+static FD_TABLE_ENTRY *FD_Hash[FD_HASH_SIZE];
+static FD_TABLE_ENTRY *FD_Free;
 
 /* result from a client request */
 BACNET_BVLC_RESULT BVLC_Result_Code = BVLC_RESULT_SUCCESSFUL_COMPLETION;
@@ -94,28 +121,107 @@ BACNET_BVLC_RESULT BVLC_Result_Code = BVLC_RESULT_SUCCESSFUL_COMPLETION;
    remote BBMD address/port here in network byte order */
 static struct sockaddr_in Remote_BBMD;
 
-#if defined(BBMD_ENABLED) && BBMD_ENABLED
-void bvlc_maintenance_timer(
-    time_t seconds)
-{
-    unsigned i = 0;
+/* where a Forwarded-NPDU goes */
+#define BVLC_FORWARD_LOCAL 0x01
+#define BVLC_FORWARD_BDT 0x02
+#define BVLC_FORWARD_FDT 0x04
 
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if (FD_Table[i].seconds_remaining) {
-                if (FD_Table[i].seconds_remaining < seconds) {
-                    FD_Table[i].seconds_remaining = 0;
-                } else {
-                    FD_Table[i].seconds_remaining -= seconds;
-                }
-                if (FD_Table[i].seconds_remaining == 0) {
-                    FD_Table[i].valid = false;
-                }
-            }
+/* a Forwarded-NPDU waiting for the forwarding thread */
+typedef struct {
+    /* originator in network order - not sent back to it */
+    struct sockaddr_in src;
+    uint8_t targets;
+    uint16_t mtu_len;
+    uint8_t mtu[MAX_MPDU];
+} BVLC_FORWARD_JOB;
+
+/* destinations gathered for one fan-out */
+typedef struct {
+    struct sockaddr_in *dest;
+    unsigned size;
+} BVLC_DEST_LIST;
+
+/* once full, messages are forwarded on the receiving thread again */
+#ifndef BVLC_FORWARD_QUEUE_SIZE
+#define BVLC_FORWARD_QUEUE_SIZE 64
+#endif
+static BVLC_FORWARD_JOB Forward_Queue[BVLC_FORWARD_QUEUE_SIZE];
+static unsigned Forward_Head;
+static unsigned Forward_Count;
+static BVLC_FORWARD_STATS Forward_Stats;
+static pthread_t Forward_Thread;
+static pthread_mutex_t Forward_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Forward_Cond = PTHREAD_COND_INITIALIZER;
+static bool Forward_Running;
+static bool Forward_Stop;
+static BVLC_DEST_LIST Worker_Dests;
+static BVLC_DEST_LIST Direct_Dests;
+/* the BDT and FDT are only changed by the receiving thread; this keeps
+   the forwarding thread out while they are */
+static pthread_mutex_t Table_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned bvlc_fdt_bucket(
+    struct sockaddr_in *sin)
+{       /* network order address */
+    uint32_t key;
+
+    key = sin->sin_addr.s_addr ^ ((uint32_t) sin->sin_port << 16);
+    key *= 2654435761u;
+
+    return (key >> 16) & (FD_HASH_SIZE - 1);
+}
+
+static FD_TABLE_ENTRY *bvlc_fdt_find(
+    struct sockaddr_in *sin)
+{       /* network order address */
+    FD_TABLE_ENTRY *entry;
+
+    entry = FD_Hash[bvlc_fdt_bucket(sin)];
+    while (entry) {
+        if ((entry->dest.sin_addr.s_addr == sin->sin_addr.s_addr) &&
+            (entry->dest.sin_port == sin->sin_port)) {
+            break;
         }
+        entry = entry->next;
     }
+
+    return entry;
+}
+
+/* takes the entry out of the hash and the active list */
+static void bvlc_fdt_remove(
+    FD_TABLE_ENTRY * entry)
+{
+    FD_TABLE_ENTRY **link;
+    FD_TABLE_ENTRY *last;
+
+    timer_wheel_stop(&entry->timer);
+    pthread_mutex_lock(&Table_Mutex);
+    link = &FD_Hash[bvlc_fdt_bucket(&entry->dest)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    /* the last active entry fills the hole */
+    FD_Active_Count--;
+    last = FD_Active[FD_Active_Count];
+    FD_Active[entry->active] = last;
+    last->active = entry->active;
+    entry->next = FD_Free;
+    FD_Free = entry;
+    pthread_mutex_unlock(&Table_Mutex);
+}
+
+/* no re-registration arrived in time */
+static void bvlc_fdt_expired(
+    BACNET_TIMER * timer)
+{
+    FD_TABLE_ENTRY *entry;
+
+    entry = (FD_TABLE_ENTRY *) ((uint8_t *) timer -
+        offsetof(FD_TABLE_ENTRY, timer));
+    bvlc_fdt_remove(entry);
 }
-#endif
 
 /* Addressing within B/IP Networks
    In the case of B/IP networks, six octets consisting of the four-octet
@@ -257,29 +363,21 @@ static int bvlc_encode_read_bdt_ack(
 {
     int pdu_len = 0;    /* return value */
     int len = 0;
-    unsigned count = 0;
     unsigned i;
 
-    for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
-        if (BBMD_Table[i].valid) {
-            count++;
-        }
-    }
-    len = bvlc_encode_read_bdt_ack_init(&pdu[0], count);
+    len = bvlc_encode_read_bdt_ack_init(&pdu[0], BBMD_Table_Count);
     pdu_len += len;
-    for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
-        if (BBMD_Table[i].valid) {
-            /* too much to send */
-            if ((pdu_len + 10) > max_pdu) {
-                pdu_len = 0;
-                break;
-            }
-            len =
-                bvlc_encode_address_entry(&pdu[pdu_len],
-                &BBMD_Table[i].dest_address, BBMD_Table[i].dest_port,
-                &BBMD_Table[i].broadcast_mask);
-            pdu_len += len;
+    for (i = 0; i < BBMD_Table_Count; i++) {
+        /* too much to send */
+        if ((pdu_len + 10) > max_pdu) {
+            pdu_len = 0;
+            break;
         }
+        len =
+            bvlc_encode_address_entry(&pdu[pdu_len],
+            &BBMD_Table[i].dest_address, BBMD_Table[i].dest_port,
+            &BBMD_Table[i].broadcast_mask);
+        pdu_len += len;
     }
 
     return pdu_len;
@@ -382,34 +480,29 @@ static int bvlc_encode_read_fdt_ack(
 {
     int pdu_len = 0;    /* return value */
     int len = 0;
-    unsigned count = 0;
     unsigned i;
     uint16_t seconds_remaining = 0;
+    FD_TABLE_ENTRY *entry;
 
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            count++;
-        }
-    }
-    len = bvlc_encode_read_fdt_ack_init(&pdu[0], count);
+    len = bvlc_encode_read_fdt_ack_init(&pdu[0], FD_Active_Count);
     pdu_len += len;
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            /* too much to send */
-            if ((pdu_len + 10) > max_pdu) {
-                pdu_len = 0;
-                break;
-            }
-            len =
-                bvlc_encode_bip_address(&pdu[pdu_len],
-                &FD_Table[i].dest_address, FD_Table[i].dest_port);
-            pdu_len += len;
-            len = encode_unsigned16(&pdu[pdu_len], FD_Table[i].time_to_live);
-            pdu_len += len;
-            seconds_remaining = FD_Table[i].seconds_remaining;
-            len = encode_unsigned16(&pdu[pdu_len], seconds_remaining);
-            pdu_len += len;
+    for (i = 0; i < FD_Active_Count; i++) {
+        entry = FD_Active[i];
+        /* too much to send */
+        if ((pdu_len + 10) > max_pdu) {
+            pdu_len = 0;
+            break;
         }
+        len =
+            bvlc_encode_bip_address(&pdu[pdu_len], &entry->dest_address,
+            entry->dest_port);
+        pdu_len += len;
+        len = encode_unsigned16(&pdu[pdu_len], entry->time_to_live);
+        pdu_len += len;
+        seconds_remaining = (uint16_t)
+            ((timer_wheel_remaining(&entry->timer) + 999) / 1000);
+        len = encode_unsigned16(&pdu[pdu_len], seconds_remaining);
+        pdu_len += len;
     }
 
     return pdu_len;
@@ -539,100 +632,139 @@ static bool bvlc_create_bdt(
     uint8_t * npdu,
     uint16_t npdu_length)
 {
-    bool status = false;
+    BBMD_TABLE_ENTRY *table;
+    BBMD_TABLE_ENTRY *entry;
+    unsigned count = npdu_length / 10;
     unsigned i = 0;
     uint16_t pdu_offset = 0;
-
-    for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
-        if (npdu_length >= 10) {
-            BBMD_Table[i].valid = true;
-            BBMD_Table[i].dest_address.s_addr =
-                ntohl(*(long *) &npdu[pdu_offset]);
-            pdu_offset += 4;
-            BBMD_Table[i].dest_port = ntohs(*(short *) &npdu[pdu_offset]);
-            pdu_offset += 2;
-            BBMD_Table[i].broadcast_mask.s_addr =
-                ntohl(*(long *) &npdu[pdu_offset]);
-            pdu_offset += 4;
-            npdu_length -= 10;
-        } else {
-            BBMD_Table[i].valid = false;
-            BBMD_Table[i].dest_address.s_addr = 0;
-            BBMD_Table[i].dest_port = 0;
-            BBMD_Table[i].broadcast_mask.s_addr = 0;
+    uint32_t raw = 0;
+
+    pthread_mutex_lock(&Table_Mutex);
+    if (count > BBMD_Table_Size) {
+        table = realloc(BBMD_Table, count * sizeof(BBMD_TABLE_ENTRY));
+        if (!table) {
+            /* keep the old table */
+            pthread_mutex_unlock(&Table_Mutex);
+            return false;
         }
+        BBMD_Table = table;
+        BBMD_Table_Size = count;
     }
-    /* did they all fit? */
-    if (npdu_length < 10) {
-        status = true;
+    for (i = 0; i < count; i++) {
+        entry = &BBMD_Table[i];
+        pdu_offset += decode_unsigned32(&npdu[pdu_offset], &raw);
+        entry->dest_address.s_addr = raw;
+        pdu_offset +=
+            decode_unsigned16(&npdu[pdu_offset], &entry->dest_port);
+        pdu_offset += decode_unsigned32(&npdu[pdu_offset], &raw);
+        entry->broadcast_mask.s_addr = raw;
+        /* The B/IP address to which the Forwarded-NPDU message is
+           sent is formed by inverting the broadcast distribution
+           mask in the BDT entry and logically ORing it with the
+           BBMD address of the same entry. */
+        memset(&entry->forward_dest, 0, sizeof(entry->forward_dest));
+        entry->forward_dest.sin_family = AF_INET;
+        entry->forward_dest.sin_addr.s_addr =
+            htonl((~entry->broadcast_mask.s_addr) |
+            entry->dest_address.s_addr);
+        entry->forward_dest.sin_port = htons(entry->dest_port);
+        /* don't send to my broadcast address or my ip address
+           on the same port */
+        entry->self = false;
+        if (entry->dest_port == bip_get_port()) {
+            raw = ntohl(entry->forward_dest.sin_addr.s_addr);
+            if ((raw == bip_get_broadcast_addr()) ||
+                (raw == bip_get_addr())) {
+                entry->self = true;
+            }
+        }
     }
+    BBMD_Table_Count = count;
+    pthread_mutex_unlock(&Table_Mutex);
 
-    return status;
+    return true;
 }
 
 static bool bvlc_register_foreign_device(
     struct sockaddr_in *sin,    /* source address in network order */
     uint16_t time_to_live)
 {       /* time in seconds */
-    unsigned i = 0;
-    bool status = false;
+    FD_TABLE_ENTRY *entry;
+    FD_TABLE_ENTRY **active;
+    unsigned size;
+    unsigned bucket;
 
     /* am I here already?  If so, update my time to live... */
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if ((FD_Table[i].dest_address.s_addr ==
-                    ntohl(sin->sin_addr.s_addr)) &&
-                (FD_Table[i].dest_port == ntohs(sin->sin_port))) {
-                status = true;
-                FD_Table[i].time_to_live = time_to_live;
-                /*  Upon receipt of a BVLL Register-Foreign-Device message, 
-                   a BBMD shall start a timer with a value equal to the 
-                   Time-to-Live parameter supplied plus a fixed grace 
-                   period of 30 seconds. */
-                FD_Table[i].seconds_remaining = time_to_live + 30;
-                break;
+    entry = bvlc_fdt_find(sin);
+    if (!entry) {
+        if (FD_Active_Count >= MAX_FD_ENTRIES) {
+            return false;
+        }
+        entry = FD_Free;
+        if (entry) {
+            FD_Free = entry->next;
+        } else {
+            entry = calloc(1, sizeof(FD_TABLE_ENTRY));
+            if (!entry) {
+                return false;
             }
         }
-    }
-    if (!status) {
-        for (i = 0; i < MAX_FD_ENTRIES; i++) {
-            if (!FD_Table[i].valid) {
-                FD_Table[i].dest_address.s_addr = ntohl(sin->sin_addr.s_addr);
-                FD_Table[i].dest_port = ntohs(sin->sin_port);
-                FD_Table[i].time_to_live = time_to_live;
-                FD_Table[i].seconds_remaining = time_to_live + 30;
-                FD_Table[i].valid = true;
-                status = true;
-                break;
+        pthread_mutex_lock(&Table_Mutex);
+        if (FD_Active_Count == FD_Active_Size) {
+            size = FD_Active_Size ? FD_Active_Size * 2 : 16;
+            active = realloc(FD_Active, size * sizeof(FD_TABLE_ENTRY *));
+            if (!active) {
+                pthread_mutex_unlock(&Table_Mutex);
+                entry->next = FD_Free;
+                FD_Free = entry;
+                return false;
             }
+            FD_Active = active;
+            FD_Active_Size = size;
         }
+        entry->dest_address.s_addr = ntohl(sin->sin_addr.s_addr);
+        entry->dest_port = ntohs(sin->sin_port);
+        memset(&entry->dest, 0, sizeof(entry->dest));
+        entry->dest.sin_family = AF_INET;
+        entry->dest.sin_addr.s_addr = sin->sin_addr.s_addr;
+        entry->dest.sin_port = sin->sin_port;
+        bucket = bvlc_fdt_bucket(sin);
+        entry->next = FD_Hash[bucket];
+        FD_Hash[bucket] = entry;
+        entry->active = FD_Active_Count;
+        FD_Active[FD_Active_Count] = entry;
+        FD_Active_Count++;
+        pthread_mutex_unlock(&Table_Mutex);
     }
-
-
-    return status;
+    entry->time_to_live = time_to_live;
+    /*  Upon receipt of a BVLL Register-Foreign-Device message, 
+       a BBMD shall start a timer with a value equal to the 
+       Time-to-Live parameter supplied plus a fixed grace 
+       period of 30 seconds. */
+    timer_wheel_start(&entry->timer, (time_to_live + 30) * 1000UL,
+        bvlc_fdt_expired);
+
+    return true;
 }
 
 static bool bvlc_delete_foreign_device(
     uint8_t * pdu)
 {
     struct sockaddr_in sin = { 0 };     /* the ip address */
+    struct in_addr address;     /* the decoded address */
     uint16_t port = 0;  /* the decoded port */
-    bool status = false;        /* return value */
-    unsigned i = 0;
-
-    bvlc_decode_bip_address(pdu, &sin.sin_addr, &port);
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if ((FD_Table[i].dest_address.s_addr == sin.sin_addr.s_addr) &&
-                (FD_Table[i].dest_port == sin.sin_port)) {
-                FD_Table[i].valid = false;
-                FD_Table[i].seconds_remaining = 0;
-                status = true;
-                break;
-            }
-        }
+    FD_TABLE_ENTRY *entry;
+
+    bvlc_decode_bip_address(pdu, &address, &port);
+    sin.sin_addr.s_addr = htonl(address.s_addr);
+    sin.sin_port = htons(port);
+    entry = bvlc_fdt_find(&sin);
+    if (!entry) {
+        return false;
     }
-    return status;
+    bvlc_fdt_remove(entry);
+
+    return true;
 }
 
 static int bvlc_send_mpdu(
@@ -651,103 +783,219 @@ static int bvlc_send_mpdu(
     bvlc_dest.sin_addr.s_addr = dest->sin_addr.s_addr;
     bvlc_dest.sin_port = dest->sin_port;
     memset(&(bvlc_dest.sin_zero), '\0', 8);
-    /* Send the packet */
-    return sendto(bip_socket(), (char *) mtu, mtu_len, 0,
-        (struct sockaddr *) &bvlc_dest, sizeof(struct sockaddr));
+    /* Send the packet - held back if a batch is open */
+    return bip_send_mpdu(&bvlc_dest, mtu, mtu_len);
 }
 
-static void bvlc_bdt_forward_npdu(
-    struct sockaddr_in *sin,    /* source address in network order */
-    uint8_t * npdu,     /* the NPDU */
-    uint16_t npdu_length)
-{       /* length of the NPDU  */
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    uint16_t mtu_len = 0;
+/* collects where a Forwarded-NPDU from src goes; the table lock keeps
+   the forwarding thread from seeing a half-written BDT or FDT */
+static unsigned bvlc_forward_collect(
+    BVLC_DEST_LIST * list,
+    struct sockaddr_in *src,    /* originator in network order */
+    uint8_t targets)
+{
+    struct sockaddr_in *dest;
+    struct sockaddr_in *bip_dest;
+    unsigned needed;
+    unsigned count = 0;
     unsigned i = 0;     /* loop counter */
-    struct sockaddr_in bip_dest = { 0 };
-
-    mtu_len = bvlc_encode_forwarded_npdu(&mtu[0], sin, npdu, npdu_length);
-    /* loop through the BDT and send one to each entry, except us */
-    for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
-        if (BBMD_Table[i].valid) {
-            /* The B/IP address to which the Forwarded-NPDU message is
-               sent is formed by inverting the broadcast distribution
-               mask in the BDT entry and logically ORing it with the
-               BBMD address of the same entry. */
-            bip_dest.sin_addr.s_addr =
-                htonl(((~BBMD_Table[i].broadcast_mask.
-                        s_addr) | BBMD_Table[i].dest_address.s_addr));
-            bip_dest.sin_port = htons(BBMD_Table[i].dest_port);
-            /* don't send to my broadcast address and same port */
-            if ((bip_dest.sin_addr.s_addr == htonl(bip_get_broadcast_addr()))
-                && (bip_dest.sin_port == htons(bip_get_port()))) {
-                continue;
+    uint32_t my_addr = htonl(bip_get_addr());
+    uint16_t my_port = htons(bip_get_port());
+
+    pthread_mutex_lock(&Table_Mutex);
+    needed = 1 + BBMD_Table_Count + FD_Active_Count;
+    if (needed > list->size) {
+        dest = realloc(list->dest, needed * sizeof(struct sockaddr_in));
+        if (!dest) {
+            pthread_mutex_unlock(&Table_Mutex);
+            return 0;
+        }
+        list->dest = dest;
+        list->size = needed;
+    }
+    /* Generate BVLL Forwarded-NPDU message on its local IP subnet using
+       the local B/IP broadcast address as the destination address.  */
+    if (targets & BVLC_FORWARD_LOCAL) {
+        dest = &list->dest[count++];
+        memset(dest, 0, sizeof(struct sockaddr_in));
+        dest->sin_family = AF_INET;
+        dest->sin_addr.s_addr = htonl(bip_get_broadcast_addr());
+        dest->sin_port = my_port;
+    }
+    /* send one to each BDT entry, except us */
+    if (targets & BVLC_FORWARD_BDT) {
+        for (i = 0; i < BBMD_Table_Count; i++) {
+            if (!BBMD_Table[i].self) {
+                list->dest[count++] = BBMD_Table[i].forward_dest;
             }
+        }
+    }
+    /* and one to each foreign device */
+    if (targets & BVLC_FORWARD_FDT) {
+        for (i = 0; i < FD_Active_Count; i++) {
+            bip_dest = &FD_Active[i]->dest;
             /* don't send to my ip address and same port */
-            if ((bip_dest.sin_addr.s_addr == htonl(bip_get_addr())) &&
-                (bip_dest.sin_port == htons(bip_get_port()))) {
+            if ((bip_dest->sin_addr.s_addr == my_addr) &&
+                (bip_dest->sin_port == my_port)) {
                 continue;
             }
-            bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-            debug_printf("BVLC: BDT Sent Forwarded-NPDU to %s:%04X\n",
-                inet_ntoa(bip_dest.sin_addr), ntohs(bip_dest.sin_port));
+            /* don't send to src ip address and same port */
+            if ((bip_dest->sin_addr.s_addr == src->sin_addr.s_addr) &&
+                (bip_dest->sin_port == src->sin_port)) {
+                continue;
+            }
+            list->dest[count++] = *bip_dest;
         }
     }
+    pthread_mutex_unlock(&Table_Mutex);
 
-    return;
+    return count;
 }
 
-/* Generate BVLL Forwarded-NPDU message on its local IP subnet using
-   the local B/IP broadcast address as the destination address.  */
-static void bvlc_forward_npdu(
-    struct sockaddr_in *sin,    /* source address in network order */
+static void *bvlc_forward_worker(
+    void *arg)
+{
+    BVLC_FORWARD_JOB *job;
+    unsigned count = 0;
+    int sent = 0;
+
+    (void) arg;
+    pthread_mutex_lock(&Forward_Mutex);
+    for (;;) {
+        while (!Forward_Stop && (Forward_Count == 0)) {
+            pthread_cond_wait(&Forward_Cond, &Forward_Mutex);
+        }
+        /* what was queued before the stop still goes out */
+        if (Forward_Count == 0) {
+            break;
+        }
+        /* the slot stays taken until it has been sent */
+        job = &Forward_Queue[Forward_Head];
+        pthread_mutex_unlock(&Forward_Mutex);
+        count = bvlc_forward_collect(&Worker_Dests, &job->src, job->targets);
+        sent = bip_send_mpdu_fanout(Worker_Dests.dest, count, job->mtu,
+            job->mtu_len);
+        pthread_mutex_lock(&Forward_Mutex);
+        Forward_Head = (Forward_Head + 1) % BVLC_FORWARD_QUEUE_SIZE;
+        Forward_Count--;
+        if (sent > 0) {
+            Forward_Stats.forwarded += sent;
+        }
+    }
+    pthread_mutex_unlock(&Forward_Mutex);
+
+    return NULL;
+}
+
+/* hands the message to the forwarding thread; false if it isn't
+   running or has fallen too far behind */
+static bool bvlc_forward_queue(
+    struct sockaddr_in *src,    /* originator in network order */
+    uint8_t * npdu,
+    uint16_t npdu_length,
+    uint8_t targets)
+{
+    BVLC_FORWARD_JOB *job;
+
+    pthread_mutex_lock(&Forward_Mutex);
+    if (!Forward_Running || (Forward_Count == BVLC_FORWARD_QUEUE_SIZE)) {
+        pthread_mutex_unlock(&Forward_Mutex);
+        return false;
+    }
+    job = &Forward_Queue[(Forward_Head +
+            Forward_Count) % BVLC_FORWARD_QUEUE_SIZE];
+    job->src = *src;
+    job->targets = targets;
+    job->mtu_len = (uint16_t)
+        bvlc_encode_forwarded_npdu(&job->mtu[0], src, npdu, npdu_length);
+    Forward_Count++;
+    if (Forward_Count > Forward_Stats.max_depth) {
+        Forward_Stats.max_depth = Forward_Count;
+    }
+    Forward_Stats.queued++;
+    pthread_cond_signal(&Forward_Cond);
+    pthread_mutex_unlock(&Forward_Mutex);
+
+    return true;
+}
+
+/* sends a Forwarded-NPDU from src to the targets, on the forwarding
+   thread when it is running or right here when it isn't */
+static void bvlc_forward(
+    struct sockaddr_in *src,    /* originator in network order */
     uint8_t * npdu,     /* the NPDU */
-    uint16_t npdu_length)
-{       /* length of the NPDU  */
+    uint16_t npdu_length,       /* length of the NPDU  */
+    uint8_t targets)
+{
     uint8_t mtu[MAX_MPDU] = { 0 };
     uint16_t mtu_len = 0;
-    struct sockaddr_in bip_dest = { 0 };
+    unsigned count = 0;
+    int sent = 0;
 
-    mtu_len = bvlc_encode_forwarded_npdu(&mtu[0], sin, npdu, npdu_length);
-    bip_dest.sin_addr.s_addr = htonl(bip_get_broadcast_addr());
-    bip_dest.sin_port = htons(bip_get_port());
-    bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-    debug_printf("BVLC: Sent Forwarded-NPDU as local broadcast.\n");
+    if (bvlc_forward_queue(src, npdu, npdu_length, targets)) {
+        return;
+    }
+    mtu_len = bvlc_encode_forwarded_npdu(&mtu[0], src, npdu, npdu_length);
+    count = bvlc_forward_collect(&Direct_Dests, src, targets);
+    /* one sendmmsg per BIP_BATCH_SIZE peers */
+    sent = bip_send_mpdu_fanout(Direct_Dests.dest, count, mtu, mtu_len);
+    debug_printf("BVLC: Sent Forwarded-NPDU to %u of %u peers.\n",
+        (sent > 0) ? (unsigned) sent : 0, count);
+    pthread_mutex_lock(&Forward_Mutex);
+    Forward_Stats.direct++;
+    if (sent > 0) {
+        Forward_Stats.forwarded += sent;
+    }
+    pthread_mutex_unlock(&Forward_Mutex);
 }
 
-static void bvlc_fdt_forward_npdu(
-    struct sockaddr_in *sin,    /* source address in network order */
-    uint8_t * npdu,     /* returns the NPDU */
-    uint16_t max_npdu)
-{       /* amount of space available in the NPDU  */
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    uint16_t mtu_len = 0;
-    unsigned i = 0;     /* loop counter */
-    struct sockaddr_in bip_dest = { 0 };
-
-    mtu_len = bvlc_encode_forwarded_npdu(&mtu[0], sin, npdu, max_npdu);
-    /* loop through the FDT and send one to each entry */
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid && FD_Table[i].seconds_remaining) {
-            bip_dest.sin_addr.s_addr = htonl(FD_Table[i].dest_address.s_addr);
-            bip_dest.sin_port = htons(FD_Table[i].dest_port);
-            /* don't send to my ip address and same port */
-            if ((bip_dest.sin_addr.s_addr == htonl(bip_get_addr())) &&
-                (bip_dest.sin_port == htons(bip_get_port()))) {
-                continue;
-            }
-            /* don't send to src ip address and same port */
-            if ((bip_dest.sin_addr.s_addr == sin->sin_addr.s_addr) &&
-                (bip_dest.sin_port == sin->sin_port)) {
-                continue;
-            }
-            bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-            debug_printf("BVLC: FDT Sent Forwarded-NPDU to %s:%04X\n",
-                inet_ntoa(bip_dest.sin_addr), ntohs(bip_dest.sin_port));
+bool bvlc_forward_start(
+    void)
+{
+    bool status = true;
+
+    pthread_mutex_lock(&Forward_Mutex);
+    if (!Forward_Running) {
+        Forward_Stop = false;
+        if (pthread_create(&Forward_Thread, NULL, bvlc_forward_worker,
+                NULL) == 0) {
+            Forward_Running = true;
+        } else {
+            status = false;
         }
     }
+    pthread_mutex_unlock(&Forward_Mutex);
 
-    return;
+    return status;
+}
+
+void bvlc_forward_stop(
+    void)
+{
+    pthread_mutex_lock(&Forward_Mutex);
+    if (!Forward_Running) {
+        pthread_mutex_unlock(&Forward_Mutex);
+        return;
+    }
+    Forward_Stop = true;
+    pthread_cond_signal(&Forward_Cond);
+    pthread_mutex_unlock(&Forward_Mutex);
+    pthread_join(Forward_Thread, NULL);
+    pthread_mutex_lock(&Forward_Mutex);
+    Forward_Running = false;
+    pthread_mutex_unlock(&Forward_Mutex);
+    free(Worker_Dests.dest);
+    Worker_Dests.dest = NULL;
+    Worker_Dests.size = 0;
+}
+
+void bvlc_forward_stats(
+    BVLC_FORWARD_STATS * stats)
+{
+    pthread_mutex_lock(&Forward_Mutex);
+    *stats = Forward_Stats;
+    stats->depth = Forward_Count;
+    pthread_mutex_unlock(&Forward_Mutex);
 }
 
 void bvlc_register_with_bbmd(
@@ -818,89 +1066,56 @@ static bool bvlc_bdt_member_mask_is_unicast(
     bool unicast = false;
     unsigned i = 0;     /* loop counter */
 
-    for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
-        if (BBMD_Table[i].valid) {
-            /* find the source address in the table */
-            if ((BBMD_Table[i].dest_address.s_addr ==
-                    htonl(sin->sin_addr.s_addr)) &&
-                (BBMD_Table[i].dest_port == htons(sin->sin_port))) {
-                /* unicast mask? */
-                if (BBMD_Table[i].broadcast_mask.s_addr == 0xFFFFFFFFL) {
-                    unicast = true;
-                    break;
-                }
+    for (i = 0; i < BBMD_Table_Count; i++) {
+        /* find the source address in the table */
+        if ((BBMD_Table[i].dest_address.s_addr ==
+                ntohl(sin->sin_addr.s_addr)) &&
+            (BBMD_Table[i].dest_port == ntohs(sin->sin_port))) {
+            /* unicast mask? */
+            if (BBMD_Table[i].broadcast_mask.s_addr == 0xFFFFFFFFL) {
+                unicast = true;
             }
+            break;
         }
     }
 
     return unicast;
 }
 
-/* returns:
-    Number of bytes received, or 0 if none or timeout. */
-uint16_t bvlc_receive(
-    BACNET_ADDRESS * src,       /* returns the source address */
-    uint8_t * npdu,     /* returns the NPDU */
-    uint16_t max_npdu,  /* amount of space available in the NPDU  */
-    unsigned timeout)
-{       /* number of milliseconds to wait for a packet */
+/* handles one received BVLL message; BBMD functions are answered here */
+/* returns the NPDU length, with *npdu pointing at it inside mpdu */
+static uint16_t bvlc_handle_message(
+    BACNET_ADDRESS * src,
+    struct sockaddr_in *from,   /* who sent it - network byte order */
+    uint8_t * mpdu,
+    int received_bytes,
+    uint8_t ** npdu)
+{
     uint16_t npdu_len = 0;      /* return value */
-    fd_set read_fds;
-    int max = 0;
-    struct timeval select_timeout;
-    struct sockaddr_in sin = { 0 };
+    struct sockaddr_in sin = *from;
     struct sockaddr_in original_sin = { 0 };
     struct sockaddr_in dest = { 0 };
-    socklen_t sin_len = sizeof(sin);
     int function_type = 0;
-    int received_bytes = 0;
     uint16_t result_code = 0;
-    uint16_t i = 0;
     bool status = false;
     uint16_t time_to_live = 0;
 
-    /* Make sure the socket is open */
-    if (bip_socket() < 0) {
-        return 0;
-    }
-
-    /* we could just use a non-blocking socket, but that consumes all
-       the CPU time.  We can use a timeout; it is only supported as
-       a select. */
-    if (timeout >= 1000) {
-        select_timeout.tv_sec = timeout / 1000;
-        select_timeout.tv_usec =
-            1000 * (timeout - select_timeout.tv_sec * 1000);
-    } else {
-        select_timeout.tv_sec = 0;
-        select_timeout.tv_usec = 1000 * timeout;
-    }
-    FD_ZERO(&read_fds);
-    FD_SET(bip_socket(), &read_fds);
-    max = bip_socket();
-    /* see if there is a packet for us */
-    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0) {
-        received_bytes =
-            recvfrom(bip_socket(), (char *) &npdu[0], max_npdu, 0,
-            (struct sockaddr *) &sin, &sin_len);
-    } else {
-        return 0;
-    }
-    /* See if there is a problem */
-    if (received_bytes < 0) {
-        return 0;
-    }
+    *npdu = NULL;
     /* no problem, just no bytes */
     if (received_bytes == 0) {
         return 0;
     }
     /* the signature of a BACnet/IP packet */
-    if (npdu[0] != BVLL_TYPE_BACNET_IP) {
+    if ((received_bytes < 4) || (mpdu[0] != BVLL_TYPE_BACNET_IP)) {
         return 0;
     }
-    function_type = npdu[1];
+    function_type = mpdu[1];
     /* decode the length of the PDU - length is inclusive of BVLC */
-    (void) decode_unsigned16(&npdu[2], &npdu_len);
+    (void) decode_unsigned16(&mpdu[2], &npdu_len);
+    /* ignore messages that claim more than was received */
+    if ((npdu_len < 4) || (npdu_len > received_bytes)) {
+        return 0;
+    }
     /* subtract off the BVLC header */
     npdu_len -= 4;
     switch (function_type) {
@@ -913,7 +1128,7 @@ uint16_t bvlc_receive(
                foreign device shall re-register with the BBMD by sending a BVLL
                Register-Foreign-Device message */
             /* FIXME: clients may need this result */
-            (void) decode_unsigned16(&npdu[4], &result_code);
+            (void) decode_unsigned16(&mpdu[4], &result_code);
             BVLC_Result_Code = (BACNET_BVLC_RESULT) result_code;
             debug_printf("BVLC: Result Code=%d\n", BVLC_Result_Code);
             /* not an NPDU */
@@ -929,7 +1144,7 @@ uint16_t bvlc_receive(
                a result code of X'0000'. Otherwise, the BBMD shall return a
                BVLC-Result message to the originating device with a result code
                of X'0010' indicating that the write attempt has failed. */
-            status = bvlc_create_bdt(&npdu[4], npdu_len);
+            status = bvlc_create_bdt(&mpdu[4], npdu_len);
             if (status) {
                 bvlc_send_result(&sin, BVLC_RESULT_SUCCESSFUL_COMPLETION);
             } else {
@@ -980,33 +1195,25 @@ uint16_t bvlc_receive(
                BACnet devices may omit the broadcast using the B/IP
                broadcast address. The method by which a BBMD determines whether
                or not other BACnet devices are present is a local matter. */
+            if (npdu_len < 6) {
+                npdu_len = 0;
+                break;
+            }
             /* decode the 4 byte original address and 2 byte port */
-            bvlc_decode_bip_address(&npdu[4], &original_sin.sin_addr,
+            bvlc_decode_bip_address(&mpdu[4], &original_sin.sin_addr,
                 &original_sin.sin_port);
             npdu_len -= 6;
-            /*  Broadcast locally if received via unicast from a BDT member */
-            if (bvlc_bdt_member_mask_is_unicast(&sin)) {
-                dest.sin_addr.s_addr = htonl(bip_get_broadcast_addr());
-                dest.sin_port = htons(bip_get_port());
-                bvlc_send_mpdu(&dest, &npdu[4 + 6], npdu_len);
-            }
             /* use the original addr from the BVLC for src */
             dest.sin_addr.s_addr = htonl(original_sin.sin_addr.s_addr);
             dest.sin_port = htons(original_sin.sin_port);
-            bvlc_fdt_forward_npdu(&dest, &npdu[4 + 6], npdu_len);
+            /*  Broadcast locally if received via unicast from a BDT member */
+            bvlc_forward(&dest, &mpdu[4 + 6], npdu_len,
+                bvlc_bdt_member_mask_is_unicast(&sin) ?
+                (BVLC_FORWARD_LOCAL | BVLC_FORWARD_FDT) : BVLC_FORWARD_FDT);
             debug_printf("BVLC: Received Forwarded-NPDU from %s:%04X.\n",
                 inet_ntoa(dest.sin_addr), ntohs(dest.sin_port));
             bvlc_internet_to_bacnet_address(src, &dest);
-            if (npdu_len < max_npdu) {
-                /* shift the buffer to return a valid PDU */
-                for (i = 0; i < npdu_len; i++) {
-                    npdu[i] = npdu[4 + 6 + i];
-                }
-            } else {
-                /* ignore packets that are too large */
-                /* clients should check my max-apdu first */
-                npdu_len = 0;
-            }
+            *npdu = &mpdu[4 + 6];
             break;
         case BVLC_REGISTER_FOREIGN_DEVICE:
             /* Upon receipt of a BVLL Register-Foreign-Device message, a BBMD
@@ -1018,7 +1225,7 @@ uint16_t bvlc_receive(
                without the receipt of another BVLL Register-Foreign-Device
                message from the same foreign device, the FDT entry for this
                device shall be cleared. */
-            (void) decode_unsigned16(&npdu[4], &time_to_live);
+            (void) decode_unsigned16(&mpdu[4], &time_to_live);
             if (bvlc_register_foreign_device(&sin, time_to_live)) {
                 bvlc_send_result(&sin, BVLC_RESULT_SUCCESSFUL_COMPLETION);
                 debug_printf("BVLC: Registered a Foreign Device.\n");
@@ -1062,7 +1269,7 @@ uint16_t bvlc_receive(
                of X'0000'. Otherwise, the BBMD shall return a BVLCResult
                message to the originating device with a result code of X'0050'
                indicating that the deletion attempt has failed. */
-            if (bvlc_delete_foreign_device(&npdu[4])) {
+            if (bvlc_delete_foreign_device(&mpdu[4])) {
                 bvlc_send_result(&sin, BVLC_RESULT_SUCCESSFUL_COMPLETION);
             } else {
                 bvlc_send_result(&sin,
@@ -1087,9 +1294,8 @@ uint16_t bvlc_receive(
                it shall return a BVLC-Result message to the foreign device
                with a result code of X'0060' indicating that the forwarding
                attempt was unsuccessful */
-            bvlc_forward_npdu(&sin, &npdu[4], npdu_len);
-            bvlc_bdt_forward_npdu(&sin, &npdu[4], npdu_len);
-            bvlc_fdt_forward_npdu(&sin, &npdu[4], npdu_len);
+            bvlc_forward(&sin, &mpdu[4], npdu_len,
+                BVLC_FORWARD_LOCAL | BVLC_FORWARD_BDT | BVLC_FORWARD_FDT);
             /* not an NPDU */
             npdu_len = 0;
             break;
@@ -1101,16 +1307,7 @@ uint16_t bvlc_receive(
                 npdu_len = 0;
             } else {
                 bvlc_internet_to_bacnet_address(src, &sin);
-                if (npdu_len < max_npdu) {
-                    /* shift the buffer to return a valid PDU */
-                    for (i = 0; i < npdu_len; i++) {
-                        npdu[i] = npdu[4 + i];
-                    }
-                } else {
-                    /* ignore packets that are too large */
-                    /* clients should check my max-apdu first */
-                    npdu_len = 0;
-                }
+                *npdu = &mpdu[4];
             }
             break;
         case BVLC_ORIGINAL_BROADCAST_NPDU:
@@ -1129,22 +1326,102 @@ uint16_t bvlc_receive(
                shall be sent directly to each foreign device currently in
                the BBMD's FDT also using the BVLL Forwarded-NPDU message. */
             bvlc_internet_to_bacnet_address(src, &sin);
-            if (npdu_len < max_npdu) {
-                /* shift the buffer to return a valid PDU */
-                for (i = 0; i < npdu_len; i++) {
-                    npdu[i] = npdu[4 + i];
-                }
-                /* if BDT or FDT entries exist, Forward the NPDU */
-                bvlc_bdt_forward_npdu(&sin, &npdu[0], npdu_len);
-                bvlc_fdt_forward_npdu(&sin, &npdu[0], npdu_len);
-            } else {
-                /* ignore packets that are too large */
-                npdu_len = 0;
-            }
+            *npdu = &mpdu[4];
+            /* if BDT or FDT entries exist, Forward the NPDU; with the
+               forwarding thread running this only queues it */
+            bvlc_forward(&sin, *npdu, npdu_len,
+                BVLC_FORWARD_BDT | BVLC_FORWARD_FDT);
             break;
         default:
+            npdu_len = 0;
             break;
     }
+    if (*npdu == NULL) {
+        npdu_len = 0;
+    }
+
+    return npdu_len;
+}
+
+/* receives one BVLL message into mpdu and handles it in place.
+   returns:
+    Number of bytes in the NPDU, or 0 if none or timeout.
+    *npdu points at the NPDU inside mpdu; nothing is copied. */
+uint16_t bvlc_receive_view(
+    BACNET_ADDRESS * src,       /* returns the source address */
+    uint8_t * mpdu,     /* buffer for the whole BVLL message */
+    uint16_t max_mpdu,  /* amount of space available in mpdu */
+    uint8_t ** npdu,    /* returns the start of the NPDU */
+    unsigned timeout)
+{       /* number of milliseconds to wait for a packet */
+    fd_set read_fds;
+    int max = 0;
+    struct timeval select_timeout;
+    struct sockaddr_in sin = { 0 };
+    socklen_t sin_len = sizeof(sin);
+    int received_bytes = 0;
+
+    *npdu = NULL;
+    /* Make sure the socket is open */
+    if (bip_socket() < 0) {
+        return 0;
+    }
+
+    /* we could just use a non-blocking socket, but that consumes all
+       the CPU time.  We can use a timeout; it is only supported as
+       a select. */
+    if (timeout >= 1000) {
+        select_timeout.tv_sec = timeout / 1000;
+        select_timeout.tv_usec =
+            1000 * (timeout - select_timeout.tv_sec * 1000);
+    } else {
+        select_timeout.tv_sec = 0;
+        select_timeout.tv_usec = 1000 * timeout;
+    }
+    FD_ZERO(&read_fds);
+    FD_SET(bip_socket(), &read_fds);
+    max = bip_socket();
+    /* see if there is a packet for us */
+    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0) {
+        received_bytes =
+            recvfrom(bip_socket(), (char *) &mpdu[0], max_mpdu, 0,
+            (struct sockaddr *) &sin, &sin_len);
+    } else {
+        return 0;
+    }
+    /* See if there is a problem */
+    if (received_bytes < 0) {
+        return 0;
+    }
+
+    return bvlc_handle_message(src, &sin, mpdu, received_bytes, npdu);
+}
+
+uint16_t bvlc_handle_mpdu(
+    BACNET_ADDRESS * src,
+    BIP_MPDU * mpdu,
+    uint8_t ** npdu)
+{
+    return bvlc_handle_message(src, &mpdu->sin, mpdu->mpdu, mpdu->mpdu_len,
+        npdu);
+}
+
+/* returns:
+    Number of bytes received, or 0 if none or timeout. */
+uint16_t bvlc_receive(
+    BACNET_ADDRESS * src,       /* returns the source address */
+    uint8_t * npdu,     /* returns the NPDU */
+    uint16_t max_npdu,  /* amount of space available in the NPDU  */
+    unsigned timeout)
+{       /* number of milliseconds to wait for a packet */
+    uint8_t *view = NULL;
+    uint16_t npdu_len = 0;
+
+    npdu_len = bvlc_receive_view(src, npdu, max_npdu, &view, timeout);
+    /* the NPDU follows the BVLC header in the same buffer */
+    if (npdu_len) {
+        memmove(npdu, view, npdu_len);
+    }
 
     return npdu_len;
 }
@@ -1158,8 +1435,7 @@ int bvlc_send_pdu(
     unsigned pdu_len)
 {       /* number of bytes of data */
     struct sockaddr_in bvlc_dest = { 0 };
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    uint16_t mtu_len = 0;
+    uint8_t header[MAX_HEADER];
     /* addr and port in host format */
     struct in_addr address;
     uint16_t port = 0;
@@ -1167,37 +1443,37 @@ int bvlc_send_pdu(
 
     /* bip datalink doesn't need to know the npdu data */
     (void) npdu_data;
-    mtu[0] = BVLL_TYPE_BACNET_IP;
+    header[0] = BVLL_TYPE_BACNET_IP;
     if (dest->net == BACNET_BROADCAST_NETWORK) {
         /* if we are a foreign device */
         if (Remote_BBMD.sin_port) {
-            mtu[1] = BVLC_DISTRIBUTE_BROADCAST_TO_NETWORK;
+            header[1] = BVLC_DISTRIBUTE_BROADCAST_TO_NETWORK;
             address.s_addr = ntohl(Remote_BBMD.sin_addr.s_addr);
             port = ntohs(Remote_BBMD.sin_port);
             debug_printf("BVLC: Sent Distribute-Broadcast-to-Network.\n");
         } else {
             address.s_addr = bip_get_broadcast_addr();
             port = bip_get_port();
-            mtu[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
+            header[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
             debug_printf("BVLC: Sent Original-Broadcast-NPDU.\n");
         }
     } else if (dest->mac_len == 6) {
         /* valid unicast */
         bvlc_decode_bip_address(&dest->mac[0], &address, &port);
-        mtu[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+        header[1] = BVLC_ORIGINAL_UNICAST_NPDU;
         debug_printf("BVLC: Sent Original-Unicast-NPDU.\n");
     } else {
         /* invalid address */
         return -1;
     }
+    bvlc_dest.sin_family = AF_INET;
     bvlc_dest.sin_addr.s_addr = htonl(address.s_addr);
     bvlc_dest.sin_port = htons(port);
     BVLC_length = pdu_len + 4 /*inclusive */ ;
-    mtu_len = 2;
-    mtu_len += encode_unsigned16(&mtu[mtu_len], BVLC_length);
-    memcpy(&mtu[mtu_len], pdu, pdu_len);
-    mtu_len += pdu_len;
-    return bvlc_send_mpdu(&bvlc_dest, mtu, mtu_len);
+    encode_unsigned16(&header[2], BVLC_length);
+    /* the PDU is sent from where it was encoded, behind the header */
+    return bip_send_mpdu_header(&bvlc_dest, header, sizeof(header), pdu,
+        (uint16_t) pdu_len);
 }
 
 #ifdef TEST
@@ -1239,6 +1515,148 @@ void testInternetAddress(
     ct_test(pTest, sin.sin_addr.s_addr == test_sin.sin_addr.s_addr);
 }
 
+void testForeignDeviceTable(
+    Test * pTest)
+{
+    struct sockaddr_in sin = { 0 };
+    uint8_t pdu[MAX_MPDU] = { 0 };
+    uint8_t entry[6] = { 0 };
+    struct in_addr address;
+    uint16_t count = 0;
+    unsigned i = 0;
+
+    sin.sin_port = htons(0xBAC0);
+    for (i = 0; i < 300; i++) {
+        sin.sin_addr.s_addr = htonl(0x0A000001 + i);
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60));
+    }
+    ct_test(pTest, FD_Active_Count == 300);
+    /* re-registration renews the existing entry */
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 120));
+    ct_test(pTest, FD_Active_Count == 300);
+    ct_test(pTest, bvlc_fdt_find(&sin)->time_to_live == 120);
+    /* deleting from the middle keeps the active list compact */
+    address.s_addr = 0x0A000001 + 7;
+    bvlc_encode_bip_address(&entry[0], &address, 0xBAC0);
+    ct_test(pTest, bvlc_delete_foreign_device(&entry[0]));
+    ct_test(pTest, !bvlc_delete_foreign_device(&entry[0]));
+    ct_test(pTest, FD_Active_Count == 299);
+    for (i = 0; i < FD_Active_Count; i++) {
+        ct_test(pTest, FD_Active[i]->active == i);
+        ct_test(pTest, bvlc_fdt_find(&FD_Active[i]->dest) == FD_Active[i]);
+    }
+    sin.sin_addr.s_addr = htonl(0x0A000001 + 7);
+    ct_test(pTest, bvlc_fdt_find(&sin) == NULL);
+    /* too many entries to fit: no ACK, the caller NAKs; only the header,
+       sized for the whole table, was written */
+    ct_test(pTest, bvlc_encode_read_fdt_ack(&pdu[0], sizeof(pdu)) == 0);
+    (void) decode_unsigned16(&pdu[2], &count);
+    ct_test(pTest, count == 4 + (299 * 10));
+    /* everything but the renewed entry expires after 60+30 seconds */
+    (void) timer_wheel_milliseconds(90 * 1000UL);
+    ct_test(pTest, FD_Active_Count == 1);
+    ct_test(pTest, FD_Active[0]->time_to_live == 120);
+    (void) timer_wheel_milliseconds(60 * 1000UL);
+    ct_test(pTest, FD_Active_Count == 0);
+    /* freed entries are reused */
+    ct_test(pTest, FD_Free != NULL);
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60));
+    ct_test(pTest, FD_Active_Count == 1);
+}
+
+void testBroadcastDistributionTable(
+    Test * pTest)
+{
+    uint8_t pdu[MAX_MPDU] = { 0 };
+    struct in_addr address;
+    struct in_addr mask;
+    struct sockaddr_in sin = { 0 };
+    int len = 0;
+
+    address.s_addr = 0xC0A80001;
+    mask.s_addr = 0xFFFFFFFF;
+    len = bvlc_encode_address_entry(&pdu[len], &address, 0xBAC0, &mask);
+    address.s_addr = 0xC0A80101;
+    mask.s_addr = 0xFFFFFF00;
+    len += bvlc_encode_address_entry(&pdu[len], &address, 0xBAC1, &mask);
+    ct_test(pTest, bvlc_create_bdt(&pdu[0], (uint16_t) len));
+    ct_test(pTest, BBMD_Table_Count == 2);
+    ct_test(pTest,
+        BBMD_Table[1].forward_dest.sin_addr.s_addr == htonl(0xC0A801FF));
+    ct_test(pTest, BBMD_Table[1].forward_dest.sin_port == htons(0xBAC1));
+    sin.sin_addr.s_addr = htonl(0xC0A80001);
+    sin.sin_port = htons(0xBAC0);
+    ct_test(pTest, bvlc_bdt_member_mask_is_unicast(&sin));
+    sin.sin_addr.s_addr = htonl(0xC0A80101);
+    sin.sin_port = htons(0xBAC1);
+    ct_test(pTest, !bvlc_bdt_member_mask_is_unicast(&sin));
+    /* a shorter table replaces the longer one */
+    ct_test(pTest, bvlc_create_bdt(&pdu[0], 10));
+    ct_test(pTest, BBMD_Table_Count == 1);
+    ct_test(pTest, bvlc_create_bdt(&pdu[0], 0));
+    ct_test(pTest, BBMD_Table_Count == 0);
+}
+
+void testForwardQueue(
+    Test * pTest)
+{
+    uint8_t pdu[MAX_MPDU] = { 0 };
+    uint8_t npdu[4] = { 1, 0x20, 0xFF, 0xFF };
+    struct in_addr address;
+    struct in_addr mask;
+    struct sockaddr_in sin = { 0 };
+    struct sockaddr_in src = { 0 };
+    BVLC_FORWARD_STATS stats;
+    unsigned i = 0;
+    int len = 0;
+
+    bip_set_addr(htonl(0xC0A80005));
+    bip_set_broadcast_addr(htonl(0xC0A800FF));
+    bip_set_port(0xBAC0);
+    while (FD_Active_Count) {
+        bvlc_fdt_remove(FD_Active[0]);
+    }
+    /* one BDT entry is us */
+    address.s_addr = 0xC0A80005;
+    mask.s_addr = 0xFFFFFFFF;
+    len = bvlc_encode_address_entry(&pdu[len], &address, 0xBAC0, &mask);
+    address.s_addr = 0xC0A80105;
+    len += bvlc_encode_address_entry(&pdu[len], &address, 0xBAC0, &mask);
+    ct_test(pTest, bvlc_create_bdt(&pdu[0], (uint16_t) len));
+    sin.sin_port = htons(0xBAC0);
+    for (i = 0; i < 3; i++) {
+        sin.sin_addr.s_addr = htonl(0x0A000001 + i);
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60));
+    }
+    /* the originator doesn't get its own message back */
+    src = sin;
+    ct_test(pTest, bvlc_forward_collect(&Direct_Dests, &src,
+            BVLC_FORWARD_FDT) == 2);
+    ct_test(pTest, bvlc_forward_collect(&Direct_Dests, &src,
+            BVLC_FORWARD_LOCAL | BVLC_FORWARD_BDT | BVLC_FORWARD_FDT) == 4);
+    ct_test(pTest,
+        Direct_Dests.dest[0].sin_addr.s_addr == htonl(0xC0A800FF));
+    ct_test(pTest,
+        Direct_Dests.dest[1].sin_addr.s_addr == htonl(0xC0A80105));
+    /* without the thread it is done right away */
+    bvlc_forward(&src, npdu, sizeof(npdu), BVLC_FORWARD_FDT);
+    bvlc_forward_stats(&stats);
+    ct_test(pTest, stats.direct == 1);
+    ct_test(pTest, stats.queued == 0);
+    /* with it, everything queued is sent before it stops */
+    ct_test(pTest, bvlc_forward_start());
+    for (i = 0; i < 10; i++) {
+        bvlc_forward(&src, npdu, sizeof(npdu), BVLC_FORWARD_FDT);
+    }
+    bvlc_forward_stop();
+    bvlc_forward_stats(&stats);
+    ct_test(pTest, (stats.queued + stats.direct) == 11);
+    ct_test(pTest, stats.queued > 0);
+    ct_test(pTest, stats.depth == 0);
+    ct_test(pTest, stats.max_depth >= 1);
+    ct_test(pTest, Forward_Count == 0);
+}
+
 #ifdef TEST_BVLC
 int main(
     void)
@@ -1252,6 +1670,12 @@ int main(
     assert(rc);
     rc = ct_addTestFunction(pTest, testInternetAddress);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testForeignDeviceTable);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testBroadcastDistributionTable);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testForwardQueue);
+    assert(rc);
     /* configure output */
     ct_setStream(pTest, stdout);
     ct_run(pTest);
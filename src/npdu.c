@@ -33,6 +33,7 @@
 ####COPYRIGHTEND####*/
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include "bacdef.h"
 #include "bacdcode.h"
 #include "bacint.h"
@@ -241,6 +242,106 @@ void npdu_encode_npdu_data(
     }
 }
 
+/* destination classes for the pre-encoded headers */
+#define NPDU_DEST_LOCAL 0
+#define NPDU_DEST_REMOTE 1
+#define NPDU_DEST_GLOBAL 2
+#define NPDU_DEST_CLASSES 3
+/* version, control, DNET, DLEN and hop count of a global broadcast */
+#define NPDU_TEMPLATE_MAX 6
+
+typedef struct npdu_template {
+    uint8_t len;
+    uint8_t octets[NPDU_TEMPLATE_MAX];
+} NPDU_TEMPLATE;
+
+/* headers for APDUs sent by this device, by destination class,
+   data_expecting_reply and priority; for a remote destination only the
+   version and control octets are kept, since DNET and DADR vary */
+static NPDU_TEMPLATE NPDU_Templates[NPDU_DEST_CLASSES][2][4];
+static bool NPDU_Templates_Ready;
+
+/* the templates come from npdu_encode_pdu, so they can't disagree */
+static void npdu_templates_init(
+    void)
+{
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_NPDU_DATA npdu_data;
+    NPDU_TEMPLATE *entry;
+    unsigned dest_class = 0;
+    unsigned reply = 0;
+    unsigned priority = 0;
+
+    for (dest_class = 0; dest_class < NPDU_DEST_CLASSES; dest_class++) {
+        if (dest_class == NPDU_DEST_LOCAL) {
+            dest.net = 0;
+        } else {
+            dest.net = BACNET_BROADCAST_NETWORK;
+        }
+        for (reply = 0; reply < 2; reply++) {
+            for (priority = 0; priority < 4; priority++) {
+                entry = &NPDU_Templates[dest_class][reply][priority];
+                npdu_encode_npdu_data(&npdu_data, reply ? true : false,
+                    (BACNET_MESSAGE_PRIORITY) priority);
+                entry->len = (uint8_t)
+                    npdu_encode_pdu(&entry->octets[0], &dest, NULL,
+                    &npdu_data);
+                if (dest_class == NPDU_DEST_REMOTE) {
+                    entry->len = 2;
+                }
+            }
+        }
+    }
+    NPDU_Templates_Ready = true;
+}
+
+/* encodes the NPDU header for an APDU sent by this device to dest,
+   copying a pre-encoded template where it can.  Our own address never
+   carries SNET, so there is no src. */
+int npdu_encode_apdu_header(
+    uint8_t * npdu,
+    BACNET_ADDRESS * dest,
+    BACNET_NPDU_DATA * npdu_data)
+{
+    NPDU_TEMPLATE *entry;
+    unsigned dest_class = NPDU_DEST_LOCAL;
+    int len = 0;
+
+    if (!npdu || !npdu_data) {
+        return 0;
+    }
+    /* anything the templates weren't built for */
+    if (npdu_data->network_layer_message ||
+        (npdu_data->protocol_version != BACNET_PROTOCOL_VERSION) ||
+        (npdu_data->hop_count != 255) || (npdu_data->priority > 3)) {
+        return npdu_encode_pdu(npdu, dest, NULL, npdu_data);
+    }
+    if (!NPDU_Templates_Ready) {
+        npdu_templates_init();
+    }
+    if (dest && dest->net) {
+        if ((dest->net == BACNET_BROADCAST_NETWORK) && (dest->len == 0)) {
+            dest_class = NPDU_DEST_GLOBAL;
+        } else {
+            dest_class = NPDU_DEST_REMOTE;
+        }
+    }
+    entry =
+        &NPDU_Templates[dest_class][npdu_data->data_expecting_reply ? 1 : 0]
+        [npdu_data->priority];
+    memcpy(&npdu[0], &entry->octets[0], entry->len);
+    len = entry->len;
+    if (dest_class == NPDU_DEST_REMOTE) {
+        len += encode_unsigned16(&npdu[len], dest->net);
+        npdu[len++] = dest->len;
+        memcpy(&npdu[len], &dest->adr[0], dest->len);
+        len += dest->len;
+        npdu[len++] = npdu_data->hop_count;
+    }
+
+    return len;
+}
+
 int npdu_decode(
     uint8_t * npdu,
     BACNET_ADDRESS * dest,
@@ -502,11 +603,66 @@ void testNPDU1(
     ct_test(pTest, npdu_src.mac_len == dest.mac_len);
 }
 
+void testNPDUTemplates(
+    Test * pTest)
+{
+    uint8_t pdu[MAX_NPDU] = { 0 };
+    uint8_t test_pdu[MAX_NPDU] = { 0 };
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_NPDU_DATA npdu_data;
+    unsigned reply = 0;
+    unsigned priority = 0;
+    unsigned i = 0;
+    int len = 0;
+    int test_len = 0;
+
+    for (i = 0; i < 4; i++) {
+        memset(&dest, 0, sizeof(dest));
+        if (i == 1) {
+            dest.net = BACNET_BROADCAST_NETWORK;
+        } else if (i == 2) {
+            dest.net = 5;
+            dest.len = 1;
+            dest.adr[0] = 0x7F;
+        } else if (i == 3) {
+            dest.net = 0x1234;
+            dest.len = 6;
+            memcpy(&dest.adr[0], "\x0a\x00\x00\x01\xba\xc0", 6);
+        }
+        for (reply = 0; reply < 2; reply++) {
+            for (priority = 0; priority < 4; priority++) {
+                npdu_encode_npdu_data(&npdu_data, reply ? true : false,
+                    (BACNET_MESSAGE_PRIORITY) priority);
+                len = npdu_encode_apdu_header(&pdu[0], &dest, &npdu_data);
+                test_len =
+                    npdu_encode_pdu(&test_pdu[0], &dest, NULL, &npdu_data);
+                ct_test(pTest, len == test_len);
+                ct_test(pTest, memcmp(pdu, test_pdu, len) == 0);
+            }
+        }
+    }
+    /* no destination is the local network */
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_URGENT);
+    len = npdu_encode_apdu_header(&pdu[0], NULL, &npdu_data);
+    test_len = npdu_encode_pdu(&test_pdu[0], NULL, NULL, &npdu_data);
+    ct_test(pTest, len == test_len);
+    ct_test(pTest, memcmp(pdu, test_pdu, len) == 0);
+    /* network layer messages are encoded the long way */
+    npdu_data.network_layer_message = true;
+    npdu_data.network_message_type = NETWORK_MESSAGE_WHO_IS_ROUTER_TO_NETWORK;
+    len = npdu_encode_apdu_header(&pdu[0], NULL, &npdu_data);
+    test_len = npdu_encode_pdu(&test_pdu[0], NULL, NULL, &npdu_data);
+    ct_test(pTest, len == test_len);
+    ct_test(pTest, memcmp(pdu, test_pdu, len) == 0);
+}
+
 #ifdef TEST_NPDU
 /* dummy stub for testing */
 void tsm_free_invoke_id(
+    BACNET_ADDRESS * src,
     uint8_t invokeID)
 {
+    (void) src;
     (void) invokeID;
 }
 
@@ -520,6 +676,36 @@ void iam_handler(
     (void) src;
 }
 
+void segment_receive(
+    BACNET_ADDRESS * src,
+    uint8_t * apdu,
+    uint16_t apdu_len)
+{
+    (void) src;
+    (void) apdu;
+    (void) apdu_len;
+}
+
+void segment_ack_handler(
+    BACNET_ADDRESS * src,
+    uint8_t * apdu,
+    uint16_t apdu_len)
+{
+    (void) src;
+    (void) apdu;
+    (void) apdu_len;
+}
+
+void segment_abort_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    bool server)
+{
+    (void) src;
+    (void) invoke_id;
+    (void) server;
+}
+
 int main(
     void)
 {
@@ -532,6 +718,8 @@ int main(
     assert(rc);
     rc = ct_addTestFunction(pTest, testNPDU2);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testNPDUTemplates);
+    assert(rc);
 
     ct_setStream(pTest, stdout);
     ct_run(pTest);
@@ -78,44 +78,33 @@ int rp_decode_service_request(
     unsigned apdu_len,
     BACNET_READ_PROPERTY_DATA * rpdata)
 {
-    unsigned len = 0;
-    uint8_t tag_number = 0;
-    uint32_t len_value_type = 0;
-    uint16_t type = 0;  /* for decoding */
+    BACNET_DECODE_CURSOR cursor;
+    int type = 0;       /* for decoding */
     uint32_t property = 0;      /* for decoding */
     uint32_t array_value = 0;   /* for decoding */
 
     /* check for value pointers */
-    if (apdu_len && rpdata) {
-        /* Tag 0: Object ID          */
-        if (!decode_is_context_tag(&apdu[len++], 0))
-            return -1;
-        len += decode_object_id(&apdu[len], &type, &rpdata->object_instance);
-        rpdata->object_type = (BACNET_OBJECT_TYPE) type;
-        /* Tag 1: Property ID */
-        len +=
-            decode_tag_number_and_value(&apdu[len], &tag_number,
-            &len_value_type);
-        if (tag_number != 1)
-            return -1;
-        len += decode_enumerated(&apdu[len], len_value_type, &property);
-        rpdata->object_property = (BACNET_PROPERTY_ID) property;
-        /* Tag 2: Optional Array Index */
-        if (len < apdu_len) {
-            len +=
-                decode_tag_number_and_value(&apdu[len], &tag_number,
-                &len_value_type);
-            if (tag_number == 2) {
-                len +=
-                    decode_unsigned(&apdu[len], len_value_type, &array_value);
-                rpdata->array_index = array_value;
-            } else
-                rpdata->array_index = BACNET_ARRAY_ALL;
-        } else
-            rpdata->array_index = BACNET_ARRAY_ALL;
-    }
+    if (!apdu_len || !rpdata)
+        return 0;
+    decode_cursor_init(&cursor, apdu, apdu_len);
+    /* Tag 0: Object ID          */
+    if (!decode_cursor_context_object_id(&cursor, 0, &type,
+            &rpdata->object_instance))
+        return -1;
+    rpdata->object_type = (BACNET_OBJECT_TYPE) type;
+    /* Tag 1: Property ID */
+    if (!decode_cursor_context_unsigned(&cursor, 1, &property))
+        return -1;
+    rpdata->object_property = (BACNET_PROPERTY_ID) property;
+    /* Tag 2: Optional Array Index */
+    if (decode_cursor_context_unsigned(&cursor, 2, &array_value))
+        rpdata->array_index = array_value;
+    else if (cursor.error)
+        return -1;
+    else
+        rpdata->array_index = BACNET_ARRAY_ALL;
 
-    return (int) len;
+    return (int) (apdu_len - decode_cursor_remaining(&cursor));
 }
 
 /* alternate method to encode the ack without extra buffer */
@@ -196,38 +196,37 @@ int rpm_decode_object_id(
     BACNET_OBJECT_TYPE * object_type,
     uint32_t * object_instance)
 {
-    unsigned len = 0;
-    uint16_t type = 0;  /* for decoding */
+    BACNET_DECODE_CURSOR cursor;
+    int type = 0;       /* for decoding */
 
     /* check for value pointers */
-    if (apdu && apdu_len && object_type && object_instance) {
-        /* Tag 0: Object ID */
-        if (!decode_is_context_tag(&apdu[len++], 0))
-            return -1;
-        len += decode_object_id(&apdu[len], &type, object_instance);
-        if (object_type)
-            *object_type = (BACNET_OBJECT_TYPE) type;
-        /* Tag 1: sequence of ReadAccessSpecification */
-        if (!decode_is_opening_tag_number(&apdu[len], 1))
-            return -1;
-        len++;  /* opening tag is only one octet */
-    }
+    if (!apdu || !apdu_len || !object_type || !object_instance)
+        return 0;
+    decode_cursor_init(&cursor, apdu, apdu_len);
+    /* Tag 0: Object ID */
+    if (!decode_cursor_context_object_id(&cursor, 0, &type, object_instance))
+        return -1;
+    *object_type = (BACNET_OBJECT_TYPE) type;
+    /* Tag 1: sequence of ReadAccessSpecification */
+    if (!decode_cursor_opening_tag(&cursor, 1))
+        return -1;
 
-    return (int) len;
+    return (int) (apdu_len - decode_cursor_remaining(&cursor));
 }
 
 int rpm_decode_object_end(
     uint8_t * apdu,
     unsigned apdu_len)
 {
-    int len = 0;        /* total length of the apdu, return value */
+    BACNET_DECODE_CURSOR cursor;
 
-    if (apdu && apdu_len) {
-        if (decode_is_closing_tag_number(apdu, 1))
-            len = 1;
-    }
+    if (!apdu || !apdu_len)
+        return 0;
+    decode_cursor_init(&cursor, apdu, apdu_len);
+    if (!decode_cursor_closing_tag(&cursor, 1))
+        return 0;
 
-    return len;
+    return (int) (apdu_len - decode_cursor_remaining(&cursor));
 }
 
 /* decode the object property portion of the service request only */
@@ -244,44 +243,27 @@ int rpm_decode_object_property(
     BACNET_PROPERTY_ID * object_property,
     int32_t * array_index)
 {
-    unsigned len = 0;
-    unsigned option_len = 0;
-    uint8_t tag_number = 0;
-    uint32_t len_value_type = 0;
+    BACNET_DECODE_CURSOR cursor;
     uint32_t property = 0;      /* for decoding */
     uint32_t array_value = 0;   /* for decoding */
 
     /* check for valid pointers */
-    if (apdu && apdu_len && object_property && array_index) {
-        /* Tag 0: propertyIdentifier */
-        if (!IS_CONTEXT_SPECIFIC(apdu[len]))
-            return -1;
-        len +=
-            decode_tag_number_and_value(&apdu[len], &tag_number,
-            &len_value_type);
-        if (tag_number != 0)
-            return -1;
-        len += decode_enumerated(&apdu[len], len_value_type, &property);
-        if (object_property)
-            *object_property = (BACNET_PROPERTY_ID) property;
-        /* Tag 1: Optional propertyArrayIndex */
-        if ((len < apdu_len) && IS_CONTEXT_SPECIFIC(apdu[len]) &&
-            (!decode_is_closing_tag(&apdu[len]))) {
-            option_len =
-                (unsigned) decode_tag_number_and_value(&apdu[len], &tag_number,
-                &len_value_type);
-            if (tag_number == 1) {
-                len += option_len;
-                len +=
-                    decode_unsigned(&apdu[len], len_value_type, &array_value);
-                *array_index = array_value;
-            } else
-                *array_index = BACNET_ARRAY_ALL;
-        } else
-            *array_index = BACNET_ARRAY_ALL;
-    }
+    if (!apdu || !apdu_len || !object_property || !array_index)
+        return 0;
+    decode_cursor_init(&cursor, apdu, apdu_len);
+    /* Tag 0: propertyIdentifier */
+    if (!decode_cursor_context_unsigned(&cursor, 0, &property))
+        return -1;
+    *object_property = (BACNET_PROPERTY_ID) property;
+    /* Tag 1: Optional propertyArrayIndex */
+    if (decode_cursor_context_unsigned(&cursor, 1, &array_value))
+        *array_index = array_value;
+    else if (cursor.error)
+        return -1;
+    else
+        *array_index = BACNET_ARRAY_ALL;
 
-    return (int) len;
+    return (int) (apdu_len - decode_cursor_remaining(&cursor));
 }
 
 int rpm_ack_encode_apdu_init(
@@ -663,6 +645,25 @@ void testReadPropertyMultiple(
     ct_test(pTest, test_len == 1);
     len += test_len;
     ct_test(pTest, len == service_request_len);
+    /* a request cut short inside a tag is refused, not read past */
+    test_len =
+        rpm_decode_object_id(service_request, 3, &object_type,
+        &object_instance);
+    ct_test(pTest, test_len == -1);
+    test_len =
+        rpm_decode_object_id(service_request, 5, &object_type,
+        &object_instance);
+    ct_test(pTest, test_len == -1);
+    len =
+        rpm_decode_object_id(service_request, service_request_len,
+        &object_type, &object_instance);
+    /* a property identifier that says it has two octets, with one left */
+    service_request[len] = 0x0A;
+    test_len =
+        rpm_decode_object_property(&service_request[len], 2,
+        &object_property, &array_index);
+    ct_test(pTest, test_len == -1);
+    ct_test(pTest, rpm_decode_object_end(&service_request[len], 2) == 0);
 }
 
 void testReadPropertyMultipleAck(
@@ -0,0 +1,840 @@
+/*####COPYRIGHTBEGIN####
+ -------------------------------------------
+ Copyright (C) 2006 Steve Karg
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to:
+ The Free Software Foundation, Inc.
+ 59 Temple Place - Suite 330
+ Boston, MA  02111-1307, USA.
+
+ As a special exception, if other files instantiate templates or
+ use macros or inline functions from this file, or you compile
+ this file and link it with other works to produce a work based
+ on this file, this file does not by itself cause the resulting
+ work to be covered by the GNU General Public License. However
+ the source code for this file must still be made available in
+ accordance with section (3) of the GNU General Public License.
+
+ This exception does not invalidate any other reasons why a work
+ based on this file might be covered by the GNU General Public
+ License.
+ -------------------------------------------
+####COPYRIGHTEND####*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bits.h"
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "apdu.h"
+#include "npdu.h"
+#include "abort.h"
+#include "datalink.h"
+#include "bacaddr.h"
+#include "timerwheel.h"
+#include "segment.h"
+
+/* the rebuilt message is passed on with a 16 bit length */
+#if (MAX_APDU_SEGMENTED > 65535)
+#error MAX_APDU * MAX_SEGMENTS_ACCEPTED must fit in 65535 octets
+#endif
+
+/* octets in front of the service data of each message */
+#define SEGMENT_ACK_HEADER 5
+#define COMPLEX_ACK_HEADER 3
+#define SEGMENT_REQUEST_HEADER 6
+#define CONFIRMED_REQUEST_HEADER 4
+
+/* one segmented message on its way out or being put back together */
+typedef struct segment_transaction {
+    /* SegmentTimer while sending, and the receive timeout */
+    BACNET_TIMER timer;
+    BACNET_ADDRESS peer;
+    bool in_use;
+    /* we are the one sending the segments */
+    bool sending;
+    /* PDU type of the message being segmented */
+    uint8_t pdu_type;
+    uint8_t invoke_id;
+    uint8_t service_choice;
+    /* ActualWindowSize */
+    uint8_t window;
+    uint8_t retries;
+    /* sending: the service data, without the APDU header;
+       receiving: the unsegmented APDU as it is rebuilt */
+    uint8_t *data;
+    unsigned data_len;
+    /* sending: octets of service data in each segment */
+    unsigned segment_len;
+    unsigned segment_count;
+    /* sending: segments the peer has acknowledged, and sent so far;
+       receiving: segments received in order, and where the window
+       that is being filled began */
+    unsigned acked;
+    unsigned sent;
+} SEGMENT_TRANSACTION;
+
+static SEGMENT_TRANSACTION Segment_List[MAX_SEGMENT_TRANSACTIONS];
+static uint8_t Segment_Window_Size = SEGMENT_WINDOW_SIZE;
+/* segments and SegmentACKs are built here, apart from the handlers */
+static uint8_t Segment_Transmit_Buffer[MAX_PDU];
+
+void segment_window_size_set(
+    uint8_t window)
+{
+    if (window < 1)
+        window = 1;
+    if (window > 127)
+        window = 127;
+    Segment_Window_Size = window;
+}
+
+uint8_t segment_window_size(
+    void)
+{
+    return Segment_Window_Size;
+}
+
+unsigned segment_transactions_active(
+    void)
+{
+    unsigned i;
+    unsigned count = 0;
+
+    for (i = 0; i < MAX_SEGMENT_TRANSACTIONS; i++) {
+        if (Segment_List[i].in_use)
+            count++;
+    }
+
+    return count;
+}
+
+static SEGMENT_TRANSACTION *segment_find(
+    BACNET_ADDRESS * peer,
+    uint8_t invoke_id,
+    uint8_t pdu_type,
+    bool sending)
+{
+    unsigned i;
+    SEGMENT_TRANSACTION *data;
+
+    for (i = 0; i < MAX_SEGMENT_TRANSACTIONS; i++) {
+        data = &Segment_List[i];
+        if (data->in_use && (data->invoke_id == invoke_id) &&
+            (data->pdu_type == pdu_type) && (data->sending == sending) &&
+            bacnet_address_same(&data->peer, peer))
+            return data;
+    }
+
+    return NULL;
+}
+
+static void segment_free(
+    SEGMENT_TRANSACTION * data)
+{
+    timer_wheel_stop(&data->timer);
+    free(data->data);
+    data->data = NULL;
+    data->in_use = false;
+}
+
+/* a transaction for this message, reusing the one it already has */
+static SEGMENT_TRANSACTION *segment_alloc(
+    BACNET_ADDRESS * peer,
+    uint8_t invoke_id,
+    uint8_t pdu_type,
+    bool sending)
+{
+    unsigned i;
+    SEGMENT_TRANSACTION *data;
+
+    data = segment_find(peer, invoke_id, pdu_type, sending);
+    if (data) {
+        segment_free(data);
+    } else {
+        for (i = 0; i < MAX_SEGMENT_TRANSACTIONS; i++) {
+            if (!Segment_List[i].in_use) {
+                data = &Segment_List[i];
+                break;
+            }
+        }
+        if (!data)
+            return NULL;
+    }
+    bacnet_address_copy(&data->peer, peer);
+    data->in_use = true;
+    data->sending = sending;
+    data->pdu_type = pdu_type;
+    data->invoke_id = invoke_id;
+    data->retries = 0;
+    data->data_len = 0;
+    data->acked = 0;
+    data->sent = 0;
+
+    return data;
+}
+
+int segment_ack_encode_apdu(
+    uint8_t * apdu,
+    bool negative_ack,
+    bool server,
+    uint8_t invoke_id,
+    uint8_t sequence_number,
+    uint8_t actual_window_size)
+{
+    apdu[0] = PDU_TYPE_SEGMENT_ACK;
+    if (negative_ack)
+        apdu[0] |= BIT1;
+    if (server)
+        apdu[0] |= BIT0;
+    apdu[1] = invoke_id;
+    apdu[2] = sequence_number;
+    apdu[3] = actual_window_size;
+
+    return 4;
+}
+
+uint16_t segment_timeout(
+    void)
+{
+    /* the APDU timeout serves for segments too */
+    return apdu_timeout();
+}
+
+unsigned segment_reply_max_apdu(
+    BACNET_CONFIRMED_SERVICE_DATA * service_data)
+{
+    unsigned max_apdu;
+    unsigned segments;
+
+    max_apdu = (unsigned) service_data->max_resp;
+    if ((max_apdu == 0) || (max_apdu > MAX_APDU))
+        max_apdu = MAX_APDU;
+    if ((MAX_SEGMENTS_ACCEPTED < 2) ||
+        !service_data->segmented_response_accepted)
+        return max_apdu;
+    /* zero is "unspecified" and 65 is "more than 64" */
+    segments = (unsigned) service_data->max_segs;
+    if ((segments == 0) || (segments > MAX_SEGMENTS_ACCEPTED))
+        segments = MAX_SEGMENTS_ACCEPTED;
+
+    return COMPLEX_ACK_HEADER + (segments * (max_apdu -
+            SEGMENT_ACK_HEADER));
+}
+
+static int segment_send(
+    SEGMENT_TRANSACTION * data,
+    unsigned index)
+{
+    BACNET_NPDU_DATA npdu_data;
+    uint8_t *pdu = &Segment_Transmit_Buffer[0];
+    unsigned offset;
+    unsigned len;
+    int pdu_len;
+
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_NORMAL);
+    pdu_len = npdu_encode_apdu_header(pdu, &data->peer, &npdu_data);
+    offset = index * data->segment_len;
+    len = data->data_len - offset;
+    if (len > data->segment_len)
+        len = data->segment_len;
+    pdu[pdu_len] = PDU_TYPE_COMPLEX_ACK | BIT3;
+    if ((index + 1) < data->segment_count)
+        pdu[pdu_len] |= BIT2;
+    pdu[pdu_len + 1] = data->invoke_id;
+    pdu[pdu_len + 2] = (uint8_t) index;
+    pdu[pdu_len + 3] = Segment_Window_Size;
+    pdu[pdu_len + 4] = data->service_choice;
+    pdu_len += SEGMENT_ACK_HEADER;
+    memcpy(&pdu[pdu_len], &data->data[offset], len);
+
+    return datalink_send_pdu(&data->peer, &npdu_data, pdu, pdu_len + len);
+}
+
+/* SegmentTimer expired: send the unacknowledged segments again */
+static void segment_send_timeout(
+    BACNET_TIMER * timer)
+{
+    SEGMENT_TRANSACTION *data;
+    unsigned index;
+
+    data = (SEGMENT_TRANSACTION *) ((uint8_t *) timer -
+        offsetof(SEGMENT_TRANSACTION, timer));
+    data->retries++;
+    if (data->retries > apdu_retries()) {
+        segment_free(data);
+        return;
+    }
+    timer_wheel_start(&data->timer, segment_timeout(), segment_send_timeout);
+    for (index = data->acked; index < data->sent; index++) {
+        segment_send(data, index);
+    }
+}
+
+/* the rest of the message never came: forget what we have */
+static void segment_receive_timeout(
+    BACNET_TIMER * timer)
+{
+    SEGMENT_TRANSACTION *data;
+
+    data = (SEGMENT_TRANSACTION *) ((uint8_t *) timer -
+        offsetof(SEGMENT_TRANSACTION, timer));
+    segment_free(data);
+}
+
+int segment_send_pdu(
+    BACNET_ADDRESS * dest,
+    BACNET_NPDU_DATA * npdu_data,
+    BACNET_CONFIRMED_SERVICE_DATA * service_data,
+    uint8_t * pdu,
+    unsigned npdu_len,
+    unsigned apdu_len)
+{
+    uint8_t *apdu = &pdu[npdu_len];
+    SEGMENT_TRANSACTION *data = NULL;
+    uint8_t abort_reason = ABORT_REASON_OTHER;
+    unsigned max_apdu;
+
+    max_apdu = (unsigned) service_data->max_resp;
+    if ((max_apdu == 0) || (max_apdu > MAX_APDU))
+        max_apdu = MAX_APDU;
+    if ((apdu_len <= max_apdu) ||
+        ((apdu[0] & 0xF0) != PDU_TYPE_COMPLEX_ACK))
+        return datalink_send_pdu(dest, npdu_data, pdu, npdu_len + apdu_len);
+    if ((MAX_SEGMENTS_ACCEPTED < 2) ||
+        !service_data->segmented_response_accepted) {
+        abort_reason = ABORT_REASON_SEGMENTATION_NOT_SUPPORTED;
+    } else if (apdu_len > segment_reply_max_apdu(service_data)) {
+        abort_reason = ABORT_REASON_BUFFER_OVERFLOW;
+    } else {
+        data =
+            segment_alloc(dest, apdu[1], PDU_TYPE_COMPLEX_ACK, true);
+        if (data) {
+            data->data = malloc(apdu_len - COMPLEX_ACK_HEADER);
+            if (!data->data) {
+                segment_free(data);
+                data = NULL;
+            }
+        }
+    }
+    if (!data) {
+        apdu_len =
+            abort_encode_apdu(apdu, service_data->invoke_id, abort_reason,
+            true);
+        return datalink_send_pdu(dest, npdu_data, pdu, npdu_len + apdu_len);
+    }
+    data->service_choice = apdu[2];
+    data->data_len = apdu_len - COMPLEX_ACK_HEADER;
+    memcpy(data->data, &apdu[COMPLEX_ACK_HEADER], data->data_len);
+    data->segment_len = max_apdu - SEGMENT_ACK_HEADER;
+    data->segment_count =
+        (data->data_len + data->segment_len - 1) / data->segment_len;
+    data->window = 1;
+    /* the first segment goes alone; its SegmentACK sets the window */
+    data->sent = 1;
+    timer_wheel_start(&data->timer, segment_timeout(), segment_send_timeout);
+
+    return segment_send(data, 0);
+}
+
+void segment_ack_handler(
+    BACNET_ADDRESS * src,
+    uint8_t * apdu,
+    uint16_t apdu_len)
+{
+    SEGMENT_TRANSACTION *data;
+    bool negative_ack;
+    uint8_t sequence_number;
+    unsigned window;
+    unsigned index;
+    unsigned first;
+    unsigned last;
+
+    /* we only send ComplexACKs in segments, so only a client acks */
+    if ((apdu_len < 4) || (apdu[0] & BIT0))
+        return;
+    data = segment_find(src, apdu[1], PDU_TYPE_COMPLEX_ACK, true);
+    if (!data)
+        return;
+    negative_ack = (apdu[0] & BIT1) ? true : false;
+    sequence_number = apdu[2];
+    /* the sequence number wraps, so find the segment it names among
+       the last one acknowledged and those still outstanding */
+    index = data->acked ? (data->acked - 1) : 0;
+    for (; index < data->sent; index++) {
+        if ((uint8_t) index == sequence_number)
+            break;
+    }
+    if (index >= data->sent)
+        return;
+    data->acked = index + 1;
+    if (data->acked >= data->segment_count) {
+        segment_free(data);
+        return;
+    }
+    window = apdu[3];
+    if (window < 1)
+        window = 1;
+    if (window > 127)
+        window = 127;
+    data->window = (uint8_t) window;
+    data->retries = 0;
+    last = data->acked + window;
+    if (last > data->segment_count)
+        last = data->segment_count;
+    first = data->acked;
+    if (!negative_ack && (data->sent > first))
+        first = data->sent;
+    timer_wheel_start(&data->timer, segment_timeout(), segment_send_timeout);
+    for (index = first; index < last; index++) {
+        segment_send(data, index);
+    }
+    if (last > data->sent)
+        data->sent = last;
+}
+
+static void segment_ack_send(
+    SEGMENT_TRANSACTION * data,
+    bool negative_ack,
+    uint8_t sequence_number)
+{
+    BACNET_NPDU_DATA npdu_data;
+    uint8_t *pdu = &Segment_Transmit_Buffer[0];
+    int pdu_len;
+
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    pdu_len = npdu_encode_apdu_header(pdu, &data->peer, &npdu_data);
+    pdu_len +=
+        segment_ack_encode_apdu(&pdu[pdu_len], negative_ack,
+        (data->pdu_type == PDU_TYPE_CONFIRMED_SERVICE_REQUEST),
+        data->invoke_id, sequence_number, data->window);
+    datalink_send_pdu(&data->peer, &npdu_data, pdu, pdu_len);
+}
+
+static void segment_abort_send(
+    BACNET_ADDRESS * dest,
+    uint8_t invoke_id,
+    uint8_t abort_reason,
+    bool server)
+{
+    BACNET_NPDU_DATA npdu_data;
+    uint8_t *pdu = &Segment_Transmit_Buffer[0];
+    int pdu_len;
+
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    pdu_len = npdu_encode_apdu_header(pdu, dest, &npdu_data);
+    pdu_len +=
+        abort_encode_apdu(&pdu[pdu_len], invoke_id, abort_reason, server);
+    datalink_send_pdu(dest, &npdu_data, pdu, pdu_len);
+}
+
+void segment_receive(
+    BACNET_ADDRESS * src,
+    uint8_t * apdu,
+    uint16_t apdu_len)
+{
+    SEGMENT_TRANSACTION *data;
+    uint8_t pdu_type;
+    uint8_t invoke_id;
+    uint8_t sequence_number;
+    uint8_t proposed_window;
+    uint8_t service_choice;
+    unsigned header_len;
+    bool server;
+    bool more_follows;
+    uint8_t *message;
+    unsigned message_len;
+
+    pdu_type = apdu[0] & 0xF0;
+    server = (pdu_type == PDU_TYPE_CONFIRMED_SERVICE_REQUEST);
+    header_len = server ? SEGMENT_REQUEST_HEADER : SEGMENT_ACK_HEADER;
+    if (apdu_len < header_len)
+        return;
+    invoke_id = apdu[header_len - 4];
+    if (MAX_SEGMENTS_ACCEPTED < 2) {
+        segment_abort_send(src, invoke_id,
+            ABORT_REASON_SEGMENTATION_NOT_SUPPORTED, server);
+        return;
+    }
+    sequence_number = apdu[header_len - 3];
+    proposed_window = apdu[header_len - 2];
+    service_choice = apdu[header_len - 1];
+    more_follows = (apdu[0] & BIT2) ? true : false;
+    data = segment_find(src, invoke_id, pdu_type, false);
+    if (sequence_number == 0) {
+        data = segment_alloc(src, invoke_id, pdu_type, false);
+        if (data) {
+            data->data = malloc(MAX_APDU_SEGMENTED);
+            if (!data->data)
+                segment_free(data);
+        }
+        if (!data || !data->data) {
+            segment_abort_send(src, invoke_id, ABORT_REASON_OTHER, server);
+            return;
+        }
+        /* the APDU as it would have been sent in one piece */
+        if (server) {
+            data->data[0] = apdu[0] & ~(BIT3 | BIT2);
+            data->data[1] = apdu[1];
+            data->data[2] = invoke_id;
+            data->data[3] = service_choice;
+            data->data_len = CONFIRMED_REQUEST_HEADER;
+        } else {
+            data->data[0] = PDU_TYPE_COMPLEX_ACK;
+            data->data[1] = invoke_id;
+            data->data[2] = service_choice;
+            data->data_len = COMPLEX_ACK_HEADER;
+        }
+        data->service_choice = service_choice;
+        data->window = proposed_window;
+        if (data->window > Segment_Window_Size)
+            data->window = Segment_Window_Size;
+        if (data->window < 1)
+            data->window = 1;
+    } else if (!data) {
+        return;
+    }
+    if (sequence_number != (uint8_t) data->acked) {
+        /* lost or repeated: ask for everything after the last segment
+           we have in order */
+        segment_ack_send(data, true, (uint8_t) (data->acked - 1));
+        data->sent = data->acked;
+        timer_wheel_start(&data->timer, 4 * segment_timeout(),
+            segment_receive_timeout);
+        return;
+    }
+    if ((data->data_len + (apdu_len - header_len)) > MAX_APDU_SEGMENTED) {
+        segment_abort_send(src, invoke_id, ABORT_REASON_BUFFER_OVERFLOW,
+            server);
+        segment_free(data);
+        return;
+    }
+    memcpy(&data->data[data->data_len], &apdu[header_len],
+        apdu_len - header_len);
+    data->data_len += apdu_len - header_len;
+    data->acked++;
+    if (!more_follows) {
+        segment_ack_send(data, false, sequence_number);
+        /* hand the slot back before the message is handled, since
+           the reply may need one of its own */
+        message = data->data;
+        message_len = data->data_len;
+        data->data = NULL;
+        segment_free(data);
+        apdu_handler(src, message, (uint16_t) message_len);
+        free(message);
+        return;
+    }
+    if ((data->acked == 1) || ((data->acked - data->sent) >= data->window)) {
+        segment_ack_send(data, false, sequence_number);
+        data->sent = data->acked;
+    }
+    timer_wheel_start(&data->timer, 4 * segment_timeout(),
+        segment_receive_timeout);
+}
+
+void segment_abort_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    bool server)
+{
+    SEGMENT_TRANSACTION *data;
+
+    if (server) {
+        /* the server gave up on the ComplexACK it was sending us */
+        data = segment_find(src, invoke_id, PDU_TYPE_COMPLEX_ACK, false);
+        if (data)
+            segment_free(data);
+    } else {
+        data = segment_find(src, invoke_id, PDU_TYPE_COMPLEX_ACK, true);
+        if (data)
+            segment_free(data);
+        data =
+            segment_find(src, invoke_id, PDU_TYPE_CONFIRMED_SERVICE_REQUEST,
+            false);
+        if (data)
+            segment_free(data);
+    }
+}
+
+#ifdef TEST
+#include <assert.h>
+#include "ctest.h"
+
+/* every PDU that goes out is kept here until the test passes it on */
+#define TEST_PDU_MAX 128
+static uint8_t Test_Pdu[TEST_PDU_MAX][MAX_PDU];
+static unsigned Test_Pdu_Len[TEST_PDU_MAX];
+static unsigned Test_Pdu_Head;
+static unsigned Test_Pdu_Tail;
+/* the ComplexACK as the client side put it back together */
+static uint8_t Test_Ack[MAX_APDU_SEGMENTED];
+static unsigned Test_Ack_Len;
+static uint8_t Test_Reply[MAX_PDU_SEGMENTED];
+
+int datalink_send_pdu(
+    BACNET_ADDRESS * dest,
+    BACNET_NPDU_DATA * npdu_data,
+    uint8_t * pdu,
+    unsigned pdu_len)
+{
+    (void) dest;
+    (void) npdu_data;
+    if (Test_Pdu_Tail < TEST_PDU_MAX) {
+        memcpy(Test_Pdu[Test_Pdu_Tail], pdu, pdu_len);
+        Test_Pdu_Len[Test_Pdu_Tail] = pdu_len;
+        Test_Pdu_Tail++;
+    }
+
+    return (int) pdu_len;
+}
+
+void datalink_get_broadcast_address(
+    BACNET_ADDRESS * dest)
+{
+    (void) dest;
+}
+
+static void test_rpm_ack_handler(
+    uint8_t * service_request,
+    uint16_t service_len,
+    BACNET_ADDRESS * src,
+    BACNET_CONFIRMED_SERVICE_ACK_DATA * service_data)
+{
+    (void) src;
+    (void) service_data;
+    memcpy(Test_Ack, service_request, service_len);
+    Test_Ack_Len = service_len;
+}
+
+/* the APDU of a PDU that went out */
+static uint8_t *test_pdu_apdu(
+    unsigned index,
+    unsigned *apdu_len)
+{
+    BACNET_ADDRESS dest;
+    BACNET_ADDRESS src;
+    BACNET_NPDU_DATA npdu_data;
+    int npdu_len;
+
+    npdu_len = npdu_decode(Test_Pdu[index], &dest, &src, &npdu_data);
+    *apdu_len = Test_Pdu_Len[index] - npdu_len;
+
+    return &Test_Pdu[index][npdu_len];
+}
+
+static void test_pdu_reset(
+    void)
+{
+    Test_Pdu_Head = 0;
+    Test_Pdu_Tail = 0;
+    Test_Ack_Len = 0;
+}
+
+/* hands everything that went out to the other side, which is us too:
+   segments reach the receiving side, SegmentACKs the sending side */
+static unsigned test_pdu_pump(
+    BACNET_ADDRESS * peer,
+    int drop_sequence)
+{
+    uint8_t *apdu;
+    unsigned apdu_len;
+    unsigned segments = 0;
+
+    while (Test_Pdu_Head < Test_Pdu_Tail) {
+        apdu = test_pdu_apdu(Test_Pdu_Head, &apdu_len);
+        Test_Pdu_Head++;
+        if ((apdu[0] & 0xF8) == (PDU_TYPE_COMPLEX_ACK | BIT3)) {
+            if (apdu[2] == drop_sequence) {
+                drop_sequence = -1;
+                continue;
+            }
+            segments++;
+        }
+        apdu_handler(peer, apdu, (uint16_t) apdu_len);
+    }
+
+    return segments;
+}
+
+static unsigned test_reply(
+    BACNET_ADDRESS * peer,
+    uint8_t invoke_id,
+    unsigned data_len)
+{
+    BACNET_NPDU_DATA npdu_data;
+    unsigned npdu_len;
+    unsigned i;
+
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    npdu_len = npdu_encode_apdu_header(Test_Reply, peer, &npdu_data);
+    Test_Reply[npdu_len] = PDU_TYPE_COMPLEX_ACK;
+    Test_Reply[npdu_len + 1] = invoke_id;
+    Test_Reply[npdu_len + 2] = SERVICE_CONFIRMED_READ_PROP_MULTIPLE;
+    for (i = 0; i < data_len; i++) {
+        Test_Reply[npdu_len + COMPLEX_ACK_HEADER + i] = (uint8_t) (i * 7);
+    }
+
+    return npdu_len;
+}
+
+static bool test_ack_same(
+    unsigned data_len)
+{
+    unsigned i;
+
+    if (Test_Ack_Len != data_len)
+        return false;
+    for (i = 0; i < data_len; i++) {
+        if (Test_Ack[i] != (uint8_t) (i * 7))
+            return false;
+    }
+
+    return true;
+}
+
+void testSegment(
+    Test * pTest)
+{
+    BACNET_ADDRESS peer = { 0 };
+    BACNET_NPDU_DATA npdu_data;
+    BACNET_CONFIRMED_SERVICE_DATA service_data = { 0 };
+    unsigned npdu_len;
+    unsigned apdu_len;
+    unsigned segments;
+    unsigned i;
+    uint8_t *apdu;
+
+    peer.mac_len = 6;
+    peer.mac[0] = 127;
+    peer.mac[3] = 1;
+    peer.mac[4] = 0xBA;
+    peer.mac[5] = 0xC0;
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    apdu_set_confirmed_ack_handler(SERVICE_CONFIRMED_READ_PROP_MULTIPLE,
+        test_rpm_ack_handler);
+    segment_window_size_set(4);
+    service_data.max_resp = 480;
+    service_data.segmented_response_accepted = true;
+    service_data.invoke_id = 9;
+
+    /* short enough for one message: sent just as it is */
+    test_pdu_reset();
+    npdu_len = test_reply(&peer, 9, 100);
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 100);
+    ct_test(pTest, Test_Pdu_Tail == 1);
+    ct_test(pTest, Test_Pdu_Len[0] == npdu_len + COMPLEX_ACK_HEADER + 100);
+    ct_test(pTest, segment_transactions_active() == 0);
+
+    /* the first segment goes alone, the rest a window at a time */
+    test_pdu_reset();
+    npdu_len = test_reply(&peer, 9, 5000);
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    ct_test(pTest, Test_Pdu_Tail == 1);
+    apdu = test_pdu_apdu(0, &apdu_len);
+    ct_test(pTest, apdu[0] == (PDU_TYPE_COMPLEX_ACK | BIT3 | BIT2));
+    ct_test(pTest, apdu[1] == 9);
+    ct_test(pTest, apdu[2] == 0);
+    ct_test(pTest, apdu[3] == 4);
+    ct_test(pTest, apdu[4] == SERVICE_CONFIRMED_READ_PROP_MULTIPLE);
+    ct_test(pTest, apdu_len == 480);
+    ct_test(pTest, segment_transactions_active() == 1);
+    segments = test_pdu_pump(&peer, -1);
+    /* 5000 octets in segments of 475 */
+    ct_test(pTest, segments == 11);
+    ct_test(pTest, test_ack_same(5000));
+    ct_test(pTest, segment_transactions_active() == 0);
+    /* SegmentACKs: the first segment, two full windows and the last */
+    ct_test(pTest, Test_Pdu_Tail == (11 + 4));
+
+    /* a segment goes missing: the receiver NAKs and it is sent again */
+    test_pdu_reset();
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    segments = test_pdu_pump(&peer, 2);
+    ct_test(pTest, test_ack_same(5000));
+    ct_test(pTest, segments > 11);
+    ct_test(pTest, segment_transactions_active() == 0);
+
+    /* no SegmentACK comes back: sent again, then given up on */
+    test_pdu_reset();
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    for (i = 0; i < apdu_retries(); i++) {
+        timer_wheel_milliseconds(segment_timeout());
+    }
+    ct_test(pTest, Test_Pdu_Tail == (1 + apdu_retries()));
+    ct_test(pTest, segment_transactions_active() == 1);
+    timer_wheel_milliseconds(segment_timeout());
+    ct_test(pTest, segment_transactions_active() == 0);
+
+    /* the client aborts part way */
+    test_pdu_reset();
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    ct_test(pTest, segment_transactions_active() == 1);
+    segment_abort_handler(&peer, 9, false);
+    ct_test(pTest, segment_transactions_active() == 0);
+
+    /* more segments than the client takes */
+    test_pdu_reset();
+    service_data.max_segs = 4;
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    apdu = test_pdu_apdu(0, &apdu_len);
+    ct_test(pTest, apdu[0] == (PDU_TYPE_ABORT | 1));
+    ct_test(pTest, apdu[2] == ABORT_REASON_BUFFER_OVERFLOW);
+    ct_test(pTest, segment_reply_max_apdu(&service_data) ==
+        (COMPLEX_ACK_HEADER + 4 * 475));
+
+    /* a client that takes no segments at all */
+    test_pdu_reset();
+    service_data.max_segs = 0;
+    service_data.segmented_response_accepted = false;
+    npdu_len = test_reply(&peer, 9, 5000);
+    segment_send_pdu(&peer, &npdu_data, &service_data, Test_Reply, npdu_len,
+        COMPLEX_ACK_HEADER + 5000);
+    apdu = test_pdu_apdu(0, &apdu_len);
+    ct_test(pTest, apdu[0] == (PDU_TYPE_ABORT | 1));
+    ct_test(pTest, apdu[2] == ABORT_REASON_SEGMENTATION_NOT_SUPPORTED);
+    ct_test(pTest, segment_reply_max_apdu(&service_data) == 480);
+    ct_test(pTest, segment_transactions_active() == 0);
+}
+
+#ifdef TEST_SEGMENT
+int main(
+    void)
+{
+    Test *pTest;
+    bool rc;
+
+    pTest = ct_create("BACnet Segmentation", NULL);
+    /* individual tests */
+    rc = ct_addTestFunction(pTest, testSegment);
+    assert(rc);
+
+    ct_setStream(pTest, stdout);
+    ct_run(pTest);
+    (void) ct_report(pTest);
+    ct_destroy(pTest);
+
+    return 0;
+}
+#endif /* TEST_SEGMENT */
+#endif /* TEST */
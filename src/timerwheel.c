@@ -0,0 +1,355 @@
+/*####COPYRIGHTBEGIN####
+ -------------------------------------------
+ Copyright (C) 2006 Steve Karg
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to:
+ The Free Software Foundation, Inc.
+ 59 Temple Place - Suite 330
+ Boston, MA  02111-1307, USA.
+
+ As a special exception, if other files instantiate templates or
+ use macros or inline functions from this file, or you compile
+ this file and link it with other works to produce a work based
+ on this file, this file does not by itself cause the resulting
+ work to be covered by the GNU General Public License. However
+ the source code for this file must still be made available in
+ accordance with section (3) of the GNU General Public License.
+
+ This exception does not invalidate any other reasons why a work
+ based on this file might be covered by the GNU General Public
+ License.
+ -------------------------------------------
+####COPYRIGHTEND####*/
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "timerwheel.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+/* furthest a timer is placed ahead; longer ones are re-placed
+   each time the top level turns */
+#define TIMER_WHEEL_SPAN \
+    (((uint64_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+static BACNET_TIMER *Wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+/* one bit per slot that holds a timer, so idle time is skipped */
+static uint64_t Wheel_Used[TIMER_WHEEL_LEVELS];
+static uint64_t Wheel_Now = 0;
+
+static unsigned timer_wheel_lowest_bit(
+    uint64_t bits)
+{
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctzll(bits);
+#else
+    unsigned bit = 0;
+
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
+static void timer_wheel_link(
+    BACNET_TIMER * timer)
+{
+    uint64_t when = timer->expires;
+    uint64_t delta;
+    unsigned level;
+
+    /* already due: run it on the tick being processed */
+    if (when < Wheel_Now)
+        when = Wheel_Now;
+    delta = when - Wheel_Now;
+    if (delta > TIMER_WHEEL_SPAN) {
+        delta = TIMER_WHEEL_SPAN;
+        when = Wheel_Now + delta;
+    }
+    for (level = 0; level < (TIMER_WHEEL_LEVELS - 1); level++) {
+        if (delta < ((uint64_t) 1 << (TIMER_WHEEL_BITS * (level + 1))))
+            break;
+    }
+    timer->level = (uint8_t) level;
+    timer->slot =
+        (uint8_t) ((when >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    timer->prev = NULL;
+    timer->next = Wheel[level][timer->slot];
+    if (timer->next)
+        timer->next->prev = timer;
+    Wheel[level][timer->slot] = timer;
+    Wheel_Used[level] |= ((uint64_t) 1 << timer->slot);
+}
+
+static void timer_wheel_unlink(
+    BACNET_TIMER * timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        Wheel[timer->level][timer->slot] = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    if (Wheel[timer->level][timer->slot] == NULL)
+        Wheel_Used[timer->level] &= ~((uint64_t) 1 << timer->slot);
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/* ticks until the wheel next reaches a slot holding a timer,
+   or UINT64_MAX if it is empty */
+static uint64_t timer_wheel_distance(
+    void)
+{
+    uint64_t distance = UINT64_MAX;
+    uint64_t block;
+    uint64_t bits;
+    uint64_t ticks;
+    unsigned shift;
+    unsigned start;
+    unsigned level;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        bits = Wheel_Used[level];
+        if (bits == 0)
+            continue;
+        shift = TIMER_WHEEL_BITS * level;
+        block = Wheel_Now >> shift;
+        /* rotate so that bit 0 is the slot after the current one */
+        start = (unsigned) ((block + 1) & TIMER_WHEEL_MASK);
+        if (start)
+            bits = (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start));
+        block += timer_wheel_lowest_bit(bits) + 1;
+        ticks = (block << shift) - Wheel_Now;
+        if (ticks < distance)
+            distance = ticks;
+    }
+
+    return distance;
+}
+
+/* moves the clock onto Wheel_Now: cascade the levels that
+   turned over, then run everything due in the level 0 slot */
+static void timer_wheel_tick(
+    void)
+{
+    BACNET_TIMER *timer;
+    unsigned level;
+    unsigned slot;
+
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (Wheel_Now & (((uint64_t) 1 << (TIMER_WHEEL_BITS * level)) - 1))
+            break;
+        slot =
+            (unsigned) ((Wheel_Now >> (TIMER_WHEEL_BITS * level)) &
+            TIMER_WHEEL_MASK);
+        while ((timer = Wheel[level][slot]) != NULL) {
+            timer_wheel_unlink(timer);
+            timer_wheel_link(timer);
+        }
+    }
+    slot = (unsigned) (Wheel_Now & TIMER_WHEEL_MASK);
+    while ((timer = Wheel[0][slot]) != NULL) {
+        timer_wheel_unlink(timer);
+        if (timer->expires > Wheel_Now) {
+            timer_wheel_link(timer);
+            continue;
+        }
+        timer->active = false;
+        /* the callback may start this or any other timer again */
+        timer->callback(timer);
+    }
+}
+
+void timer_wheel_start(
+    BACNET_TIMER * timer,
+    uint32_t milliseconds,
+    timer_wheel_callback callback)
+{
+    if (timer->active)
+        timer_wheel_unlink(timer);
+    /* the soonest a timer can fire is the next tick */
+    if (milliseconds == 0)
+        milliseconds = 1;
+    timer->expires = Wheel_Now + milliseconds;
+    timer->callback = callback;
+    timer->active = true;
+    timer_wheel_link(timer);
+}
+
+void timer_wheel_stop(
+    BACNET_TIMER * timer)
+{
+    if (timer->active) {
+        timer_wheel_unlink(timer);
+        timer->active = false;
+    }
+}
+
+bool timer_wheel_active(
+    BACNET_TIMER * timer)
+{
+    return timer->active;
+}
+
+uint32_t timer_wheel_remaining(
+    BACNET_TIMER * timer)
+{
+    uint64_t remaining = 0;
+
+    if (timer->active && (timer->expires > Wheel_Now)) {
+        remaining = timer->expires - Wheel_Now;
+        if (remaining > UINT32_MAX)
+            remaining = UINT32_MAX;
+    }
+
+    return (uint32_t) remaining;
+}
+
+/* called with the time since the last call; skips straight
+   over ticks that have nothing to cascade or run */
+void timer_wheel_milliseconds(
+    uint32_t milliseconds)
+{
+    uint64_t target = Wheel_Now + milliseconds;
+    uint64_t distance;
+
+    while (Wheel_Now < target) {
+        distance = timer_wheel_distance();
+        if (distance > (target - Wheel_Now)) {
+            Wheel_Now = target;
+            break;
+        }
+        Wheel_Now += distance;
+        timer_wheel_tick();
+    }
+}
+
+uint32_t timer_wheel_next(
+    void)
+{
+    uint64_t distance = timer_wheel_distance();
+
+    if (distance >= TIMER_WHEEL_IDLE)
+        return TIMER_WHEEL_IDLE;
+
+    return (uint32_t) distance;
+}
+
+uint64_t timer_wheel_now(
+    void)
+{
+    return Wheel_Now;
+}
+
+#ifdef TEST
+#include <assert.h>
+#include <string.h>
+#include "ctest.h"
+
+static unsigned Fired;
+static uint64_t Fired_At[4];
+static BACNET_TIMER Test_Timer[4];
+
+static void test_timer_expired(
+    BACNET_TIMER * timer)
+{
+    Fired_At[timer - &Test_Timer[0]] = timer_wheel_now();
+    Fired++;
+}
+
+static void test_timer_restart(
+    BACNET_TIMER * timer)
+{
+    test_timer_expired(timer);
+    if (Fired < 3)
+        timer_wheel_start(timer, 100, test_timer_restart);
+}
+
+void testTimerWheel(
+    Test * pTest)
+{
+    uint64_t start;
+    unsigned i;
+
+    ct_test(pTest, timer_wheel_next() == TIMER_WHEEL_IDLE);
+    /* one timer in each of the lower levels, fired on time even
+       when the clock moves in uneven steps */
+    start = timer_wheel_now();
+    Fired = 0;
+    timer_wheel_start(&Test_Timer[0], 10, test_timer_expired);
+    timer_wheel_start(&Test_Timer[1], 3000, test_timer_expired);
+    timer_wheel_start(&Test_Timer[2], 300000, test_timer_expired);
+    timer_wheel_start(&Test_Timer[3], 50, test_timer_expired);
+    ct_test(pTest, timer_wheel_next() <= 10);
+    ct_test(pTest, timer_wheel_remaining(&Test_Timer[1]) == 3000);
+    timer_wheel_stop(&Test_Timer[3]);
+    ct_test(pTest, !timer_wheel_active(&Test_Timer[3]));
+    ct_test(pTest, timer_wheel_remaining(&Test_Timer[3]) == 0);
+    for (i = 0; i < 3001; i += 7) {
+        timer_wheel_milliseconds(7);
+    }
+    ct_test(pTest, Fired == 2);
+    ct_test(pTest, Fired_At[0] == start + 10);
+    ct_test(pTest, Fired_At[1] == start + 3000);
+    ct_test(pTest, timer_wheel_active(&Test_Timer[2]));
+    /* a single large step still runs it at its own expiry */
+    timer_wheel_milliseconds(1000000);
+    ct_test(pTest, Fired == 3);
+    ct_test(pTest, Fired_At[2] == start + 300000);
+    ct_test(pTest, timer_wheel_next() == TIMER_WHEEL_IDLE);
+    /* a callback can restart its own timer */
+    start = timer_wheel_now();
+    Fired = 0;
+    timer_wheel_start(&Test_Timer[0], 100, test_timer_restart);
+    timer_wheel_milliseconds(1000);
+    ct_test(pTest, Fired == 3);
+    ct_test(pTest, Fired_At[0] == start + 300);
+    /* beyond the span of the wheel */
+    start = timer_wheel_now();
+    Fired = 0;
+    timer_wheel_start(&Test_Timer[1], UINT32_MAX, test_timer_expired);
+    timer_wheel_milliseconds(UINT32_MAX - 1);
+    ct_test(pTest, Fired == 0);
+    ct_test(pTest, timer_wheel_remaining(&Test_Timer[1]) == 1);
+    timer_wheel_milliseconds(1);
+    ct_test(pTest, Fired == 1);
+    ct_test(pTest, Fired_At[1] == start + UINT32_MAX);
+}
+
+#ifdef TEST_TIMER_WHEEL
+int main(
+    void)
+{
+    Test *pTest;
+    bool rc;
+
+    pTest = ct_create("BACnet Timer Wheel", NULL);
+    /* individual tests */
+    rc = ct_addTestFunction(pTest, testTimerWheel);
+    assert(rc);
+
+    ct_setStream(pTest, stdout);
+    ct_run(pTest);
+    (void) ct_report(pTest);
+    ct_destroy(pTest);
+
+    return 0;
+}
+#endif /* TEST_TIMER_WHEEL */
+#endif /* TEST */
@@ -35,6 +35,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "bits.h"
 #include "apdu.h"
 #include "bacdef.h"
@@ -54,125 +55,269 @@
 /* If we are only a server and only initiate broadcasts, */
 /* then we don't need a TSM layer. */
 
-/* FIXME: not coded for segmentation */
+/* Segments we receive or send in a reply are windowed by segment.c; */
+/* confirmed requests we originate are still never segmented. */
 
 /* declare space for the TSM transactions, and set it up in the init. */
 /* table rules: an Invoke ID = 0 is an unused spot in the table */
 static BACNET_TSM_DATA TSM_List[MAX_TSM_TRANSACTIONS];
 
-/* returns MAX_TSM_TRANSACTIONS if not found */
-static uint8_t tsm_find_invokeID_index(
+/* Invoke IDs only have to be unique per peer, so a transaction is keyed
+   by (peer, invoke ID) and every peer has its own 255 IDs. */
+typedef struct tsm_peer {
+    BACNET_ADDRESS address;
+    /* invoke IDs in use for this peer, one bit each */
+    uint32_t used[256 / 32];
+    /* transactions holding a spot in TSM_List */
+    uint16_t count;
+    /* where the search for the next invoke ID starts */
+    uint8_t next_invokeID;
+    /* next peer in the same hash bucket, plus one */
+    uint16_t hash_next;
+} TSM_PEER;
+
+/* a peer only exists while it has a transaction */
+static TSM_PEER TSM_Peer[MAX_TSM_TRANSACTIONS];
+/* both hash tables are sized to the power of two above the table */
+#define TSM_HASH_SIZE \
+    ((MAX_TSM_TRANSACTIONS > 1024) ? 4096 : \
+     (MAX_TSM_TRANSACTIONS > 256) ? 1024 : 256)
+/* peer index plus one for each bucket, 0 if empty */
+static uint16_t TSM_Peer_Hash[TSM_HASH_SIZE];
+/* TSM_List index plus one for each bucket, 0 if empty */
+static uint16_t TSM_Transaction_Hash[TSM_HASH_SIZE];
+/* per TSM_List spot: its peer, and the next spot in its bucket plus one */
+static uint16_t TSM_Transaction_Peer[MAX_TSM_TRANSACTIONS];
+static uint16_t TSM_Transaction_Next[MAX_TSM_TRANSACTIONS];
+/* TSM_List spots and peers that were used and freed again */
+static uint16_t TSM_Free_Slot[MAX_TSM_TRANSACTIONS];
+static unsigned TSM_Free_Slot_Count = 0;
+static uint16_t TSM_Free_Peer[MAX_TSM_TRANSACTIONS];
+static unsigned TSM_Free_Peer_Count = 0;
+/* spots and peers from here up have never been used */
+static unsigned TSM_Slot_High = 0;
+static unsigned TSM_Peer_High = 0;
+/* most transactions one peer may have outstanding */
+static uint8_t TSM_Peer_Window = MAX_TSM_PEER_TRANSACTIONS;
+
+static unsigned tsm_transaction_bucket(
+    uint16_t peer,
     uint8_t invokeID)
 {
-    unsigned i = 0;     /* counter */
-    uint8_t index = MAX_TSM_TRANSACTIONS;       /* return value */
+    return ((peer * 2654435761u) ^ invokeID) & (TSM_HASH_SIZE - 1);
+}
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == invokeID) {
-            index = i;
-            break;
-        }
+/* returns MAX_TSM_TRANSACTIONS if the peer has no transactions */
+static uint16_t tsm_find_peer(
+    BACNET_ADDRESS * address)
+{
+    uint16_t entry = 0;
+
+    if (address == NULL)
+        return MAX_TSM_TRANSACTIONS;
+    entry =
+        TSM_Peer_Hash[bacnet_address_hash(address) & (TSM_HASH_SIZE - 1)];
+    while (entry) {
+        if (bacnet_address_same(&TSM_Peer[entry - 1].address, address))
+            return entry - 1;
+        entry = TSM_Peer[entry - 1].hash_next;
     }
 
-    return index;
+    return MAX_TSM_TRANSACTIONS;
 }
 
-static uint8_t tsm_find_first_free_index(
-    void)
+static uint16_t tsm_add_peer(
+    BACNET_ADDRESS * address)
 {
-    unsigned i = 0;     /* counter */
-    uint8_t index = MAX_TSM_TRANSACTIONS;       /* return value */
+    uint16_t peer = 0;
+    unsigned bucket = 0;
+
+    if (TSM_Free_Peer_Count)
+        peer = TSM_Free_Peer[--TSM_Free_Peer_Count];
+    else
+        peer = TSM_Peer_High++;
+    memset(&TSM_Peer[peer], 0, sizeof(TSM_PEER));
+    bacnet_address_copy(&TSM_Peer[peer].address, address);
+    TSM_Peer[peer].next_invokeID = 1;
+    bucket = bacnet_address_hash(address) & (TSM_HASH_SIZE - 1);
+    TSM_Peer[peer].hash_next = TSM_Peer_Hash[bucket];
+    TSM_Peer_Hash[bucket] = peer + 1;
+
+    return peer;
+}
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == 0) {
-            index = i;
-            break;
-        }
+static void tsm_remove_peer(
+    uint16_t peer)
+{
+    uint16_t *link = NULL;
+
+    link =
+        &TSM_Peer_Hash[bacnet_address_hash(&TSM_Peer[peer].address) &
+        (TSM_HASH_SIZE - 1)];
+    while (*link && (*link != peer + 1))
+        link = &TSM_Peer[*link - 1].hash_next;
+    if (*link)
+        *link = TSM_Peer[peer].hash_next;
+    TSM_Free_Peer[TSM_Free_Peer_Count++] = peer;
+}
+
+/* returns MAX_TSM_TRANSACTIONS if not found */
+static uint16_t tsm_find_invokeID_index(
+    BACNET_ADDRESS * address,
+    uint8_t invokeID)
+{
+    uint16_t peer = 0;
+    uint16_t entry = 0;
+
+    if (invokeID == 0)
+        return MAX_TSM_TRANSACTIONS;
+    peer = tsm_find_peer(address);
+    if (peer == MAX_TSM_TRANSACTIONS)
+        return MAX_TSM_TRANSACTIONS;
+    entry = TSM_Transaction_Hash[tsm_transaction_bucket(peer, invokeID)];
+    while (entry) {
+        if ((TSM_List[entry - 1].InvokeID == invokeID) &&
+            (TSM_Transaction_Peer[entry - 1] == peer))
+            return entry - 1;
+        entry = TSM_Transaction_Next[entry - 1];
     }
 
-    return index;
+    return MAX_TSM_TRANSACTIONS;
 }
 
-bool tsm_transaction_available(
-    void)
+/* index of the lowest bit set; bits must not be zero */
+static unsigned tsm_lowest_bit(
+    uint32_t bits)
 {
-    bool status = false;        /* return value */
-    unsigned i = 0;     /* counter */
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctz(bits);
+#else
+    unsigned bit = 0;
+
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == 0) {
-            /* one is available! */
-            status = true;
-            break;
-        }
+/* next unused invoke ID for the peer at or after next_invokeID,
+   wrapping around; returns 0 if all 255 are in use */
+static uint8_t tsm_peer_free_invokeID(
+    TSM_PEER * peer)
+{
+    unsigned word = peer->next_invokeID / 32;
+    uint32_t free_bits = 0;
+    unsigned n = 0;
+
+    /* the partial first word, then all eight words again */
+    free_bits = ~peer->used[word] & (~0u << (peer->next_invokeID % 32));
+    for (n = 0; n <= 8; n++) {
+        /* skip zero - we treat that internally as invalid or no free */
+        if (word == 0)
+            free_bits &= ~1u;
+        if (free_bits)
+            return (uint8_t) (word * 32 + tsm_lowest_bit(free_bits));
+        word = (word + 1) % 8;
+        free_bits = ~peer->used[word];
     }
 
-    return status;
+    return 0;
 }
 
-uint8_t tsm_transaction_idle_count(
+bool tsm_transaction_available(
     void)
 {
-    uint8_t count = 0;  /* return value */
-    unsigned i = 0;     /* counter */
+    return (TSM_Free_Slot_Count || (TSM_Slot_High < MAX_TSM_TRANSACTIONS));
+}
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if ((TSM_List[i].InvokeID == 0) &&
-            (TSM_List[i].state == TSM_STATE_IDLE)) {
-            /* one is available! */
-            count++;
-        }
-    }
+uint16_t tsm_transaction_idle_count(
+    void)
+{
+    /* every spot without an invoke ID is idle */
+    return TSM_Free_Slot_Count + (MAX_TSM_TRANSACTIONS - TSM_Slot_High);
+}
 
-    return count;
+void tsm_peer_window_set(
+    uint8_t window)
+{
+    if (window)
+        TSM_Peer_Window = window;
 }
 
-/* gets the next free invokeID,
+uint8_t tsm_peer_window(
+    void)
+{
+    return TSM_Peer_Window;
+}
+
+/* gets the next free invokeID for the peer,
    and reserves a spot in the table
    returns 0 if none are available */
 uint8_t tsm_next_free_invokeID(
-    void)
+    BACNET_ADDRESS * dest)
 {
-    static uint8_t current_invokeID = 1;        /* incremented... */
-    uint8_t index = 0;
+    uint16_t index = 0;
+    uint16_t peer = 0;
     uint8_t invokeID = 0;
-    bool found = false;
+    unsigned bucket = 0;
 
     /* is there even space available? */
-    if (tsm_transaction_available()) {
-        while (!found) {
-            index = tsm_find_invokeID_index(current_invokeID);
-            if (index == MAX_TSM_TRANSACTIONS) {
-                /* Not found, so this invokeID is not used */
-                found = true;
-                /* set this id into the table */
-                index = tsm_find_first_free_index();
-                if (index != MAX_TSM_TRANSACTIONS) {
-                    TSM_List[index].InvokeID = invokeID = current_invokeID;
-                    TSM_List[index].state = TSM_STATE_IDLE;
-                    TSM_List[index].RequestTimer = apdu_timeout();
-                    /* update for the next call or check */
-                    current_invokeID++;
-                    /* skip zero - we treat that internally as invalid or no free */
-                    if (current_invokeID == 0) {
-                        current_invokeID = 1;
-                    }
-                }
-            } else {
-                /* found! This invokeID is already used */
-                /* try next one */
-                current_invokeID++;
-                /* skip zero - we treat that internally as invalid or no free */
-                if (current_invokeID == 0) {
-                    current_invokeID = 1;
-                }
-            }
-        }
-    }
+    if ((dest == NULL) || !tsm_transaction_available())
+        return 0;
+    peer = tsm_find_peer(dest);
+    if (peer == MAX_TSM_TRANSACTIONS)
+        peer = tsm_add_peer(dest);
+    else if (TSM_Peer[peer].count >= TSM_Peer_Window)
+        return 0;
+    invokeID = tsm_peer_free_invokeID(&TSM_Peer[peer]);
+    if (invokeID == 0)
+        return 0;
+    TSM_Peer[peer].used[invokeID / 32] |= (1u << (invokeID % 32));
+    TSM_Peer[peer].count++;
+    /* update for the next call */
+    TSM_Peer[peer].next_invokeID = invokeID + 1;
+    if (TSM_Free_Slot_Count)
+        index = TSM_Free_Slot[--TSM_Free_Slot_Count];
+    else
+        index = TSM_Slot_High++;
+    /* set this id into the table */
+    TSM_List[index].InvokeID = invokeID;
+    TSM_List[index].state = TSM_STATE_IDLE;
+    bacnet_address_copy(&TSM_List[index].dest, dest);
+    TSM_Transaction_Peer[index] = peer;
+    bucket = tsm_transaction_bucket(peer, invokeID);
+    TSM_Transaction_Next[index] = TSM_Transaction_Hash[bucket];
+    TSM_Transaction_Hash[bucket] = index + 1;
 
     return invokeID;
 }
 
+/* RequestTimer expired: retry, or mark the transaction failed */
+static void tsm_request_timeout(
+    BACNET_TIMER * timer)
+{
+    BACNET_TSM_DATA *data;
+
+    data = (BACNET_TSM_DATA *) ((uint8_t *) timer -
+        offsetof(BACNET_TSM_DATA, RequestTimer));
+    if (data->state != TSM_STATE_AWAIT_CONFIRMATION)
+        return;
+    data->RetryCount--;
+    if (data->RetryCount) {
+        timer_wheel_start(&data->RequestTimer, apdu_timeout(),
+            tsm_request_timeout);
+        datalink_send_pdu(&data->dest, &data->npdu_data, &data->apdu[0],
+            data->apdu_len);
+    } else {
+        /* note: the invoke id has not been cleared yet
+           and this indicates a failed message:
+           IDLE and a valid invoke id */
+        data->state = TSM_STATE_IDLE;
+    }
+}
+
 void tsm_set_confirmed_unsegmented_transaction(
     uint8_t invokeID,
     BACNET_ADDRESS * dest,
@@ -180,24 +325,23 @@ void tsm_set_confirmed_unsegmented_transaction(
     uint8_t * apdu,
     uint16_t apdu_len)
 {
-    uint16_t j = 0;
-    uint8_t index;
+    uint16_t index;
 
     if (invokeID) {
-        index = tsm_find_invokeID_index(invokeID);
+        index = tsm_find_invokeID_index(dest, invokeID);
         if (index < MAX_TSM_TRANSACTIONS) {
             /* assign the transaction */
             TSM_List[index].state = TSM_STATE_AWAIT_CONFIRMATION;
             TSM_List[index].RetryCount = apdu_retries();
             /* start the timer */
-            TSM_List[index].RequestTimer = apdu_timeout();
+            timer_wheel_start(&TSM_List[index].RequestTimer, apdu_timeout(),
+                tsm_request_timeout);
             /* copy the data */
-            for (j = 0; j < apdu_len; j++) {
-                TSM_List[index].apdu[j] = apdu[j];
-            }
+            if (apdu_len > MAX_PDU)
+                apdu_len = MAX_PDU;
+            memcpy(&TSM_List[index].apdu[0], apdu, apdu_len);
             TSM_List[index].apdu_len = apdu_len;
             npdu_copy_data(&TSM_List[index].npdu_data, ndpu_data);
-            bacnet_address_copy(&TSM_List[index].dest, dest);
         }
     }
 
@@ -213,23 +357,17 @@ bool tsm_get_transaction_pdu(
     uint8_t * apdu,
     uint16_t * apdu_len)
 {
-    uint16_t j = 0;
-    uint8_t index;
+    uint16_t index;
     bool found = false;
 
     if (invokeID) {
-        index = tsm_find_invokeID_index(invokeID);
-        /* how much checking is needed?  state?  dest match? just invokeID? */
+        index = tsm_find_invokeID_index(dest, invokeID);
         if (index < MAX_TSM_TRANSACTIONS) {
             /* FIXME: we may want to free the transaction so it doesn't timeout */
             /* retrieve the transaction */
-            /* FIXME: bounds check the pdu_len? */
             *apdu_len = TSM_List[index].apdu_len;
-            for (j = 0; j < *apdu_len; j++) {
-                apdu[j] = TSM_List[index].apdu[j];
-            }
+            memcpy(apdu, &TSM_List[index].apdu[0], *apdu_len);
             npdu_copy_data(ndpu_data, &TSM_List[index].npdu_data);
-            bacnet_address_copy(dest, &TSM_List[index].dest);
             found = true;
         }
     }
@@ -237,58 +375,49 @@ bool tsm_get_transaction_pdu(
     return found;
 }
 
-/* called once a millisecond or slower */
+/* called once a millisecond or slower; only the transactions
+   whose RequestTimer expires are visited */
 void tsm_timer_milliseconds(
     uint16_t milliseconds)
 {
-    unsigned i = 0;     /* counter */
-
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].state == TSM_STATE_AWAIT_CONFIRMATION) {
-            if (TSM_List[i].RequestTimer > milliseconds)
-                TSM_List[i].RequestTimer -= milliseconds;
-            else
-                TSM_List[i].RequestTimer = 0;
-            /* timeout.  retry? */
-            if (TSM_List[i].RequestTimer == 0) {
-                TSM_List[i].RetryCount--;
-                TSM_List[i].RequestTimer = apdu_timeout();
-                if (TSM_List[i].RetryCount) {
-                    datalink_send_pdu(&TSM_List[i].dest,
-                        &TSM_List[i].npdu_data, &TSM_List[i].apdu[0],
-                        TSM_List[i].apdu_len);
-                } else {
-                    /* note: the invoke id has not been cleared yet
-                       and this indicates a failed message:
-                       IDLE and a valid invoke id */
-                    TSM_List[i].state = TSM_STATE_IDLE;
-                }
-            }
-        }
-    }
+    timer_wheel_milliseconds(milliseconds);
 }
 
 /* frees the invokeID and sets its state to IDLE */
 void tsm_free_invoke_id(
+    BACNET_ADDRESS * src,
     uint8_t invokeID)
 {
-    uint8_t index;
+    uint16_t index;
+    uint16_t peer;
+    uint16_t *link;
 
-    index = tsm_find_invokeID_index(invokeID);
+    index = tsm_find_invokeID_index(src, invokeID);
     if (index < MAX_TSM_TRANSACTIONS) {
+        peer = TSM_Transaction_Peer[index];
+        link = &TSM_Transaction_Hash[tsm_transaction_bucket(peer, invokeID)];
+        while (*link != index + 1)
+            link = &TSM_Transaction_Next[*link - 1];
+        *link = TSM_Transaction_Next[index];
+        timer_wheel_stop(&TSM_List[index].RequestTimer);
         TSM_List[index].state = TSM_STATE_IDLE;
         TSM_List[index].InvokeID = 0;
+        TSM_Free_Slot[TSM_Free_Slot_Count++] = index;
+        TSM_Peer[peer].used[invokeID / 32] &= ~(1u << (invokeID % 32));
+        if (--TSM_Peer[peer].count == 0)
+            tsm_remove_peer(peer);
     }
 }
 
 /* check if the invoke ID has been made free */
 bool tsm_invoke_id_free(
+    BACNET_ADDRESS * dest,
     uint8_t invokeID)
 {
     bool status = true;
-    uint8_t index;
+    uint16_t index;
 
-    index = tsm_find_invokeID_index(invokeID);
+    index = tsm_find_invokeID_index(dest, invokeID);
     if (index < MAX_TSM_TRANSACTIONS)
         status = false;
 
@@ -297,12 +426,13 @@ bool tsm_invoke_id_free(
 
 /* see if the invoke ID has failed get a confirmation */
 bool tsm_invoke_id_failed(
+    BACNET_ADDRESS * dest,
     uint8_t invokeID)
 {
     bool status = false;
-    uint8_t index;
+    uint16_t index;
 
-    index = tsm_find_invokeID_index(invokeID);
+    index = tsm_find_invokeID_index(dest, invokeID);
     if (index < MAX_TSM_TRANSACTIONS) {
         /* a valid invoke ID and the state is IDLE is a
            message that failed to confirm */
@@ -347,8 +477,93 @@ void datalink_get_broadcast_address(
 void testTSM(
     Test * pTest)
 {
-    /* FIXME: add some unit testing... */
-    return;
+    static uint8_t ids[MAX_TSM_TRANSACTIONS];
+    static bool used[256];
+    uint8_t apdu[MAX_PDU] = { 1, 2, 3 };
+    uint8_t test_apdu[MAX_PDU] = { 0 };
+    uint16_t test_apdu_len = 0;
+    BACNET_ADDRESS peer_a = { 0 };
+    BACNET_ADDRESS peer_b = { 0 };
+    BACNET_NPDU_DATA npdu_data = { 0 };
+    BACNET_NPDU_DATA test_npdu_data = { 0 };
+    unsigned window = MAX_TSM_TRANSACTIONS / 2;
+    unsigned i = 0;
+    uint8_t invokeID = 0;
+
+    if (window > 100)
+        window = 100;
+    if (window == 0)
+        window = 1;
+    peer_a.mac_len = 6;
+    peer_a.mac[0] = 192;
+    peer_b.mac_len = 6;
+    peer_b.mac[0] = 10;
+    tsm_peer_window_set(window);
+    ct_test(pTest, tsm_peer_window() == window);
+    ct_test(pTest, tsm_transaction_available());
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    ct_test(pTest, tsm_next_free_invokeID(NULL) == 0);
+    /* each peer has its own invoke IDs, up to its window */
+    for (i = 0; i < window; i++) {
+        ids[i] = tsm_next_free_invokeID(&peer_a);
+        ct_test(pTest, ids[i] != 0);
+        ct_test(pTest, !used[ids[i]]);
+        used[ids[i]] = true;
+        ct_test(pTest, !tsm_invoke_id_free(&peer_a, ids[i]));
+        ct_test(pTest, tsm_invoke_id_free(&peer_b, ids[i]));
+    }
+    ct_test(pTest, tsm_next_free_invokeID(&peer_a) == 0);
+    invokeID = tsm_next_free_invokeID(&peer_b);
+    if (window < MAX_TSM_TRANSACTIONS) {
+        ct_test(pTest, invokeID == ids[0]);
+    }
+    ct_test(pTest, tsm_transaction_idle_count() ==
+        MAX_TSM_TRANSACTIONS - window - (invokeID ? 1 : 0));
+    /* the transaction is found by peer and invoke ID */
+    tsm_set_confirmed_unsegmented_transaction(ids[0], &peer_a, &npdu_data,
+        &apdu[0], 3);
+    ct_test(pTest, tsm_get_transaction_pdu(ids[0], &peer_a,
+            &test_npdu_data, &test_apdu[0], &test_apdu_len));
+    ct_test(pTest, test_apdu_len == 3);
+    ct_test(pTest, test_apdu[2] == 3);
+    test_apdu_len = 0;
+    ct_test(pTest, !tsm_get_transaction_pdu(ids[0], &peer_b,
+            &test_npdu_data, &test_apdu[0], &test_apdu_len) ||
+        test_apdu_len == 0);
+    /* freeing one peer's ID leaves the other's alone */
+    if (invokeID) {
+        tsm_free_invoke_id(&peer_b, invokeID);
+        ct_test(pTest, tsm_invoke_id_free(&peer_b, invokeID));
+        ct_test(pTest, !tsm_invoke_id_free(&peer_a, invokeID));
+    }
+    /* it fails once every retry has timed out */
+    ct_test(pTest, !tsm_invoke_id_failed(&peer_a, ids[0]));
+    for (i = 0; i < apdu_retries(); i++) {
+        tsm_timer_milliseconds(apdu_timeout());
+    }
+    ct_test(pTest, tsm_invoke_id_failed(&peer_a, ids[0]));
+    /* a freed ID is not handed out again straight away */
+    tsm_free_invoke_id(&peer_a, ids[0]);
+    ct_test(pTest, tsm_invoke_id_free(&peer_a, ids[0]));
+    invokeID = tsm_next_free_invokeID(&peer_a);
+    ct_test(pTest, invokeID != 0);
+    if (window < 254) {
+        ct_test(pTest, invokeID != ids[0]);
+    }
+    tsm_free_invoke_id(&peer_a, invokeID);
+    /* the table can be emptied and filled again */
+    for (i = 1; i < window; i++) {
+        tsm_free_invoke_id(&peer_a, ids[i]);
+    }
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    tsm_peer_window_set(MAX_TSM_PEER_TRANSACTIONS);
+    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
+        /* more peers than one window holds */
+        peer_b.mac[5] = (uint8_t) (i / MAX_TSM_PEER_TRANSACTIONS);
+        ct_test(pTest, tsm_next_free_invokeID(&peer_b) != 0);
+    }
+    ct_test(pTest, !tsm_transaction_available());
+    ct_test(pTest, tsm_next_free_invokeID(&peer_a) == 0);
 }
 
 #ifdef TEST_TSM
@@ -28,8 +28,15 @@
  * TWCi XML Data Feed License Agreement.
  *
  */
+#include <stdlib.h>
+#include <sys/select.h>
+#include <strings.h>
 #include "xoapweather.h"
 
+/* a stalled server gives up a transfer instead of holding the caller */
+#define XOAP_WEATHER_CONNECT_TIMEOUT 15L	// seconds to connect
+#define XOAP_WEATHER_TRANSFER_TIMEOUT 120L	// seconds for the whole transfer
+
 /**
  * Static function declarations
  * Needed for internal use only
@@ -46,13 +53,27 @@ static void xoap_weather_parse_wind(xmlNode *cur_node, xoap_weather_wind *wind);
 static void xoap_weather_parse_day(xmlNode *cur_node, xoap_weather_day *day);
 static void xoap_weather_parse_part(xmlNode *cur_node, xoap_weather_weather *weather);
 static void xoap_weather_free_weather(xoap_weather_weather *w);
-static size_t xoap_weather_memory_callback(void *ptr, size_t size, size_t nmemb, void *data);
+static int  xoap_weather_error_report(int type);
+static void xoap_weather_stream_start(void *ctx, const xmlChar *name, const xmlChar **atts);
+static void xoap_weather_stream_end(void *ctx, const xmlChar *name);
+static void xoap_weather_stream_characters(void *ctx, const xmlChar *ch, int len);
+static xoap_weather_rain *xoap_weather_rain_new(void);
+static void xoap_weather_stream_abandon(xoap_weather_stream *stream);
 
 /** variables */
 char *partnerID;
 char *licenseKey;
 CURL *curlHandle;
 
+/* Bounds how long any one transfer on a handle can take */
+static void
+xoap_weather_curl_timeouts(CURL *curl) {
+	/* timeouts must not use signals, the caller may have other threads */
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, XOAP_WEATHER_CONNECT_TIMEOUT);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, XOAP_WEATHER_TRANSFER_TIMEOUT);
+}
+
 
 xoap_weather_handle *
 xoap_weather_init(const char *ptID, const char *lkey) {
@@ -61,17 +82,38 @@ xoap_weather_init(const char *ptID, const char *lkey) {
 		return NULL;
 	}
 
+	/* may be called again to change the keys */
+	XOAPW_FREE(partnerID);
+	XOAPW_FREE(licenseKey);
 	partnerID = strdup(ptID);
 	licenseKey = strdup(lkey);
 	/* initialize a curl easy handle */
-	curlHandle = curl_easy_init();
+	if (curlHandle == NULL) {
+		curlHandle = curl_easy_init();
+		if (curlHandle)
+			xoap_weather_curl_timeouts(curlHandle);
+	}
 
+	return xoap_weather_handle_new();
+}
+
+xoap_weather_handle *
+xoap_weather_handle_new(void) {
 	xoap_weather_handle *h = malloc(sizeof(xoap_weather_handle));
 	h->locid = NULL;
 	h->unit = 's'; // Make STANDARD the default unit
+	h->fetch = XOAP_WEATHER_FETCH_DAYF1;
 	return h;
 }
 
+void
+xoap_weather_handle_free(xoap_weather_handle *h) {
+	if (h == NULL)
+		return;
+	XOAPW_FREE(h->locid);
+	free(h);
+}
+
 int
 xoap_weather_setopt(xoap_weather_handle *hand, xoap_weather_opt opt, ...) {
 	if (hand == NULL) {
@@ -83,6 +125,7 @@ xoap_weather_setopt(xoap_weather_handle *hand, xoap_weather_opt opt, ...) {
 	va_start(ap, opt);
 	switch (opt) {
 		case XOAP_WEATHER_OPT_ID:
+			XOAPW_FREE(hand->locid);
 			hand->locid = strdup(va_arg(ap, char*));
 			break;
 		case XOAP_WEATHER_OPT_UNIT:
@@ -101,6 +144,32 @@ xoap_weather_setopt(xoap_weather_handle *hand, xoap_weather_opt opt, ...) {
 	return 0;
 }
 
+/* Prints the TWCi error type; RETURN: 1 if the type is a known error */
+int
+xoap_weather_error_report(int type) {
+	switch (type) {
+		case XOAP_WEATHER_INVALID_LOCATION:
+			fprintf(stderr, "ERROR: Invalid location set in handle\n");
+			return 1;
+		case XOAP_WEATHER_UNKNOWN_ERROR:
+			fprintf(stderr, "ERROR: UNKNOWN ERROR\n");
+			return 1;
+		case XOAP_WEATHER_NO_LOCATION:
+			fprintf(stderr, "ERROR: No location set in handle\n");
+			return 1;
+		case XOAP_WEATHER_INVALID_PID:
+			fprintf(stderr, "ERROR: Invalid partner id\n");
+			return 1;
+		case XOAP_WEATHER_INVALID_PCODE:
+			fprintf(stderr, "ERROR: Invalid product code\n");
+			return 1;
+		case XOAP_WEATHER_INVALID_LKEY:
+			fprintf(stderr, "ERROR: Invalid license key\n");
+			return 1;
+	}
+	return 0;
+}
+
 int
 xoap_weather_error_check(xmlNode *root) {
 	if (strncmp((char *)root->name, "error", 5) == 0) {
@@ -108,33 +177,10 @@ xoap_weather_error_check(xmlNode *root) {
 		for (node = root->children; (node != NULL); node = node->next) {
 			if (node->type == XML_ELEMENT_NODE && strncmp((char *)node->name, "err", 3) == 0) {
 				xmlChar *prop = xmlGetProp(node, (const xmlChar *)"type");
-				switch ((int)atoi((char *)prop)) {
-					case XOAP_WEATHER_INVALID_LOCATION:
-						fprintf(stderr, "ERROR: Invalid location set in handle\n");
-						xmlFree(prop);
-						return 1;
-					case XOAP_WEATHER_UNKNOWN_ERROR:
-						fprintf(stderr, "ERROR: UNKNOWN ERROR\n");
-						xmlFree(prop);
-						return 1;
-					case XOAP_WEATHER_NO_LOCATION:
-						fprintf(stderr, "ERROR: No location set in handle\n");
-						xmlFree(prop);
-						return 1;
-					case XOAP_WEATHER_INVALID_PID:
-						fprintf(stderr, "ERROR: Invalid partner id\n");
-						xmlFree(prop);
-						return 1;
-					case XOAP_WEATHER_INVALID_PCODE:
-						fprintf(stderr, "ERROR: Invalid product code\n");
-						xmlFree(prop);
-						return 1;
-					case XOAP_WEATHER_INVALID_LKEY:
-						fprintf(stderr, "ERROR: Invalid license key\n");
-						xmlFree(prop);
-						return 1;
-				}
+				int known = xoap_weather_error_report((int)atoi((char *)prop));
 				xmlFree(prop);
+				if (known)
+					return 1;
 			}
 		}
 	}
@@ -228,183 +274,95 @@ xoap_weather_search(const char *loc) {
 	return wloc;
 }
 
-xoap_weather_rain *
-xoap_weather_rain(const xoap_weather_handle *hand) {
-	if (hand == NULL || hand->locid == NULL) {
-		fprintf(stderr, "ERROR: handle is NULL or handle option XOAP_WEATHER_OPT_ID not set");
-		return NULL;
-	}
-
-	/* build URL */
-	int urlSize = 180
-	char url[urlSize];
-	snprintf(url, urlSize, WU_SEARCH_URL"%s", loc);
+/* Builds the Weather Underground geo lookup URL for the handle */
+static void
+xoap_weather_rain_search_url(const xoap_weather_handle *hand, char *url, size_t urlSize) {
+	snprintf(url, urlSize, WU_SEARCH_URL"%s", hand->locid);
+}
 
-	struct xoap_weather_memory xml;
-	xml.memory = NULL;
-	xml.size = 0;    /* no data at this point */
+/* Builds the observation URL for the station found by the geo lookup */
+static int
+xoap_weather_rain_station_url(const xoap_weather_rain *wrain, char *url, size_t urlSize) {
+	if (wrain->station_id)
+		snprintf(url, urlSize, WU_WEATHER_STATION_URL"%s", wrain->station_id);
+	else if (wrain->airport_id)
+		snprintf(url, urlSize, WU_AIRPORT_URL"%s", wrain->airport_id);
+	else {
+		fprintf(stderr, "ERROR: no weather station found near location\n");
+		return 1;
+	}
+	return 0;
+}
 
+/* Runs one transfer on the global curl handle, parsing it as it arrives */
+static int
+xoap_weather_perform_stream(const char *url, xoap_weather_stream *stream) {
 	/* set options for curl handle */
 	curl_easy_setopt(curlHandle, CURLOPT_URL, url);
 	curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 1L);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)&xml);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, xoap_weather_memory_callback);
+	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)stream);
+	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, xoap_weather_stream_callback);
 
 	/* perform file transfer */
 	CURLcode result;
 	if ( (result = curl_easy_perform(curlHandle)) != 0 ) {
 		fprintf(stderr, "%s\n", curl_easy_strerror(result));
 		fprintf(stderr, "ERROR: file transfer failed\n");
-		return NULL;
-	}
-
-	/* create data structure */
-	xoap_weather_rain *wrain = malloc(sizeof(xoap_weather_rain));
-	wrain->airport_id = NULL;
-	wrain->station_id = NULL;
-	wrain->rain_last_day = 0;
-	wrain->rain_last_hr = 0;
-	wrain->is_raining = 0;
-
-	/* Open XML document */
-	xmlDocPtr doc;
-	doc = xmlReadMemory(xml.memory, xml.size, "xml", "UTF-8", 0);
-	if (doc == NULL) {
-		fprintf(stderr, "ERROR: failed to parse XML document: xoap_weather_search_location()\n");
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlCleanupParser();
-		return NULL;
-	}
-
-	/*Get the root element node */
-	xmlNode *root = NULL;
-	root = xmlDocGetRootElement(doc);
-	if (root == NULL) {
-		fprintf(stderr, "ERROR: failed to get root element from XML document\n");
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlFreeDoc(doc);
-		xmlCleanupParser();
-		return NULL;
+		xoap_weather_stream_finish(stream);
+		return 1;
 	}
+	return xoap_weather_stream_finish(stream);
+}
 
-	if (xoap_weather_error_check(root) != 0) {
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlFreeDoc(doc);
-		xmlCleanupParser();
+xoap_weather_rain *
+xoap_weather_fetch_rain(const xoap_weather_handle *hand) {
+	if (hand == NULL || hand->locid == NULL) {
+		fprintf(stderr, "ERROR: handle is NULL or handle option XOAP_WEATHER_OPT_ID not set\n");
 		return NULL;
 	}
-
-	/* parse xml data */
-	xmlNode *cur_node,c_node,cc_node,cc_node,ccc_node;
-	for(cur_node = root->children; cur_node != NULL; cur_node = cur_node->next) {
-		if ( cur_node->type == XML_ELEMENT_NODE &&
-				strcmp((char*)cur_node->name, "nearby_weather_stations") == 0 ) {
-			for (c_node = cur_node->children; c_node != NULL; c_node = c_node->next) {
-				/* first let's deal with the airports */
-				if ( c_node->type == XML_ELEMENT_NODE && strcmp(c_node->name, "airport") == 0){
-					cc_node = c_node->children; //get just the first station
-					if (cc_node->type == XML_ELEMENT_NODE && strcmp(cc_node->name, "station") == 0){
-						for (ccc_node = cc_node->children; ccc_node != NULL; ccc_node->next) {
-							if (ccc_node->type == XML_ELEMENT_NODE && strcmp(ccc_node->name, "icao") == 0){
-								wrain->airport_id = (char *)xmlNodeGetContent(ccc_node);
-							}
-						}
-					}
-				}
-				if (c_node->type == XML_ELEMENT_NODE && strcmp(c_node->name, "pws") == 0) {
-					cc_node = c_node->children; //get just the first station
-					if (cc_node->type == XML_ELEMENT_NODE && strcmp(cc_node->name, "station") == 0) {
-						for (ccc_node = cc_node->children; ccc_node != NULL; ccc_node->next) {
-							if (ccc_node->type == XML_ELEMENT_NODE && strcmp(ccc_node->name, "id") == 0){
-								wrain->station_id = (char *)xmlNodeGetContent(ccc_node);
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
-	XOAPW_FREE(xml.memory);
-
-	/* Now we need to do this again to get the rain data */
-	snprintf(url, urlSize, WU_WEATHER_STATION_URL"%s", wrain->station_id);
-
-	xml.memory = NULL;
-	xml.size = 0;    /* no data at this point */
-
-	/* set options for curl handle */
-	curl_easy_setopt(curlHandle, CURLOPT_URL, url);
-	curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 1L);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)&xml);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, xoap_weather_memory_callback);
-
-	/* perform file transfer */
-	CURLcode result;
-	if ( (result = curl_easy_perform(curlHandle)) != 0 ) {
-		fprintf(stderr, "%s\n", curl_easy_strerror(result));
-		fprintf(stderr, "ERROR: file transfer failed\n");
+	if ( !curlHandle ) {
+		fprintf(stderr, "ERROR: curl handle was NULL. Call xoap_weather_init() first\n");
 		return NULL;
 	}
 
-	/* Open XML document */
-	doc = xmlReadMemory(xml.memory, xml.size, "xml", "UTF-8", 0);
-	if (doc == NULL) {
-		fprintf(stderr, "ERROR: failed to parse XML document: xoap_weather_search_location()\n");
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlCleanupParser();
-		return NULL;
-	}
+	/* build URL */
+	int urlSize = 180;
+	char url[urlSize];
+	xoap_weather_rain_search_url(hand, url, urlSize);
 
-	/*Get the root element node */
-	*root = NULL;
-	root = xmlDocGetRootElement(doc);
-	if (root == NULL) {
-		fprintf(stderr, "ERROR: failed to get root element from XML document\n");
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlFreeDoc(doc);
-		xmlCleanupParser();
+	/* create data structure */
+	xoap_weather_rain *wrain = xoap_weather_rain_new();
+	if (xoap_weather_perform_stream(url,
+				xoap_weather_stream_new(XOAP_WEATHER_STREAM_RAIN_STATIONS, wrain)) != 0 ||
+			xoap_weather_rain_station_url(wrain, url, urlSize) != 0) {
+		xoap_weather_free_rain(wrain);
 		return NULL;
 	}
 
-	if (xoap_weather_error_check(root) != 0) {
-		XOAPW_FREE(xml.memory);
-		XOAPW_FREE(wrain);
-		xmlFreeDoc(doc);
-		xmlCleanupParser();
+	/* Now we need to do this again to get the rain data */
+	if (xoap_weather_perform_stream(url,
+				xoap_weather_stream_new(XOAP_WEATHER_STREAM_RAIN_OBS, wrain)) != 0) {
+		xoap_weather_free_rain(wrain);
 		return NULL;
 	}
 
-	for(cur_node = root->children; cur_node != NULL; cur_node = cur_node->next) {
-		if ( cur_node->type == XML_ELEMENT_NODE){
-			XOAPW_SEI(cur_node,"precip_1_hr_in",wrain->rain_last_hr);
-			XOAPW_SEI(cur_node,"precip_today_in",wrain->rain_last_day);
-		}
-
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
-	XOAPW_FREE(xml.memory);
-
 	return wrain;
 }
 
-xoap_weather_forecast *
-xoap_weather_fetch(const xoap_weather_handle *hand) {
-	if (hand == NULL || hand->locid == NULL) {
-		fprintf(stderr, "ERROR: handle is NULL or handle option XOAP_WEATHER_OPT_ID not set\n");
-		return NULL;
-	}
-
+xoap_weather_rain *
+xoap_weather_rain_new(void) {
+	xoap_weather_rain *wrain = malloc(sizeof(xoap_weather_rain));
+	wrain->airport_id = NULL;
+	wrain->station_id = NULL;
+	wrain->rain_last_day = 0;
+	wrain->rain_last_hr = 0;
+	wrain->is_raining = 0;
+	return wrain;
+}
 
-	/* build URL */
-	int urlSize = 180;
-	char url[urlSize];
+/* Builds the TWCi URL for the fetch type set in the handle */
+static int
+xoap_weather_forecast_url(const xoap_weather_handle *hand, char *url, size_t urlSize) {
 	switch (hand->fetch) {
 		case XOAP_WEATHER_FETCH_LOC:
 			snprintf(url, urlSize, 
@@ -431,84 +389,454 @@ xoap_weather_fetch(const xoap_weather_handle *hand) {
 		default:
 			/* Invalid XOAP_WEATHER_FETCH type given */
 			fprintf(stderr, "ERROR: invalid XOAP_WEATHER_FETCH was set to options handle\n");
-			return NULL;
-			break;
+			return 1;
 	}
+	return 0;
+}
 
-	struct xoap_weather_memory xml;
-	xml.memory=NULL; 
-	xml.size = 0;    /* no data at this point */
+xoap_weather_forecast *
+xoap_weather_fetch(const xoap_weather_handle *hand) {
+	if (hand == NULL || hand->locid == NULL) {
+		fprintf(stderr, "ERROR: handle is NULL or handle option XOAP_WEATHER_OPT_ID not set\n");
+		return NULL;
+	}
+	if ( !curlHandle ) {
+		fprintf(stderr, "ERROR: curl handle was NULL. Call xoap_weather_init() first\n");
+		return NULL;
+	}
 
-	/* set options for curl handle */
-	curl_easy_setopt(curlHandle, CURLOPT_URL, url);
-	curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 1L);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, (void *)&xml);
-	curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, xoap_weather_memory_callback);
-	/* perform file transfer */
-	CURLcode result;
-	if ( (result = curl_easy_perform(curlHandle)) != 0 ) {
-		fprintf(stderr, "%s\n", curl_easy_strerror(result));
+
+	/* build URL */
+	int urlSize = 180;
+	char url[urlSize];
+	if (xoap_weather_forecast_url(hand, url, urlSize) != 0)
+		return NULL;
+
+	/* parse straight into the forecast while the body arrives */
+	xoap_weather_forecast *fcast = xoap_weather_forecast_new(hand);
+	if (xoap_weather_perform_stream(url,
+				xoap_weather_stream_new(XOAP_WEATHER_STREAM_FORECAST, fcast)) != 0) {
+		xoap_weather_free_forecast(fcast);
 		return NULL;
 	}
+	return fcast;
+}
 
+xoap_weather_forecast *
+xoap_weather_forecast_new(const xoap_weather_handle *hand) {
 	/* create data structure */
-	xoap_weather_forecast *fcast = malloc(sizeof(xoap_weather_forecast));
+	xoap_weather_forecast *fcast = calloc(1, sizeof(xoap_weather_forecast));
 	fcast->cc = NULL;
 	fcast->days = NULL;
 	fcast->total_days = 0;
 
 	/* allocate space and initialize for cc and days (if needed) */
 	if (hand->fetch != XOAP_WEATHER_FETCH_LOC) {
-		fcast->cc = malloc(sizeof(xoap_weather_cc));
-		fcast->cc->swa = NULL;
-		fcast->cc->swal = NULL;
-		fcast->cc->lsup = NULL;
-		fcast->cc->obst = NULL;
-		fcast->cc->cond = NULL;
-		fcast->cc->bart = NULL;
-		fcast->cc->moon_name = NULL;
-		fcast->cc->uvid = NULL;
-		fcast->cc->wind.speed = NULL;
-		fcast->cc->wind.gust = NULL;
-		fcast->cc->wind.direction = NULL;
-	}
-
-	if (hand->fetch != XOAP_WEATHER_FETCH_LOC || hand->fetch != XOAP_WEATHER_FETCH_CC) {
-		fcast->days = malloc(sizeof(xoap_weather_day) * (hand->fetch - 1));
+		fcast->cc = calloc(1, sizeof(xoap_weather_cc));
+	}
+
+	if (hand->fetch != XOAP_WEATHER_FETCH_LOC && hand->fetch != XOAP_WEATHER_FETCH_CC) {
 		fcast->total_days = hand->fetch - 1;
-		xoap_weather_day *day;
-		int i;
-		for (i = 0; (i < fcast->total_days); i++) {
-			day = &fcast->days[i];
-			day->week_day = NULL;
-			day->date = NULL;
-			day->sun_rise = NULL;
-			day->sun_set = NULL;
-			day->day.cond = NULL;
-			day->day.cond_short = NULL;
-			day->day.wind.speed = NULL;
-			day->day.wind.gust = NULL;
-			day->day.wind.direction = NULL;
-			day->night.cond = NULL;
-			day->night.cond_short = NULL;
-			day->night.wind.speed = NULL;
-			day->night.wind.gust = NULL;
-			day->night.wind.direction = NULL;
-		}
+		fcast->days = calloc(fcast->total_days, sizeof(xoap_weather_day));
 	}
+	return fcast;
+}
+
+xoap_weather_forecast *
+xoap_weather_parse_memory(const xoap_weather_handle *hand, const struct xoap_weather_memory *xml) {
+	xoap_weather_forecast *fcast = xoap_weather_forecast_new(hand);
 
 	/* parse xml data */
-	if (xoap_weather_parse_forecast(&xml, fcast) != 0) {
-		XOAPW_FREE(fcast->cc);
-		XOAPW_FREE(fcast->days);
-		XOAPW_FREE(fcast);
+	if (xoap_weather_parse_forecast(xml, fcast) != 0) {
+		xoap_weather_free_forecast(fcast);
 		fcast = NULL;
 	}
-
-	XOAPW_FREE(xml.memory);
 	return fcast;
 }
 
+/** One URL remembered by a fetch context */
+typedef struct {
+	char *url;
+	xoap_weather_stream_type type;
+	CURL *curl;		// kept so its settings survive between refreshes
+	struct curl_slist *headers; // conditional request headers
+	char *etag;		// validators sent with the next request
+	char *last_modified;
+	char *new_etag;		// validators received with this response
+	char *new_last_modified;
+	void *result;		// last good parse, reused on 304 Not Modified
+	void *pending;		// result being parsed from this response
+	xoap_weather_stream *stream;
+	int used;		// requested during this fetch
+	int ok;			// this transfer succeeded
+	int not_modified;	// this transfer got 304 Not Modified
+} xoap_weather_entry;
+
+struct xoap_weather_context {
+	CURLM *multi;		// owns the connection and DNS caches
+	char *proxy;
+	xoap_weather_entry **entry;	// each one is passed to curl, so they never move
+	int total_entries;
+	volatile int stop;	// set from another thread by xoap_weather_context_stop()
+};
+
+xoap_weather_context *
+xoap_weather_context_new(void) {
+	xoap_weather_context *ctx = calloc(1, sizeof(xoap_weather_context));
+	if (ctx == NULL)
+		return NULL;
+	ctx->multi = curl_multi_init();
+	if (ctx->multi == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+void
+xoap_weather_context_proxy(xoap_weather_context *ctx, const char *proxy) {
+	int i;
+	if (ctx == NULL)
+		return;
+	XOAPW_FREE(ctx->proxy);
+	ctx->proxy = proxy ? strdup(proxy) : NULL;
+	for (i = 0; i < ctx->total_entries; i++)
+		curl_easy_setopt(ctx->entry[i]->curl, CURLOPT_PROXY, ctx->proxy);
+}
+
+static void
+xoap_weather_result_free(xoap_weather_stream_type type, void *result) {
+	if (type == XOAP_WEATHER_STREAM_FORECAST)
+		xoap_weather_free_forecast(result);
+	else
+		xoap_weather_free_rain(result);
+}
+
+static void
+xoap_weather_entry_free(xoap_weather_entry *e) {
+	if (e->curl)
+		curl_easy_cleanup(e->curl);
+	if (e->headers)
+		curl_slist_free_all(e->headers);
+	XOAPW_FREE(e->url);
+	XOAPW_FREE(e->etag);
+	XOAPW_FREE(e->last_modified);
+	XOAPW_FREE(e->new_etag);
+	XOAPW_FREE(e->new_last_modified);
+	xoap_weather_result_free(e->type, e->result);
+	xoap_weather_result_free(e->type, e->pending);
+	free(e);
+}
+
+void
+xoap_weather_context_stop(xoap_weather_context *ctx) {
+	if (ctx)
+		__sync_lock_test_and_set(&ctx->stop, 1);
+}
+
+void
+xoap_weather_context_free(xoap_weather_context *ctx) {
+	int i;
+	if (ctx == NULL)
+		return;
+	for (i = 0; i < ctx->total_entries; i++)
+		xoap_weather_entry_free(ctx->entry[i]);
+	XOAPW_FREE(ctx->entry);
+	XOAPW_FREE(ctx->proxy);
+	curl_multi_cleanup(ctx->multi);
+	free(ctx);
+}
+
+/* Keeps the ETag and Last-Modified headers of a response */
+static size_t
+xoap_weather_header_callback(char *buffer, size_t size, size_t nitems, void *data) {
+	size_t realsize = size * nitems;
+	xoap_weather_entry *e = data;
+	char **target = NULL;
+	size_t skip = 0;
+
+	if (realsize > 5 && strncasecmp(buffer, "ETag:", 5) == 0) {
+		target = &e->new_etag;
+		skip = 5;
+	} else if (realsize > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0) {
+		target = &e->new_last_modified;
+		skip = 14;
+	}
+	if (target) {
+		while (skip < realsize && (buffer[skip] == ' ' || buffer[skip] == '\t'))
+			skip++;
+		size_t len = realsize - skip;
+		while (len > 0 && (buffer[skip + len - 1] == '\r' || buffer[skip + len - 1] == '\n'))
+			len--;
+		XOAPW_FREE(*target);
+		*target = strndup(buffer + skip, len);
+	}
+	return realsize;
+}
+
+/* Finds the entry for url, adding it if this is the first request */
+static xoap_weather_entry *
+xoap_weather_entry_get(xoap_weather_context *ctx, const char *url, xoap_weather_stream_type type) {
+	int i;
+	for (i = 0; i < ctx->total_entries; i++) {
+		if (ctx->entry[i]->type == type && strcmp(ctx->entry[i]->url, url) == 0)
+			return ctx->entry[i];
+	}
+	xoap_weather_entry **grown = realloc(ctx->entry, (ctx->total_entries + 1) * sizeof(xoap_weather_entry *));
+	if (grown == NULL)
+		return NULL;
+	ctx->entry = grown;
+	xoap_weather_entry *e = calloc(1, sizeof(xoap_weather_entry));
+	if (e == NULL)
+		return NULL;
+	e->curl = curl_easy_init();
+	if (e->curl == NULL) {
+		free(e);
+		return NULL;
+	}
+	e->url = strdup(url);
+	e->type = type;
+	curl_easy_setopt(e->curl, CURLOPT_URL, e->url);
+	curl_easy_setopt(e->curl, CURLOPT_NOPROGRESS, 1L);
+	curl_easy_setopt(e->curl, CURLOPT_WRITEFUNCTION, xoap_weather_stream_callback);
+	curl_easy_setopt(e->curl, CURLOPT_HEADERFUNCTION, xoap_weather_header_callback);
+	curl_easy_setopt(e->curl, CURLOPT_PROXY, ctx->proxy);
+	xoap_weather_curl_timeouts(e->curl);
+	ctx->entry[ctx->total_entries++] = e;
+	return e;
+}
+
+/* Starts the transfer for an entry, parsing into pending */
+static int
+xoap_weather_entry_start(xoap_weather_context *ctx, xoap_weather_entry *e, void *pending) {
+	char header[256];
+
+	e->used = 1;
+	e->ok = 0;
+	e->not_modified = 0;
+	e->stream = xoap_weather_stream_new(e->type, pending);
+	if (e->stream == NULL) {
+		xoap_weather_result_free(e->type, pending);
+		return 1;
+	}
+	e->pending = pending;
+	XOAPW_FREE(e->new_etag);
+	XOAPW_FREE(e->new_last_modified);
+	e->new_etag = NULL;
+	e->new_last_modified = NULL;
+	if (e->headers)
+		curl_slist_free_all(e->headers);
+	e->headers = NULL;
+	/* only ask for a 304 when we still have something to reuse */
+	if (e->result && e->etag) {
+		snprintf(header, sizeof(header), "If-None-Match: %s", e->etag);
+		e->headers = curl_slist_append(e->headers, header);
+	}
+	if (e->result && e->last_modified) {
+		snprintf(header, sizeof(header), "If-Modified-Since: %s", e->last_modified);
+		e->headers = curl_slist_append(e->headers, header);
+	}
+	curl_easy_setopt(e->curl, CURLOPT_HTTPHEADER, e->headers);
+	curl_easy_setopt(e->curl, CURLOPT_WRITEDATA, (void *)e->stream);
+	curl_easy_setopt(e->curl, CURLOPT_HEADERDATA, (void *)e);
+	curl_multi_add_handle(ctx->multi, e->curl);
+	return 0;
+}
+
+/* Runs every transfer added to the multi handle until all are done, or
+ * until the context is stopped; unfinished transfers then count as failed */
+static void
+xoap_weather_multi_perform(xoap_weather_context *ctx) {
+	CURLM *multi = ctx->multi;
+	int running = 0;
+	curl_multi_perform(multi, &running);
+	while (running && !ctx->stop) {
+		fd_set fdread, fdwrite, fdexcep;
+		int maxfd = -1;
+		long timeout_ms = -1;
+		struct timeval timeout;
+
+		FD_ZERO(&fdread);
+		FD_ZERO(&fdwrite);
+		FD_ZERO(&fdexcep);
+		curl_multi_timeout(multi, &timeout_ms);
+		if (timeout_ms < 0 || timeout_ms > 1000)
+			timeout_ms = 1000;
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_usec = (timeout_ms % 1000) * 1000;
+		curl_multi_fdset(multi, &fdread, &fdwrite, &fdexcep, &maxfd);
+		if (maxfd >= 0)
+			select(maxfd + 1, &fdread, &fdwrite, &fdexcep, &timeout);
+		else if (timeout_ms > 0)
+			select(0, NULL, NULL, NULL, &timeout);
+		curl_multi_perform(multi, &running);
+	}
+}
+
+/* Finishes every started transfer: a 200 that parsed replaces the
+ * result, a 304 keeps the result we had, anything else fails */
+static void
+xoap_weather_multi_results(xoap_weather_context *ctx) {
+	CURLMsg *msg;
+	int left, i;
+	long code;
+
+	while ((msg = curl_multi_info_read(ctx->multi, &left)) != NULL) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+		for (i = 0; i < ctx->total_entries; i++) {
+			if (ctx->entry[i]->curl == msg->easy_handle && ctx->entry[i]->stream)
+				break;
+		}
+		if (i == ctx->total_entries)
+			continue;
+		xoap_weather_entry *e = ctx->entry[i];
+		if (msg->data.result != CURLE_OK) {
+			fprintf(stderr, "%s\n", curl_easy_strerror(msg->data.result));
+			continue;
+		}
+		code = 0;
+		curl_easy_getinfo(e->curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code == 304 && e->result) {
+			e->not_modified = 1;
+			e->ok = 1;
+		} else if (code == 200) {
+			e->ok = 1;
+		} else
+			fprintf(stderr, "ERROR: %s returned HTTP %ld\n", e->url, code);
+	}
+	for (i = 0; i < ctx->total_entries; i++) {
+		xoap_weather_entry *e = ctx->entry[i];
+		if (e->stream == NULL)
+			continue;
+		curl_multi_remove_handle(ctx->multi, e->curl);
+		/* a 304 has no body, so there is no document to finish */
+		if (!e->ok || e->not_modified)
+			xoap_weather_stream_abandon(e->stream);
+		else if (xoap_weather_stream_finish(e->stream) != 0)
+			e->ok = 0;
+		e->stream = NULL;
+		if (e->ok && !e->not_modified) {
+			xoap_weather_result_free(e->type, e->result);
+			e->result = e->pending;
+			XOAPW_FREE(e->etag);
+			XOAPW_FREE(e->last_modified);
+			e->etag = e->new_etag;
+			e->last_modified = e->new_last_modified;
+			e->new_etag = NULL;
+			e->new_last_modified = NULL;
+		} else
+			xoap_weather_result_free(e->type, e->pending);
+		e->pending = NULL;
+	}
+}
+
+/* Forgets the URLs that were not requested by the last fetch */
+static void
+xoap_weather_context_prune(xoap_weather_context *ctx) {
+	int i, kept = 0;
+	for (i = 0; i < ctx->total_entries; i++) {
+		if (ctx->entry[i]->used) {
+			ctx->entry[i]->used = 0;
+			ctx->entry[kept++] = ctx->entry[i];
+		} else
+			xoap_weather_entry_free(ctx->entry[i]);
+	}
+	ctx->total_entries = kept;
+}
+
+int
+xoap_weather_fetch_multi(xoap_weather_context *ctx, xoap_weather_request *req, int count) {
+	if (ctx == NULL || req == NULL || count <= 0)
+		return count == 0 ? 0 : -1;
+	if (ctx->stop)
+		return -1;
+
+	int urlSize = 180;
+	char url[urlSize];
+	int i, failed = 0;
+	/* the entries each request is waiting on */
+	xoap_weather_entry **forecast = calloc(count, sizeof(xoap_weather_entry *));
+	xoap_weather_entry **rain = calloc(count, sizeof(xoap_weather_entry *));
+	if (forecast == NULL || rain == NULL) {
+		XOAPW_FREE(forecast);
+		XOAPW_FREE(rain);
+		return -1;
+	}
+
+	/* first round: every forecast and every station lookup at once */
+	for (i = 0; i < count; i++) {
+		xoap_weather_entry *e;
+		req[i].forecast = NULL;
+		req[i].rain = NULL;
+		req[i].not_modified = 0;
+		if (req[i].hand == NULL || req[i].hand->locid == NULL)
+			continue;
+		if (xoap_weather_forecast_url(req[i].hand, url, urlSize) == 0 &&
+				(e = xoap_weather_entry_get(ctx, url, XOAP_WEATHER_STREAM_FORECAST)) != NULL) {
+			forecast[i] = e;
+			if (!e->used)
+				xoap_weather_entry_start(ctx, e, xoap_weather_forecast_new(req[i].hand));
+		}
+		xoap_weather_rain_search_url(req[i].hand, url, urlSize);
+		if ((e = xoap_weather_entry_get(ctx, url, XOAP_WEATHER_STREAM_RAIN_STATIONS)) != NULL) {
+			rain[i] = e;
+			if (!e->used)
+				xoap_weather_entry_start(ctx, e, xoap_weather_rain_new());
+		}
+	}
+	xoap_weather_multi_perform(ctx);
+	xoap_weather_multi_results(ctx);
+
+	/* second round: the observations from the stations we found */
+	for (i = 0; i < count; i++) {
+		if (forecast[i] && forecast[i]->ok) {
+			req[i].forecast = forecast[i]->result;
+			req[i].not_modified = forecast[i]->not_modified;
+		}
+		xoap_weather_entry *e = rain[i];
+		rain[i] = NULL;
+		if (e == NULL || !e->ok)
+			continue;
+		xoap_weather_rain *stations = e->result;
+		if (xoap_weather_rain_station_url(stations, url, urlSize) != 0)
+			continue;
+		/* the observation carries the station it came from */
+		xoap_weather_rain *wrain = xoap_weather_rain_new();
+		if (wrain == NULL)
+			continue;
+		if (stations->airport_id)
+			wrain->airport_id = strdup(stations->airport_id);
+		if (stations->station_id)
+			wrain->station_id = strdup(stations->station_id);
+		if ((e = xoap_weather_entry_get(ctx, url, XOAP_WEATHER_STREAM_RAIN_OBS)) == NULL) {
+			xoap_weather_free_rain(wrain);
+			continue;
+		}
+		rain[i] = e;
+		if (e->used) {
+			/* another location shares this station */
+			xoap_weather_free_rain(wrain);
+			continue;
+		}
+		xoap_weather_entry_start(ctx, e, wrain);
+	}
+	xoap_weather_multi_perform(ctx);
+	xoap_weather_multi_results(ctx);
+
+	for (i = 0; i < count; i++) {
+		if (rain[i] && rain[i]->ok)
+			req[i].rain = rain[i]->result;
+		if (req[i].forecast == NULL)
+			failed++;
+	}
+
+	xoap_weather_context_prune(ctx);
+	free(forecast);
+	free(rain);
+	return failed;
+}
+
 int
 xoap_weather_parse_forecast(const struct xoap_weather_memory *xml, xoap_weather_forecast *fcast) {
 	/* Open XML document */
@@ -746,7 +1074,7 @@ xoap_weather_parse_day(xmlNode *cur_node, xoap_weather_day *day) {
 			if ( strcmp((char *)node->name, "part") == 0 ) {
 				/* see if part is for day or night */
 				xmlChar *dorn = xmlGetProp(node, (const xmlChar *)"p");
-				if ( strcmp((char *)dorn, "d") )
+				if ( strcmp((char *)dorn, "d") == 0 )
 					xoap_weather_parse_part(node, &day->day);
 				else
 					xoap_weather_parse_part(node, &day->night);
@@ -774,14 +1102,335 @@ xoap_weather_parse_part(xmlNode *cur_node, xoap_weather_weather *w) {
 }
 
 
+/**
+ * Streaming parser
+ * The body is handed to a libxml2 push parser chunk by chunk as curl
+ * receives it, and the SAX callbacks store each element straight into
+ * the result. Only the element being read is ever held in memory.
+ */
+
+/** Longest element path we track (weather/dayf/day/part/wind/s is 6) */
+#define XOAPW_STREAM_DEPTH 8
+/** Longest element name we compare; longer names are truncated */
+#define XOAPW_STREAM_NAME 32
+/** Longest element content we keep; longer content is truncated */
+#define XOAPW_STREAM_TEXT 256
+
+struct xoap_weather_stream {
+	xmlParserCtxtPtr ctxt;
+	xoap_weather_stream_type type;
+	void *result;		// xoap_weather_forecast or xoap_weather_rain
+	int depth;		// number of open elements
+	char path[XOAPW_STREAM_DEPTH][XOAPW_STREAM_NAME];
+	char text[XOAPW_STREAM_TEXT];
+	size_t text_len;
+	short link;		// index of the current lnks/link
+	short day;		// index of the current dayf/day, -1 if out of range
+	char part;		// 'd' or 'n' for the current dayf/day/part
+	int failed;		// TWCi error or unusable document
+};
+
+/* RETURN: attribute value from a SAX attribute list, or NULL */
+static const char *
+xoap_weather_stream_attr(const xmlChar **atts, const char *name) {
+	int i;
+	if (atts == NULL)
+		return NULL;
+	for (i = 0; atts[i] != NULL; i += 2) {
+		if (strcmp((const char *)atts[i], name) == 0)
+			return (const char *)atts[i + 1];
+	}
+	return NULL;
+}
+
+/* RETURN: name of the open element n levels above the current one */
+static const char *
+xoap_weather_stream_up(const xoap_weather_stream *stream, int n) {
+	if (n >= stream->depth || stream->depth - 1 - n >= XOAPW_STREAM_DEPTH)
+		return "";
+	return stream->path[stream->depth - 1 - n];
+}
+
+static void
+xoap_weather_stream_start(void *ctx, const xmlChar *xname, const xmlChar **atts) {
+	xoap_weather_stream *stream = ctx;
+	const char *name = (const char *)xname;
+	const char *value;
+
+	if (stream->depth < XOAPW_STREAM_DEPTH) {
+		strncpy(stream->path[stream->depth], name, XOAPW_STREAM_NAME - 1);
+		stream->path[stream->depth][XOAPW_STREAM_NAME - 1] = 0;
+	}
+	stream->depth++;
+	stream->text_len = 0;
+	stream->text[0] = 0;
+
+	if (stream->depth == 1) {
+		if (strcmp(name, "error") == 0)
+			stream->failed = 1;
+		value = xoap_weather_stream_attr(atts, "ver");
+		if (stream->type == XOAP_WEATHER_STREAM_FORECAST && value &&
+				TWCi_VERSION != (float)atof(value))
+			fprintf(stderr,"WARNING!!! "XOAP_WEATHER_LIBNAME" does not support fetched data. Parsing results UNKNOWN!!!\n");
+		return;
+	}
+	if (stream->depth == 2 && strcmp(xoap_weather_stream_up(stream, 1), "error") == 0 &&
+			strncmp(name, "err", 3) == 0) {
+		value = xoap_weather_stream_attr(atts, "type");
+		if (value)
+			xoap_weather_error_report(atoi(value));
+		return;
+	}
+	if (stream->type != XOAP_WEATHER_STREAM_FORECAST)
+		return;
+
+	xoap_weather_forecast *fcast = stream->result;
+	if (stream->depth == 2 && strcmp(name, "loc") == 0) {
+		value = xoap_weather_stream_attr(atts, "id");
+		if (value) {
+			XOAPW_FREE(fcast->id);
+			fcast->id = strdup(value);
+		}
+	} else if (stream->depth == 3 && strcmp(name, "day") == 0 &&
+			strcmp(xoap_weather_stream_up(stream, 1), "dayf") == 0) {
+		/* Get the day's spot in the forcast (0=>today, 1=>tomorrow, etc.) */
+		value = xoap_weather_stream_attr(atts, "d");
+		stream->day = value ? (short)atoi(value) : -1;
+		if (stream->day < 0 || stream->day >= fcast->total_days) {
+			stream->day = -1;
+			return;
+		}
+		xoap_weather_day *day = &fcast->days[stream->day];
+		if ((value = xoap_weather_stream_attr(atts, "t")) != NULL) {
+			XOAPW_FREE(day->week_day);
+			day->week_day = strdup(value);
+		}
+		if ((value = xoap_weather_stream_attr(atts, "dt")) != NULL) {
+			XOAPW_FREE(day->date);
+			day->date = strdup(value);
+		}
+	} else if (stream->depth == 4 && strcmp(name, "part") == 0) {
+		/* see if part is for day or night */
+		value = xoap_weather_stream_attr(atts, "p");
+		stream->part = (value && strcmp(value, "d") == 0) ? 'd' : 'n';
+	}
+}
+
+static void
+xoap_weather_stream_characters(void *ctx, const xmlChar *ch, int len) {
+	xoap_weather_stream *stream = ctx;
+	size_t room = XOAPW_STREAM_TEXT - 1 - stream->text_len;
+	if ((size_t)len > room)
+		len = (int)room;
+	memcpy(&stream->text[stream->text_len], ch, len);
+	stream->text_len += len;
+	stream->text[stream->text_len] = 0;
+}
+
+static void
+xoap_weather_stream_wind(const char *name, const char *text, xoap_weather_wind *wind) {
+	XOAPW_STS(name, "s", text, wind->speed)
+	XOAPW_STS(name, "gust", text, wind->gust)
+	XOAPW_STI(name, "d", text, wind->direction_n)
+	XOAPW_STS(name, "t", text, wind->direction)
+}
+
+static void
+xoap_weather_stream_part(const xoap_weather_stream *stream, const char *name, const char *text, xoap_weather_weather *w) {
+	if (stream->depth == 5) {
+		XOAPW_STI(name, "icon", text, w->icon)
+		XOAPW_STS(name, "t", text, w->cond)
+		XOAPW_STS(name, "bt", text, w->cond_short)
+		XOAPW_STI(name, "ppcp", text, w->chance_precipitation)
+		XOAPW_STI(name, "hmid", text, w->humidity)
+	} else if (stream->depth == 6 && strcmp(xoap_weather_stream_up(stream, 1), "wind") == 0) {
+		xoap_weather_stream_wind(name, text, &w->wind);
+	}
+}
+
+/* Stores a finished element of a TWCi forecast */
+static void
+xoap_weather_stream_forecast_end(xoap_weather_stream *stream, const char *name, const char *text) {
+	xoap_weather_forecast *fcast = stream->result;
+	const char *section = xoap_weather_stream_up(stream, stream->depth - 2);
+	const char *parent = xoap_weather_stream_up(stream, 1);
+
+	if (strcmp(section, "head") == 0 && stream->depth == 3) {
+		XOAPW_STS(name, "locale", text, fcast->units.locale)
+		XOAPW_STS(name, "ut", text, fcast->units.ut)
+		XOAPW_STS(name, "ud", text, fcast->units.ud)
+		XOAPW_STS(name, "us", text, fcast->units.us)
+		XOAPW_STS(name, "up", text, fcast->units.up)
+		XOAPW_STS(name, "ur", text, fcast->units.ur)
+	} else if (strcmp(section, "lnks") == 0) {
+		if (stream->depth == 3 && strcmp(name, "link") == 0) {
+			stream->link++;
+		} else if (stream->depth == 4 && stream->link < TWCi_RL_COUNT) {
+			XOAPW_STS(name, "l", text, fcast->links[stream->link].link)
+			XOAPW_STS(name, "t", text, fcast->links[stream->link].description)
+		}
+	} else if (strcmp(section, "loc") == 0 && stream->depth == 3) {
+		XOAPW_STS(name, "tm", text, fcast->time_fetched)
+		XOAPW_STF(name, "lat", text, fcast->lat)
+		XOAPW_STF(name, "lon", text, fcast->lon)
+		XOAPW_STS(name, "sunr", text, fcast->sun_rise)
+		XOAPW_STS(name, "suns", text, fcast->sun_set)
+		XOAPW_STI(name, "zone", text, fcast->zone)
+		XOAPW_STS(name, "dnam", text, fcast->name)
+	} else if (fcast->cc && strcmp(section, "swa") == 0 && stream->depth == 4) {
+		XOAPW_STS(name, "t", text, fcast->cc->swa)
+		XOAPW_STS(name, "l", text, fcast->cc->swal)
+	} else if (fcast->cc && strcmp(section, "cc") == 0) {
+		xoap_weather_cc *cc = fcast->cc;
+		if (stream->depth == 3) {
+			XOAPW_STS(name, "lsup", text, cc->lsup)
+			XOAPW_STS(name, "obst", text, cc->obst)
+			XOAPW_STI(name, "tmp", text, cc->temp)
+			XOAPW_STI(name, "flik", text, cc->feels)
+			XOAPW_STS(name, "t", text, cc->cond)
+			XOAPW_STI(name, "icon", text, cc->icon)
+			XOAPW_STI(name, "hmid", text, cc->humidity)
+			XOAPW_STF(name, "vis", text, cc->visibility)
+			XOAPW_STI(name, "dewp", text, cc->dewp)
+		} else if (stream->depth == 4 && strcmp(parent, "bar") == 0) {
+			XOAPW_STF(name, "r", text, cc->barp)
+			XOAPW_STS(name, "d", text, cc->bart)
+		} else if (stream->depth == 4 && strcmp(parent, "uv") == 0) {
+			XOAPW_STF(name, "i", text, cc->uvi)
+			XOAPW_STS(name, "t", text, cc->uvid)
+		} else if (stream->depth == 4 && strcmp(parent, "moon") == 0) {
+			XOAPW_STI(name, "icon", text, cc->moon_icon)
+			XOAPW_STS(name, "t", text, cc->moon_name)
+		} else if (stream->depth == 4 && strcmp(parent, "wind") == 0) {
+			xoap_weather_stream_wind(name, text, &cc->wind);
+		}
+	} else if (strcmp(section, "dayf") == 0 && stream->depth >= 4 && stream->day >= 0) {
+		xoap_weather_day *day = &fcast->days[stream->day];
+		if (stream->depth == 4) {
+			XOAPW_STI(name, "hi", text, day->high)
+			XOAPW_STI(name, "low", text, day->low)
+			XOAPW_STS(name, "sunr", text, day->sun_rise)
+			XOAPW_STS(name, "suns", text, day->sun_set)
+		} else if (strcmp(xoap_weather_stream_up(stream, stream->depth - 4), "part") == 0) {
+			xoap_weather_stream_part(stream, name, text,
+				stream->part == 'd' ? &day->day : &day->night);
+		}
+	}
+}
+
+/* Stores a finished element of a Weather Underground document */
+static void
+xoap_weather_stream_rain_end(xoap_weather_stream *stream, const char *name, const char *text) {
+	xoap_weather_rain *wrain = stream->result;
+
+	if (stream->type == XOAP_WEATHER_STREAM_RAIN_OBS) {
+		if (stream->depth == 2) {
+			XOAPW_STF(name, "precip_1hr_in", text, wrain->rain_last_hr)
+			XOAPW_STF(name, "precip_today_in", text, wrain->rain_last_day)
+		}
+		return;
+	}
+	/* nearby_weather_stations/{airport,pws}/station/..., first station only */
+	if (stream->depth != 5 ||
+			strcmp(xoap_weather_stream_up(stream, 3), "nearby_weather_stations") != 0 ||
+			strcmp(xoap_weather_stream_up(stream, 1), "station") != 0)
+		return;
+	if (strcmp(xoap_weather_stream_up(stream, 2), "airport") == 0 && !wrain->airport_id) {
+		XOAPW_STS(name, "icao", text, wrain->airport_id)
+	}
+	if (strcmp(xoap_weather_stream_up(stream, 2), "pws") == 0 && !wrain->station_id) {
+		XOAPW_STS(name, "id", text, wrain->station_id)
+	}
+}
+
+static void
+xoap_weather_stream_end(void *ctx, const xmlChar *xname) {
+	xoap_weather_stream *stream = ctx;
+	const char *name = (const char *)xname;
+
+	if (!stream->failed && stream->depth <= XOAPW_STREAM_DEPTH) {
+		if (stream->type == XOAP_WEATHER_STREAM_FORECAST)
+			xoap_weather_stream_forecast_end(stream, name, stream->text);
+		else
+			xoap_weather_stream_rain_end(stream, name, stream->text);
+	}
+	stream->depth--;
+	stream->text_len = 0;
+	stream->text[0] = 0;
+}
+
+xoap_weather_stream *
+xoap_weather_stream_new(xoap_weather_stream_type type, void *result) {
+	static xmlSAXHandler sax;
+	if (!sax.startElement) {
+		sax.startElement = xoap_weather_stream_start;
+		sax.endElement = xoap_weather_stream_end;
+		sax.characters = xoap_weather_stream_characters;
+		sax.cdataBlock = xoap_weather_stream_characters;
+	}
+
+	if (result == NULL)
+		return NULL;
+	xoap_weather_stream *stream = calloc(1, sizeof(xoap_weather_stream));
+	if (stream == NULL)
+		return NULL;
+	stream->type = type;
+	stream->result = result;
+	stream->day = -1;
+	stream->ctxt = xmlCreatePushParserCtxt(&sax, stream, NULL, 0, NULL);
+	if (stream->ctxt == NULL) {
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+size_t
+xoap_weather_stream_callback(void *ptr, size_t size, size_t nmemb, void *data) {
+	size_t realsize = size * nmemb;
+	xoap_weather_stream *stream = (xoap_weather_stream *)data;
+
+	if (stream == NULL || stream->failed)
+		return 0;	/* stop the transfer, the document is no use */
+	if (xmlParseChunk(stream->ctxt, (const char *)ptr, (int)realsize, 0) != 0)
+		stream->failed = 1;
+	return stream->failed ? 0 : realsize;
+}
+
+int
+xoap_weather_stream_finish(xoap_weather_stream *stream) {
+	int status = 1;
+	if (stream == NULL)
+		return 1;
+	if (!stream->failed) {
+		xmlParseChunk(stream->ctxt, NULL, 0, 1);
+		if (stream->ctxt->wellFormed)
+			status = 0;
+		else
+			fprintf(stderr, "ERROR: failed to parse XML document\n");
+	}
+	xmlFreeParserCtxt(stream->ctxt);
+	free(stream);
+	return status;
+}
+
+/* Frees a stream whose document will never be finished */
+static void
+xoap_weather_stream_abandon(xoap_weather_stream *stream) {
+	xmlFreeParserCtxt(stream->ctxt);
+	free(stream);
+}
+
 void
 xoap_weather_cleanup(xoap_weather_handle *h) {
 	curl_easy_cleanup(curlHandle);
 	curl_global_cleanup();
 	XOAPW_FREE(partnerID);
 	XOAPW_FREE(licenseKey);
-	XOAPW_FREE(h->locid);
-	XOAPW_FREE(h);
+	partnerID = NULL;
+	licenseKey = NULL;
+	curlHandle = NULL;
+	xoap_weather_handle_free(h);
 }
 
 void
@@ -799,9 +1448,8 @@ xoap_weather_free_locs(xoap_weather_locs *s) {
 
 void
 xoap_weather_free_rain(xoap_weather_rain *r) {
-	XOAPW_FREE(r->rain_last_day);
-	XOAPW_FREE(r->rain_last_hr);
-	XOAPW_FREE(r->is_raining);
+	if (r == NULL)
+		return;
 	XOAPW_FREE(r->airport_id);
 	XOAPW_FREE(r->station_id);
 	free(r);
@@ -809,6 +1457,8 @@ xoap_weather_free_rain(xoap_weather_rain *r) {
 
 void
 xoap_weather_free_forecast(xoap_weather_forecast *f) {
+	if (f == NULL)
+		return;
 	XOAPW_FREE(f->time_fetched);
 	XOAPW_FREE(f->id);
 	XOAPW_FREE(f->name);